@@ -1,13 +1,16 @@
 #include "eth.h"
+#include "arp.h"
 #include <rawnet.h>
 #include <timerms.h>
 
 #include "ipv4.h"
+#include "trace.h"
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
 #include <netinet/in.h>
 #include <stdbool.h>
+#include <pthread.h>
 
 #define ARP_REQ 0x01
 #define ARP_REP 0x02
@@ -27,13 +30,37 @@ struct arp_frame{
   ipv4_addr_t dest_ipv4_addr;  /* Dirección IPv4 destino */
 };
 
+/* Resolucion en curso de arp_resolve_start() */
+struct arp_pending{
+  int used;
+  reactor_t* reactor;
+  eth_iface_t* iface;
+  ipv4_addr_t dest;
+  arp_callback_t callback;
+  void* arg;
+  wheel_timer_t timer;  /* temporizador de los 2 segundos en el reactor */
+};
+
+/* Cada hilo tiene sus propias resoluciones en curso, igual que su propio
+   reactor (ver eth_fanout.h) */
+static __thread struct arp_pending arp_pendings[ARP_PENDING_MAX];
+
+/* Interfaz con el manejador ARP registrado, y su cache de vecinos */
+struct arp_listener{
+  eth_iface_t* iface;
+  arp_cache_t* cache;
+};
+
+/* Tabla de todo el proceso: un hilo puede llamar a arp_unlisten() sobre la
+   interfaz de otro, asi que se protege con un cerrojo */
+static struct arp_listener arp_listeners[ARP_LISTEN_MAX];
+static pthread_mutex_t arp_listeners_lock = PTHREAD_MUTEX_INITIALIZER;
+
 /*
-*  Dada la dirección IPv4, envie una peticion ARP por la interfaz Ethernet
-*  especificado y rellene la dirección MAC con la respuesta obtenida, o
-*  devuelva 0 si la respuesta no ha llegado despues de 2 segundos.
+*  Funcion que envia por la interfaz la peticion ARP de la direccion 'dest',
+*  a la direccion de difusion o, si 'mac_dst' no es NULL, solo a esa direccion
 */
-
-int arp_resolve(eth_iface_t* iface, ipv4_addr_t dest, mac_addr_t mac,   ipv4_addr_t src_ipv4_addr){
+static int arp_request_send(eth_iface_t* iface, mac_addr_t mac_dst, ipv4_addr_t dest, ipv4_addr_t src_ipv4_addr){
   uint16_t type = 0x0806;
   struct arp_frame arp_message;
   arp_message.hard_addr = htons(0x0001);
@@ -43,21 +70,81 @@ int arp_resolve(eth_iface_t* iface, ipv4_addr_t dest, mac_addr_t mac,   ipv4_add
   mac_addr_t mac_src;
   eth_getaddr(iface, mac_src);//obtenemos mi direccion MAC
   arp_message.opcode = htons(ARP_REQ);
-  memset(arp_message.dest_mac_addr, 0, MAC_ADDR_SIZE);//esto tiene que ser la direccion broadcast, porque es la direccion que hay que encotrar
+  if(mac_dst == NULL){
+    memset(arp_message.dest_mac_addr, 0, MAC_ADDR_SIZE);//esto tiene que ser la direccion broadcast, porque es la direccion que hay que encotrar
+  }else{
+    memcpy(arp_message.dest_mac_addr, mac_dst, MAC_ADDR_SIZE);//la direccion que se quiere comprobar
+  }
   memcpy(arp_message.src_mac_addr , mac_src, MAC_ADDR_SIZE);
   memcpy(arp_message.dest_ipv4_addr, dest, IPv4_ADDR_SIZE);
   memcpy(arp_message.src_ipv4_addr, src_ipv4_addr, IPv4_ADDR_SIZE);
 
-  char mac_origen[MAC_STR_LENGTH];
-  mac_addr_str(mac_src, mac_origen);
-  printf("\nDirección MAC origen: %s\n\n", mac_origen);
+  TRACE(TRACE_INFO, TRACE_ARP_REQUEST, ipv4_addr_value(dest), 0, 0, 0, NULL, 0);
 
-  int a = eth_send(iface, MAC_BCAST_ADDR, type, (unsigned char *) &arp_message, sizeof(struct arp_frame));
+  int a = eth_send(iface, (mac_dst == NULL) ? MAC_BCAST_ADDR : mac_dst, type, (unsigned char *) &arp_message, sizeof(struct arp_frame));
   if(a < 0){
     fprintf(stderr, "ERROR");
     return -1;
   }
 
+  return 0;
+}
+
+/*
+*  Envia la peticion ARP de 'dest' a la direccion de difusion
+*/
+int arp_request(eth_iface_t* iface, ipv4_addr_t dest, ipv4_addr_t src_ipv4_addr){
+  return arp_request_send(iface, NULL, dest, src_ipv4_addr);
+}
+
+/*
+*  Envia la peticion ARP de 'dest' solo a la direccion MAC 'mac' que ya se
+*  conoce, para comprobar que sigue siendo valida
+*/
+int arp_probe(eth_iface_t* iface, mac_addr_t mac, ipv4_addr_t dest, ipv4_addr_t src_ipv4_addr){
+  return arp_request_send(iface, mac, dest, src_ipv4_addr);
+}
+
+/*
+*  Funcion que responde por la interfaz a la peticion ARP 'request', dirigida
+*  a nuestra direccion IPv4
+*/
+static int arp_reply(eth_iface_t* iface, struct arp_frame* request){
+  struct arp_frame arp_message;
+  arp_message.hard_addr = htons(0x0001);
+  arp_message.prot_addr = htons(0x0800);
+  arp_message.hard_length = 0x06;
+  arp_message.prot_length = 0x04;
+  arp_message.opcode = htons(ARP_REP);
+  eth_getaddr(iface, arp_message.src_mac_addr);//la direccion que se pregunta es la nuestra
+  memcpy(arp_message.src_ipv4_addr, request->dest_ipv4_addr, IPv4_ADDR_SIZE);
+  memcpy(arp_message.dest_mac_addr, request->src_mac_addr, MAC_ADDR_SIZE);
+  memcpy(arp_message.dest_ipv4_addr, request->src_ipv4_addr, IPv4_ADDR_SIZE);
+
+  TRACE(TRACE_INFO, TRACE_ARP_ANSWER, ipv4_addr_value(request->src_ipv4_addr), 0, 0, 0, NULL, 0);
+
+  //La respuesta va solo al que pregunta, no a la direccion de difusion
+  if(eth_send(iface, request->src_mac_addr, 0x0806, (unsigned char *) &arp_message, sizeof(struct arp_frame)) < 0){
+    fprintf(stderr, "arp_reply(): ERROR en eth_send()\n");
+    return -1;
+  }
+
+  return 0;
+}
+
+/*
+*  Dada la dirección IPv4, envie una peticion ARP por la interfaz Ethernet
+*  especificado y rellene la dirección MAC con la respuesta obtenida, o
+*  devuelva 0 si la respuesta no ha llegado despues de 2 segundos.
+*/
+
+int arp_resolve(eth_iface_t* iface, ipv4_addr_t dest, mac_addr_t mac,   ipv4_addr_t src_ipv4_addr){
+  uint16_t type = 0x0806;
+
+  if(arp_request(iface, dest, src_ipv4_addr) < 0){
+    return -1;
+  }
+
   struct arp_frame arp_recibido;
   bool is_response;
   bool is_my_response;
@@ -68,11 +155,15 @@ int arp_resolve(eth_iface_t* iface, ipv4_addr_t dest, mac_addr_t mac,   ipv4_add
   mac_addr_t assoc_mac;
 
   int r;
+  is_my_response = false;
   do {
     time_left=timerms_left(&timer);
     r = eth_recv(iface, assoc_mac, type, (unsigned char *)&arp_recibido,
           sizeof(struct arp_frame), time_left);
 //    printf("\nvalor de r=%d\n", r);//longitud en bytes de los datos de la trama recibida
+    if(r <= 0){
+      break;//error o tiempo agotado
+    }
 
     //Comprobar si la respuesta es ARP
     is_response =  arp_recibido.opcode == ntohs(ARP_REP);
@@ -86,21 +177,203 @@ int arp_resolve(eth_iface_t* iface, ipv4_addr_t dest, mac_addr_t mac,   ipv4_add
     }
 
 
-  }while(!is_my_response && !(r>0));
+  //Otras tramas ARP (peticiones, respuestas a otras direcciones) no terminan
+  //la espera: la MAC que se devuelve (y se guarda en la cache) debe ser la de 'dest'
+  }while(!is_my_response);
 
 
-  /* Declaracion de variables a usar */
-  char str[MAC_STR_LENGTH];
-  /* Imprimir la direccion MAC del servidor */
+  /* Trazar el resultado (el programa que llama muestra la direccion MAC) */
   if(r == -1){
     fprintf(stderr, "\nError en el mensaje ARP\n");
   }else if (r == 0) {
-    printf("\nNo ha habido respuesta en dos segundos\n");
+    TRACE(TRACE_INFO, TRACE_ARP_TIMEOUT, ipv4_addr_value(dest), 0, 0, 0, NULL, 0);
   } else {
-    mac_addr_str(mac,str);
-    printf("\nDirección MAC servidor: %s\n", str);
+    TRACE(TRACE_INFO, TRACE_ARP_REPLY, ipv4_addr_value(dest),
+          (mac[0] << 24) | (mac[1] << 16) | (mac[2] << 8) | mac[3],
+          (mac[4] << 8) | mac[5], 0, NULL, 0);
  }
 
 
   return r;
 }
+
+
+/*
+*  Funcion manejadora de las tramas ARP de la interfaz: responde a las
+*  peticiones a nuestra direccion, anota en la cache los emisores de las
+*  peticiones y las respuestas, y termina las resoluciones de
+*  arp_resolve_start() a las que responde la trama
+*/
+static int arp_eth_handler(eth_iface_t* iface, eth_rx_frame_t* frame, void* arg){
+  if(frame->payload_len < (int) sizeof(struct arp_frame)){
+    return 0;
+  }
+  struct arp_frame* arp_recibido = (struct arp_frame*) (frame->frame + frame->payload_offset);
+  struct arp_listener* listener = arg;
+  arp_cache_t* cache = NULL;
+  if(listener != NULL){
+    pthread_mutex_lock(&arp_listeners_lock);
+    if(listener->iface == iface){
+      cache = listener->cache;
+    }
+    pthread_mutex_unlock(&arp_listeners_lock);
+  }
+
+  if(arp_recibido->opcode == htons(ARP_REQ)){
+    //Sin cache no se conoce la direccion IPv4 de la interfaz
+    if(cache == NULL){
+      return 0;
+    }
+    if(arp_cache_is_local(cache, arp_recibido->dest_ipv4_addr)){
+      //Peticion a nuestra direccion: el emisor va a enviarnos datagramas y
+      //seguramente le responderemos, asi que se anota en la cache (salvo las
+      //sondas con IP origen 0.0.0.0) y se le responde
+      if(memcmp(arp_recibido->src_ipv4_addr, IPv4_ZERO_ADDR, IPv4_ADDR_SIZE) != 0){
+        arp_cache_update(cache, arp_recibido->src_ipv4_addr, arp_recibido->src_mac_addr);
+      }
+      arp_reply(iface, arp_recibido);
+    }else{
+      //Peticion a otro equipo: solo se actualiza el emisor si ya estaba
+      arp_cache_confirm(cache, arp_recibido->src_ipv4_addr, arp_recibido->src_mac_addr);
+    }
+    return 1;
+  }
+  if(arp_recibido->opcode != htons(ARP_REP)){
+    return 0;
+  }
+
+  //Con cache, la respuesta completa su resolucion y sale la cola de datagramas
+  //que la esperaba. La cache atiende todas las respuestas, asi que no se
+  //dejan encoladas en el distribuidor ocupando el anillo de recepcion
+  int consumed = 0;
+  if(cache != NULL){
+    arp_cache_confirm(cache, arp_recibido->src_ipv4_addr, arp_recibido->src_mac_addr);
+    consumed = 1;
+  }
+
+  int i;
+  for(i=0; i<ARP_PENDING_MAX; i++){
+    struct arp_pending* pending = &arp_pendings[i];
+    if(pending->used && (pending->iface == iface) &&
+       (memcmp(pending->dest, arp_recibido->src_ipv4_addr, IPv4_ADDR_SIZE) == 0)){
+      timer_wheel_cancel(reactor_wheel(pending->reactor), &pending->timer);
+      pending->used = 0;
+      TRACE(TRACE_INFO, TRACE_ARP_REPLY, ipv4_addr_value(pending->dest),
+            (arp_recibido->src_mac_addr[0] << 24) | (arp_recibido->src_mac_addr[1] << 16) |
+            (arp_recibido->src_mac_addr[2] << 8) | arp_recibido->src_mac_addr[3],
+            (arp_recibido->src_mac_addr[4] << 8) | arp_recibido->src_mac_addr[5], 0, NULL, 0);
+      pending->callback(pending->dest, arp_recibido->src_mac_addr, pending->arg);
+      consumed = 1;
+    }
+  }
+
+  return consumed;
+}
+
+/*
+*  Funcion que se invoca al pasar 2 segundos sin respuesta a una resolucion
+*  de arp_resolve_start()
+*/
+static void arp_timeout(void* arg){
+  struct arp_pending* pending = arg;
+  pending->used = 0;
+  TRACE(TRACE_INFO, TRACE_ARP_TIMEOUT, ipv4_addr_value(pending->dest), 0, 0, 0, NULL, 0);
+  pending->callback(pending->dest, NULL, pending->arg);
+}
+
+/*
+*  Envia la peticion ARP sin esperar la respuesta, que se entrega a
+*  'callback' desde el reactor
+*/
+int arp_resolve_start(reactor_t* reactor, eth_iface_t* iface, ipv4_addr_t dest, ipv4_addr_t src_ipv4_addr, arp_callback_t callback, void* arg){
+  struct arp_pending* pending = NULL;
+  int i;
+  for(i=0; i<ARP_PENDING_MAX; i++){
+    if(!arp_pendings[i].used){
+      pending = &arp_pendings[i];
+      break;
+    }
+  }
+  if(pending == NULL){
+    fprintf(stderr, "arp_resolve_start(): ERROR: demasiadas resoluciones en curso\n");
+    return -1;
+  }
+
+  //Las respuestas llegan por el manejador de tramas ARP de la interfaz
+  if((arp_listen(iface, NULL) == -1) ||
+     (reactor_add_iface(reactor, iface) == -1)){
+    return -1;
+  }
+
+  wheel_timer_init(&pending->timer, arp_timeout, pending);
+  timer_wheel_add(reactor_wheel(reactor), &pending->timer, 2000);
+  pending->used = 1;
+  pending->reactor = reactor;
+  pending->iface = iface;
+  memcpy(pending->dest, dest, IPv4_ADDR_SIZE);
+  pending->callback = callback;
+  pending->arg = arg;
+
+  if(arp_request(iface, dest, src_ipv4_addr) < 0){
+    timer_wheel_cancel(reactor_wheel(reactor), &pending->timer);
+    pending->used = 0;
+    return -1;
+  }
+
+  return 0;
+}
+
+/*
+*  Registra el manejador de las tramas ARP de la interfaz, asociado a su
+*  cache de vecinos (si la tiene)
+*/
+int arp_listen(eth_iface_t* iface, arp_cache_t* cache){
+  pthread_mutex_lock(&arp_listeners_lock);
+  struct arp_listener* listener = NULL;
+  int i;
+  for(i=0; i<ARP_LISTEN_MAX; i++){
+    if(arp_listeners[i].iface == iface){
+      listener = &arp_listeners[i];
+      break;
+    }
+    if((listener == NULL) && (arp_listeners[i].iface == NULL)){
+      listener = &arp_listeners[i];
+    }
+  }
+  if(listener == NULL){
+    pthread_mutex_unlock(&arp_listeners_lock);
+    fprintf(stderr, "arp_listen(): ERROR: demasiadas interfaces\n");
+    return -1;
+  }
+
+  if(eth_register_type(iface, 0x0806, arp_eth_handler, listener) == -1){
+    pthread_mutex_unlock(&arp_listeners_lock);
+    return -1;
+  }
+  if(listener->iface != iface){
+    listener->iface = iface;
+    listener->cache = NULL;
+  }
+  if(cache != NULL){
+    listener->cache = cache;
+  }
+  pthread_mutex_unlock(&arp_listeners_lock);
+
+  return 0;
+}
+
+/*
+*  Elimina el manejador ARP de la interfaz
+*/
+void arp_unlisten(eth_iface_t* iface){
+  pthread_mutex_lock(&arp_listeners_lock);
+  int i;
+  for(i=0; i<ARP_LISTEN_MAX; i++){
+    if(arp_listeners[i].iface == iface){
+      eth_unregister_type(iface, 0x0806);
+      arp_listeners[i].iface = NULL;
+      arp_listeners[i].cache = NULL;
+    }
+  }
+  pthread_mutex_unlock(&arp_listeners_lock);
+}
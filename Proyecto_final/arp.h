@@ -1,5 +1,10 @@
+#ifndef _ARP_H
+#define _ARP_H
+
 #include "eth.h"
 #include "ipv4.h"
+#include "reactor.h"
+#include "arp_cache.h"
 
 /*
 *   Funciones que estan definidas en "ipv4.c"
@@ -13,3 +18,55 @@
   devuelva 0 si la respuesta no ha llegado despues de 2 segundos.
 */
 int arp_resolve(eth_iface_t* iface, ipv4_addr_t dest, mac_addr_t mac,  ipv4_addr_t src_ipv4_addr);
+
+/*
+  Envia por la interfaz la peticion ARP de la direccion 'dest' sin esperar
+  la respuesta. Devuelve 0, o -1 si hay error.
+*/
+int arp_request(eth_iface_t* iface, ipv4_addr_t dest, ipv4_addr_t src_ipv4_addr);
+
+/*
+  Igual que arp_request(), pero envia la peticion solo a la direccion MAC
+  'mac' que ya se conoce de 'dest' (sin difusion), para comprobar que sigue
+  siendo valida. Devuelve 0, o -1 si hay error.
+*/
+int arp_probe(eth_iface_t* iface, mac_addr_t mac, ipv4_addr_t dest, ipv4_addr_t src_ipv4_addr);
+
+/* Numero maximo de interfaces con el manejador ARP registrado en el proceso
+   (una por hilo en un grupo de fanout, ver eth_fanout.h) */
+#define ARP_LISTEN_MAX 64
+
+/*
+  Registra el manejador de las tramas ARP de la interfaz, que las procesa
+  desde cualquier camino de recepcion (ipv4_recv(), eth_dispatch(),
+  reactor_run()...). Si 'cache' no es NULL, cada respuesta completa la
+  resolucion de la cache y envia los datagramas que la esperaban (ver
+  arp_cache_send()); si es NULL se mantiene la cache que ya tuviera la
+  interfaz. Devuelve 0, o -1 si hay error.
+*/
+int arp_listen(eth_iface_t* iface, arp_cache_t* cache);
+
+/* Elimina el manejador ARP de la interfaz. Debe llamarse antes de eth_close() */
+void arp_unlisten(eth_iface_t* iface);
+
+/* Numero maximo de resoluciones ARP con arp_resolve_start() en curso */
+#define ARP_PENDING_MAX 32
+
+/*
+  Funcion que se invoca al terminar una resolucion de arp_resolve_start(),
+  con la direccion MAC obtenida en 'mac', o con 'mac' NULL si la respuesta
+  no ha llegado despues de 2 segundos.
+*/
+typedef void (*arp_callback_t)(ipv4_addr_t dest, mac_addr_t mac, void* arg);
+
+/*
+  Igual que arp_resolve(), pero sin bloquearse: envia la peticion ARP y
+  retorna. La respuesta se recoge desde el camino de recepcion de la
+  interfaz (normalmente reactor_run(), al que se anade la interfaz) y el
+  vencimiento de los 2 segundos con un temporizador del reactor; en ambos
+  casos se invoca 'callback' con el argumento 'arg'. Devuelve 0, o -1 si hay
+  error o ya hay ARP_PENDING_MAX resoluciones en curso.
+*/
+int arp_resolve_start(reactor_t* reactor, eth_iface_t* iface, ipv4_addr_t dest, ipv4_addr_t src_ipv4_addr, arp_callback_t callback, void* arg);
+
+#endif /* _ARP_H */
@@ -0,0 +1,1755 @@
+#include "arp_cache.h"
+#include "arp.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sched.h>
+#include <pthread.h>
+
+/* Datagrama encolado en espera de la resolución de su vecino */
+struct arp_queued {
+  struct arp_queued * next;
+  uint16_t type;
+  int len;
+  unsigned char data[];
+};
+
+/* Instantánea de la caché ('arp_cache_save()'): una cabecera seguida de
+   'count' entradas, todo en el orden de bytes de la máquina */
+#define ARP_SNAPSHOT_MAGIC "ARPC"
+#define ARP_SNAPSHOT_VERSION 1
+
+struct arp_snapshot_header {
+  char magic[4];
+  uint32_t version;
+  uint32_t count;
+  uint32_t reserved;
+};
+
+struct arp_snapshot_entry {
+  int64_t confirmed;   /* Instante de la confirmación, en ms del reloj de
+                          tiempo real */
+  uint8_t addr[IPv4_ADDR_SIZE];
+  uint8_t mac[MAC_ADDR_SIZE];
+  uint8_t reserved[6];
+};
+
+/* Entrada de la caché */
+struct arp_entry {
+  uint32_t key;        /* Dirección IPv4 ('ipv4_addr_value()') */
+  ipv4_addr_t addr;
+  mac_addr_t mac;
+  long long int confirmed;  /* Instante de la última confirmación, en ms del
+                               reloj monotónico */
+  int used;
+  int permanent;       /* Entrada estática */
+  int next;            /* Siguiente entrada de la misma posición de la tabla
+                          hash (o de la lista de libres), o -1 */
+  /* Resolución en curso ('mac' no es válida) */
+  int incomplete;
+  int probes;               /* Peticiones enviadas sin respuesta */
+  long long int requested;  /* Instante de la última petición */
+  struct arp_queued * queue;       /* Datagramas encolados, en orden */
+  struct arp_queued * queue_tail;
+  int queued;
+  int refreshing;      /* Se ha enviado la petición unicast que la comprueba */
+  /* Entrada negativa o recién creada ('mac' no es válida) */
+  int failed;
+  int failures;                /* Resoluciones fallidas seguidas */
+  long long int failed_until;  /* Fin de la entrada negativa */
+};
+
+/* Copia de los campos de una entrada que se leen sin cerrojo. Estos campos
+   sólo se escriben entre 'arp_cache_write_begin()' y
+   'arp_cache_write_end()', para que las lecturas detecten los cambios. */
+struct arp_entry_view {
+  mac_addr_t mac;
+  long long int confirmed;
+  long long int requested;
+  long long int failed_until;
+  int permanent;
+  int incomplete;
+  int probes;
+  int failed;
+  int refreshing;
+};
+
+/* Contadores de las lecturas sin cerrojo. Cada hilo suma en uno de
+   'ARP_CACHE_SHARDS', que ocupa su propia línea de caché, para que los
+   lectores no se disputen una misma línea en cada consulta */
+#define ARP_CACHE_SHARDS 16
+#define ARP_CACHE_LINE 64
+
+/* Intentos de una lectura sin cerrojo antes de ceder la CPU */
+#define ARP_CACHE_SPINS 64
+
+struct arp_cache_shard {
+  long int hits;
+  long int misses;
+  long int expired;
+  long int read_retries;
+  char pad[ARP_CACHE_LINE - 4 * sizeof(long int)];
+};
+
+/* Contador del proceso con el que se reparte un contador a cada hilo */
+static int arp_cache_shard_seq = 0;
+static __thread int arp_cache_shard = -1;
+
+struct arp_cache {
+  int size;               /* Número máximo de entradas */
+  int shift;              /* 32 - log2(posiciones de la tabla hash) */
+  long int reachable_time;
+  long int stale_time;
+  int max_probes;
+  long int retrans_time;
+  int free_list;          /* Primera entrada libre, o -1 */
+  arp_cache_stats_t stats;
+  int * buckets;          /* Primera entrada de cada posición, o -1 */
+  struct arp_entry * entries;
+  eth_iface_t * iface;    /* Interfaz asociada, o NULL */
+  pthread_t iface_thread; /* Hilo que recibe por la interfaz asociada */
+  ipv4_addr_t addr;       /* Dirección IPv4 de la interfaz asociada */
+  /* Concurrencia: las escrituras se serializan con 'lock' (recursivo, pues
+     la respuesta ARP puede llegar mientras se envía) y cada posición de la
+     tabla hash tiene un contador de secuencia, impar mientras se escriben
+     sus entradas, con el que las lecturas detectan que deben repetirse */
+  pthread_mutex_t lock;
+  unsigned int * seqs;
+  struct arp_cache_shard * shards;
+};
+
+
+/* Devuelve el instante actual en milisegundos del reloj monotónico */
+static long long int arp_cache_now ( void )
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+
+  return (long long int) ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+
+/* Devuelve el instante actual en milisegundos del reloj de tiempo real,
+   que a diferencia del monotónico tiene sentido entre ejecuciones */
+static long long int arp_cache_wall_now ( void )
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_REALTIME, &ts);
+
+  return (long long int) ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+
+/* Posición de la tabla hash de una dirección IPv4. Las direcciones de una
+   misma red sólo se diferencian en los bits bajos, así que se mezclan con
+   una multiplicación antes de quedarse con los bits altos. */
+static int arp_cache_bucket ( arp_cache_t * cache, uint32_t key )
+{
+  return (int) ((uint32_t) (key * 2654435761u) >> cache->shift);
+}
+
+
+/* Contadores de lectura del hilo que llama */
+static struct arp_cache_shard * arp_cache_my_shard ( arp_cache_t * cache )
+{
+  if (arp_cache_shard == -1) {
+    arp_cache_shard = __atomic_fetch_add(&arp_cache_shard_seq, 1,
+                                         __ATOMIC_RELAXED) % ARP_CACHE_SHARDS;
+  }
+
+  return &cache->shards[arp_cache_shard];
+}
+
+
+/* Suma 1 a un contador de lectura. Sólo hay conflicto si más de
+   'ARP_CACHE_SHARDS' hilos comparten la caché. */
+static void arp_cache_count ( long int * counter )
+{
+  __atomic_fetch_add(counter, 1, __ATOMIC_RELAXED);
+}
+
+
+/* Comienza la escritura de las entradas de la posición 'bucket' de la
+   tabla (con el cerrojo tomado): las lecturas que la solapen se repiten */
+static void arp_cache_write_begin ( arp_cache_t * cache, int bucket )
+{
+  __atomic_store_n(&cache->seqs[bucket], cache->seqs[bucket] + 1,
+                   __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+
+/* Termina la escritura de las entradas de la posición 'bucket' */
+static void arp_cache_write_end ( arp_cache_t * cache, int bucket )
+{
+  __atomic_store_n(&cache->seqs[bucket], cache->seqs[bucket] + 1,
+                   __ATOMIC_RELEASE);
+}
+
+
+/* Estado de una entrada confirmada en 'confirmed', en el instante 'now' */
+static int arp_cache_age_state
+( arp_cache_t * cache, long long int confirmed, long long int now )
+{
+  long long int age = now - confirmed;
+  if (age < cache->reachable_time) {
+    return ARP_STATE_REACHABLE;
+  }
+  if (age < cache->reachable_time + cache->stale_time) {
+    return ARP_STATE_STALE;
+  }
+  return ARP_STATE_EXPIRED;
+}
+
+
+/* Busca 'key' sin tomar el cerrojo y copia su entrada en 'view'. Devuelve
+   1 si está o 0 si no. Si un escritor cambia mientras tanto la posición de
+   la tabla, la búsqueda se repite: las entradas nunca se liberan, sólo se
+   reutilizan, así que recorrer una lista que está cambiando no sale de la
+   tabla, y el número de pasos se limita por si se recorre en círculo. Si la
+   escritura no termina pronto (el escritor puede haber perdido la CPU), se
+   cede la CPU en lugar de seguir esperando activamente. */
+static int arp_cache_peek
+( arp_cache_t * cache, uint32_t key, struct arp_entry_view * view )
+{
+  int bucket = arp_cache_bucket(cache, key);
+  unsigned int * seq = &cache->seqs[bucket];
+  int tries = 0;
+
+  while (1) {
+    unsigned int start = __atomic_load_n(seq, __ATOMIC_ACQUIRE);
+    if ((start & 1) == 0) {
+      int found = 0;
+      int steps = 0;
+      int i = __atomic_load_n(&cache->buckets[bucket], __ATOMIC_RELAXED);
+      while ((i != -1) && (steps++ < cache->size)) {
+        struct arp_entry * entry = &cache->entries[i];
+        if (entry->key == key) {
+          memcpy(view->mac, entry->mac, MAC_ADDR_SIZE);
+          view->confirmed = entry->confirmed;
+          view->requested = entry->requested;
+          view->failed_until = entry->failed_until;
+          view->permanent = entry->permanent;
+          view->incomplete = entry->incomplete;
+          view->probes = entry->probes;
+          view->failed = entry->failed;
+          view->refreshing = entry->refreshing;
+          found = 1;
+          break;
+        }
+        i = __atomic_load_n(&entry->next, __ATOMIC_RELAXED);
+      }
+      __atomic_thread_fence(__ATOMIC_ACQUIRE);
+      if (__atomic_load_n(seq, __ATOMIC_RELAXED) == start) {
+        return found;
+      }
+    }
+    if (tries == 0) {
+      arp_cache_count(&arp_cache_my_shard(cache)->read_retries);
+    }
+    tries++;
+    if ((tries % ARP_CACHE_SPINS) == 0) {
+      sched_yield();
+    }
+  }
+}
+
+
+/* Estado de una entrada leída con 'arp_cache_peek()'. A diferencia de
+   'arp_cache_state()', no cambia la entrada: una resolución sin respuesta
+   ya es 'ARP_STATE_FAILED', pero es un escritor quien la convierte en
+   negativa. */
+static int arp_cache_view_state
+( arp_cache_t * cache, struct arp_entry_view * view, long long int now )
+{
+  if (view->permanent) {
+    return ARP_STATE_REACHABLE;
+  }
+  if (view->incomplete) {
+    if ((view->probes < cache->max_probes) ||
+        (now - view->requested < cache->retrans_time)) {
+      return ARP_STATE_INCOMPLETE;
+    }
+    return ARP_STATE_FAILED;
+  }
+  if (view->failed) {
+    return (now < view->failed_until) ? ARP_STATE_FAILED : ARP_STATE_EXPIRED;
+  }
+  return arp_cache_age_state(cache, view->confirmed, now);
+}
+
+
+/* Descarta los datagramas encolados de una entrada */
+static void arp_cache_drop_queue ( arp_cache_t * cache, struct arp_entry * entry )
+{
+  while (entry->queue != NULL) {
+    struct arp_queued * queued = entry->queue;
+    entry->queue = queued->next;
+    free(queued);
+  }
+  entry->queue_tail = NULL;
+  cache->stats.queue_drops += entry->queued;
+  entry->queued = 0;
+}
+
+
+/* Convierte la entrada en negativa: descarta sus datagramas encolados y,
+   mientras dure, los envíos al vecino fallan sin esperar. Cada resolución
+   fallida seguida dobla la duración. */
+static void arp_cache_fail
+( arp_cache_t * cache, struct arp_entry * entry, long long int now )
+{
+  arp_cache_drop_queue(cache, entry);
+  int bucket = arp_cache_bucket(cache, entry->key);
+  arp_cache_write_begin(cache, bucket);
+  entry->incomplete = 0;
+  entry->probes = 0;
+  entry->refreshing = 0;
+  entry->failed = 1;
+
+  long int backoff = ARP_FAILED_MAX_TIME;
+  if (entry->failures < 16) {
+    backoff = (long int) ARP_FAILED_TIME << entry->failures;
+    if (backoff > ARP_FAILED_MAX_TIME) {
+      backoff = ARP_FAILED_MAX_TIME;
+    }
+  }
+  entry->failures++;
+  entry->failed_until = now + backoff;
+  /* Para la sustitución, la entrada cuenta como confirmada ahora */
+  entry->confirmed = now;
+  arp_cache_write_end(cache, bucket);
+  cache->stats.failures++;
+}
+
+
+/* Estado de una entrada en el instante 'now' (con el cerrojo tomado). Una
+   resolución cuya última petición ha agotado su tiempo sin respuesta falla
+   aquí, al consultarla. */
+static int arp_cache_state
+( arp_cache_t * cache, struct arp_entry * entry, long long int now )
+{
+  if (entry->permanent) {
+    return ARP_STATE_REACHABLE;
+  }
+  if (entry->incomplete) {
+    if ((entry->probes < cache->max_probes) ||
+        (now - entry->requested < cache->retrans_time)) {
+      return ARP_STATE_INCOMPLETE;
+    }
+    arp_cache_fail(cache, entry, now);
+  }
+  if (entry->failed) {
+    return (now < entry->failed_until) ? ARP_STATE_FAILED : ARP_STATE_EXPIRED;
+  }
+  return arp_cache_age_state(cache, entry->confirmed, now);
+}
+
+
+/* Devuelve el índice de la entrada de 'key', o -1 si no está (con el
+   cerrojo tomado) */
+static int arp_cache_find ( arp_cache_t * cache, uint32_t key )
+{
+  int i = cache->buckets[arp_cache_bucket(cache, key)];
+  while ((i != -1) && (cache->entries[i].key != key)) {
+    i = cache->entries[i].next;
+  }
+
+  return i;
+}
+
+
+/* Indica si hay que comprobar ya una entrada válida: si le quedan menos de
+   'ARP_REFRESH_TIME' ms y no hay otra comprobación reciente */
+static int arp_cache_needs_refresh
+( arp_cache_t * cache, struct arp_entry_view * view, long long int now )
+{
+  if ((cache->iface == NULL) || view->permanent) {
+    return 0;
+  }
+
+  long long int expires =
+    view->confirmed + cache->reachable_time + cache->stale_time;
+  if (expires - now > ARP_REFRESH_TIME) {
+    return 0;
+  }
+
+  return ! (view->refreshing && (now - view->requested < cache->retrans_time));
+}
+
+
+/* Consulta de una entrada válida: si lo necesita, comprueba con una
+   petición unicast que el vecino sigue en la misma dirección MAC, sin dejar
+   de usarla. Como sólo se hace al consultarla, sólo se comprueban las
+   entradas en uso. La decisión se toma con la copia leída sin cerrojo y se
+   repite con el cerrojo, que así sólo se toma en la ventana de
+   comprobación. */
+static void arp_cache_refresh
+( arp_cache_t * cache, uint32_t key, struct arp_entry_view * view,
+  long long int now )
+{
+  if ( ! arp_cache_needs_refresh(cache, view, now) ) {
+    return;
+  }
+
+  pthread_mutex_lock(&cache->lock);
+  int i = arp_cache_find(cache, key);
+  if (i != -1) {
+    struct arp_entry * entry = &cache->entries[i];
+    struct arp_entry_view current;
+    current.confirmed = entry->confirmed;
+    current.requested = entry->requested;
+    current.permanent = entry->permanent;
+    current.refreshing = entry->refreshing;
+    int state = arp_cache_state(cache, entry, now);
+    if (((state == ARP_STATE_REACHABLE) || (state == ARP_STATE_STALE)) &&
+        arp_cache_needs_refresh(cache, &current, now)) {
+      int bucket = arp_cache_bucket(cache, key);
+      arp_cache_write_begin(cache, bucket);
+      entry->refreshing = 1;
+      entry->requested = now;
+      arp_cache_write_end(cache, bucket);
+      cache->stats.refreshes++;
+      arp_probe(cache->iface, entry->mac, entry->addr, cache->addr);
+    }
+  }
+  pthread_mutex_unlock(&cache->lock);
+}
+
+
+/* Envía a la dirección MAC ya resuelta de la entrada los datagramas que
+   estaban encolados. Los que no se pueden enviar se cuentan como
+   descartados en las estadísticas */
+static void arp_cache_flush ( arp_cache_t * cache, struct arp_entry * entry )
+{
+  while (entry->queue != NULL) {
+    struct arp_queued * queued = entry->queue;
+    entry->queue = queued->next;
+    entry->queued--;
+    int err = eth_send(cache->iface, entry->mac, queued->type,
+                       queued->data, queued->len);
+    if (err < 0) {
+      cache->stats.queue_drops++;
+    }
+    free(queued);
+  }
+  entry->queue_tail = NULL;
+}
+
+
+/* Saca la entrada 'index' de su posición de la tabla hash y la devuelve a
+   la lista de libres */
+static void arp_cache_unlink ( arp_cache_t * cache, int index )
+{
+  struct arp_entry * entry = &cache->entries[index];
+  int bucket = arp_cache_bucket(cache, entry->key);
+  arp_cache_write_begin(cache, bucket);
+  int * prev = &cache->buckets[bucket];
+  while (*prev != index) {
+    prev = &cache->entries[*prev].next;
+  }
+  __atomic_store_n(prev, entry->next, __ATOMIC_RELAXED);
+  entry->permanent = 0;
+  entry->incomplete = 0;
+  entry->refreshing = 0;
+  entry->failed = 0;
+  __atomic_store_n(&entry->next, cache->free_list, __ATOMIC_RELAXED);
+  arp_cache_write_end(cache, bucket);
+
+  arp_cache_drop_queue(cache, entry);
+  entry->used = 0;
+  cache->free_list = index;
+  cache->stats.entries--;
+}
+
+
+/* Añade a la tabla una entrada para 'key' y devuelve su índice, o -1 si
+   todas son estáticas. La entrada se crea sin dirección MAC válida
+   ('failed' con 'failed_until' a 0, es decir, 'ARP_STATE_EXPIRED'), de
+   modo que las lecturas sin cerrojo no la usen hasta que se rellene. Si la
+   caché está llena sustituye a la entrada dinámica confirmada hace más
+   tiempo, que es la que antes expira (o ya ha expirado). Recorrer toda la
+   tabla sólo ocurre al añadir un vecino nuevo, nunca al consultarla. */
+static int arp_cache_insert
+( arp_cache_t * cache, uint32_t key, ipv4_addr_t addr )
+{
+  if (cache->free_list == -1) {
+    int victim = -1;
+    int j;
+    for (j=0; j<cache->size; j++) {
+      if (cache->entries[j].permanent) {
+        continue;
+      }
+      if ((victim == -1) ||
+          (cache->entries[j].confirmed < cache->entries[victim].confirmed)) {
+        victim = j;
+      }
+    }
+    if (victim == -1) {
+      fprintf(stderr, "arp_cache_insert(): ERROR: caché llena de entradas "
+              "estáticas\n");
+      return -1;
+    }
+    arp_cache_unlink(cache, victim);
+    cache->stats.evictions++;
+  }
+
+  int i = cache->free_list;
+  struct arp_entry * entry = &cache->entries[i];
+  cache->free_list = entry->next;
+
+  int bucket = arp_cache_bucket(cache, key);
+  arp_cache_write_begin(cache, bucket);
+  entry->key = key;
+  memcpy(entry->addr, addr, IPv4_ADDR_SIZE);
+  entry->used = 1;
+  entry->incomplete = 0;
+  entry->probes = 0;
+  entry->failed = 1;
+  entry->failed_until = 0;
+  entry->failures = 0;
+  __atomic_store_n(&entry->next, cache->buckets[bucket], __ATOMIC_RELAXED);
+  __atomic_store_n(&cache->buckets[bucket], i, __ATOMIC_RELAXED);
+  arp_cache_write_end(cache, bucket);
+  cache->stats.entries++;
+
+  return i;
+}
+
+
+/* Comienza (o continúa) la resolución de 'addr' y devuelve el índice de su
+   entrada, en el estado 'ARP_STATE_INCOMPLETE', o -1 si no cabe. No debe
+   llamarse con la entrada en el estado 'ARP_STATE_FAILED'. La petición ARP
+   sólo se envía si es la primera o la anterior lleva 'retrans_time' ms sin
+   respuesta; tras 'max_probes' peticiones es 'arp_cache_state()' quien da
+   la resolución por fallida. */
+static int arp_cache_probe ( arp_cache_t * cache, ipv4_addr_t addr )
+{
+  uint32_t key = ipv4_addr_value(addr);
+  long long int now = arp_cache_now();
+
+  int i = arp_cache_find(cache, key);
+  if (i == -1) {
+    i = arp_cache_insert(cache, key, addr);
+    if (i == -1) {
+      return -1;
+    }
+  }
+  struct arp_entry * entry = &cache->entries[i];
+
+  if (entry->incomplete &&
+      ((now - entry->requested < cache->retrans_time) ||
+       (entry->probes >= cache->max_probes))) {
+    return i;
+  }
+
+  int bucket = arp_cache_bucket(cache, key);
+  arp_cache_write_begin(cache, bucket);
+  if ( ! entry->incomplete ) {
+    entry->refreshing = 0;
+    entry->failed = 0;
+    entry->incomplete = 1;
+    entry->probes = 0;
+    /* Para la sustitución, la entrada cuenta como confirmada ahora */
+    entry->confirmed = now;
+  }
+  entry->requested = now;
+  entry->probes++;
+  arp_cache_write_end(cache, bucket);
+  arp_request(cache->iface, addr, cache->addr);
+
+  return i;
+}
+
+
+/* arp_cache_t * arp_cache_create
+ * ( int size, long int reachable_time, long int stale_time );
+ *
+ * DESCRIPCIÓN:
+ *   Esta función crea una caché de vecinos vacía.
+ *
+ *   La memoria de la caché debe ser liberada con 'arp_cache_free()'.
+ *
+ * PARÁMETROS:
+ *             'size': Número máximo de entradas.
+ *   'reachable_time': Milisegundos que una entrada confirmada permanece en
+ *                     el estado 'ARP_STATE_REACHABLE'.
+ *       'stale_time': Milisegundos que permanece después en el estado
+ *                     'ARP_STATE_STALE' antes de expirar.
+ *
+ * VALOR DEVUELTO:
+ *   La caché creada.
+ *
+ * ERRORES:
+ *   La función devuelve 'NULL' si los parámetros no son válidos o se ha
+ *   producido algún error.
+ */
+arp_cache_t * arp_cache_create
+( int size, long int reachable_time, long int stale_time )
+{
+  if ((size < 1) || (size > (1 << 20))) {
+    fprintf(stderr, "arp_cache_create(): ERROR: tamaño inválido\n");
+    return NULL;
+  }
+  if ((reachable_time < 0) || (stale_time < 0)) {
+    fprintf(stderr, "arp_cache_create(): ERROR: tiempo de vida inválido\n");
+    return NULL;
+  }
+
+  arp_cache_t * cache = calloc(1, sizeof(struct arp_cache));
+  if (cache == NULL) {
+    fprintf(stderr, "arp_cache_create(): ERROR en calloc()\n");
+    return NULL;
+  }
+  pthread_mutexattr_t attr;
+  pthread_mutexattr_init(&attr);
+  pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+  pthread_mutex_init(&cache->lock, &attr);
+  pthread_mutexattr_destroy(&attr);
+
+  /* Al menos dos posiciones por entrada, para que las listas de cada
+     posición sean cortas */
+  int num_buckets = 2;
+  int shift = 31;
+  while (num_buckets < 2 * size) {
+    num_buckets <<= 1;
+    shift--;
+  }
+
+  cache->buckets = malloc(num_buckets * sizeof(int));
+  cache->entries = calloc(size, sizeof(struct arp_entry));
+  cache->seqs = calloc(num_buckets, sizeof(unsigned int));
+  /* Cada contador de lectura en su propia línea de caché */
+  if (posix_memalign((void **) &cache->shards, ARP_CACHE_LINE,
+                     ARP_CACHE_SHARDS * sizeof(struct arp_cache_shard)) != 0) {
+    cache->shards = NULL;
+  } else {
+    memset(cache->shards, 0, ARP_CACHE_SHARDS * sizeof(struct arp_cache_shard));
+  }
+  if ((cache->buckets == NULL) || (cache->entries == NULL) ||
+      (cache->seqs == NULL) || (cache->shards == NULL)) {
+    fprintf(stderr, "arp_cache_create(): ERROR en malloc()\n");
+    arp_cache_free(cache);
+    return NULL;
+  }
+
+  cache->size = size;
+  cache->shift = shift;
+  cache->reachable_time = reachable_time;
+  cache->stale_time = stale_time;
+  cache->max_probes = ARP_MAX_PROBES;
+  cache->retrans_time = ARP_RETRANS_TIME;
+
+  int i;
+  for (i=0; i<num_buckets; i++) {
+    cache->buckets[i] = -1;
+  }
+  for (i=0; i<size; i++) {
+    cache->entries[i].next = (i + 1 < size) ? i + 1 : -1;
+  }
+  cache->free_list = 0;
+
+  return cache;
+}
+
+
+/* int arp_cache_set_ttl
+ * ( arp_cache_t * cache, long int reachable_time, long int stale_time );
+ *
+ * DESCRIPCIÓN:
+ *   Esta función cambia los tiempos de vida de las entradas de la caché.
+ *   Los nuevos tiempos se aplican también a las entradas existentes.
+ *
+ * VALOR DEVUELTO:
+ *   Devuelve '0' si se han cambiado los tiempos.
+ *
+ * ERRORES:
+ *   La función devuelve '-1' si algún tiempo es negativo.
+ */
+int arp_cache_set_ttl
+( arp_cache_t * cache, long int reachable_time, long int stale_time )
+{
+  if (cache == NULL) {
+    fprintf(stderr, "arp_cache_set_ttl(): ERROR: cache == NULL\n");
+    return -1;
+  }
+  if ((reachable_time < 0) || (stale_time < 0)) {
+    fprintf(stderr, "arp_cache_set_ttl(): ERROR: tiempo de vida inválido\n");
+    return -1;
+  }
+
+  pthread_mutex_lock(&cache->lock);
+  cache->reachable_time = reachable_time;
+  cache->stale_time = stale_time;
+  pthread_mutex_unlock(&cache->lock);
+
+  return 0;
+}
+
+
+/* int arp_cache_set_probes
+ * ( arp_cache_t * cache, int max_probes, long int retrans_time );
+ *
+ * DESCRIPCIÓN:
+ *   Esta función cambia cuántas peticiones ARP se envían a un vecino sin
+ *   resolver y cada cuánto tiempo, es decir, cuánto se tarda en darlo por
+ *   inalcanzable: 'max_probes' * 'retrans_time' ms. Por defecto son
+ *   'ARP_MAX_PROBES' peticiones cada 'ARP_RETRANS_TIME' ms.
+ *
+ * PARÁMETROS:
+ *          'cache': Caché de vecinos.
+ *     'max_probes': Número de peticiones sin respuesta tras el que la
+ *                   resolución falla.
+ *   'retrans_time': Milisegundos de espera de cada petición.
+ *
+ * VALOR DEVUELTO:
+ *   Devuelve '0' si se han cambiado los valores.
+ *
+ * ERRORES:
+ *   La función devuelve '-1' si algún valor no es positivo.
+ */
+int arp_cache_set_probes
+( arp_cache_t * cache, int max_probes, long int retrans_time )
+{
+  if (cache == NULL) {
+    fprintf(stderr, "arp_cache_set_probes(): ERROR: cache == NULL\n");
+    return -1;
+  }
+  if ((max_probes < 1) || (retrans_time < 1)) {
+    fprintf(stderr, "arp_cache_set_probes(): ERROR: valor inválido\n");
+    return -1;
+  }
+
+  pthread_mutex_lock(&cache->lock);
+  cache->max_probes = max_probes;
+  cache->retrans_time = retrans_time;
+  pthread_mutex_unlock(&cache->lock);
+
+  return 0;
+}
+
+
+/* int arp_cache_attach
+ * ( arp_cache_t * cache, eth_iface_t * iface, ipv4_addr_t addr );
+ *
+ * DESCRIPCIÓN:
+ *   Esta función asocia la caché a la interfaz 'iface', con dirección IPv4
+ *   'addr', y registra el manejador de las tramas ARP de la interfaz
+ *   ('arp_listen()'), que anota las respuestas en la caché.
+ *
+ *   A partir de entonces las respuestas ARP de la interfaz las consume el
+ *   manejador: no deben esperarse con 'arp_resolve()' (sí con
+ *   'arp_resolve_start()').
+ *
+ *   El hilo que llama a esta función es el hilo de la interfaz: el único
+ *   desde el que la caché procesa las tramas recibidas.
+ *
+ * VALOR DEVUELTO:
+ *   Devuelve '0' si la caché se ha asociado a la interfaz.
+ *
+ * ERRORES:
+ *   La función devuelve '-1' si se ha producido algún error.
+ */
+int arp_cache_attach
+( arp_cache_t * cache, eth_iface_t * iface, ipv4_addr_t addr )
+{
+  if ((cache == NULL) || (iface == NULL)) {
+    fprintf(stderr, "arp_cache_attach(): ERROR: parámetro NULL\n");
+    return -1;
+  }
+
+  if (arp_listen(iface, cache) == -1) {
+    return -1;
+  }
+  cache->iface = iface;
+  cache->iface_thread = pthread_self();
+  memcpy(cache->addr, addr, IPv4_ADDR_SIZE);
+
+  return 0;
+}
+
+
+/* int arp_cache_is_local ( arp_cache_t * cache, ipv4_addr_t addr );
+ *
+ * DESCRIPCIÓN:
+ *   Esta función indica si 'addr' es la dirección IPv4 de la interfaz
+ *   asociada a la caché, es decir, si hay que responder a las peticiones
+ *   ARP de esa dirección.
+ *
+ * VALOR DEVUELTO:
+ *   Devuelve '1' si es la dirección de la interfaz, o '0' en otro caso (o
+ *   si la caché no está asociada a ninguna interfaz).
+ */
+int arp_cache_is_local ( arp_cache_t * cache, ipv4_addr_t addr )
+{
+  return (cache->iface != NULL) &&
+         (memcmp(cache->addr, addr, IPv4_ADDR_SIZE) == 0);
+}
+
+
+/* int arp_cache_add_static
+ * ( arp_cache_t * cache, ipv4_addr_t addr, mac_addr_t mac );
+ *
+ * DESCRIPCIÓN:
+ *   Esta función añade a la caché una entrada estática (permanente) de
+ *   'addr' con la dirección MAC 'mac', o convierte en estática la entrada
+ *   que ya hubiera. Si su resolución estaba en curso, se envían los
+ *   datagramas encolados.
+ *
+ * VALOR DEVUELTO:
+ *   Devuelve '0' si se ha añadido la entrada.
+ *
+ * ERRORES:
+ *   La función devuelve '-1' si todas las entradas de la caché son
+ *   estáticas o se ha producido algún otro error.
+ */
+int arp_cache_add_static
+( arp_cache_t * cache, ipv4_addr_t addr, mac_addr_t mac )
+{
+  if (cache == NULL) {
+    fprintf(stderr, "arp_cache_add_static(): ERROR: cache == NULL\n");
+    return -1;
+  }
+
+  pthread_mutex_lock(&cache->lock);
+  uint32_t key = ipv4_addr_value(addr);
+  int i = arp_cache_find(cache, key);
+  if (i == -1) {
+    i = arp_cache_insert(cache, key, addr);
+    if (i == -1) {
+      pthread_mutex_unlock(&cache->lock);
+      return -1;
+    }
+  }
+
+  struct arp_entry * entry = &cache->entries[i];
+  int was_incomplete = entry->incomplete;
+  int bucket = arp_cache_bucket(cache, key);
+  arp_cache_write_begin(cache, bucket);
+  memcpy(entry->mac, mac, MAC_ADDR_SIZE);
+  entry->confirmed = arp_cache_now();
+  entry->permanent = 1;
+  entry->refreshing = 0;
+  entry->failed = 0;
+  entry->failures = 0;
+  entry->incomplete = 0;
+  entry->probes = 0;
+  arp_cache_write_end(cache, bucket);
+
+  if (was_incomplete) {
+    if (cache->iface != NULL) {
+      arp_cache_flush(cache, entry);
+    } else {
+      arp_cache_drop_queue(cache, entry);
+    }
+  }
+  pthread_mutex_unlock(&cache->lock);
+
+  return 0;
+}
+
+
+/* int arp_cache_read ( arp_cache_t * cache, char * filename );
+ *
+ * DESCRIPCIÓN:
+ *   Esta función lee el fichero de vecinos especificado y añade a la caché
+ *   como entradas estáticas los vecinos leídos. Cada línea del fichero
+ *   tiene el formato "<IPv4Address> <MACAddress>"; las líneas vacías y las
+ *   que empiezan por '#' se ignoran.
+ *
+ * PARÁMETROS:
+ *      'cache': Caché de vecinos donde añadir las entradas.
+ *   'filename': Nombre del fichero de vecinos.
+ *
+ * VALOR DEVUELTO:
+ *   El número de vecinos leídos y añadidos a la caché, o '0' si no se ha
+ *   leído ninguno.
+ *
+ * ERRORES:
+ *   La función devuelve '-1' si se ha producido algún error al leer el
+ *   fichero de vecinos.
+ */
+int arp_cache_read ( arp_cache_t * cache, char * filename )
+{
+  int read_neighbors = 0;
+
+  FILE * neighbors_file = fopen(filename, "r");
+  if (neighbors_file == NULL) {
+    fprintf(stderr, "Error opening input ARP Neighbors file \"%s\": %s.\n",
+            filename, strerror(errno));
+    return -1;
+  }
+
+  int linenum = 0;
+  char line_buf[1024];
+  char addr_str[256];
+  char mac_str[256];
+  int err = 0;
+
+  while ((! feof(neighbors_file)) && (err == 0)) {
+
+    linenum++;
+
+    /* Read next line of file */
+    char* line = fgets(line_buf, 1024, neighbors_file);
+    if (line == NULL) {
+      break;
+    }
+
+    /* If this line is empty or a comment, just ignore it */
+    if ((line_buf[0] == '\n') || (line_buf[0] == '#')) {
+      continue;
+    }
+
+    /* Parse line: Format "<addr> <mac>\n" */
+    int params = sscanf(line, "%255s %255s\n", addr_str, mac_str);
+    if (params != 2) {
+      fprintf(stderr, "%s:%d: Invalid ARP Neighbor format: '%s' (%d params)\n",
+              filename, linenum, line, params);
+      fprintf(stderr, "%s:%d: Format must be: <addr> <mac>\n",
+              filename, linenum);
+      err = -1;
+      break;
+    }
+
+    ipv4_addr_t addr;
+    if (ipv4_str_addr(addr_str, addr) == -1) {
+      fprintf(stderr, "%s:%d: Invalid <addr> value: '%s'\n",
+              filename, linenum, addr_str);
+      err = -1;
+      break;
+    }
+
+    mac_addr_t mac;
+    if (mac_str_addr(mac_str, mac) == -1) {
+      fprintf(stderr, "%s:%d: Invalid <mac> value: '%s'\n",
+              filename, linenum, mac_str);
+      err = -1;
+      break;
+    }
+
+    /* Add new static entry to the cache */
+    err = arp_cache_add_static(cache, addr, mac);
+    if (err == 0) {
+      read_neighbors++;
+    }
+  } /* while() */
+
+  if (err == -1) {
+    read_neighbors = -1;
+  }
+
+  /* Close ARP Neighbors file */
+  fclose(neighbors_file);
+
+  return read_neighbors;
+}
+
+
+/* int arp_cache_save ( arp_cache_t * cache, char * filename );
+ *
+ * DESCRIPCIÓN:
+ *   Esta función guarda en el fichero especificado una instantánea de las
+ *   entradas dinámicas de la caché en los estados 'ARP_STATE_REACHABLE' y
+ *   'ARP_STATE_STALE', con el instante (del reloj de tiempo real) en que se
+ *   confirmó cada una. El fichero se escribe con otro nombre y se renombra
+ *   al terminar, de modo que nunca queda a medio escribir.
+ *
+ * PARÁMETROS:
+ *      'cache': Caché de vecinos.
+ *   'filename': Nombre del fichero de la instantánea.
+ *
+ * VALOR DEVUELTO:
+ *   El número de entradas guardadas.
+ *
+ * ERRORES:
+ *   La función devuelve '-1' si se ha producido algún error al escribir el
+ *   fichero.
+ */
+int arp_cache_save ( arp_cache_t * cache, char * filename )
+{
+  if ((cache == NULL) || (filename == NULL)) {
+    fprintf(stderr, "arp_cache_save(): ERROR: parámetro NULL\n");
+    return -1;
+  }
+
+  char tmp_name[1024];
+  if (snprintf(tmp_name, sizeof(tmp_name), "%s.tmp", filename) >=
+      (int) sizeof(tmp_name)) {
+    fprintf(stderr, "arp_cache_save(): ERROR: nombre demasiado largo\n");
+    return -1;
+  }
+
+  FILE * file = fopen(tmp_name, "w");
+  if (file == NULL) {
+    fprintf(stderr, "arp_cache_save(): ERROR en fopen(\"%s\"): %s\n",
+            tmp_name, strerror(errno));
+    return -1;
+  }
+
+  /* La cabecera se escribe al final, con el número de entradas */
+  struct arp_snapshot_header header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, ARP_SNAPSHOT_MAGIC, sizeof(header.magic));
+  header.version = ARP_SNAPSHOT_VERSION;
+  int err = (fwrite(&header, sizeof(header), 1, file) != 1);
+
+  pthread_mutex_lock(&cache->lock);
+  long long int now = arp_cache_now();
+  long long int wall_now = arp_cache_wall_now();
+  int i;
+  for (i=0; (i<cache->size) && ( ! err ); i++) {
+    struct arp_entry * entry = &cache->entries[i];
+    if (( ! entry->used ) || entry->permanent) {
+      continue;
+    }
+    int state = arp_cache_state(cache, entry, now);
+    if ((state != ARP_STATE_REACHABLE) && (state != ARP_STATE_STALE)) {
+      continue;
+    }
+
+    struct arp_snapshot_entry record;
+    memset(&record, 0, sizeof(record));
+    record.confirmed = wall_now - (now - entry->confirmed);
+    memcpy(record.addr, entry->addr, IPv4_ADDR_SIZE);
+    memcpy(record.mac, entry->mac, MAC_ADDR_SIZE);
+    err = (fwrite(&record, sizeof(record), 1, file) != 1);
+    header.count++;
+  }
+  pthread_mutex_unlock(&cache->lock);
+
+  if ( ! err ) {
+    err = (fseek(file, 0, SEEK_SET) == -1) ||
+          (fwrite(&header, sizeof(header), 1, file) != 1);
+  }
+  if ((fclose(file) != 0) || err) {
+    fprintf(stderr, "arp_cache_save(): ERROR al escribir \"%s\": %s\n",
+            tmp_name, strerror(errno));
+    unlink(tmp_name);
+    return -1;
+  }
+
+  if (rename(tmp_name, filename) == -1) {
+    fprintf(stderr, "arp_cache_save(): ERROR en rename(): %s\n",
+            strerror(errno));
+    unlink(tmp_name);
+    return -1;
+  }
+
+  return (int) header.count;
+}
+
+
+/* int arp_cache_load ( arp_cache_t * cache, char * filename );
+ *
+ * DESCRIPCIÓN:
+ *   Esta función proyecta en memoria ('mmap()') la instantánea guardada con
+ *   'arp_cache_save()' y añade a la caché sus entradas que todavía no han
+ *   expirado, con el tiempo que llevan confirmadas. Las direcciones que ya
+ *   están en la caché (por ejemplo, las estáticas) no se cambian.
+ *
+ * PARÁMETROS:
+ *      'cache': Caché de vecinos.
+ *   'filename': Nombre del fichero de la instantánea.
+ *
+ * VALOR DEVUELTO:
+ *   El número de entradas añadidas, o '0' si el fichero no existe (por
+ *   ejemplo, en el primer arranque).
+ *
+ * ERRORES:
+ *   La función devuelve '-1' si no se ha podido leer el fichero o no es
+ *   una instantánea válida.
+ */
+int arp_cache_load ( arp_cache_t * cache, char * filename )
+{
+  if ((cache == NULL) || (filename == NULL)) {
+    fprintf(stderr, "arp_cache_load(): ERROR: parámetro NULL\n");
+    return -1;
+  }
+
+  int fd = open(filename, O_RDONLY);
+  if (fd == -1) {
+    if (errno == ENOENT) {
+      return 0;
+    }
+    fprintf(stderr, "arp_cache_load(): ERROR en open(\"%s\"): %s\n",
+            filename, strerror(errno));
+    return -1;
+  }
+
+  struct stat st;
+  if (fstat(fd, &st) == -1) {
+    fprintf(stderr, "arp_cache_load(): ERROR en fstat(): %s\n",
+            strerror(errno));
+    close(fd);
+    return -1;
+  }
+  if (st.st_size < (off_t) sizeof(struct arp_snapshot_header)) {
+    fprintf(stderr, "arp_cache_load(): ERROR: \"%s\" no es una "
+            "instantánea válida\n", filename);
+    close(fd);
+    return -1;
+  }
+
+  void * map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED) {
+    fprintf(stderr, "arp_cache_load(): ERROR en mmap(): %s\n",
+            strerror(errno));
+    return -1;
+  }
+
+  struct arp_snapshot_header * header = map;
+  struct arp_snapshot_entry * records = (struct arp_snapshot_entry *) (header + 1);
+  if ((memcmp(header->magic, ARP_SNAPSHOT_MAGIC, sizeof(header->magic)) != 0) ||
+      (header->version != ARP_SNAPSHOT_VERSION) ||
+      (st.st_size != (off_t) (sizeof(struct arp_snapshot_header) +
+                              header->count * sizeof(struct arp_snapshot_entry)))) {
+    fprintf(stderr, "arp_cache_load(): ERROR: \"%s\" no es una "
+            "instantánea válida\n", filename);
+    munmap(map, st.st_size);
+    return -1;
+  }
+
+  /* El tiempo que lleva confirmada cada entrada se traslada del reloj de
+     tiempo real al monotónico de esta ejecución */
+  pthread_mutex_lock(&cache->lock);
+  long long int now = arp_cache_now();
+  long long int wall_now = arp_cache_wall_now();
+  int loaded = 0;
+  uint32_t n;
+  for (n=0; n<header->count; n++) {
+    struct arp_snapshot_entry * record = &records[n];
+    long long int age = wall_now - record->confirmed;
+    if (age < 0) {
+      age = 0;
+    }
+    if (age >= cache->reachable_time + cache->stale_time) {
+      continue;
+    }
+
+    uint32_t key = ipv4_addr_value(record->addr);
+    if (arp_cache_find(cache, key) != -1) {
+      continue;
+    }
+    int i = arp_cache_insert(cache, key, record->addr);
+    if (i == -1) {
+      break;
+    }
+    struct arp_entry * entry = &cache->entries[i];
+    int bucket = arp_cache_bucket(cache, key);
+    arp_cache_write_begin(cache, bucket);
+    memcpy(entry->mac, record->mac, MAC_ADDR_SIZE);
+    entry->confirmed = now - age;
+    entry->failed = 0;
+    arp_cache_write_end(cache, bucket);
+    loaded++;
+  }
+  pthread_mutex_unlock(&cache->lock);
+
+  munmap(map, st.st_size);
+
+  return loaded;
+}
+
+
+/* int arp_cache_lookup
+ * ( arp_cache_t * cache, ipv4_addr_t addr, mac_addr_t mac );
+ *
+ * DESCRIPCIÓN:
+ *   Esta función busca la dirección IPv4 indicada en la caché y, si está,
+ *   copia en 'mac' su dirección MAC.
+ *
+ *   Si la caché está asociada a una interfaz y a la entrada dinámica le
+ *   quedan menos de 'ARP_REFRESH_TIME' ms, envía la petición ARP unicast
+ *   que la comprueba.
+ *
+ * VALOR DEVUELTO:
+ *   El estado de la dirección en la caché. Sólo las direcciones en los
+ *   estados 'ARP_STATE_REACHABLE' y 'ARP_STATE_STALE' deben usarse para
+ *   enviar; a las del estado 'ARP_STATE_FAILED' no debe enviarse.
+ */
+int arp_cache_lookup ( arp_cache_t * cache, ipv4_addr_t addr, mac_addr_t mac )
+{
+  uint32_t key = ipv4_addr_value(addr);
+  struct arp_cache_shard * shard = arp_cache_my_shard(cache);
+
+  struct arp_entry_view view;
+  if ( ! arp_cache_peek(cache, key, &view) ) {
+    arp_cache_count(&shard->misses);
+    return ARP_STATE_NONE;
+  }
+  memcpy(mac, view.mac, MAC_ADDR_SIZE);
+
+  long long int now = arp_cache_now();
+  int state = arp_cache_view_state(cache, &view, now);
+  if ((state == ARP_STATE_REACHABLE) || (state == ARP_STATE_STALE)) {
+    arp_cache_count(&shard->hits);
+    arp_cache_refresh(cache, key, &view, now);
+  } else {
+    arp_cache_count(&shard->misses);
+    if (state == ARP_STATE_EXPIRED) {
+      arp_cache_count(&shard->expired);
+    }
+    if ((state == ARP_STATE_FAILED) && view.incomplete) {
+      /* Resolución que acaba de fallar: se convierte en negativa */
+      pthread_mutex_lock(&cache->lock);
+      int i = arp_cache_find(cache, key);
+      if (i != -1) {
+        arp_cache_state(cache, &cache->entries[i], now);
+      }
+      pthread_mutex_unlock(&cache->lock);
+    }
+  }
+
+  return state;
+}
+
+
+/* int arp_cache_update
+ * ( arp_cache_t * cache, ipv4_addr_t addr, mac_addr_t mac );
+ *
+ * DESCRIPCIÓN:
+ *   Esta función anota en la caché que la dirección IPv4 'addr' tiene la
+ *   dirección MAC 'mac', confirmada en este instante. La entrada pasa al
+ *   estado 'ARP_STATE_REACHABLE' (también si era una entrada negativa) y, si
+ *   su resolución estaba en curso, se envían los datagramas encolados. Si la
+ *   caché está llena se sustituye la entrada dinámica confirmada hace más
+ *   tiempo. Las entradas estáticas no se cambian.
+ *
+ * VALOR DEVUELTO:
+ *   Devuelve '0' si se ha actualizado la caché.
+ *
+ * ERRORES:
+ *   La función devuelve '-1' si se ha producido algún error.
+ */
+int arp_cache_update ( arp_cache_t * cache, ipv4_addr_t addr, mac_addr_t mac )
+{
+  if (cache == NULL) {
+    fprintf(stderr, "arp_cache_update(): ERROR: cache == NULL\n");
+    return -1;
+  }
+
+  pthread_mutex_lock(&cache->lock);
+  uint32_t key = ipv4_addr_value(addr);
+  int i = arp_cache_find(cache, key);
+  if (i == -1) {
+    i = arp_cache_insert(cache, key, addr);
+    if (i == -1) {
+      pthread_mutex_unlock(&cache->lock);
+      return -1;
+    }
+  }
+
+  struct arp_entry * entry = &cache->entries[i];
+  if (entry->permanent) {
+    pthread_mutex_unlock(&cache->lock);
+    return 0;
+  }
+
+  if (entry->refreshing) {
+    cache->stats.refreshed++;
+  }
+  int was_incomplete = entry->incomplete;
+  int bucket = arp_cache_bucket(cache, key);
+  arp_cache_write_begin(cache, bucket);
+  memcpy(entry->mac, mac, MAC_ADDR_SIZE);
+  entry->confirmed = arp_cache_now();
+  entry->refreshing = 0;
+  entry->failed = 0;
+  entry->incomplete = 0;
+  entry->probes = 0;
+  arp_cache_write_end(cache, bucket);
+  entry->failures = 0;
+
+  if (was_incomplete) {
+    cache->stats.resolutions++;
+    if (cache->iface != NULL) {
+      arp_cache_flush(cache, entry);
+    } else {
+      arp_cache_drop_queue(cache, entry);
+    }
+  }
+  pthread_mutex_unlock(&cache->lock);
+
+  return 0;
+}
+
+
+/* int arp_cache_confirm
+ * ( arp_cache_t * cache, ipv4_addr_t addr, mac_addr_t mac );
+ *
+ * DESCRIPCIÓN:
+ *   Esta función anota una respuesta ARP de 'addr'. Si la dirección está en
+ *   la caché, se actualiza como con 'arp_cache_update()' y, si su resolución
+ *   estaba en curso, se envían los datagramas encolados. Las respuestas de
+ *   direcciones que no están en la caché se ignoran.
+ *
+ * VALOR DEVUELTO:
+ *   Devuelve '1' si la dirección estaba en la caché, o '0' en otro caso.
+ */
+int arp_cache_confirm ( arp_cache_t * cache, ipv4_addr_t addr, mac_addr_t mac )
+{
+  pthread_mutex_lock(&cache->lock);
+  int found = (arp_cache_find(cache, ipv4_addr_value(addr)) != -1);
+  if (found) {
+    arp_cache_update(cache, addr, mac);
+  }
+  pthread_mutex_unlock(&cache->lock);
+
+  return found;
+}
+
+
+/* Camino lento de 'arp_cache_send()', con el cerrojo tomado: el vecino
+   puede haberse resuelto entretanto; si no, se encola el datagrama */
+static int arp_cache_send_locked
+( arp_cache_t * cache, ipv4_addr_t addr, uint16_t type, pkt_buf_t * pkt )
+{
+  struct arp_cache_shard * shard = arp_cache_my_shard(cache);
+
+  int i = arp_cache_find(cache, ipv4_addr_value(addr));
+  if (i != -1) {
+    struct arp_entry * entry = &cache->entries[i];
+    int state = arp_cache_state(cache, entry, arp_cache_now());
+    if ((state == ARP_STATE_REACHABLE) || (state == ARP_STATE_STALE)) {
+      arp_cache_count(&shard->hits);
+      return eth_send_pkt(cache->iface, entry->mac, type, pkt);
+    }
+    if (state == ARP_STATE_FAILED) {
+      cache->stats.unreachable++;
+      return ARP_UNREACHABLE;
+    }
+    if (state == ARP_STATE_EXPIRED) {
+      arp_cache_count(&shard->expired);
+    }
+  }
+  arp_cache_count(&shard->misses);
+
+  /* Vecino sin resolver: encolar el datagrama y retornar */
+  i = arp_cache_probe(cache, addr);
+  if (i == -1) {
+    return -1;
+  }
+  struct arp_entry * entry = &cache->entries[i];
+  if (entry->queued >= ARP_CACHE_QUEUE_LEN) {
+    cache->stats.queue_drops++;
+    fprintf(stderr, "arp_cache_send(): ERROR: cola del vecino llena\n");
+    return -1;
+  }
+
+  struct arp_queued * queued = malloc(sizeof(struct arp_queued) + pkt->len);
+  if (queued == NULL) {
+    fprintf(stderr, "arp_cache_send(): ERROR en malloc()\n");
+    return -1;
+  }
+  queued->next = NULL;
+  queued->type = type;
+  queued->len = pkt->len;
+  memcpy(queued->data, pkt->data, pkt->len);
+
+  if (entry->queue_tail == NULL) {
+    entry->queue = queued;
+  } else {
+    entry->queue_tail->next = queued;
+  }
+  entry->queue_tail = queued;
+  entry->queued++;
+  cache->stats.queued++;
+
+  return pkt->len;
+}
+
+
+/* int arp_cache_send
+ * ( arp_cache_t * cache, ipv4_addr_t addr, uint16_t type, pkt_buf_t * pkt );
+ *
+ * DESCRIPCIÓN:
+ *   Esta función envía el paquete 'pkt' por la interfaz de la caché al
+ *   vecino 'addr', sin bloquearse.
+ *
+ *   Si la dirección MAC del vecino está en la caché (estados
+ *   'ARP_STATE_REACHABLE' o 'ARP_STATE_STALE'), el paquete se envía con
+ *   'eth_send_pkt()'. Si no, se copia en la cola del vecino (hasta
+ *   'ARP_CACHE_QUEUE_LEN' paquetes) y, si no había ya una petición ARP en
+ *   curso, se envía una. Los paquetes encolados se envían al llegar la
+ *   respuesta.
+ *
+ *   La petición se repite cada 'retrans_time' ms mientras se sigan
+ *   enviando paquetes al vecino; tras 'max_probes' peticiones sin
+ *   respuesta se descartan los paquetes encolados y la entrada pasa a ser
+ *   negativa. Los paquetes a un vecino con entrada negativa no se encolan:
+ *   la función retorna en el acto con 'ARP_UNREACHABLE'. Antes de encolar,
+ *   en el hilo de la interfaz se procesan sin esperar las tramas ya
+ *   recibidas, para que también un programa que sólo envía complete sus
+ *   resoluciones.
+ *
+ *   Puede llamarse desde varios hilos a la vez. Los demás hilos no procesan
+ *   las tramas recibidas: sus paquetes encolados se envían cuando el hilo
+ *   de la interfaz recibe la respuesta.
+ *
+ * PARÁMETROS:
+ *   'cache': Caché asociada a una interfaz con 'arp_cache_attach()'.
+ *    'addr': Dirección IPv4 del vecino (el siguiente salto).
+ *    'type': Valor del campo 'Tipo' de la trama.
+ *     'pkt': Buffer con el payload de la trama.
+ *
+ * VALOR DEVUELTO:
+ *   El número de bytes de datos enviados o encolados.
+ *
+ * ERRORES:
+ *   La función devuelve 'ARP_UNREACHABLE' si el vecino tiene una entrada
+ *   negativa, o '-1' si la cola del vecino está llena o se ha producido
+ *   algún otro error.
+ */
+int arp_cache_send
+( arp_cache_t * cache, ipv4_addr_t addr, uint16_t type, pkt_buf_t * pkt )
+{
+  if ((cache == NULL) || (cache->iface == NULL)) {
+    fprintf(stderr, "arp_cache_send(): ERROR: caché sin interfaz\n");
+    return -1;
+  }
+
+  uint32_t key = ipv4_addr_value(addr);
+  struct arp_entry_view view;
+  if (arp_cache_peek(cache, key, &view)) {
+    long long int now = arp_cache_now();
+    int state = arp_cache_view_state(cache, &view, now);
+
+    /* Camino rápido, sin cerrojo de la caché: vecino resuelto. La
+       interfaz serializa los envíos de varios hilos */
+    if ((state == ARP_STATE_REACHABLE) || (state == ARP_STATE_STALE)) {
+      arp_cache_count(&arp_cache_my_shard(cache)->hits);
+      arp_cache_refresh(cache, key, &view, now);
+      return eth_send_pkt(cache->iface, view.mac, type, pkt);
+    }
+
+    /* Con la resolución en curso, la respuesta puede estar ya entre las
+       tramas recibidas. Sólo el hilo de la interfaz puede procesarlas */
+    if ((state == ARP_STATE_INCOMPLETE) &&
+        pthread_equal(pthread_self(), cache->iface_thread) &&
+        (eth_dispatch(cache->iface, 0) == -1)) {
+      return -1;
+    }
+  }
+
+  pthread_mutex_lock(&cache->lock);
+  int r = arp_cache_send_locked(cache, addr, type, pkt);
+  pthread_mutex_unlock(&cache->lock);
+
+  return r;
+}
+
+
+/* int arp_cache_remove ( arp_cache_t * cache, ipv4_addr_t addr );
+ *
+ * DESCRIPCIÓN:
+ *   Esta función elimina de la caché la dirección IPv4 indicada.
+ *
+ * VALOR DEVUELTO:
+ *   Devuelve '0' si la dirección se ha eliminado, o '-1' si no estaba en la
+ *   caché.
+ */
+int arp_cache_remove ( arp_cache_t * cache, ipv4_addr_t addr )
+{
+  pthread_mutex_lock(&cache->lock);
+  int i = arp_cache_find(cache, ipv4_addr_value(addr));
+  if (i != -1) {
+    arp_cache_unlink(cache, i);
+  }
+  pthread_mutex_unlock(&cache->lock);
+
+  return (i != -1) ? 0 : -1;
+}
+
+
+/* int arp_cache_resolve
+ * ( arp_cache_t * cache, eth_iface_t * iface, ipv4_addr_t addr,
+ *   mac_addr_t mac, ipv4_addr_t src_addr );
+ *
+ * DESCRIPCIÓN:
+ *   Esta función obtiene la dirección MAC de 'addr': de la caché si está en
+ *   los estados 'ARP_STATE_REACHABLE' o 'ARP_STATE_STALE' o, si no,
+ *   enviando peticiones ARP y esperando la respuesta, que se anota en la
+ *   caché. Si no llega, la entrada pasa a ser negativa.
+ *
+ *   Si la caché está asociada a 'iface', mientras espera procesa las tramas
+ *   recibidas con 'eth_dispatch()', y la espera dura como mucho
+ *   'max_probes' * 'retrans_time' ms. Si no, usa 'arp_resolve()'.
+ *
+ *   Con una entrada negativa la función retorna sin enviar ni esperar.
+ *
+ * PARÁMETROS:
+ *      'cache': Caché de vecinos de la interfaz.
+ *      'iface': Interfaz por la que se envía la petición ARP.
+ *       'addr': Dirección IPv4 que se quiere resolver.
+ *        'mac': Parámetro de salida con la dirección MAC.
+ *   'src_addr': Dirección IPv4 de la interfaz, origen de la petición.
+ *
+ * VALOR DEVUELTO:
+ *   Devuelve '1' si se ha obtenido la dirección MAC, o '0' si no ha llegado
+ *   la respuesta ARP.
+ *
+ * ERRORES:
+ *   La función devuelve 'ARP_UNREACHABLE' si 'addr' ya tenía una entrada
+ *   negativa, o '-1' si se ha producido algún error.
+ */
+int arp_cache_resolve
+( arp_cache_t * cache, eth_iface_t * iface, ipv4_addr_t addr,
+  mac_addr_t mac, ipv4_addr_t src_addr )
+{
+  if ((cache == NULL) || (iface == NULL)) {
+    fprintf(stderr, "arp_cache_resolve(): ERROR: parámetro NULL\n");
+    return -1;
+  }
+
+  int state = arp_cache_lookup(cache, addr, mac);
+  if ((state == ARP_STATE_REACHABLE) || (state == ARP_STATE_STALE)) {
+    return 1;
+  }
+  if (state == ARP_STATE_FAILED) {
+    pthread_mutex_lock(&cache->lock);
+    cache->stats.unreachable++;
+    pthread_mutex_unlock(&cache->lock);
+    return ARP_UNREACHABLE;
+  }
+
+  uint32_t key = ipv4_addr_value(addr);
+
+  if (cache->iface != iface) {
+    int r = arp_resolve(iface, addr, mac, src_addr);
+    if (r < 0) {
+      return r;
+    }
+    if (r == 0) {
+      pthread_mutex_lock(&cache->lock);
+      int i = arp_cache_find(cache, key);
+      if (i == -1) {
+        i = arp_cache_insert(cache, key, addr);
+      }
+      if (i != -1) {
+        arp_cache_fail(cache, &cache->entries[i], arp_cache_now());
+      }
+      pthread_mutex_unlock(&cache->lock);
+      return 0;
+    }
+    pthread_mutex_lock(&cache->lock);
+    arp_cache_update(cache, addr, mac);
+    cache->stats.resolutions++;
+    pthread_mutex_unlock(&cache->lock);
+    return 1;
+  }
+
+  /* Caché asociada: la respuesta llega al manejador ARP de la interfaz, y
+     las peticiones se repiten hasta que la resolución termina o falla. El
+     cerrojo se suelta mientras se espera. */
+  while (1) {
+    pthread_mutex_lock(&cache->lock);
+    int i = arp_cache_find(cache, key);
+    if (i == -1) {
+      i = arp_cache_probe(cache, addr);
+      if (i == -1) {
+        pthread_mutex_unlock(&cache->lock);
+        return -1;
+      }
+    }
+    struct arp_entry * entry = &cache->entries[i];
+    long long int now = arp_cache_now();
+    state = arp_cache_state(cache, entry, now);
+    if ((state == ARP_STATE_REACHABLE) || (state == ARP_STATE_STALE)) {
+      memcpy(mac, entry->mac, MAC_ADDR_SIZE);
+      pthread_mutex_unlock(&cache->lock);
+      return 1;
+    }
+    if (state == ARP_STATE_FAILED) {
+      pthread_mutex_unlock(&cache->lock);
+      return 0;
+    }
+
+    arp_cache_probe(cache, addr);
+    long long int wait = entry->requested + cache->retrans_time - now;
+    pthread_mutex_unlock(&cache->lock);
+    if (eth_dispatch(iface, (wait > 0) ? wait : 0) == -1) {
+      return -1;
+    }
+  }
+}
+
+
+/* int arp_cache_resolve_batch
+ * ( arp_cache_t * cache, ipv4_addr_t addrs[], mac_addr_t macs[],
+ *   int results[], int num, long int timeout );
+ *
+ * DESCRIPCIÓN:
+ *   Esta función resuelve a la vez las 'num' direcciones IPv4 de 'addrs':
+ *   envía seguidas las peticiones ARP de todas las que no están en la caché
+ *   y espera las respuestas, que llegan en cualquier orden, con un único
+ *   plazo para todas. Mientras espera procesa las tramas recibidas con
+ *   'eth_dispatch()' y repite cada 'retrans_time' ms (hasta 'max_probes'
+ *   veces) las peticiones sin respuesta, como 'arp_cache_send()'.
+ *
+ *   Así el tiempo de resolver muchos vecinos es el de la resolución más
+ *   lenta, no la suma de todas.
+ *
+ * PARÁMETROS:
+ *     'cache': Caché asociada a una interfaz con 'arp_cache_attach()'.
+ *     'addrs': Direcciones IPv4 que se quieren resolver.
+ *      'macs': Parámetro de salida con la dirección MAC de cada dirección
+ *              resuelta.
+ *   'results': Parámetro de salida con el resultado de cada dirección: '1'
+ *              si se ha obtenido su dirección MAC, '0' si no ha llegado la
+ *              respuesta ARP antes del plazo, o 'ARP_UNREACHABLE' si ya
+ *              tenía una entrada negativa (y no se ha enviado la petición).
+ *       'num': Número de direcciones.
+ *   'timeout': Plazo en milisegundos para todas las direcciones. Si no es
+ *              positivo, se espera a que cada resolución termine o falle
+ *              (unos 'max_probes' * 'retrans_time' ms).
+ *
+ * VALOR DEVUELTO:
+ *   El número de direcciones resueltas.
+ *
+ * ERRORES:
+ *   La función devuelve '-1' si se ha producido algún error.
+ */
+int arp_cache_resolve_batch
+( arp_cache_t * cache, ipv4_addr_t addrs[], mac_addr_t macs[],
+  int results[], int num, long int timeout )
+{
+  if ((cache == NULL) || (cache->iface == NULL)) {
+    fprintf(stderr, "arp_cache_resolve_batch(): ERROR: caché sin interfaz\n");
+    return -1;
+  }
+  if (num <= 0) {
+    return 0;
+  }
+
+  /* Enviar seguidas las peticiones de las direcciones sin resolver, que
+     quedan con 'results' a 0 */
+  int resolved = 0;
+  int pending = 0;
+  int i;
+  pthread_mutex_lock(&cache->lock);
+  for (i=0; i<num; i++) {
+    int state = arp_cache_lookup(cache, addrs[i], macs[i]);
+    if ((state == ARP_STATE_REACHABLE) || (state == ARP_STATE_STALE)) {
+      results[i] = 1;
+      resolved++;
+    } else if (state == ARP_STATE_FAILED) {
+      cache->stats.unreachable++;
+      results[i] = ARP_UNREACHABLE;
+    } else if (arp_cache_probe(cache, addrs[i]) == -1) {
+      pthread_mutex_unlock(&cache->lock);
+      return -1;
+    } else {
+      results[i] = 0;
+      pending++;
+    }
+  }
+  pthread_mutex_unlock(&cache->lock);
+
+  /* Recoger las respuestas hasta que no quede ninguna pendiente o venza el
+     plazo común. Sin plazo, cada resolución termina al fallar. */
+  long long int deadline = (timeout > 0) ? arp_cache_now() + timeout : -1;
+  while (pending > 0) {
+    long long int now = arp_cache_now();
+    if ((deadline != -1) && (now >= deadline)) {
+      break;
+    }
+    long long int wait = cache->retrans_time;
+    if ((deadline != -1) && (deadline - now < wait)) {
+      wait = deadline - now;
+    }
+    if (eth_dispatch(cache->iface, wait) == -1) {
+      return -1;
+    }
+
+    pthread_mutex_lock(&cache->lock);
+    now = arp_cache_now();
+    pending = 0;
+    for (i=0; i<num; i++) {
+      if (results[i] != 0) {
+        continue;
+      }
+      int index = arp_cache_find(cache, ipv4_addr_value(addrs[i]));
+      if (index == -1) {
+        /* Sustituida por otra dirección del lote: la caché es pequeña */
+        continue;
+      }
+      struct arp_entry * entry = &cache->entries[index];
+      int state = arp_cache_state(cache, entry, now);
+      if ((state == ARP_STATE_REACHABLE) || (state == ARP_STATE_STALE)) {
+        memcpy(macs[i], entry->mac, MAC_ADDR_SIZE);
+        results[i] = 1;
+        resolved++;
+      } else if (state == ARP_STATE_INCOMPLETE) {
+        arp_cache_probe(cache, addrs[i]);
+        pending++;
+      }
+    }
+    pthread_mutex_unlock(&cache->lock);
+  }
+
+  return resolved;
+}
+
+
+/* void arp_cache_get_stats ( arp_cache_t * cache, arp_cache_stats_t * stats );
+ *
+ * DESCRIPCIÓN:
+ *   Esta función copia en 'stats' las estadísticas de la caché.
+ */
+void arp_cache_get_stats ( arp_cache_t * cache, arp_cache_stats_t * stats )
+{
+  pthread_mutex_lock(&cache->lock);
+  *stats = cache->stats;
+  pthread_mutex_unlock(&cache->lock);
+
+  int i;
+  for (i=0; i<ARP_CACHE_SHARDS; i++) {
+    struct arp_cache_shard * shard = &cache->shards[i];
+    stats->hits += __atomic_load_n(&shard->hits, __ATOMIC_RELAXED);
+    stats->misses += __atomic_load_n(&shard->misses, __ATOMIC_RELAXED);
+    stats->expired += __atomic_load_n(&shard->expired, __ATOMIC_RELAXED);
+    stats->read_retries += __atomic_load_n(&shard->read_retries,
+                                           __ATOMIC_RELAXED);
+  }
+}
+
+
+/* void arp_cache_free ( arp_cache_t * cache );
+ *
+ * DESCRIPCIÓN:
+ *   Esta función libera la caché y todas sus entradas, descartando los
+ *   datagramas encolados, y elimina el manejador ARP de su interfaz. Debe
+ *   llamarse antes de cerrar la interfaz.
+ */
+void arp_cache_free ( arp_cache_t * cache )
+{
+  if (cache == NULL) {
+    return;
+  }
+
+  if (cache->iface != NULL) {
+    arp_unlisten(cache->iface);
+  }
+  if (cache->entries != NULL) {
+    int i;
+    for (i=0; i<cache->size; i++) {
+      arp_cache_drop_queue(cache, &cache->entries[i]);
+    }
+  }
+  free(cache->buckets);
+  free(cache->entries);
+  free(cache->seqs);
+  free(cache->shards);
+  pthread_mutex_destroy(&cache->lock);
+  free(cache);
+}
@@ -0,0 +1,551 @@
+#ifndef _ARP_CACHE_H
+#define _ARP_CACHE_H
+
+#include "eth.h"
+#include "ipv4.h"
+
+/* Caché de vecinos ARP.
+ *
+ * Guarda la dirección MAC de las direcciones IPv4 ya resueltas, para que
+ * 'ipv4_send()' no tenga que enviar una petición ARP y esperar su respuesta
+ * en cada datagrama: una consulta a la caché cuesta una búsqueda en una
+ * tabla hash indexada por la dirección IPv4.
+ *
+ * El estado de cada entrada se deduce del tiempo transcurrido desde que se
+ * confirmó la dirección MAC (con una respuesta ARP):
+ *   'ARP_STATE_REACHABLE': Confirmada hace menos de 'reachable_time' ms.
+ *   'ARP_STATE_STALE': Confirmada hace menos de 'reachable_time' +
+ *                      'stale_time' ms. La dirección se sigue usando, pero
+ *                      puede haber cambiado.
+ *   'ARP_STATE_EXPIRED': Más antigua. No se usa: hay que volver a
+ *                        resolverla.
+ *
+ * Para que el primer datagrama tras la expiración no pague una resolución
+ * completa, las entradas que se siguen usando se comprueban antes de que
+ * expiren: cada consulta ('arp_cache_lookup()', 'arp_cache_send()') a una
+ * entrada a la que le quedan menos de 'ARP_REFRESH_TIME' ms envía una
+ * petición ARP unicast a su dirección MAC (como mucho una cada
+ * 'retrans_time' ms, ver 'arp_cache_set_probes()'), mientras se sigue
+ * usando la dirección anterior. La respuesta la confirma de nuevo. Las
+ * entradas que no se usan no se comprueban y expiran.
+ *
+ * La caché tiene un número máximo de entradas que se reserva al crearla.
+ * Cuando está llena, cada dirección nueva sustituye a la entrada confirmada
+ * hace más tiempo (normalmente una ya expirada).
+ *
+ * Las entradas estáticas ('arp_cache_add_static()', 'arp_cache_read()')
+ * están siempre en el estado 'ARP_STATE_REACHABLE': no expiran, no se
+ * comprueban, no se sustituyen y los mensajes ARP no las cambian. Sólo
+ * 'arp_cache_remove()' las elimina.
+ *
+ * Para que un proceso que se reinicia no tenga que resolver de nuevo todos
+ * sus vecinos, 'arp_cache_save()' guarda las entradas dinámicas válidas en
+ * un fichero binario (la instantánea) y 'arp_cache_load()' las recupera,
+ * con el tiempo que llevan confirmadas. Las que han expirado entretanto se
+ * descartan al cargarlas.
+ *
+ * El manejador ARP de la interfaz asociada a la caché responde a las
+ * peticiones de su dirección IPv4 y anota en la caché al emisor, de modo que
+ * responderle no necesita otra resolución. Las demás peticiones y las
+ * respuestas sólo actualizan las direcciones que ya están en la caché.
+ *
+ * Una caché asociada a una interfaz con 'arp_cache_attach()' resuelve sin
+ * bloquearse: 'arp_cache_send()' encola los datagramas hacia un vecino sin
+ * resolver (estado 'ARP_STATE_INCOMPLETE'), envía una única petición ARP y
+ * retorna. La respuesta se procesa desde el camino de recepción de la
+ * interfaz, que envía entonces los datagramas encolados. Así un vecino lento
+ * o caído sólo retrasa sus propios datagramas.
+ *
+ * La petición se repite cada 'retrans_time' ms hasta 'max_probes' veces
+ * (ver 'arp_cache_set_probes()'). Si ninguna obtiene respuesta, la entrada
+ * queda como negativa ('ARP_STATE_FAILED') y se descartan sus datagramas
+ * encolados: mientras dure, los envíos al vecino fallan en el acto con
+ * 'ARP_UNREACHABLE', sin encolar ni enviar peticiones. La duración empieza
+ * en 'ARP_FAILED_TIME' ms y se dobla con cada resolución fallida seguida
+ * del mismo vecino, hasta 'ARP_FAILED_MAX_TIME' ms; una respuesta ARP la
+ * devuelve a su valor inicial. Así un programa que envía sin parar a una
+ * dirección caída no se bloquea ni inunda la red de difusiones.
+ *
+ * Una caché puede consultarse desde varios hilos. 'arp_cache_lookup()' no
+ * toma ningún cerrojo: lee la entrada con un contador de secuencia por
+ * cubeta de la tabla hash (seqlock) y la vuelve a leer si un escritor la ha
+ * cambiado mientras tanto. Las escrituras (respuestas ARP, anotación de
+ * emisores, expiración, colas de datagramas, resoluciones) se serializan con
+ * un cerrojo de la caché, que las consultas nunca toman. Los contadores de
+ * consultas se reparten por hilo para que no compitan por la misma línea de
+ * caché; 'arp_cache_get_stats()' los suma.
+ *
+ * Las funciones de envío de la interfaz Ethernet admiten llamadas
+ * simultáneas, así que 'arp_cache_send()' (y las peticiones de comprobación
+ * de las consultas) puede llamarse desde cualquier hilo. La recepción no:
+ * el manejador ARP, que llama a 'arp_cache_update()' y
+ * 'arp_cache_confirm()' y envía los datagramas encolados, se ejecuta en el
+ * hilo que recibe por la interfaz asociada (el que llamó a
+ * 'arp_cache_attach()'), que debe seguir recibiendo para que terminen las
+ * resoluciones que empiezan los demás hilos. 'arp_cache_resolve()' y
+ * 'arp_cache_resolve_batch()', que esperan la respuesta recibiendo por la
+ * interfaz, sólo pueden llamarse desde ese hilo. En una caché sin interfaz
+ * asociada, todas las funciones pueden llamarse desde cualquier hilo.
+ */
+typedef struct arp_cache arp_cache_t;
+
+/* Número de entradas por defecto de la caché de cada capa IPv4 */
+#define ARP_CACHE_SIZE 256
+
+/* Tiempos por defecto (en milisegundos) que una entrada permanece en los
+   estados 'ARP_STATE_REACHABLE' y 'ARP_STATE_STALE' */
+#define ARP_REACHABLE_TIME 30000
+#define ARP_STALE_TIME 60000
+
+/* Estados de una dirección en la caché */
+#define ARP_STATE_NONE      0 /* No está en la caché */
+#define ARP_STATE_REACHABLE 1 /* Confirmada recientemente */
+#define ARP_STATE_STALE     2 /* Se usa, pero puede haber cambiado */
+#define ARP_STATE_EXPIRED   3 /* Hay que volver a resolverla */
+#define ARP_STATE_INCOMPLETE 4 /* Resolución en curso */
+#define ARP_STATE_FAILED    5 /* Sin respuesta: vecino inalcanzable */
+
+/* Valor devuelto (distinto de '-1') por los envíos y resoluciones que
+   fallan sin esperar porque el vecino está en el estado 'ARP_STATE_FAILED' */
+#define ARP_UNREACHABLE (-2)
+
+/* Número máximo de datagramas encolados hacia un vecino sin resolver */
+#define ARP_CACHE_QUEUE_LEN 16
+
+/* Valores por defecto de los milisegundos sin respuesta tras los que se
+   repite la petición ARP, y del número de peticiones tras el que la
+   resolución falla */
+#define ARP_RETRANS_TIME 1000
+#define ARP_MAX_PROBES 3
+
+/* Milisegundos que dura la primera entrada negativa de un vecino, y máximo
+   al que llega doblándose con cada resolución fallida seguida */
+#define ARP_FAILED_TIME 1000
+#define ARP_FAILED_MAX_TIME 60000
+
+/* Milisegundos antes de la expiración a partir de los que se comprueban las
+   entradas en uso */
+#define ARP_REFRESH_TIME 5000
+
+/* Estadísticas de una caché de vecinos */
+typedef struct arp_cache_stats {
+  long int hits;        /* Consultas resueltas por la caché */
+  long int misses;      /* Consultas de direcciones ausentes o expiradas */
+  long int resolutions; /* Resoluciones ARP completadas */
+  long int evictions;   /* Entradas sustituidas por caché llena */
+  long int queued;      /* Datagramas encolados en espera de resolución */
+  long int queue_drops; /* Datagramas encolados descartados, incluidos los
+                           que fallan al enviarse tras la resolución */
+  long int refreshes;   /* Peticiones unicast a entradas a punto de expirar */
+  long int refreshed;   /* Entradas confirmadas de nuevo por esas peticiones */
+  long int expired;     /* Consultas de entradas ya expiradas, que pagan una
+                           resolución completa */
+  long int failures;    /* Resoluciones sin respuesta (entradas negativas) */
+  long int unreachable; /* Envíos rechazados por entrada negativa */
+  long int read_retries; /* Lecturas sin cerrojo repetidas por coincidir con
+                            una escritura */
+  int entries;          /* Entradas en uso */
+} arp_cache_stats_t;
+
+
+/* arp_cache_t * arp_cache_create
+ * ( int size, long int reachable_time, long int stale_time );
+ *
+ * DESCRIPCIÓN:
+ *   Esta función crea una caché de vecinos vacía.
+ *
+ *   La memoria de la caché debe ser liberada con 'arp_cache_free()'.
+ *
+ * PARÁMETROS:
+ *             'size': Número máximo de entradas.
+ *   'reachable_time': Milisegundos que una entrada confirmada permanece en
+ *                     el estado 'ARP_STATE_REACHABLE'.
+ *       'stale_time': Milisegundos que permanece después en el estado
+ *                     'ARP_STATE_STALE' antes de expirar.
+ *
+ * VALOR DEVUELTO:
+ *   La caché creada.
+ *
+ * ERRORES:
+ *   La función devuelve 'NULL' si los parámetros no son válidos o se ha
+ *   producido algún error.
+ */
+arp_cache_t * arp_cache_create
+( int size, long int reachable_time, long int stale_time );
+
+
+/* int arp_cache_set_ttl
+ * ( arp_cache_t * cache, long int reachable_time, long int stale_time );
+ *
+ * DESCRIPCIÓN:
+ *   Esta función cambia los tiempos de vida de las entradas de la caché.
+ *   Los nuevos tiempos se aplican también a las entradas existentes.
+ *
+ * VALOR DEVUELTO:
+ *   Devuelve '0' si se han cambiado los tiempos.
+ *
+ * ERRORES:
+ *   La función devuelve '-1' si algún tiempo es negativo.
+ */
+int arp_cache_set_ttl
+( arp_cache_t * cache, long int reachable_time, long int stale_time );
+
+
+/* int arp_cache_set_probes
+ * ( arp_cache_t * cache, int max_probes, long int retrans_time );
+ *
+ * DESCRIPCIÓN:
+ *   Esta función cambia cuántas peticiones ARP se envían a un vecino sin
+ *   resolver y cada cuánto tiempo, es decir, cuánto se tarda en darlo por
+ *   inalcanzable: 'max_probes' * 'retrans_time' ms. Por defecto son
+ *   'ARP_MAX_PROBES' peticiones cada 'ARP_RETRANS_TIME' ms.
+ *
+ * PARÁMETROS:
+ *          'cache': Caché de vecinos.
+ *     'max_probes': Número de peticiones sin respuesta tras el que la
+ *                   resolución falla.
+ *   'retrans_time': Milisegundos de espera de cada petición.
+ *
+ * VALOR DEVUELTO:
+ *   Devuelve '0' si se han cambiado los valores.
+ *
+ * ERRORES:
+ *   La función devuelve '-1' si algún valor no es positivo.
+ */
+int arp_cache_set_probes
+( arp_cache_t * cache, int max_probes, long int retrans_time );
+
+
+/* int arp_cache_attach
+ * ( arp_cache_t * cache, eth_iface_t * iface, ipv4_addr_t addr );
+ *
+ * DESCRIPCIÓN:
+ *   Esta función asocia la caché a la interfaz 'iface', con dirección IPv4
+ *   'addr', y registra el manejador de las tramas ARP de la interfaz
+ *   ('arp_listen()'), que anota las respuestas en la caché.
+ *
+ *   A partir de entonces las respuestas ARP de la interfaz las consume el
+ *   manejador: no deben esperarse con 'arp_resolve()' (sí con
+ *   'arp_resolve_start()').
+ *
+ *   El hilo que llama a esta función es el hilo de la interfaz: el único
+ *   desde el que la caché procesa las tramas recibidas.
+ *
+ * VALOR DEVUELTO:
+ *   Devuelve '0' si la caché se ha asociado a la interfaz.
+ *
+ * ERRORES:
+ *   La función devuelve '-1' si se ha producido algún error.
+ */
+int arp_cache_attach
+( arp_cache_t * cache, eth_iface_t * iface, ipv4_addr_t addr );
+
+
+/* int arp_cache_is_local ( arp_cache_t * cache, ipv4_addr_t addr );
+ *
+ * DESCRIPCIÓN:
+ *   Esta función indica si 'addr' es la dirección IPv4 de la interfaz
+ *   asociada a la caché, es decir, si hay que responder a las peticiones
+ *   ARP de esa dirección.
+ *
+ * VALOR DEVUELTO:
+ *   Devuelve '1' si es la dirección de la interfaz, o '0' en otro caso (o
+ *   si la caché no está asociada a ninguna interfaz).
+ */
+int arp_cache_is_local ( arp_cache_t * cache, ipv4_addr_t addr );
+
+
+/* int arp_cache_add_static
+ * ( arp_cache_t * cache, ipv4_addr_t addr, mac_addr_t mac );
+ *
+ * DESCRIPCIÓN:
+ *   Esta función añade a la caché una entrada estática (permanente) de
+ *   'addr' con la dirección MAC 'mac', o convierte en estática la entrada
+ *   que ya hubiera. Si su resolución estaba en curso, se envían los
+ *   datagramas encolados.
+ *
+ * VALOR DEVUELTO:
+ *   Devuelve '0' si se ha añadido la entrada.
+ *
+ * ERRORES:
+ *   La función devuelve '-1' si todas las entradas de la caché son
+ *   estáticas o se ha producido algún otro error.
+ */
+int arp_cache_add_static
+( arp_cache_t * cache, ipv4_addr_t addr, mac_addr_t mac );
+
+
+/* int arp_cache_read ( arp_cache_t * cache, char * filename );
+ *
+ * DESCRIPCIÓN:
+ *   Esta función lee el fichero de vecinos especificado y añade a la caché
+ *   como entradas estáticas los vecinos leídos. Cada línea del fichero
+ *   tiene el formato "<IPv4Address> <MACAddress>"; las líneas vacías y las
+ *   que empiezan por '#' se ignoran.
+ *
+ * PARÁMETROS:
+ *      'cache': Caché de vecinos donde añadir las entradas.
+ *   'filename': Nombre del fichero de vecinos.
+ *
+ * VALOR DEVUELTO:
+ *   El número de vecinos leídos y añadidos a la caché, o '0' si no se ha
+ *   leído ninguno.
+ *
+ * ERRORES:
+ *   La función devuelve '-1' si se ha producido algún error al leer el
+ *   fichero de vecinos.
+ */
+int arp_cache_read ( arp_cache_t * cache, char * filename );
+
+
+/* int arp_cache_save ( arp_cache_t * cache, char * filename );
+ *
+ * DESCRIPCIÓN:
+ *   Esta función guarda en el fichero especificado una instantánea de las
+ *   entradas dinámicas de la caché en los estados 'ARP_STATE_REACHABLE' y
+ *   'ARP_STATE_STALE', con el instante (del reloj de tiempo real) en que se
+ *   confirmó cada una. El fichero se escribe con otro nombre y se renombra
+ *   al terminar, de modo que nunca queda a medio escribir.
+ *
+ * PARÁMETROS:
+ *      'cache': Caché de vecinos.
+ *   'filename': Nombre del fichero de la instantánea.
+ *
+ * VALOR DEVUELTO:
+ *   El número de entradas guardadas.
+ *
+ * ERRORES:
+ *   La función devuelve '-1' si se ha producido algún error al escribir el
+ *   fichero.
+ */
+int arp_cache_save ( arp_cache_t * cache, char * filename );
+
+
+/* int arp_cache_load ( arp_cache_t * cache, char * filename );
+ *
+ * DESCRIPCIÓN:
+ *   Esta función proyecta en memoria ('mmap()') la instantánea guardada con
+ *   'arp_cache_save()' y añade a la caché sus entradas que todavía no han
+ *   expirado, con el tiempo que llevan confirmadas. Las direcciones que ya
+ *   están en la caché (por ejemplo, las estáticas) no se cambian.
+ *
+ * PARÁMETROS:
+ *      'cache': Caché de vecinos.
+ *   'filename': Nombre del fichero de la instantánea.
+ *
+ * VALOR DEVUELTO:
+ *   El número de entradas añadidas, o '0' si el fichero no existe (por
+ *   ejemplo, en el primer arranque).
+ *
+ * ERRORES:
+ *   La función devuelve '-1' si no se ha podido leer el fichero o no es
+ *   una instantánea válida.
+ */
+int arp_cache_load ( arp_cache_t * cache, char * filename );
+
+
+/* int arp_cache_lookup
+ * ( arp_cache_t * cache, ipv4_addr_t addr, mac_addr_t mac );
+ *
+ * DESCRIPCIÓN:
+ *   Esta función busca la dirección IPv4 indicada en la caché y, si está,
+ *   copia en 'mac' su dirección MAC.
+ *
+ *   Si la caché está asociada a una interfaz y a la entrada dinámica le
+ *   quedan menos de 'ARP_REFRESH_TIME' ms, envía la petición ARP unicast
+ *   que la comprueba.
+ *
+ * VALOR DEVUELTO:
+ *   El estado de la dirección en la caché. Sólo las direcciones en los
+ *   estados 'ARP_STATE_REACHABLE' y 'ARP_STATE_STALE' deben usarse para
+ *   enviar; a las del estado 'ARP_STATE_FAILED' no debe enviarse.
+ */
+int arp_cache_lookup ( arp_cache_t * cache, ipv4_addr_t addr, mac_addr_t mac );
+
+
+/* int arp_cache_update
+ * ( arp_cache_t * cache, ipv4_addr_t addr, mac_addr_t mac );
+ *
+ * DESCRIPCIÓN:
+ *   Esta función anota en la caché que la dirección IPv4 'addr' tiene la
+ *   dirección MAC 'mac', confirmada en este instante. La entrada pasa al
+ *   estado 'ARP_STATE_REACHABLE' (también si era una entrada negativa) y, si
+ *   su resolución estaba en curso, se envían los datagramas encolados. Si la
+ *   caché está llena se sustituye la entrada dinámica confirmada hace más
+ *   tiempo. Las entradas estáticas no se cambian.
+ *
+ * VALOR DEVUELTO:
+ *   Devuelve '0' si se ha actualizado la caché.
+ *
+ * ERRORES:
+ *   La función devuelve '-1' si se ha producido algún error.
+ */
+int arp_cache_update ( arp_cache_t * cache, ipv4_addr_t addr, mac_addr_t mac );
+
+
+/* int arp_cache_confirm
+ * ( arp_cache_t * cache, ipv4_addr_t addr, mac_addr_t mac );
+ *
+ * DESCRIPCIÓN:
+ *   Esta función anota una respuesta ARP de 'addr'. Si la dirección está en
+ *   la caché, se actualiza como con 'arp_cache_update()' y, si su resolución
+ *   estaba en curso, se envían los datagramas encolados. Las respuestas de
+ *   direcciones que no están en la caché se ignoran.
+ *
+ * VALOR DEVUELTO:
+ *   Devuelve '1' si la dirección estaba en la caché, o '0' en otro caso.
+ */
+int arp_cache_confirm ( arp_cache_t * cache, ipv4_addr_t addr, mac_addr_t mac );
+
+
+/* int arp_cache_send
+ * ( arp_cache_t * cache, ipv4_addr_t addr, uint16_t type, pkt_buf_t * pkt );
+ *
+ * DESCRIPCIÓN:
+ *   Esta función envía el paquete 'pkt' por la interfaz de la caché al
+ *   vecino 'addr', sin bloquearse.
+ *
+ *   Si la dirección MAC del vecino está en la caché (estados
+ *   'ARP_STATE_REACHABLE' o 'ARP_STATE_STALE'), el paquete se envía con
+ *   'eth_send_pkt()'. Si no, se copia en la cola del vecino (hasta
+ *   'ARP_CACHE_QUEUE_LEN' paquetes) y, si no había ya una petición ARP en
+ *   curso, se envía una. Los paquetes encolados se envían al llegar la
+ *   respuesta.
+ *
+ *   La petición se repite cada 'retrans_time' ms mientras se sigan
+ *   enviando paquetes al vecino; tras 'max_probes' peticiones sin
+ *   respuesta se descartan los paquetes encolados y la entrada pasa a ser
+ *   negativa. Los paquetes a un vecino con entrada negativa no se encolan:
+ *   la función retorna en el acto con 'ARP_UNREACHABLE'. Antes de encolar,
+ *   en el hilo de la interfaz se procesan sin esperar las tramas ya
+ *   recibidas, para que también un programa que sólo envía complete sus
+ *   resoluciones.
+ *
+ *   Puede llamarse desde varios hilos a la vez. Los demás hilos no procesan
+ *   las tramas recibidas: sus paquetes encolados se envían cuando el hilo
+ *   de la interfaz recibe la respuesta.
+ *
+ * PARÁMETROS:
+ *   'cache': Caché asociada a una interfaz con 'arp_cache_attach()'.
+ *    'addr': Dirección IPv4 del vecino (el siguiente salto).
+ *    'type': Valor del campo 'Tipo' de la trama.
+ *     'pkt': Buffer con el payload de la trama.
+ *
+ * VALOR DEVUELTO:
+ *   El número de bytes de datos enviados o encolados.
+ *
+ * ERRORES:
+ *   La función devuelve 'ARP_UNREACHABLE' si el vecino tiene una entrada
+ *   negativa, o '-1' si la cola del vecino está llena o se ha producido
+ *   algún otro error.
+ */
+int arp_cache_send
+( arp_cache_t * cache, ipv4_addr_t addr, uint16_t type, pkt_buf_t * pkt );
+
+
+/* int arp_cache_remove ( arp_cache_t * cache, ipv4_addr_t addr );
+ *
+ * DESCRIPCIÓN:
+ *   Esta función elimina de la caché la dirección IPv4 indicada.
+ *
+ * VALOR DEVUELTO:
+ *   Devuelve '0' si la dirección se ha eliminado, o '-1' si no estaba en la
+ *   caché.
+ */
+int arp_cache_remove ( arp_cache_t * cache, ipv4_addr_t addr );
+
+
+/* int arp_cache_resolve
+ * ( arp_cache_t * cache, eth_iface_t * iface, ipv4_addr_t addr,
+ *   mac_addr_t mac, ipv4_addr_t src_addr );
+ *
+ * DESCRIPCIÓN:
+ *   Esta función obtiene la dirección MAC de 'addr': de la caché si está en
+ *   los estados 'ARP_STATE_REACHABLE' o 'ARP_STATE_STALE' o, si no,
+ *   enviando peticiones ARP y esperando la respuesta, que se anota en la
+ *   caché. Si no llega, la entrada pasa a ser negativa.
+ *
+ *   Si la caché está asociada a 'iface', mientras espera procesa las tramas
+ *   recibidas con 'eth_dispatch()', y la espera dura como mucho
+ *   'max_probes' * 'retrans_time' ms. Si no, usa 'arp_resolve()'.
+ *
+ *   Con una entrada negativa la función retorna sin enviar ni esperar.
+ *
+ * PARÁMETROS:
+ *      'cache': Caché de vecinos de la interfaz.
+ *      'iface': Interfaz por la que se envía la petición ARP.
+ *       'addr': Dirección IPv4 que se quiere resolver.
+ *        'mac': Parámetro de salida con la dirección MAC.
+ *   'src_addr': Dirección IPv4 de la interfaz, origen de la petición.
+ *
+ * VALOR DEVUELTO:
+ *   Devuelve '1' si se ha obtenido la dirección MAC, o '0' si no ha llegado
+ *   la respuesta ARP.
+ *
+ * ERRORES:
+ *   La función devuelve 'ARP_UNREACHABLE' si 'addr' ya tenía una entrada
+ *   negativa, o '-1' si se ha producido algún error.
+ */
+int arp_cache_resolve
+( arp_cache_t * cache, eth_iface_t * iface, ipv4_addr_t addr,
+  mac_addr_t mac, ipv4_addr_t src_addr );
+
+
+/* int arp_cache_resolve_batch
+ * ( arp_cache_t * cache, ipv4_addr_t addrs[], mac_addr_t macs[],
+ *   int results[], int num, long int timeout );
+ *
+ * DESCRIPCIÓN:
+ *   Esta función resuelve a la vez las 'num' direcciones IPv4 de 'addrs':
+ *   envía seguidas las peticiones ARP de todas las que no están en la caché
+ *   y espera las respuestas, que llegan en cualquier orden, con un único
+ *   plazo para todas. Mientras espera procesa las tramas recibidas con
+ *   'eth_dispatch()' y repite cada 'retrans_time' ms (hasta 'max_probes'
+ *   veces) las peticiones sin respuesta, como 'arp_cache_send()'.
+ *
+ *   Así el tiempo de resolver muchos vecinos es el de la resolución más
+ *   lenta, no la suma de todas.
+ *
+ * PARÁMETROS:
+ *     'cache': Caché asociada a una interfaz con 'arp_cache_attach()'.
+ *     'addrs': Direcciones IPv4 que se quieren resolver.
+ *      'macs': Parámetro de salida con la dirección MAC de cada dirección
+ *              resuelta.
+ *   'results': Parámetro de salida con el resultado de cada dirección: '1'
+ *              si se ha obtenido su dirección MAC, '0' si no ha llegado la
+ *              respuesta ARP antes del plazo, o 'ARP_UNREACHABLE' si ya
+ *              tenía una entrada negativa (y no se ha enviado la petición).
+ *       'num': Número de direcciones.
+ *   'timeout': Plazo en milisegundos para todas las direcciones. Si no es
+ *              positivo, se espera a que cada resolución termine o falle
+ *              (unos 'max_probes' * 'retrans_time' ms).
+ *
+ * VALOR DEVUELTO:
+ *   El número de direcciones resueltas.
+ *
+ * ERRORES:
+ *   La función devuelve '-1' si se ha producido algún error.
+ */
+int arp_cache_resolve_batch
+( arp_cache_t * cache, ipv4_addr_t addrs[], mac_addr_t macs[],
+  int results[], int num, long int timeout );
+
+
+/* void arp_cache_get_stats ( arp_cache_t * cache, arp_cache_stats_t * stats );
+ *
+ * DESCRIPCIÓN:
+ *   Esta función copia en 'stats' las estadísticas de la caché.
+ */
+void arp_cache_get_stats ( arp_cache_t * cache, arp_cache_stats_t * stats );
+
+
+/* void arp_cache_free ( arp_cache_t * cache );
+ *
+ * DESCRIPCIÓN:
+ *   Esta función libera la caché y todas sus entradas, descartando los
+ *   datagramas encolados, y elimina el manejador ARP de su interfaz. Debe
+ *   llamarse antes de cerrar la interfaz.
+ */
+void arp_cache_free ( arp_cache_t * cache );
+
+#endif /* _ARP_CACHE_H */
@@ -0,0 +1,222 @@
+#include "arp_cache.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <libgen.h>
+
+#define MAX_READERS 64
+
+/* Datos compartidos por los hilos de la prueba */
+struct bench {
+  arp_cache_t * cache;
+  int entries;
+  volatile int stop;
+};
+
+/* Datos de cada hilo lector */
+struct reader {
+  struct bench * bench;
+  pthread_t thread;
+  int index;
+  long int lookups;
+  long int found;
+};
+
+
+/* Direccion IPv4 de la entrada 'i' de la prueba (10.x.y.z) */
+void bench_addr(int i, ipv4_addr_t addr){
+  addr[0] = 10;
+  addr[1] = (i >> 16) & 0xFF;
+  addr[2] = (i >> 8) & 0xFF;
+  addr[3] = i & 0xFF;
+}
+
+
+/* Hilo lector: consulta direcciones de la cache sin parar, como lo haria
+   un hilo que envia datagramas */
+void * reader_thread(void * arg){
+  struct reader * r = arg;
+  struct bench * b = r->bench;
+  unsigned int seed = 12345 + r->index;
+  mac_addr_t mac;
+  ipv4_addr_t addr;
+
+  while (!b->stop) {
+    int k;
+    for (k=0; k<1000; k++) {
+      bench_addr(rand_r(&seed) % b->entries, addr);
+      int state = arp_cache_lookup(b->cache, addr, mac);
+      if ((state == ARP_STATE_REACHABLE) || (state == ARP_STATE_STALE)) {
+        r->found++;
+      }
+    }
+    r->lookups += 1000;
+  }
+
+  return NULL;
+}
+
+
+/* Hilo emisor: envia datagramas de 64 bytes a direcciones de la cache con
+   arp_cache_send(), todos por la misma interfaz. Los vecinos que el
+   escritor acaba de eliminar se encolan hasta llenar su cola */
+void * sender_thread(void * arg){
+  struct reader * r = arg;
+  struct bench * b = r->bench;
+  unsigned int seed = 12345 + r->index;
+  ipv4_addr_t addr;
+  pkt_buf_t pkt;
+
+  while (!b->stop) {
+    int k;
+    for (k=0; k<1000; k++) {
+      bench_addr(rand_r(&seed) % b->entries, addr);
+      pkt_buf_init(&pkt);
+      memset(pkt_buf_put(&pkt, 64), 0, 64);
+      if (arp_cache_send(b->cache, addr, 0x0800, &pkt) > 0) {
+        r->found++;
+      }
+    }
+    r->lookups += 1000;
+  }
+
+  return NULL;
+}
+
+
+/* Hilo escritor: simula respuestas ARP (actualiza entradas), anotaciones de
+   emisores y expiraciones (elimina entradas y las vuelve a anotar) */
+void * writer_thread(void * arg){
+  struct bench * b = arg;
+  unsigned int seed = 54321;
+  mac_addr_t mac = {0x02, 0x00, 0x00, 0x00, 0x00, 0x00};
+  ipv4_addr_t addr;
+  long int writes = 0;
+
+  while (!b->stop) {
+    int i = rand_r(&seed) % b->entries;
+    bench_addr(i, addr);
+    mac[5] = writes & 0xFF;
+    if ((writes % 8) == 0) {
+      arp_cache_remove(b->cache, addr);
+    }
+    arp_cache_update(b->cache, addr, mac);
+    writes++;
+  }
+
+  printf("Escrituras: %ld\n", writes);
+
+  return NULL;
+}
+
+
+int main ( int argc, char * argv[] )
+{
+  /* Mostrar mensaje de ayuda si el número de argumentos es incorrecto */
+  char * myself = basename(argv[0]);
+  if ((argc != 4) && (argc != 5)) {
+    printf("\nUso: %s <lectores> <segundos> <entradas> [envio]\n", myself);
+    printf("\n     <lectores>: Numero de hilos que consultan la cache\n");
+    printf("\n     <segundos>: Duracion de la prueba\n");
+    printf("\n     <entradas>: Numero de vecinos en la cache\n");
+    printf("\n        [envio]: Los lectores envian con arp_cache_send() por"
+           " una interfaz\n                  vwire en lugar de consultar\n");
+    exit(-1);
+  }
+
+  /* Procesar los argumentos de la línea de comandos */
+  int num_readers = atoi(argv[1]);
+  int seconds = atoi(argv[2]);
+  int entries = atoi(argv[3]);
+  int send = (argc == 5);
+  if ((num_readers < 1) || (num_readers > MAX_READERS) ||
+      (seconds < 1) || (entries < 1) ||
+      (send && (strcmp(argv[4], "envio") != 0))) {
+    fprintf(stderr, "\n%s: Argumentos incorrectos\n", myself);
+    exit(-1);
+  }
+
+  /* Crear la cache y anotar todos los vecinos */
+  struct bench b;
+  b.cache = arp_cache_create(entries, ARP_REACHABLE_TIME, ARP_STALE_TIME);
+  if (b.cache == NULL) {
+    exit(-1);
+  }
+  b.entries = entries;
+  b.stop = 0;
+
+  /* En la prueba de envio la cache se asocia a una interfaz vwire, que este
+     hilo no usa: las tramas salen por el cable sin que nadie las reciba */
+  eth_iface_t * iface = NULL;
+  if (send) {
+    ipv4_addr_t local = {10, 255, 255, 254};
+    iface = eth_open("vwire:arp_cache_bench");
+    if ((iface == NULL) || (arp_cache_attach(b.cache, iface, local) == -1)) {
+      exit(-1);
+    }
+  }
+
+  mac_addr_t mac = {0x02, 0x00, 0x00, 0x00, 0x00, 0x01};
+  ipv4_addr_t addr;
+  int i;
+  for (i=0; i<entries; i++) {
+    bench_addr(i, addr);
+    arp_cache_update(b.cache, addr, mac);
+  }
+
+  /* Lanzar los lectores y el escritor */
+  struct reader readers[MAX_READERS];
+  memset(readers, 0, sizeof(readers));
+  for (i=0; i<num_readers; i++) {
+    readers[i].bench = &b;
+    readers[i].index = i;
+    pthread_create(&readers[i].thread, NULL,
+                   send ? sender_thread : reader_thread, &readers[i]);
+  }
+  pthread_t writer;
+  pthread_create(&writer, NULL, writer_thread, &b);
+
+  struct timespec start, end;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  struct timespec duration = {seconds, 0};
+  nanosleep(&duration, NULL);
+  b.stop = 1;
+
+  for (i=0; i<num_readers; i++) {
+    pthread_join(readers[i].thread, NULL);
+  }
+  pthread_join(writer, NULL);
+  clock_gettime(CLOCK_MONOTONIC, &end);
+
+  /* Imprimir los resultados */
+  double elapsed = (end.tv_sec - start.tv_sec) +
+                   (end.tv_nsec - start.tv_nsec) / 1e9;
+  long int total = 0;
+  char * ops = send ? "envios" : "consultas";
+  for (i=0; i<num_readers; i++) {
+    printf("Lector %d: %.0f %s/s (%ld %s)\n", i,
+           readers[i].lookups / elapsed, ops, readers[i].found,
+           send ? "enviados o encolados" : "resueltas");
+    total += readers[i].lookups;
+  }
+  printf("Total: %.0f %s/s\n", total / elapsed, ops);
+
+  arp_cache_stats_t stats;
+  arp_cache_get_stats(b.cache, &stats);
+  printf("Aciertos: %ld, fallos: %ld, lecturas repetidas: %ld\n",
+         stats.hits, stats.misses, stats.read_retries);
+  if (send) {
+    printf("Encolados: %ld, descartados: %ld\n",
+           stats.queued, stats.queue_drops);
+  }
+
+  arp_cache_free(b.cache);
+  if (iface != NULL) {
+    eth_close(iface);
+  }
+
+  return 0;
+}
@@ -56,7 +56,16 @@ int main ( int argc, char * argv[] )
   eth_iface_t* eth_iface = eth_open(iface_name);
 
   /* Enviar la peticion ARP */
-  arp_resolve(eth_iface, server_ip, server_mac, client_ip);
+  int r = arp_resolve(eth_iface, server_ip, server_mac, client_ip);
+
+  /* Imprimir la direccion MAC del servidor */
+  if (r == 0) {
+    printf("\nNo ha habido respuesta en dos segundos\n");
+  } else if (r > 0) {
+    char str[MAC_STR_LENGTH];
+    mac_addr_str(server_mac, str);
+    printf("\nDirección MAC servidor: %s\n", str);
+  }
 
 
 
@@ -1,28 +1,121 @@
 #include "eth.h"
+#include "eth_backend.h"
+#include "eth_capture.h"
+#include "trace.h"
 #include <rawnet.h>
 #include <timerms.h>
 
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <errno.h>
+#include <poll.h>
+#include <time.h>
+#include <pthread.h>
 #include <netinet/in.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/ioctl.h>
+#include <net/if.h>
 
 /* Dirección MAC de difusión: FF:FF:FF:FF:FF:FF */
 mac_addr_t MAC_BCAST_ADDR = { 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF };
 
+/* Longitud máxima del nombre de una interfaz Ethernet */
+#define ETH_IFNAME_MAX_LENGTH 256
+
+/* Número máximo de tramas de un lote de 'eth_send_batch()' */
+#define ETH_BATCH_MAX 64
+
+/* Backends disponibles, seleccionados en 'eth_open()' con el prefijo
+   "<backend>:" del nombre de la interfaz */
+static eth_backend_t * eth_backends[] = {
+  &ETH_BACKEND_PACKET,
+  &ETH_BACKEND_RING,
+  &ETH_BACKEND_VWIRE,
+  &ETH_BACKEND_PCAP,
+  NULL
+};
+
+/* Cola de recepción de un tipo de trama registrado en el distribuidor */
+struct eth_type_queue {
+  int registered;          /* La posición está en uso */
+  uint16_t type;           /* Valor del campo 'Tipo' de las tramas */
+  eth_handler_t handler;   /* Función manejadora, o NULL */
+  void * handler_arg;      /* Argumento de la función manejadora */
+  eth_rx_frame_t * frames[ETH_DISPATCH_QUEUE_LEN]; /* Tramas encoladas */
+  int head;                /* Posición de la trama más antigua */
+  int count;               /* Número de tramas encoladas */
+};
+
+/* Número máximo de instrucciones del programa BPF del filtro de recepción:
+   8 para la dirección MAC, hasta 4 + 2 * ETH_FILTER_MAX_CONDS por regla y
+   1 para descartar la trama */
+#define ETH_FILTER_MAX_INSNS \
+  (9 + ETH_FILTER_MAX_RULES * (4 + 2 * ETH_FILTER_MAX_CONDS))
+
+/* Regla del filtro de recepción */
+struct eth_filter_rule {
+  int used;       /* La posición está en uso */
+  uint16_t type;  /* Valor del campo 'Tipo' de las tramas aceptadas */
+  int num_conds;  /* Número de condiciones */
+  eth_filter_cond_t conds[ETH_FILTER_MAX_CONDS]; /* Condiciones */
+};
+
 /* Estructura del manejador del interfaz ethernet */
 struct eth_iface {
-  rawiface_t * raw_iface; /* Manejador del interfaz "crudo" */
+  eth_backend_t * backend; /* Backend que envía y recibe las tramas */
+  void * backend_data;     /* Estado privado del backend */
+  char name[ETH_IFNAME_MAX_LENGTH]; /* Nombre de la interfaz */
   mac_addr_t mac_address; /* Dirección MAC del interfaz. Se almacena aquí en
                              lugar de consultar al interfaz "en crudo" para
                              evitar una llamada al sistema adcional cada vez
                              que se quiera enviar una trama. */
+  int mtu;                 /* MTU de la interfaz ('eth_setmtu()') */
+
+  /* Anillo de recepción: tramas reservadas al abrir la interfaz que se
+     prestan a las capas superiores con 'eth_recv_frame()' */
+  unsigned char * rx_buffers;  /* ETH_RX_RING_SIZE tramas consecutivas */
+  int rx_frame_size;           /* Tamaño de cada trama: cabecera + MTU */
+  eth_rx_frame_t rx_ring[ETH_RX_RING_SIZE]; /* Descriptores de las tramas */
+  int rx_free[ETH_RX_RING_SIZE]; /* Pila de posiciones libres del anillo */
+  int rx_free_count;             /* Número de posiciones libres */
+
+  /* Distribuidor de recepción: colas de los tipos de trama registrados */
+  struct eth_type_queue type_queues[ETH_DISPATCH_TYPES];
+  eth_stats_t stats; /* Estadísticas de recepción */
+
+  /* Sondeo activo ('eth_set_busy_poll()'): presupuestos en microsegundos */
+  long int busy_poll_max;    /* Presupuesto máximo, o 0 si no se sondea */
+  long int busy_poll_budget; /* Presupuesto actual, adaptado al tráfico */
+
+  /* Filtro de recepción. También se instala en el núcleo si el backend lo
+     permite */
+  struct eth_filter_rule filter_rules[ETH_FILTER_MAX_RULES];
+  int filter_num_rules; /* Número de reglas en uso */
+
+  eth_capture_t * capture; /* Captura pcapng en curso, o NULL */
+
+  /* Serializa los envíos de varios hilos (el backend, las marcas de
+     transmisión) y las escrituras en la captura, que también hace la
+     recepción */
+  pthread_mutex_t tx_lock;
+
+  /* Marcas de tiempo de transmisión ('eth_get_tx_tstamp()') */
+  int tx_tstamps;        /* Marcas del núcleo activadas */
+  uint32_t tx_count;     /* Tramas enviadas desde que se activaron */
+  uint64_t tx_tstamp;    /* Marca de la pila del último envío, o 0 */
+  uint64_t tx_kernel;    /* Última marca del núcleo leída */
+  uint32_t tx_kernel_id; /* Número de orden de su trama */
 };
 
-/* Tamaño de la cabecera Ethernet (sin incluir el campo FCS) */
-#define ETH_HEADER_SIZE 14
-/* Tamaño máximo de una trama Ethernet (sin incluir el campo FCS) */
-#define ETH_FRAME_MAX_LENGTH (ETH_HEADER_SIZE + ETH_MTU)
+/* Cabecera Ethernet, tal y como se antepone en un 'pkt_buf_t' */
+struct eth_header {
+  mac_addr_t dest_addr; /* Dirección MAC destino*/
+  mac_addr_t src_addr;  /* Dirección MAC origen */
+  uint16_t type;        /* Campo 'Tipo'.
+                           Identificador de la capa de red superior */
+};
 
 /* Cabecera de una trama Ethernet */
 struct eth_frame {
@@ -30,13 +123,127 @@ struct eth_frame {
   mac_addr_t src_addr;  /* Dirección MAC origen */
   uint16_t type;        /* Campo 'Tipo'.
                            Identificador de la capa de red superior */
-  unsigned char payload[ETH_MTU]; /* Campo 'payload'.
+  unsigned char payload[ETH_MAX_MTU]; /* Campo 'payload'.
                                           Datos de la capa superior */
 
   /* NOTA: El campo "Frame Checksum" (FCS) no está incluido en la estructura
      porque lo añade automáticamente la tarjeta de red. */
 };
 
+static int eth_pkt_prepare
+( eth_iface_t * iface, mac_addr_t dst, uint16_t type, pkt_buf_t * pkt );
+static int eth_rx_ring_alloc ( eth_iface_t * iface, int mtu );
+static eth_rx_frame_t * eth_frame_alloc ( eth_iface_t * iface );
+static int eth_frame_accept ( eth_iface_t * iface, eth_rx_frame_t * rx_frame );
+static int eth_frame_deliver
+( eth_iface_t * iface, eth_rx_frame_t * rx_frame, int wanted_type );
+static int eth_read_batch
+( eth_iface_t * iface, eth_rx_frame_t * rx_frames[], int max_frames,
+  long int timeout );
+static int eth_backend_read
+( eth_iface_t * iface, unsigned char * buffers[], int frame_lens[],
+  uint64_t tstamps[], int num, long int timeout );
+static int eth_busy_poll
+( eth_iface_t * iface, unsigned char * buffers[], int frame_lens[],
+  uint64_t tstamps[], int num, long int * timeout );
+static void eth_tx_done
+( eth_iface_t * iface, unsigned char * frames[], int frame_lens[], int num );
+static int eth_dispatch_frames
+( eth_iface_t * iface, int max_frames, long int timeout );
+static int eth_poll_wait
+( eth_poll_entry_t entries[], int num, long int timeout );
+static struct eth_type_queue * eth_type_queue_get
+( eth_iface_t * iface, uint16_t type, int create );
+static int eth_type_queue_pop
+( eth_iface_t * iface, uint16_t type,
+  eth_rx_frame_t * frames[], int max_frames );
+static int eth_filter_match ( eth_iface_t * iface, eth_rx_frame_t * rx_frame );
+static int eth_filter_update ( eth_iface_t * iface );
+
+
+/* Backend por defecto, basado en la librería 'rawnet'. Su estado privado es
+   el propio manejador del interfaz "crudo". */
+
+static void * eth_rawnet_open ( char * ifname, mac_addr_t addr )
+{
+  rawiface_t * raw_iface = rawiface_open(ifname);
+  if (raw_iface == NULL) {
+    fprintf(stderr, "eth_open(): ERROR en rawiface_open(): %s\n",
+            rawnet_strerror());
+    return NULL;
+  }
+  rawiface_getaddr(raw_iface, addr);
+
+  return raw_iface;
+}
+
+static int eth_rawnet_send ( void * priv, unsigned char * frame, int frame_len )
+{
+  int bytes_sent = rawnet_send((rawiface_t *) priv, frame, frame_len);
+  if (bytes_sent == -1) {
+    fprintf(stderr, "eth_send(): ERROR en rawnet_send(): %s\n",
+            rawnet_strerror());
+  }
+
+  return bytes_sent;
+}
+
+static int eth_rawnet_recv
+( void * priv, unsigned char buffer[], int buf_len, long int timeout )
+{
+  int frame_len = rawnet_recv((rawiface_t *) priv, buffer, buf_len, timeout);
+  if (frame_len < 0) {
+    fprintf(stderr, "eth_recv(): ERROR en rawnet_recv(): %s\n",
+            rawnet_strerror());
+  }
+
+  return frame_len;
+}
+
+static int eth_rawnet_getfd ( void * priv )
+{
+  /* 'rawnet' no expone el descriptor de su socket */
+  (void) priv;
+  return -1;
+}
+
+static int eth_rawnet_getmtu ( void * priv )
+{
+  /* 'rawnet' tampoco expone la MTU: se consulta al núcleo por el nombre de
+     la interfaz */
+  int fd = socket(AF_INET, SOCK_DGRAM, 0);
+  if (fd == -1) {
+    return -1;
+  }
+  struct ifreq ifr;
+  memset(&ifr, 0, sizeof(struct ifreq));
+  strncpy(ifr.ifr_name, rawiface_getname((rawiface_t *) priv), IFNAMSIZ - 1);
+  int err = ioctl(fd, SIOCGIFMTU, &ifr);
+  close(fd);
+
+  return (err == -1) ? -1 : ifr.ifr_mtu;
+}
+
+static int eth_rawnet_close ( void * priv )
+{
+  return rawiface_close((rawiface_t *) priv);
+}
+
+eth_backend_t ETH_BACKEND_RAWNET = {
+  .name = "rawnet",
+  .open = eth_rawnet_open,
+  .send = eth_rawnet_send,
+  .send_batch = NULL,
+  .recv = eth_rawnet_recv,
+  .recv_batch = NULL,
+  .getfd = eth_rawnet_getfd,
+  .getmtu = eth_rawnet_getmtu,
+  .set_filter = NULL,
+  .set_tx_tstamps = NULL,
+  .tx_tstamp = NULL,
+  .close = eth_rawnet_close
+};
+
 
 /* eth_iface_t * eth_open ( char* ifname );
  *
@@ -47,9 +254,35 @@ struct eth_frame {
  *   La memoria del manejador de interfaz devuelto debe ser liberada con la
  *   función 'eth_close()'.
  *
+ *   Por defecto las tramas se envían y reciben con la librería 'rawnet'. El
+ *   nombre de la interfaz puede llevar un prefijo "<backend>:" para
+ *   seleccionar otra implementación, sin que cambie el resto de funciones:
+ *     "packet:<ifname>": Socket AF_PACKET propio, que permite enviar y
+ *                        recibir lotes de tramas con una única llamada al
+ *                        sistema.
+ *       "ring:<ifname>": Socket AF_PACKET con anillos TPACKET_V3 de
+ *                        recepción y envío compartidos con el núcleo, sin
+ *                        llamadas al sistema por trama.
+ *                        Ambos admiten la opción ",fanout=<grupo>[:<modo>]"
+ *                        para unirse a un grupo PACKET_FANOUT, en el que
+ *                        el núcleo reparte las tramas recibidas entre
+ *                        varios sockets de la misma interfaz por flujo
+ *                        ("hash", por defecto), por CPU ("cpu"), por
+ *                        turno ("rr") o por cola de la tarjeta ("qm")
+ *                        (ver eth_fanout.h).
+ *   "vwire:<cable>[,<MAC>]": Cable virtual dentro del proceso que conecta
+ *                        todas las interfaces abiertas con el mismo
+ *                        nombre de cable, sin necesidad de tarjeta de red
+ *                        ni de privilegios.
+ *   "pcap:<fichero>[,<opciones>]": Reproduce las tramas de un fichero
+ *                        pcap a su ritmo original, a un número fijo de
+ *                        tramas por segundo o lo más rápido posible, y
+ *                        guarda las tramas enviadas en otro fichero pcap
+ *                        (ver eth_pcap.c).
+ *
  * PARÁMETROS:
  *   'ifname': Cadena de texto con el nombre de la interfaz Ethernet que se
- *             desea inicializar.
+ *             desea inicializar, opcionalmente precedido de "<backend>:".
  *
  * VALOR DEVUELTO:
  *   Manejador de la interfaz Ethernet inicializada.
@@ -71,17 +304,73 @@ eth_iface_t * eth_open ( char* ifname )
     return NULL;
   }
 
-  /* Abrir el interfaz "en crudo" subyacente */
-  rawiface_t * raw_iface = rawiface_open(ifname);
-  if (raw_iface == NULL) {
-    fprintf(stderr, "eth_open(): ERROR en rawiface_open(): %s\n",
-            rawnet_strerror());
+  eth_iface->rx_buffers = NULL;
+
+  /* Distribuidor de recepción sin tipos registrados */
+  memset(eth_iface->type_queues, 0, sizeof(eth_iface->type_queues));
+  memset(&eth_iface->stats, 0, sizeof(eth_stats_t));
+
+  /* Filtro de recepción vacío: se aceptan todas las tramas */
+  memset(eth_iface->filter_rules, 0, sizeof(eth_iface->filter_rules));
+  eth_iface->filter_num_rules = 0;
+
+  eth_iface->capture = NULL;
+  eth_iface->busy_poll_max = 0;
+  eth_iface->busy_poll_budget = 0;
+  eth_iface->tx_tstamps = 0;
+  eth_iface->tx_count = 0;
+  eth_iface->tx_tstamp = 0;
+  pthread_mutex_init(&eth_iface->tx_lock, NULL);
+
+  /* Seleccionar el backend según el prefijo del nombre de la interfaz */
+  eth_iface->backend = &ETH_BACKEND_RAWNET;
+  char * sep = strchr(ifname, ':');
+  if (sep != NULL) {
+    size_t prefix_len = sep - ifname;
+    eth_iface->backend = NULL;
+    int i;
+    for (i=0; eth_backends[i] != NULL; i++) {
+      if ((strlen(eth_backends[i]->name) == prefix_len) &&
+          (strncmp(eth_backends[i]->name, ifname, prefix_len) == 0)) {
+        eth_iface->backend = eth_backends[i];
+      }
+    }
+    if (eth_iface->backend == NULL) {
+      fprintf(stderr, "eth_open(): ERROR: backend desconocido: '%.*s'\n",
+              (int) prefix_len, ifname);
+      free(eth_iface);
+      return NULL;
+    }
+    ifname = sep + 1;
+  }
+  strncpy(eth_iface->name, ifname, ETH_IFNAME_MAX_LENGTH - 1);
+  eth_iface->name[ETH_IFNAME_MAX_LENGTH - 1] = '\0';
+
+  /* Abrir la interfaz con el backend y copiar la dirección MAC en el
+     manejador */
+  eth_iface->backend_data =
+    eth_iface->backend->open(eth_iface->name, eth_iface->mac_address);
+  if (eth_iface->backend_data == NULL) {
+    free(eth_iface);
     return NULL;
   }
-  eth_iface->raw_iface = raw_iface;
 
-  /* Copiar la dirección MAC en el manejador */
-  rawiface_getaddr(raw_iface, eth_iface->mac_address);
+  /* Reservar las tramas del anillo de recepción con el tamaño que permite
+     la MTU de la interfaz */
+  int mtu = -1;
+  if (eth_iface->backend->getmtu != NULL) {
+    mtu = eth_iface->backend->getmtu(eth_iface->backend_data);
+  }
+  if (mtu < ETH_MIN_MTU) {
+    mtu = ETH_MTU;
+  } else if (mtu > ETH_MAX_MTU) {
+    mtu = ETH_MAX_MTU;
+  }
+  if (eth_rx_ring_alloc(eth_iface, mtu) == -1) {
+    eth_iface->backend->close(eth_iface->backend_data);
+    free(eth_iface);
+    return NULL;
+  }
 
   return eth_iface;
 }
@@ -110,7 +399,7 @@ char * eth_getname ( eth_iface_t * iface )
   char* iface_name = NULL;
 
   if (iface != NULL) {
-    iface_name = rawiface_getname(iface->raw_iface);
+    iface_name = iface->name;
   }
 
   return iface_name;
@@ -137,6 +426,98 @@ void eth_getaddr ( eth_iface_t * iface, mac_addr_t addr )
   }
 }
 
+
+/* int eth_getmtu ( eth_iface_t * iface );
+ *
+ * DESCRIPCIÓN:
+ *   Esta función devuelve la MTU de la interfaz Ethernet especificada, es
+ *   decir, el tamaño máximo del payload de las tramas que pueden enviarse y
+ *   recibirse por ella.
+ *
+ *   Al abrir la interfaz, la MTU es la configurada en el sistema operativo
+ *   (backends "packet", "ring" y 'rawnet') o 'ETH_MTU' si el backend no
+ *   permite consultarla, limitada siempre a 'ETH_MAX_MTU'.
+ *
+ * PARÁMETROS:
+ *   'iface': Manejador de la interfaz Ethernet.
+ *
+ * VALOR DEVUELTO:
+ *   La MTU de la interfaz en bytes.
+ *
+ * ERRORES:
+ *   La función devuelve '-1' si la interfaz no ha sido inicializada
+ *   correctamente.
+ */
+int eth_getmtu ( eth_iface_t * iface )
+{
+  if (iface == NULL) {
+    fprintf(stderr, "eth_getmtu(): ERROR: iface == NULL\n");
+    return -1;
+  }
+
+  return iface->mtu;
+}
+
+
+/* int eth_setmtu ( eth_iface_t * iface, int mtu );
+ *
+ * DESCRIPCIÓN:
+ *   Esta función modifica la MTU con la que la librería usa la interfaz
+ *   Ethernet especificada (por ejemplo, para usar tramas "jumbo"). No
+ *   modifica la MTU configurada en el sistema operativo, que no puede
+ *   superarse si el backend permite consultarla.
+ *
+ *   Las tramas del anillo de recepción se reservan de nuevo con el tamaño
+ *   de la nueva MTU, por lo que no puede haber tramas recibidas prestadas
+ *   con 'eth_recv_frame()' o encoladas en el distribuidor.
+ *
+ * PARÁMETROS:
+ *   'iface': Manejador de la interfaz Ethernet.
+ *     'mtu': Nueva MTU en bytes, entre 'ETH_MIN_MTU' y 'ETH_MAX_MTU'.
+ *
+ * VALOR DEVUELTO:
+ *   Devuelve '0' si se ha modificado la MTU.
+ *
+ * ERRORES:
+ *   La función devuelve '-1' si la MTU no es válida, supera la MTU del
+ *   sistema operativo, hay tramas prestadas o se ha producido algún otro
+ *   error.
+ */
+int eth_setmtu ( eth_iface_t * iface, int mtu )
+{
+  if (iface == NULL) {
+    fprintf(stderr, "eth_setmtu(): ERROR: iface == NULL\n");
+    return -1;
+  }
+  if ((mtu < ETH_MIN_MTU) || (mtu > ETH_MAX_MTU)) {
+    fprintf(stderr, "eth_setmtu(): ERROR: MTU inválida: %d (entre %d y %d)\n",
+            mtu, ETH_MIN_MTU, ETH_MAX_MTU);
+    return -1;
+  }
+  if (iface->backend->getmtu != NULL) {
+    int link_mtu = iface->backend->getmtu(iface->backend_data);
+    if ((link_mtu > 0) && (mtu > link_mtu)) {
+      fprintf(stderr, "eth_setmtu(): ERROR: la MTU de %s es %d bytes\n",
+              iface->name, link_mtu);
+      return -1;
+    }
+  }
+  if (iface->rx_free_count != ETH_RX_RING_SIZE) {
+    fprintf(stderr, "eth_setmtu(): ERROR: hay tramas recibidas prestadas\n");
+    return -1;
+  }
+
+  /* Reservar el nuevo anillo antes de liberar el anterior, que se conserva
+     si hay algún error */
+  unsigned char * old_buffers = iface->rx_buffers;
+  if (eth_rx_ring_alloc(iface, mtu) == -1) {
+    return -1;
+  }
+  free(old_buffers);
+
+  return 0;
+}
+
 /* int eth_send
  * ( eth_iface_t * iface,
  *   mac_addr_t dst, uint16_t type, unsigned char * data, int data_len );
@@ -145,6 +526,13 @@ void eth_getaddr ( eth_iface_t * iface, mac_addr_t addr )
  *   Esta función permite enviar una trama Ethernet a través de la interfaz
  *   indicada.
  *
+ *   Las funciones de envío ('eth_send()', 'eth_send_pkt()' y
+ *   'eth_send_batch()') pueden llamarse desde varios hilos a la vez sobre la
+ *   misma interfaz, mientras otro hilo recibe por ella: los envíos se
+ *   serializan con un cerrojo de la interfaz, que la recepción no toma
+ *   salvo para capturar las tramas. Las demás funciones de la interfaz
+ *   deben llamarse desde un único hilo.
+ *
  * PARÁMETROS:
  *    'iface': Manejador de la interfaz Ethernet por la que se quiere enviar
  *             el paquete.
@@ -165,6 +553,51 @@ void eth_getaddr ( eth_iface_t * iface, mac_addr_t addr )
 int eth_send
 ( eth_iface_t * iface,
   mac_addr_t dst, uint16_t type, unsigned char * payload, int payload_len )
+{
+  /* Copiar el payload una única vez en un buffer de paquete con espacio
+     para la cabecera Ethernet */
+  pkt_buf_t pkt;
+  pkt_buf_init(&pkt);
+  unsigned char * data = pkt_buf_put(&pkt, payload_len);
+  if (data == NULL) {
+    fprintf(stderr, "eth_send(): ERROR: payload demasiado grande: %d bytes\n",
+            payload_len);
+    return -1;
+  }
+  memcpy(data, payload, payload_len);
+
+  return eth_send_pkt(iface, dst, type, &pkt);
+}
+
+/* int eth_send_pkt
+ * ( eth_iface_t * iface, mac_addr_t dst, uint16_t type, pkt_buf_t * pkt );
+ *
+ * DESCRIPCIÓN:
+ *   Esta función permite enviar una trama Ethernet cuyo payload se encuentra
+ *   en el buffer de paquete indicado. La cabecera Ethernet se antepone en el
+ *   propio buffer, por lo que el payload no se copia.
+ *
+ *   Tras la llamada, el buffer contiene la trama Ethernet completa si se
+ *   ha enviado, o queda como estaba, sin la cabecera, si no.
+ *
+ * PARÁMETROS:
+ *   'iface': Manejador de la interfaz Ethernet por la que se quiere
+ *            enviar el paquete.
+ *            La interfaz debe haber sido inicializada con 'eth_open()'
+ *            previamente.
+ *     'dst': Dirección MAC del equipo destino.
+ *    'type': Valor del campo 'Tipo' de la trama Ethernet a enviar.
+ *     'pkt': Buffer de paquete que contiene el payload de la trama, con al
+ *            menos 'ETH_HEADER_SIZE' bytes libres delante de los datos.
+ *
+ * VALOR DEVUELTO:
+ *   El número de bytes de datos que han podido ser enviados.
+ *
+ * ERRORES:
+ *   La función devuelve '-1' si se ha producido algún error.
+ */
+int eth_send_pkt
+( eth_iface_t * iface, mac_addr_t dst, uint16_t type, pkt_buf_t * pkt )
 {
   int bytes_sent;
 
@@ -174,35 +607,170 @@ int eth_send
     return -1;
   }
 
-  /* Crear la Trama Ethernet y rellenar todos los campos */
-  struct eth_frame eth_frame;
-  memcpy(eth_frame.dest_addr, dst, MAC_ADDR_SIZE);
-  memcpy(eth_frame.src_addr, iface->mac_address, MAC_ADDR_SIZE);
-  eth_frame.type = htons(type);
-  memcpy(eth_frame.payload, payload, payload_len);
-  int eth_frame_len = ETH_HEADER_SIZE + payload_len;
-
-  /* Imprimir trama Ethernet */
-  char* iface_name = eth_getname(iface);
-  char mac_str[MAC_STR_LENGTH];
-  mac_addr_str(dst, mac_str);
-  printf("eth_send(type=0x%04x, payload[%d]) > %s/%s\n",
-         type, payload_len, iface_name, mac_str);
-  print_pkt((unsigned char *) &eth_frame, eth_frame_len, ETH_HEADER_SIZE);
+  /* Anteponer la cabecera Ethernet */
+  if (eth_pkt_prepare(iface, dst, type, pkt) == -1) {
+    return -1;
+  }
 
-  /* Enviar la trama Ethernet creada con rawnet_send() y comprobar errores */
-  bytes_sent = rawnet_send
-    (iface->raw_iface, (unsigned char *) &eth_frame, eth_frame_len);
+  /* Enviar la trama Ethernet con el backend de la interfaz */
+  pthread_mutex_lock(&iface->tx_lock);
+  bytes_sent = iface->backend->send(iface->backend_data, pkt->data, pkt->len);
+  if (bytes_sent != -1) {
+    eth_tx_done(iface, &pkt->data, &pkt->len, 1);
+  }
+  pthread_mutex_unlock(&iface->tx_lock);
   if (bytes_sent == -1) {
-    fprintf(stderr, "eth_send(): ERROR en rawnet_send(): %s\n",
-            rawnet_strerror());
+    /* Devolver el buffer como estaba, para que pueda volver a enviarse */
+    pkt_buf_pull(pkt, ETH_HEADER_SIZE);
     return -1;
   }
 
-  /* Devolver el número de bytes de datos recibidos */
+  /* Devolver el número de bytes de datos enviados */
   return (bytes_sent - ETH_HEADER_SIZE);
 }
 
+
+/* int eth_send_batch
+ * ( eth_iface_t * iface, mac_addr_t dst[], uint16_t type,
+ *   pkt_buf_t * pkts[], int num );
+ *
+ * DESCRIPCIÓN:
+ *   Esta función permite enviar un lote de tramas Ethernet a través de la
+ *   interfaz indicada. Si el backend de la interfaz lo permite, todo el lote
+ *   se entrega al núcleo con una única llamada al sistema.
+ *
+ *   Igual que en 'eth_send_pkt()', la cabecera Ethernet de cada trama se
+ *   antepone en su propio buffer de paquete. Los buffers de las tramas que
+ *   no se envían quedan como estaban, sin la cabecera, de modo que el resto
+ *   del lote puede volver a enviarse.
+ *
+ * PARÁMETROS:
+ *   'iface': Manejador de la interfaz Ethernet por la que se quieren enviar
+ *            las tramas.
+ *     'dst': Array con la dirección MAC destino de cada trama.
+ *    'type': Valor del campo 'Tipo' de todas las tramas del lote.
+ *    'pkts': Array con los buffers de paquete de cada trama.
+ *     'num': Número de tramas del lote.
+ *
+ * VALOR DEVUELTO:
+ *   El número de tramas que han podido ser enviadas, que son siempre las
+ *   primeras del lote ('0' si 'num' es '0').
+ *
+ * ERRORES:
+ *   La función devuelve '-1' si se ha producido algún error antes de enviar
+ *   ninguna trama.
+ */
+int eth_send_batch
+( eth_iface_t * iface, mac_addr_t dst[], uint16_t type,
+  pkt_buf_t * pkts[], int num )
+{
+  /* Comprobar parámetros */
+  if (iface == NULL) {
+    fprintf(stderr, "eth_send_batch(): ERROR: iface == NULL\n");
+    return -1;
+  }
+  if (num == 0) {
+    return 0;
+  }
+
+  int frames_sent = 0;
+  while (frames_sent < num) {
+    int batch_len = num - frames_sent;
+    if (batch_len > ETH_BATCH_MAX) {
+      batch_len = ETH_BATCH_MAX;
+    }
+
+    /* Anteponer las cabeceras Ethernet del lote. Si una trama no puede
+       prepararse, se envían las anteriores y el lote termina en ella */
+    unsigned char * frames[ETH_BATCH_MAX];
+    int frame_lens[ETH_BATCH_MAX];
+    int prepared;
+    for (prepared=0; prepared<batch_len; prepared++) {
+      int k = frames_sent + prepared;
+      if (eth_pkt_prepare(iface, dst[k], type, pkts[k]) == -1) {
+        break;
+      }
+      frames[prepared] = pkts[k]->data;
+      frame_lens[prepared] = pkts[k]->len;
+    }
+
+    /* Enviar el lote. Si el backend no envía por lotes, trama a trama */
+    int err;
+    pthread_mutex_lock(&iface->tx_lock);
+    if ((prepared > 0) && (iface->backend->send_batch != NULL)) {
+      err = iface->backend->send_batch
+        (iface->backend_data, frames, frame_lens, prepared);
+    } else {
+      for (err=0; err<prepared; err++) {
+        if (iface->backend->send(iface->backend_data,
+                                 frames[err], frame_lens[err]) == -1) {
+          break;
+        }
+      }
+    }
+    if (err < 0) {
+      err = 0;
+    }
+    if (err > 0) {
+      eth_tx_done(iface, frames, frame_lens, err);
+    }
+    pthread_mutex_unlock(&iface->tx_lock);
+
+    /* Quitar la cabecera de las tramas preparadas que no se han enviado,
+       para que el llamante pueda volver a enviarlas */
+    int i;
+    for (i=err; i<prepared; i++) {
+      pkt_buf_pull(pkts[frames_sent + i], ETH_HEADER_SIZE);
+    }
+    frames_sent += err;
+    if (err < batch_len) {
+      break;
+    }
+  }
+
+  return (frames_sent > 0) ? frames_sent : -1;
+}
+
+
+/* int eth_pkt_prepare
+ * ( eth_iface_t * iface, mac_addr_t dst, uint16_t type, pkt_buf_t * pkt );
+ *
+ * DESCRIPCIÓN:
+ *   Antepone la cabecera Ethernet al payload del buffer de paquete indicado,
+ *   dejando en él la trama lista para ser enviada.
+ *
+ * VALOR DEVUELTO:
+ *   '0' si la trama se ha preparado o '-1' si no había hueco para la
+ *   cabecera.
+ */
+static int eth_pkt_prepare
+( eth_iface_t * iface, mac_addr_t dst, uint16_t type, pkt_buf_t * pkt )
+{
+  int payload_len = pkt->len;
+  if (payload_len > iface->mtu) {
+    fprintf(stderr, "eth_send(): ERROR: payload mayor que la MTU de %s: "
+            "%d bytes (MTU %d)\n", iface->name, payload_len, iface->mtu);
+    return -1;
+  }
+
+  /* Anteponer la cabecera Ethernet al payload y rellenar todos los campos */
+  struct eth_header * eth_header =
+    (struct eth_header *) pkt_buf_push(pkt, ETH_HEADER_SIZE);
+  if (eth_header == NULL) {
+    fprintf(stderr, "eth_send(): ERROR: no hay espacio para la cabecera\n");
+    return -1;
+  }
+  memcpy(eth_header->dest_addr, dst, MAC_ADDR_SIZE);
+  memcpy(eth_header->src_addr, iface->mac_address, MAC_ADDR_SIZE);
+  eth_header->type = htons(type);
+
+  /* Trazar trama Ethernet ('trace_decode' muestra el volcado) */
+  TRACE(TRACE_DEBUG, TRACE_ETH_SEND, type, payload_len, 0, 0,
+        pkt->data, pkt->len);
+
+  return 0;
+}
+
 /* int eth_recv
  * ( eth_iface_t * iface,
  *   mac_addr_t src, uint16_t type, unsigned char buffer[], long int timeout );
@@ -226,7 +794,11 @@ int eth_send
  *             memoria indicada, que debe estar reservada previamente.
  *     'type': Valor del campo 'Tipo' de la trama Ethernet que se desea
  *             recibir.
- *             Las tramas con un valor 'type' diferente serán descartadas.
+ *             Las tramas de otro tipo registrado (ver 'eth_register_type()')
+ *             se pasan a su manejador o se encolan en su cola del
+ *             distribuidor; sólo se descartan las de tipos no registrados
+ *             y las que no caben en una cola llena, y ambas se cuentan en
+ *             las estadísticas de la interfaz.
  *   'buffer': Array donde se almacenarán los datos de la trama recibida.
  *  'buf_len': Longitud del 'buffer' dónde se almacenarán los datos de la trama
  *             recibida. Si se reciben más datos de los que caben el en 'buffer'
@@ -246,121 +818,1699 @@ int eth_send
  *   La función devuelve '-1' si se ha producido algún error.
  */
 int eth_recv( eth_iface_t * iface, mac_addr_t src, uint16_t type, unsigned char buffer[],int buf_len, long int timeout ){
-  int payload_len;
+  eth_rx_frame_t * frame;
 
-  /* Comprobar parámetros */
-  if (iface == NULL) {
-    fprintf(stderr, "eth_recv(): ERROR: iface == NULL\n");
-    return -1;
+  /* Recibir la trama en el anillo de recepción */
+  int payload_len = eth_recv_frame(iface, src, type, &frame, timeout);
+  if (payload_len <= 0) {
+    return payload_len;
   }
 
-  /* Inicializar temporizador para mantener timeout si se reciben tramas con
-     tipo incorrecto. */
-  timerms_t timer;
-  timerms_reset(&timer, timeout);
-
-  int frame_len;
-  int eth_buf_len = ETH_HEADER_SIZE + buf_len;
-  unsigned char eth_buffer[eth_buf_len];
-  struct eth_frame * eth_frame_ptr = NULL;
-  int is_target_type;
-  int is_my_mac;
-
-  do {
-    long int time_left = timerms_left(&timer);
-
-    /* Recibir trama del interfaz Ethernet y procesar errores */
-    frame_len = rawnet_recv (iface->raw_iface, eth_buffer, eth_buf_len,
-                             time_left);
-    if (frame_len < 0) {
-      fprintf(stderr, "eth_recv(): ERROR en rawnet_recv(): %s\n",
-              rawnet_strerror());
-      return -1;
-    } else if (frame_len == 0) {
-      /* Timeout! */
-      return 0;
-    } else if (frame_len < ETH_HEADER_SIZE) {
-      fprintf(stderr, "eth_recv(): Trama de tamaño invalido: %d bytes\n",
-              frame_len);
-      continue;
-    }
-
-    /* Comprobar si es la trama que estamos buscando */
-    eth_frame_ptr = (struct eth_frame *) eth_buffer;
-    is_my_mac = (memcmp(eth_frame_ptr->dest_addr,
-                        iface->mac_address, MAC_ADDR_SIZE) == 0);
-    is_target_type = (ntohs(eth_frame_ptr->type) == type);
-
-  } while ( ! (is_my_mac && is_target_type) );
-
-  /* Trama recibida con 'tipo' indicado. Copiar datos y dirección MAC origen */
-  memcpy(src, eth_frame_ptr->src_addr, MAC_ADDR_SIZE);
-  payload_len = frame_len - ETH_HEADER_SIZE;
+  /* Copiar los datos al buffer del llamante y devolver la trama al anillo */
   if (buf_len > payload_len) {
     buf_len = payload_len;
   }
-  memcpy(buffer, eth_frame_ptr->payload, buf_len);
+  memcpy(buffer, frame->frame + frame->payload_offset, buf_len);
+  eth_frame_release(iface, frame);
 
   return payload_len;
 }
 
 
-/* int eth_poll
- * ( eth_iface_t * ifaces[], int ifnum, long int timeout );
+/* int eth_recv_frame
+ * ( eth_iface_t * iface, mac_addr_t src, uint16_t type,
+ *   eth_rx_frame_t ** frame, long int timeout );
  *
  * DESCRIPCIÓN:
- *   Esta función permite esperar paquetes en múltiples interfaces Ethernet
- *   simultaneamente. Cuando alguna de las interfaces indicadas reciba una
- *   trama, la función devolverá la primera interfaz que tiene una trama
- *   listo para ser recibida mediante la funcion 'eth_recv()'.
+ *   Esta función permite obtener el siguiente paquete recibido por la
+ *   interfaz Ethernet indicada sin copiar sus datos. La trama se recibe
+ *   directamente en una posición libre del anillo de recepción de la
+ *   interfaz y se devuelve un descriptor que la referencia.
  *
- *   Esta operación puede escuchar de los interfaces Ethernet indefinidamente
- *   o un tiempo limitado dependiento del parámetro 'timeout'.
+ *   La trama prestada debe devolverse con 'eth_frame_release()'.
  *
  * PARÁMETROS:
- *  'ifaces': Array con los manejadores de interfaces Ethernet por los que se
- *            quiere recibir.
- *            Todos los interfaces deben haber sido inicializados con
- *            'eth_open()' previamente.
- *   'ifnum': Número de interfaces que aparecen en el array 'ifaces'.
- * 'timeout': Tiempo en milisegundos que debe esperarse a recibir una trama
- *            antes de retornar. Un número negativo indicará que debe
- *            esperarse indefinidamente.
+ *    'iface': Manejador de la interfaz Ethernet por la que se desea recibir
+ *             un paquete.
+ *             La interfaz debe haber sido inicializada con 'eth_open()'
+ *             previamente.
+ *      'src': Dirección MAC del equipo que envió la trama Ethernet recibida.
+ *             Este es un parámetro de salida.
+ *     'type': Valor del campo 'Tipo' de la trama Ethernet que se desea
+ *             recibir.
+ *             Las tramas de otro tipo registrado (ver 'eth_register_type()')
+ *             se pasan a su manejador o se encolan en su cola del
+ *             distribuidor; sólo se descartan las de tipos no registrados
+ *             y las que no caben en una cola llena, y ambas se cuentan en
+ *             las estadísticas de la interfaz.
+ *    'frame': Parámetro de salida donde se devuelve el descriptor de la trama
+ *             recibida. Su 'payload_offset' y 'payload_len' indican el payload
+ *             de la trama Ethernet.
+ *  'timeout': Tiempo en milisegundos que debe esperarse a recibir una trama
+ *             antes de retornar, con la misma semántica que en 'eth_recv()'.
  *
  * VALOR DEVUELTO:
- *   El índice del primer interfaz [0, ifnum-1] que tiene una trama lista para
- *   ser recibida o '-2' si ha expirado el temporizador.
+ *   La longitud en bytes de los datos de la trama recibida, o '0' si no se
+ *   ha recibido ninguna trama porque ha expirado el temporizador.
  *
  * ERRORES:
- *   La función devuelve '-1' si se ha producido algún error.
+ *   La función devuelve '-1' si se ha producido algún error, incluyendo que
+ *   todas las tramas del anillo de recepción estén prestadas.
  */
-int eth_poll
-( eth_iface_t * ifaces[], int ifnum, long int timeout )
+int eth_recv_frame
+( eth_iface_t * iface, mac_addr_t src, uint16_t type,
+  eth_rx_frame_t ** frame, long int timeout )
 {
-  int iface_index;
-
-  /* Crear lista de interfaces hardware */
-  rawiface_t * raw_ifaces[ifnum];
-  int i;
+  /* Comprobar parámetros */
+  if ((iface == NULL) || (frame == NULL)) {
+    fprintf(stderr, "eth_recv(): ERROR: iface == NULL\n");
+    return -1;
+  }
+
+  /* Registrar el tipo para que las tramas que lleguen mientras se esperan
+     otros tipos se encolen en lugar de descartarse */
+  eth_type_queue_get(iface, type, 1);
+
+  /* Si ya se había leído alguna trama de este tipo, entregarla */
+  eth_rx_frame_t * rx_frame;
+  if (eth_type_queue_pop(iface, type, &rx_frame, 1) == 0) {
+
+    /* Inicializar temporizador para mantener timeout si se reciben tramas
+       con tipo incorrecto. */
+    timerms_t timer;
+    timerms_reset(&timer, timeout);
+
+    do {
+      /* Recibir trama del interfaz Ethernet en una posición libre del
+         anillo de recepción */
+      int frames_read = eth_read_batch(iface, &rx_frame, 1,
+                                       timerms_left(&timer));
+      if (frames_read <= 0) {
+        /* Error o timeout */
+        return frames_read;
+      }
+
+      /* Comprobar si es la trama que estamos buscando. Las tramas de otros
+         tipos registrados se reparten a su manejador o a su cola, y las
+         descartadas vuelven al anillo */
+    } while (( ! eth_frame_accept(iface, rx_frame) ) ||
+             ( ! eth_frame_deliver(iface, rx_frame, type) ));
+  }
+
+  /* Trama recibida con 'tipo' indicado. Copiar la dirección MAC origen */
+  struct eth_header * eth_header =
+    (struct eth_header *) (rx_frame->frame + rx_frame->l2_offset);
+  memcpy(src, eth_header->src_addr, MAC_ADDR_SIZE);
+  *frame = rx_frame;
+
+  return rx_frame->payload_len;
+}
+
+
+/* int eth_recv_batch
+ * ( eth_iface_t * iface, uint16_t type,
+ *   eth_rx_frame_t * frames[], int max_frames, long int timeout );
+ *
+ * DESCRIPCIÓN:
+ *   Esta función permite obtener de una vez todas las tramas pendientes de
+ *   la interfaz Ethernet indicada, hasta un máximo de 'max_frames'. Si el
+ *   backend de la interfaz lo permite, el lote se lee del núcleo con una
+ *   única llamada al sistema.
+ *
+ *   Igual que con 'eth_recv_frame()', las tramas se prestan del anillo de
+ *   recepción y deben liberarse una a una con 'eth_frame_release()'. La
+ *   dirección MAC origen de cada trama se encuentra en su cabecera
+ *   Ethernet, en 'frame + l2_offset + MAC_ADDR_SIZE'.
+ *
+ * PARÁMETROS:
+ *        'iface': Manejador de la interfaz Ethernet por la que se desea
+ *                 recibir.
+ *         'type': Valor del campo 'Tipo' de las tramas que se desean recibir.
+ *                 Las tramas de otros tipos se tratan como en 'eth_recv()'.
+ *       'frames': Array donde se devuelven los descriptores de las tramas
+ *                 recibidas.
+ *   'max_frames': Número máximo de tramas a recibir.
+ *      'timeout': Tiempo en milisegundos que debe esperarse a recibir la
+ *                 primera trama, con la misma semántica que en 'eth_recv()'.
+ *
+ * VALOR DEVUELTO:
+ *   El número de tramas recibidas, o '0' si ha expirado el temporizador.
+ *
+ * ERRORES:
+ *   La función devuelve '-1' si se ha producido algún error.
+ */
+int eth_recv_batch
+( eth_iface_t * iface, uint16_t type,
+  eth_rx_frame_t * frames[], int max_frames, long int timeout )
+{
+  /* Comprobar parámetros */
+  if ((iface == NULL) || (frames == NULL)) {
+    fprintf(stderr, "eth_recv_batch(): ERROR: iface == NULL\n");
+    return -1;
+  }
+
+  /* Registrar el tipo y entregar primero las tramas ya encoladas */
+  eth_type_queue_get(iface, type, 1);
+  int frames_recv = eth_type_queue_pop(iface, type, frames, max_frames);
+  if (frames_recv > 0) {
+    return frames_recv;
+  }
+
+  timerms_t timer;
+  timerms_reset(&timer, timeout);
+
+  eth_rx_frame_t * rx_frames[ETH_BATCH_MAX];
+  do {
+    int frames_read = eth_read_batch
+      (iface, rx_frames, max_frames, timerms_left(&timer));
+    if (frames_read <= 0) {
+      /* Error o timeout */
+      return frames_read;
+    }
+
+    /* Quedarse con las tramas buscadas y repartir las demás */
+    int i;
+    for (i=0; i<frames_read; i++) {
+      if ( ! eth_frame_accept(iface, rx_frames[i]) ) {
+        continue;
+      }
+      if (eth_frame_deliver(iface, rx_frames[i], type)) {
+        frames[frames_recv] = rx_frames[i];
+        frames_recv++;
+      }
+    }
+  } while (frames_recv == 0);
+
+  return frames_recv;
+}
+
+
+/* int eth_register_type
+ * ( eth_iface_t * iface, uint16_t type, eth_handler_t handler, void * arg );
+ *
+ * DESCRIPCIÓN:
+ *   Esta función registra un tipo de trama en el distribuidor de recepción
+ *   de la interfaz. Cada vez que cualquier función de recepción lea de la
+ *   interfaz una trama de un tipo registrado distinto del que está
+ *   esperando, la trama se encola (hasta 'ETH_DISPATCH_QUEUE_LEN' tramas)
+ *   en lugar de descartarse, y la siguiente llamada a 'eth_recv()' o
+ *   'eth_recv_frame()' con ese tipo la obtiene sin leer de la interfaz.
+ *
+ *   Si se indica una función manejadora, se invoca con cada trama de ese
+ *   tipo antes de encolarla o entregarla.
+ *
+ * PARÁMETROS:
+ *     'iface': Manejador de la interfaz Ethernet.
+ *      'type': Valor del campo 'Tipo' de las tramas que se desea registrar.
+ *   'handler': Función manejadora de las tramas de ese tipo, o 'NULL'.
+ *       'arg': Argumento que se pasará a la función manejadora.
+ *
+ * VALOR DEVUELTO:
+ *   Devuelve '0' si el tipo se ha registrado.
+ *
+ * ERRORES:
+ *   La función devuelve '-1' si ya hay 'ETH_DISPATCH_TYPES' tipos
+ *   registrados.
+ */
+int eth_register_type
+( eth_iface_t * iface, uint16_t type, eth_handler_t handler, void * arg )
+{
+  if (iface == NULL) {
+    return -1;
+  }
+
+  struct eth_type_queue * queue = eth_type_queue_get(iface, type, 1);
+  if (queue == NULL) {
+    fprintf(stderr, "eth_register_type(): ERROR: no caben más tipos\n");
+    return -1;
+  }
+  queue->handler = handler;
+  queue->handler_arg = arg;
+
+  return 0;
+}
+
+
+/* int eth_unregister_type ( eth_iface_t * iface, uint16_t type );
+ *
+ * DESCRIPCIÓN:
+ *   Esta función elimina un tipo de trama del distribuidor de recepción,
+ *   descartando las tramas que tuviera encoladas.
+ *
+ * PARÁMETROS:
+ *   'iface': Manejador de la interfaz Ethernet.
+ *    'type': Valor del campo 'Tipo' que se desea eliminar.
+ *
+ * VALOR DEVUELTO:
+ *   Devuelve '0' si el tipo se ha eliminado, o '-1' si no estaba registrado.
+ */
+int eth_unregister_type ( eth_iface_t * iface, uint16_t type )
+{
+  if (iface == NULL) {
+    return -1;
+  }
+
+  struct eth_type_queue * queue = eth_type_queue_get(iface, type, 0);
+  if (queue == NULL) {
+    return -1;
+  }
+
+  eth_rx_frame_t * rx_frame;
+  while (eth_type_queue_pop(iface, type, &rx_frame, 1) > 0) {
+    eth_frame_release(iface, rx_frame);
+  }
+  queue->registered = 0;
+  queue->handler = NULL;
+  queue->handler_arg = NULL;
+
+  return 0;
+}
+
+
+/* int eth_dispatch ( eth_iface_t * iface, long int timeout );
+ *
+ * DESCRIPCIÓN:
+ *   Esta función lee de la interfaz todas las tramas pendientes (esperando
+ *   como máximo 'timeout' milisegundos a la primera) y las reparte entre los
+ *   manejadores y colas de los tipos registrados, sin entregar ninguna al
+ *   llamante.
+ *
+ * PARÁMETROS:
+ *     'iface': Manejador de la interfaz Ethernet.
+ *   'timeout': Tiempo máximo de espera, con la misma semántica que en
+ *              'eth_recv()'.
+ *
+ * VALOR DEVUELTO:
+ *   El número de tramas leídas, o '0' si ha expirado el temporizador.
+ *
+ * ERRORES:
+ *   La función devuelve '-1' si se ha producido algún error.
+ */
+int eth_dispatch ( eth_iface_t * iface, long int timeout )
+{
+  if (iface == NULL) {
+    fprintf(stderr, "eth_dispatch(): ERROR: iface == NULL\n");
+    return -1;
+  }
+
+  return eth_dispatch_frames(iface, ETH_BATCH_MAX, timeout);
+}
+
+
+/* int eth_dispatch_frames
+ * ( eth_iface_t * iface, int max_frames, long int timeout );
+ *
+ * DESCRIPCIÓN:
+ *   Lee un lote de hasta 'max_frames' tramas de la interfaz (y como mucho
+ *   'ETH_BATCH_MAX') y las reparte entre los manejadores y colas de los
+ *   tipos registrados.
+ *
+ * VALOR DEVUELTO:
+ *   El número de tramas leídas, '0' si ha expirado el temporizador o '-1'
+ *   si se ha producido algún error.
+ */
+static int eth_dispatch_frames
+( eth_iface_t * iface, int max_frames, long int timeout )
+{
+  eth_rx_frame_t * rx_frames[ETH_BATCH_MAX];
+  int frames_read = eth_read_batch(iface, rx_frames, max_frames, timeout);
+
+  int i;
+  for (i=0; i<frames_read; i++) {
+    if (eth_frame_accept(iface, rx_frames[i])) {
+      eth_frame_deliver(iface, rx_frames[i], -1);
+    }
+  }
+
+  return frames_read;
+}
+
+
+/* void eth_get_stats ( eth_iface_t * iface, eth_stats_t * stats );
+ *
+ * DESCRIPCIÓN:
+ *   Esta función copia en 'stats' las estadísticas de recepción de la
+ *   interfaz indicada.
+ */
+void eth_get_stats ( eth_iface_t * iface, eth_stats_t * stats )
+{
+  if ((iface != NULL) && (stats != NULL)) {
+    memcpy(stats, &iface->stats, sizeof(eth_stats_t));
+    stats->busy_poll_budget = iface->busy_poll_budget;
+    if (iface->capture != NULL) {
+      eth_capture_stats(iface->capture,
+                        &stats->capture_frames, &stats->capture_dropped);
+    }
+  }
+}
+
+
+/* int eth_set_busy_poll ( eth_iface_t * iface, long int budget );
+ *
+ * DESCRIPCIÓN:
+ *   Esta función activa el modo de sondeo activo ("busy-poll") en la
+ *   recepción de la interfaz indicada. Antes de bloquearse esperando una
+ *   trama, las funciones de recepción leen de la interfaz sin esperar
+ *   repetidamente durante, como mucho, el presupuesto actual. Así se evita
+ *   la latencia de dormir y despertar al hilo cuando las tramas llegan
+ *   poco después de empezar a esperar, a cambio de ocupar la CPU.
+ *
+ *   El presupuesto se adapta al tráfico reciente: se duplica (hasta
+ *   'budget') cada vez que llega una trama durante el sondeo y se reduce a
+ *   la mitad (hasta 'ETH_BUSY_POLL_MIN', o 'budget' si es menor) cada vez
+ *   que se agota sin que llegue ninguna. Las lecturas, aciertos, esperas bloqueantes y el
+ *   presupuesto actual se consultan con 'eth_get_stats()'.
+ *
+ *   El tiempo de sondeo forma parte del 'timeout' de cada función de
+ *   recepción, cuya semántica no cambia. Con 'timeout' igual a '0' no se
+ *   sondea.
+ *
+ * PARÁMETROS:
+ *    'iface': Manejador de la interfaz Ethernet.
+ *   'budget': Presupuesto máximo del sondeo en microsegundos, o '0' para
+ *             desactivarlo (modo por defecto).
+ *
+ * VALOR DEVUELTO:
+ *   Devuelve '0' si se ha cambiado el modo de recepción.
+ *
+ * ERRORES:
+ *   La función devuelve '-1' si la interfaz no es válida o el presupuesto
+ *   es negativo.
+ */
+int eth_set_busy_poll ( eth_iface_t * iface, long int budget )
+{
+  if ((iface == NULL) || (budget < 0)) {
+    fprintf(stderr, "eth_set_busy_poll(): ERROR: parámetro inválido\n");
+    return -1;
+  }
+
+  /* Empezar con el presupuesto máximo: el primer sondeo que se agote lo
+     reducirá si no hay tráfico */
+  iface->busy_poll_max = budget;
+  iface->busy_poll_budget = budget;
+
+  return 0;
+}
+
+
+
+/* uint64_t eth_tstamp_now ( void );
+ *
+ * DESCRIPCIÓN:
+ *   Esta función devuelve el instante actual en el reloj de las marcas de
+ *   tiempo de las tramas ('eth_meta_t'), en nanosegundos.
+ */
+uint64_t eth_tstamp_now ( void )
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_REALTIME, &ts);
+
+  return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+
+/* int eth_set_tx_tstamps ( eth_iface_t * iface, int enable );
+ *
+ * DESCRIPCIÓN:
+ *   Esta función activa o desactiva las marcas de tiempo de transmisión del
+ *   núcleo en la interfaz indicada. Con ellas activadas, el núcleo anota el
+ *   instante en que cada trama enviada sale hacia la tarjeta y
+ *   'eth_get_tx_tstamp()' lo devuelve.
+ *
+ *   Las marcas se acumulan en el socket hasta que se consultan, por lo que
+ *   debe llamarse a 'eth_get_tx_tstamp()' tras cada envío mientras estén
+ *   activadas.
+ *
+ * PARÁMETROS:
+ *    'iface': Manejador de la interfaz Ethernet.
+ *   'enable': '1' para activar las marcas o '0' para desactivarlas.
+ *
+ * VALOR DEVUELTO:
+ *   Devuelve '0' si se ha cambiado la configuración.
+ *
+ * ERRORES:
+ *   La función devuelve '-1' si el backend de la interfaz no proporciona
+ *   marcas de tiempo de transmisión (sólo lo hace "packet") o se ha
+ *   producido algún error. Las marcas de la pila de 'eth_get_tx_tstamp()'
+ *   siguen disponibles.
+ */
+int eth_set_tx_tstamps ( eth_iface_t * iface, int enable )
+{
+  if (iface == NULL) {
+    fprintf(stderr, "eth_set_tx_tstamps(): ERROR: iface == NULL\n");
+    return -1;
+  }
+  if (iface->backend->set_tx_tstamps == NULL) {
+    fprintf(stderr, "eth_set_tx_tstamps(): ERROR: el backend \"%s\" no "
+            "proporciona marcas de transmisión\n", iface->backend->name);
+    return -1;
+  }
+
+  enable = (enable != 0);
+  pthread_mutex_lock(&iface->tx_lock);
+  int err = iface->backend->set_tx_tstamps(iface->backend_data, enable);
+  if (err != -1) {
+    /* El núcleo numera las tramas desde que se activan las marcas */
+    iface->tx_tstamps = enable;
+    iface->tx_count = 0;
+    iface->tx_kernel = 0;
+  }
+  pthread_mutex_unlock(&iface->tx_lock);
+
+  return (err == -1) ? -1 : 0;
+}
+
+
+/* int eth_get_tx_tstamp ( eth_iface_t * iface, uint64_t * tstamp );
+ *
+ * DESCRIPCIÓN:
+ *   Esta función devuelve en 'tstamp' el instante en que se completó el
+ *   envío de la última trama enviada por la interfaz: la marca del núcleo si
+ *   están activadas con 'eth_set_tx_tstamps()' y ya está disponible, o si
+ *   no la marca de la pila tomada cuando el backend terminó de enviarla.
+ *
+ * PARÁMETROS:
+ *    'iface': Manejador de la interfaz Ethernet.
+ *   'tstamp': Parámetro de salida con la marca de tiempo, en el mismo reloj
+ *             que 'eth_tstamp_now()'.
+ *
+ * VALOR DEVUELTO:
+ *   El origen de la marca ('ETH_TSTAMP_KERNEL' o 'ETH_TSTAMP_STACK'), o
+ *   'ETH_TSTAMP_NONE' si todavía no se ha enviado ninguna trama.
+ *
+ * ERRORES:
+ *   La función devuelve '-1' si se ha producido algún error.
+ */
+int eth_get_tx_tstamp ( eth_iface_t * iface, uint64_t * tstamp )
+
+{
+  if ((iface == NULL) || (tstamp == NULL)) {
+    fprintf(stderr, "eth_get_tx_tstamp(): ERROR: parámetro NULL\n");
+    return -1;
+  }
+
+  pthread_mutex_lock(&iface->tx_lock);
+  int source = ETH_TSTAMP_NONE;
+  if (iface->tx_tstamp != 0) {
+    source = ETH_TSTAMP_STACK;
+    *tstamp = iface->tx_tstamp;
+  }
+
+  /* Leer las marcas del núcleo pendientes. Sólo se usa la más reciente si
+     corresponde a la última trama enviada */
+  if ((source != ETH_TSTAMP_NONE) && iface->tx_tstamps) {
+    uint64_t kernel;
+    uint32_t id;
+    int err = iface->backend->tx_tstamp(iface->backend_data, &kernel, &id);
+    if (err == -1) {
+      source = -1;
+    } else if (err == 1) {
+      iface->tx_kernel = kernel;
+      iface->tx_kernel_id = id;
+    }
+    if ((source != -1) && (iface->tx_kernel != 0) && (iface->tx_count > 0) &&
+        (iface->tx_kernel_id == iface->tx_count - 1)) {
+      *tstamp = iface->tx_kernel;
+      source = ETH_TSTAMP_KERNEL;
+    }
+  }
+  pthread_mutex_unlock(&iface->tx_lock);
+
+  return source;
+}
+
+
+/* int eth_capture_start
+ * ( eth_iface_t * iface, char * filename, int snaplen, long int rotate_size );
+ *
+ * DESCRIPCIÓN:
+ *   Esta función inicia la captura en formato pcapng de todas las tramas
+ *   enviadas y recibidas por la interfaz, con marcas de tiempo en
+ *   nanosegundos.
+ *
+ *   Las tramas se copian a un anillo en memoria que un hilo aparte vuelca al
+ *   fichero, por lo que la captura nunca bloquea el envío ni la recepción:
+ *   si el hilo no da abasto las tramas se descartan y se contabilizan en el
+ *   campo 'capture_dropped' de 'eth_get_stats()'.
+ *
+ * PARÁMETROS:
+ *         'iface': Manejador de la interfaz Ethernet.
+ *      'filename': Nombre del fichero pcapng.
+ *       'snaplen': Número máximo de bytes que se guardan de cada trama, o
+ *                  '0' para guardarlas completas.
+ *   'rotate_size': Tamaño en bytes a partir del cual se continúa en el
+ *                  fichero "<filename>.1", "<filename>.2", etc., o '0' para
+ *                  no rotar.
+ *
+ * VALOR DEVUELTO:
+ *   Devuelve '0' si la captura se ha iniciado.
+ *
+ * ERRORES:
+ *   La función devuelve '-1' si ya había una captura en curso o si no ha
+ *   podido abrirse el fichero.
+ */
+int eth_capture_start
+( eth_iface_t * iface, char * filename, int snaplen, long int rotate_size )
+{
+  if ((iface == NULL) || (filename == NULL)) {
+    fprintf(stderr, "eth_capture_start(): ERROR: iface == NULL\n");
+    return -1;
+  }
+  if (iface->capture != NULL) {
+    fprintf(stderr, "eth_capture_start(): ERROR: ya hay una captura\n");
+    return -1;
+  }
+
+  eth_capture_t * capture = eth_capture_open(filename, snaplen, rotate_size);
+  if (capture == NULL) {
+    return -1;
+  }
+  pthread_mutex_lock(&iface->tx_lock);
+  iface->capture = capture;
+  pthread_mutex_unlock(&iface->tx_lock);
+
+  return 0;
+}
+
+
+/* int eth_capture_stop ( eth_iface_t * iface );
+ *
+ * DESCRIPCIÓN:
+ *   Esta función termina la captura de la interfaz, esperando a que se
+ *   escriban en el fichero todas las tramas capturadas. 'eth_close()' la
+ *   invoca automáticamente.
+ *
+ * PARÁMETROS:
+ *   'iface': Manejador de la interfaz Ethernet.
+ *
+ * VALOR DEVUELTO:
+ *   Devuelve '0' si la captura ha terminado correctamente.
+ *
+ * ERRORES:
+ *   La función devuelve '-1' si no había captura en curso o si se ha
+ *   producido algún error al escribir el fichero.
+ */
+int eth_capture_stop ( eth_iface_t * iface )
+{
+  if ((iface == NULL) || (iface->capture == NULL)) {
+    fprintf(stderr, "eth_capture_stop(): ERROR: no hay captura\n");
+    return -1;
+  }
+
+  /* Retirar la captura antes de cerrarla, para que ningún envío la use */
+  pthread_mutex_lock(&iface->tx_lock);
+  eth_capture_t * capture = iface->capture;
+  iface->capture = NULL;
+  pthread_mutex_unlock(&iface->tx_lock);
+
+  /* Conservar los contadores de la captura en las estadísticas */
+  eth_capture_stats(capture,
+                    &iface->stats.capture_frames,
+                    &iface->stats.capture_dropped);
+
+  int err = eth_capture_close(capture);
+
+  return err;
+}
+
+
+/* int eth_filter_add
+ * ( eth_iface_t * iface, uint16_t type,
+ *   eth_filter_cond_t conds[], int num_conds );
+ *
+ * DESCRIPCIÓN:
+ *   Esta función añade una regla al filtro de recepción de la interfaz. La
+ *   regla acepta las tramas del tipo indicado que cumplan todas las
+ *   condiciones de 'conds'.
+ *
+ *   Mientras la interfaz tenga alguna regla, sólo se reciben las tramas
+ *   dirigidas a su dirección MAC (o a la de difusión) que cumplan alguna de
+ *   ellas. Si el backend lo permite, el filtro se compila a un programa BPF
+ *   que se instala en el socket, de modo que el resto de tramas se
+ *   descartan en el núcleo sin llegar a copiarse. El programa se regenera
+ *   cada vez que se añade o elimina una regla. Sin reglas se reciben todas
+ *   las tramas.
+ *
+ * PARÁMETROS:
+ *       'iface': Manejador de la interfaz Ethernet.
+ *        'type': Valor del campo 'Tipo' de las tramas aceptadas.
+ *       'conds': Condiciones adicionales que deben cumplir las tramas.
+ *   'num_conds': Número de condiciones (como máximo
+ *                'ETH_FILTER_MAX_CONDS').
+ *
+ * VALOR DEVUELTO:
+ *   El identificador de la regla, necesario para eliminarla con
+ *   'eth_filter_remove()'.
+ *
+ * ERRORES:
+ *   La función devuelve '-1' si la regla no es válida o si ya hay
+ *   'ETH_FILTER_MAX_RULES' reglas.
+ */
+int eth_filter_add
+( eth_iface_t * iface, uint16_t type,
+  eth_filter_cond_t conds[], int num_conds )
+{
+  if (iface == NULL) {
+    fprintf(stderr, "eth_filter_add(): ERROR: iface == NULL\n");
+    return -1;
+  }
+  if ((num_conds < 0) || (num_conds > ETH_FILTER_MAX_CONDS)) {
+    fprintf(stderr, "eth_filter_add(): ERROR: demasiadas condiciones\n");
+    return -1;
+  }
+
+  int i;
+  for (i=0; i<num_conds; i++) {
+    int size = conds[i].size;
+    if (((size != 1) && (size != 2) && (size != 4)) ||
+        (conds[i].offset < 0) ||
+        ((conds[i].base != ETH_FILTER_L3) && (conds[i].base != ETH_FILTER_L4))) {
+      fprintf(stderr, "eth_filter_add(): ERROR: condición inválida\n");
+      return -1;
+    }
+  }
+
+  /* Buscar una posición libre para la regla */
+  int rule_id;
+  for (rule_id=0; rule_id<ETH_FILTER_MAX_RULES; rule_id++) {
+    if ( ! iface->filter_rules[rule_id].used ) {
+      break;
+    }
+  }
+  if (rule_id == ETH_FILTER_MAX_RULES) {
+    fprintf(stderr, "eth_filter_add(): ERROR: no caben más reglas\n");
+    return -1;
+  }
+
+  struct eth_filter_rule * rule = &iface->filter_rules[rule_id];
+  rule->used = 1;
+  rule->type = type;
+  rule->num_conds = num_conds;
+  if (num_conds > 0) {
+    memcpy(rule->conds, conds, num_conds * sizeof(eth_filter_cond_t));
+  }
+  iface->filter_num_rules++;
+
+  eth_filter_update(iface);
+
+  return rule_id;
+}
+
+
+/* int eth_filter_remove ( eth_iface_t * iface, int rule_id );
+ *
+ * DESCRIPCIÓN:
+ *   Esta función elimina una regla del filtro de recepción de la interfaz y
+ *   actualiza el programa BPF instalado en el socket.
+ *
+ * PARÁMETROS:
+ *     'iface': Manejador de la interfaz Ethernet.
+ *   'rule_id': Identificador devuelto por 'eth_filter_add()'.
+ *
+ * VALOR DEVUELTO:
+ *   Devuelve '0' si la regla se ha eliminado.
+ *
+ * ERRORES:
+ *   La función devuelve '-1' si la regla no existe.
+ */
+int eth_filter_remove ( eth_iface_t * iface, int rule_id )
+{
+  if ((iface == NULL) || (rule_id < 0) || (rule_id >= ETH_FILTER_MAX_RULES) ||
+      ( ! iface->filter_rules[rule_id].used )) {
+    fprintf(stderr, "eth_filter_remove(): ERROR: regla inexistente\n");
+    return -1;
+  }
+
+  iface->filter_rules[rule_id].used = 0;
+  iface->filter_num_rules--;
+
+  eth_filter_update(iface);
+
+  return 0;
+}
+
+
+/* int eth_read_batch
+ * ( eth_iface_t * iface, eth_rx_frame_t * rx_frames[], int max_frames,
+ *   long int timeout );
+ *
+ * DESCRIPCIÓN:
+ *   Lee de la interfaz hasta 'max_frames' tramas en posiciones libres del
+ *   anillo de recepción, con una única llamada al backend si éste permite
+ *   recepciones por lotes. Sólo se rellena 'frame_len' de cada trama, que
+ *   todavía debe comprobarse con 'eth_frame_accept()'.
+ *
+ * VALOR DEVUELTO:
+ *   El número de tramas leídas, '0' si ha expirado el temporizador o '-1'
+ *   si se ha producido algún error.
+ */
+static int eth_read_batch
+( eth_iface_t * iface, eth_rx_frame_t * rx_frames[], int max_frames,
+  long int timeout )
+{
+  if (max_frames > ETH_BATCH_MAX) {
+    max_frames = ETH_BATCH_MAX;
+  }
+  if (max_frames > iface->rx_free_count) {
+    max_frames = iface->rx_free_count;
+  }
+  if (max_frames <= 0) {
+    fprintf(stderr, "eth_recv(): ERROR: anillo de recepción agotado\n");
+    return -1;
+  }
+
+  /* Tomar las posiciones libres del anillo que ocupará el lote */
+  unsigned char * buffers[ETH_BATCH_MAX];
+  int frame_lens[ETH_BATCH_MAX];
+  uint64_t tstamps[ETH_BATCH_MAX];
+  int i;
+  for (i=0; i<max_frames; i++) {
+    rx_frames[i] = eth_frame_alloc(iface);
+    buffers[i] = rx_frames[i]->frame;
+  }
+
+  /* Sondear la interfaz sin esperar antes de bloquearse, si está activado
+     el sondeo activo */
+  int buffers_used = 0;
+  if ((iface->busy_poll_max > 0) && (timeout != 0)) {
+    buffers_used = eth_busy_poll(iface, buffers, frame_lens, tstamps,
+                                 max_frames, &timeout);
+  }
+  if (buffers_used == 0) {
+    buffers_used = eth_backend_read(iface, buffers, frame_lens, tstamps,
+                                    max_frames, timeout);
+  }
+
+  /* Anotar las marcas de tiempo y devolver al anillo las posiciones que no
+     se han usado. Las tramas sin marca del backend usan la de la lectura. */
+  uint64_t now = (buffers_used > 0) ? eth_tstamp_now() : 0;
+  for (i=0; i<max_frames; i++) {
+    if (i < buffers_used) {
+      rx_frames[i]->frame_len = frame_lens[i];
+      eth_meta_t * meta = &rx_frames[i]->meta;
+      meta->rx_read = now;
+      if (tstamps[i] != 0) {
+        meta->rx_tstamp = tstamps[i];
+        meta->rx_tstamp_src = ETH_TSTAMP_KERNEL;
+      } else {
+        meta->rx_tstamp = now;
+        meta->rx_tstamp_src = ETH_TSTAMP_STACK;
+      }
+    } else {
+      eth_frame_release(iface, rx_frames[i]);
+    }
+  }
+
+  return buffers_used;
+}
+
+
+/* Anota el envío de las 'num' tramas que ha aceptado el backend, para
+   'eth_get_tx_tstamp()' y la captura de la interfaz. Las tramas que no
+   llegan a enviarse no se capturan. Se llama con 'tx_lock' tomado. */
+static void eth_tx_done
+( eth_iface_t * iface, unsigned char * frames[], int frame_lens[], int num )
+{
+  iface->tx_tstamp = eth_tstamp_now();
+  iface->tx_count += num;
+
+  if (iface->capture != NULL) {
+    int i;
+    for (i=0; i<num; i++) {
+      eth_capture_frame(iface->capture, frames[i], frame_lens[i],
+                        iface->tx_tstamp);
+    }
+  }
+}
+
+
+/* int eth_backend_read
+ * ( eth_iface_t * iface, unsigned char * buffers[], int frame_lens[],
+ *   uint64_t tstamps[], int num, long int timeout );
+ *
+ * DESCRIPCIÓN:
+ *   Lee del backend hasta 'num' tramas en 'buffers', esperando como máximo
+ *   'timeout' a la primera: con una única llamada si el backend permite
+ *   recepciones por lotes o, si no, esperando la primera trama y recogiendo
+ *   sin esperar las siguientes. En 'tstamps' se devuelven las marcas de
+ *   llegada del backend, o '0' si no las proporciona.
+ *
+ * VALOR DEVUELTO:
+ *   El número de buffers utilizados, '0' si ha expirado el temporizador o
+ *   '-1' si se ha producido algún error.
+ */
+static int eth_backend_read
+( eth_iface_t * iface, unsigned char * buffers[], int frame_lens[],
+  uint64_t tstamps[], int num, long int timeout )
+{
+  if (iface->backend->recv_batch != NULL) {
+    return iface->backend->recv_batch
+      (iface->backend_data, buffers, iface->rx_frame_size,
+       frame_lens, tstamps, num, timeout);
+  }
+
+  int buffers_used = 0;
+  while (buffers_used < num) {
+    int frame_len = iface->backend->recv
+      (iface->backend_data, buffers[buffers_used], iface->rx_frame_size,
+       (buffers_used == 0) ? timeout : 0);
+    if (frame_len <= 0) {
+      if ((frame_len < 0) && (buffers_used == 0)) {
+        buffers_used = -1;
+      }
+      break;
+    }
+    frame_lens[buffers_used] = frame_len;
+    tstamps[buffers_used] = 0;
+    buffers_used++;
+  }
+
+  return buffers_used;
+}
+
+
+/* Devuelve el instante actual del reloj monotónico en microsegundos */
+static long long int eth_now_us ( void )
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+
+  return (long long int) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+
+/* int eth_busy_poll
+ * ( eth_iface_t * iface, unsigned char * buffers[], int frame_lens[],
+ *   uint64_t tstamps[], int num, long int * timeout );
+ *
+ * DESCRIPCIÓN:
+ *   Lee del backend sin esperar repetidamente hasta que llegue alguna trama
+ *   o se agote el presupuesto actual del sondeo activo (o el 'timeout', si
+ *   es menor), y adapta el presupuesto: se duplica si ha llegado alguna
+ *   trama y se reduce a la mitad si no.
+ *
+ *   Si no llega ninguna trama, descuenta de '*timeout' el tiempo sondeado
+ *   para que la espera bloqueante posterior no supere el 'timeout'
+ *   original.
+ *
+ * VALOR DEVUELTO:
+ *   El número de buffers utilizados, '0' si se ha agotado el presupuesto o
+ *   '-1' si se ha producido algún error.
+ */
+static int eth_busy_poll
+( eth_iface_t * iface, unsigned char * buffers[], int frame_lens[],
+  uint64_t tstamps[], int num, long int * timeout )
+{
+  long long int start = eth_now_us();
+  long long int spin_end = start + iface->busy_poll_budget;
+  if ((*timeout > 0) && (spin_end > start + *timeout * 1000LL)) {
+    spin_end = start + *timeout * 1000LL;
+  }
+
+  long long int now;
+  do {
+    iface->stats.busy_poll_spins++;
+    int buffers_used = eth_backend_read(iface, buffers, frame_lens, tstamps,
+                                        num, 0);
+    if (buffers_used != 0) {
+      if (buffers_used > 0) {
+        iface->stats.busy_poll_hits++;
+        iface->busy_poll_budget *= 2;
+        if (iface->busy_poll_budget > iface->busy_poll_max) {
+          iface->busy_poll_budget = iface->busy_poll_max;
+        }
+      }
+      return buffers_used;
+    }
+    now = eth_now_us();
+  } while (now < spin_end);
+
+  /* Presupuesto agotado: se pasa a esperar bloqueado el tiempo restante,
+     redondeando hacia arriba el tiempo ya sondeado */
+  iface->stats.busy_poll_fallbacks++;
+  iface->busy_poll_budget /= 2;
+  long int budget_min = (ETH_BUSY_POLL_MIN < iface->busy_poll_max) ?
+                        ETH_BUSY_POLL_MIN : iface->busy_poll_max;
+  if (iface->busy_poll_budget < budget_min) {
+    iface->busy_poll_budget = budget_min;
+  }
+  if (*timeout > 0) {
+    long int spent = (long int) ((now - start + 999) / 1000);
+    *timeout = (spent < *timeout) ? *timeout - spent : 0;
+  }
+
+  return 0;
+}
+
+
+/* int eth_rx_ring_alloc ( eth_iface_t * iface, int mtu );
+ *
+ * DESCRIPCIÓN:
+ *   Reserva las tramas del anillo de recepción, con el tamaño necesario
+ *   para la MTU indicada, y las deja todas libres. Establece además la MTU
+ *   de la interfaz. No libera el anillo anterior.
+ *
+ * VALOR DEVUELTO:
+ *   '0' si se ha reservado el anillo o '-1' si se ha producido algún error.
+ */
+static int eth_rx_ring_alloc ( eth_iface_t * iface, int mtu )
+{
+  int frame_size = ETH_HEADER_SIZE + mtu;
+  unsigned char * buffers = malloc((size_t) ETH_RX_RING_SIZE * frame_size);
+  if (buffers == NULL) {
+    fprintf(stderr, "eth_open(): ERROR en malloc()\n");
+    return -1;
+  }
+
+  iface->rx_buffers = buffers;
+  iface->rx_frame_size = frame_size;
+  iface->mtu = mtu;
+  int i;
+  for (i=0; i<ETH_RX_RING_SIZE; i++) {
+    iface->rx_ring[i].frame = buffers + (i * frame_size);
+    iface->rx_ring[i].slot = i;
+    iface->rx_free[i] = i;
+  }
+  iface->rx_free_count = ETH_RX_RING_SIZE;
+
+  return 0;
+}
+
+
+/* eth_rx_frame_t * eth_frame_alloc ( eth_iface_t * iface );
+ *
+ * DESCRIPCIÓN:
+ *   Toma una posición libre del anillo de recepción de la interfaz.
+ *
+ * VALOR DEVUELTO:
+ *   El descriptor de la posición, o 'NULL' si todas están prestadas.
+ */
+static eth_rx_frame_t * eth_frame_alloc ( eth_iface_t * iface )
+{
+  if (iface->rx_free_count == 0) {
+    fprintf(stderr, "eth_recv(): ERROR: anillo de recepción agotado\n");
+    return NULL;
+  }
+  iface->rx_free_count--;
+
+  return &iface->rx_ring[iface->rx_free[iface->rx_free_count]];
+}
+
+
+/* int eth_frame_accept ( eth_iface_t * iface, eth_rx_frame_t * rx_frame );
+ *
+ * DESCRIPCIÓN:
+ *   Comprueba si la trama recibida en 'rx_frame', de longitud 'frame_len',
+ *   va dirigida a la interfaz (o es de difusión). En ese caso rellena su
+ *   descriptor y, en caso contrario, la devuelve al anillo de recepción.
+ *
+ * VALOR DEVUELTO:
+ *   '1' si la trama es aceptada y '0' si se ha descartado.
+ */
+static int eth_frame_accept ( eth_iface_t * iface, eth_rx_frame_t * rx_frame )
+{
+  int frame_len = rx_frame->frame_len;
+
+  if (frame_len == 0) {
+    /* Trama descartada por el backend */
+    eth_frame_release(iface, rx_frame);
+    return 0;
+  } else if (frame_len < ETH_HEADER_SIZE) {
+    fprintf(stderr, "eth_recv(): Trama de tamaño invalido: %d bytes\n",
+            frame_len);
+    eth_frame_release(iface, rx_frame);
+    return 0;
+  }
+
+  /* Capturar todas las tramas leídas de la interfaz. El anillo de la
+     captura sólo admite un escritor, así que se comparte el cerrojo de los
+     envíos */
+  if (iface->capture != NULL) {
+    pthread_mutex_lock(&iface->tx_lock);
+    eth_capture_frame(iface->capture, rx_frame->frame, frame_len,
+                      rx_frame->meta.rx_tstamp);
+    pthread_mutex_unlock(&iface->tx_lock);
+  }
+
+  /* Aceptar las tramas dirigidas a la interfaz y las de difusión (como las
+     peticiones ARP) */
+  struct eth_header * eth_header = (struct eth_header *) rx_frame->frame;
+  int is_my_mac = (memcmp(eth_header->dest_addr,
+                          iface->mac_address, MAC_ADDR_SIZE) == 0);
+  int is_bcast = (memcmp(eth_header->dest_addr,
+                         MAC_BCAST_ADDR, MAC_ADDR_SIZE) == 0);
+  if (( ! is_my_mac ) && ( ! is_bcast )) {
+    iface->stats.rx_not_for_us++;
+    eth_frame_release(iface, rx_frame);
+    return 0;
+  }
+
+  /* Aplicar el filtro de recepción a las tramas que no haya descartado el
+     núcleo (backend sin filtros o tramas anteriores a instalarlo) */
+  if ( ! eth_filter_match(iface, rx_frame) ) {
+    iface->stats.rx_filtered++;
+    eth_frame_release(iface, rx_frame);
+    return 0;
+  }
+
+  /* Rellenar el descriptor */
+  if (frame_len > iface->rx_frame_size) {
+    frame_len = iface->rx_frame_size;
+  }
+  rx_frame->frame_len = frame_len;
+  rx_frame->l2_offset = 0;
+  rx_frame->l3_offset = ETH_HEADER_SIZE;
+  rx_frame->l4_offset = -1;
+  rx_frame->payload_offset = ETH_HEADER_SIZE;
+  rx_frame->payload_len = frame_len - ETH_HEADER_SIZE;
+  iface->stats.rx_frames++;
+
+  TRACE(TRACE_DEBUG, TRACE_ETH_RECV, ntohs(eth_header->type),
+        rx_frame->payload_len, 0, 0, rx_frame->frame, frame_len);
+
+  return 1;
+}
+
+
+/* int eth_frame_deliver
+ * ( eth_iface_t * iface, eth_rx_frame_t * rx_frame, int wanted_type );
+ *
+ * DESCRIPCIÓN:
+ *   Decide el destino de una trama aceptada. Si su tipo tiene un manejador
+ *   registrado, se le pasa primero. Si no lo consume y es del tipo
+ *   'wanted_type' que espera el llamante, se le entrega. En otro caso se
+ *   encola en la cola de su tipo, o se descarta si el tipo no está
+ *   registrado o su cola está llena. Con 'wanted_type' igual a '-1' nunca se
+ *   entrega la trama al llamante.
+ *
+ * VALOR DEVUELTO:
+ *   '1' si la trama debe entregarse al llamante, o '0' si ya no le
+ *   pertenece.
+ */
+static int eth_frame_deliver
+( eth_iface_t * iface, eth_rx_frame_t * rx_frame, int wanted_type )
+{
+  struct eth_header * eth_header =
+    (struct eth_header *) (rx_frame->frame + rx_frame->l2_offset);
+  uint16_t type = ntohs(eth_header->type);
+
+  struct eth_type_queue * queue = eth_type_queue_get(iface, type, 0);
+  if ((queue != NULL) && (queue->handler != NULL)) {
+    if (queue->handler(iface, rx_frame, queue->handler_arg)) {
+      iface->stats.rx_handled++;
+      eth_frame_release(iface, rx_frame);
+      return 0;
+    }
+  }
+
+  if (type == wanted_type) {
+    return 1;
+  }
+
+  if (queue == NULL) {
+    iface->stats.rx_unknown_type++;
+    eth_frame_release(iface, rx_frame);
+  } else if (queue->count == ETH_DISPATCH_QUEUE_LEN) {
+    iface->stats.rx_queue_full++;
+    eth_frame_release(iface, rx_frame);
+  } else {
+    queue->frames[(queue->head + queue->count) % ETH_DISPATCH_QUEUE_LEN] =
+      rx_frame;
+    queue->count++;
+    iface->stats.rx_queued++;
+  }
+
+  return 0;
+}
+
+
+/* struct eth_type_queue * eth_type_queue_get
+ * ( eth_iface_t * iface, uint16_t type, int create );
+ *
+ * DESCRIPCIÓN:
+ *   Busca la cola del tipo de trama indicado. Si no existe y 'create' es
+ *   distinto de cero, la registra en la primera posición libre.
+ *
+ * VALOR DEVUELTO:
+ *   La cola del tipo, o 'NULL' si no está registrado (o no caben más).
+ */
+static struct eth_type_queue * eth_type_queue_get
+( eth_iface_t * iface, uint16_t type, int create )
+{
+  struct eth_type_queue * free_queue = NULL;
+
+  int i;
+  for (i=0; i<ETH_DISPATCH_TYPES; i++) {
+    struct eth_type_queue * queue = &iface->type_queues[i];
+    if (queue->registered) {
+      if (queue->type == type) {
+        return queue;
+      }
+    } else if (free_queue == NULL) {
+      free_queue = queue;
+    }
+  }
+
+  if ((! create) || (free_queue == NULL)) {
+    return NULL;
+  }
+  memset(free_queue, 0, sizeof(struct eth_type_queue));
+  free_queue->type = type;
+  free_queue->registered = 1;
+
+  return free_queue;
+}
+
+
+/* int eth_type_queue_pop
+ * ( eth_iface_t * iface, uint16_t type,
+ *   eth_rx_frame_t * frames[], int max_frames );
+ *
+ * DESCRIPCIÓN:
+ *   Extrae hasta 'max_frames' tramas de la cola del tipo indicado.
+ *
+ * VALOR DEVUELTO:
+ *   El número de tramas extraídas.
+ */
+static int eth_type_queue_pop
+( eth_iface_t * iface, uint16_t type,
+  eth_rx_frame_t * frames[], int max_frames )
+{
+  struct eth_type_queue * queue = eth_type_queue_get(iface, type, 0);
+  int frames_pop = 0;
+
+  while ((queue != NULL) && (queue->count > 0) &&
+         (frames_pop < max_frames)) {
+    frames[frames_pop] = queue->frames[queue->head];
+    queue->head = (queue->head + 1) % ETH_DISPATCH_QUEUE_LEN;
+    queue->count--;
+    frames_pop++;
+  }
+
+  return frames_pop;
+}
+
+
+/* int eth_filter_match ( eth_iface_t * iface, eth_rx_frame_t * rx_frame );
+ *
+ * DESCRIPCIÓN:
+ *   Comprueba en espacio de usuario si la trama cumple alguna regla del
+ *   filtro de recepción. Es equivalente al programa BPF que genera
+ *   'eth_filter_update()', sin la comprobación de la dirección MAC.
+ *
+ * VALOR DEVUELTO:
+ *   '1' si la trama cumple alguna regla o no hay reglas, '0' en otro caso.
+ */
+static int eth_filter_match ( eth_iface_t * iface, eth_rx_frame_t * rx_frame )
+{
+  if (iface->filter_num_rules == 0) {
+    return 1;
+  }
+
+  unsigned char * frame = rx_frame->frame;
+  int frame_len = rx_frame->frame_len;
+  uint16_t type = (frame[12] << 8) | frame[13];
+
+  /* Comienzo de la cabecera de transporte según la longitud de la
+     cabecera IPv4, como la instrucción BPF_MSH */
+  int l4_offset = -1;
+  if (frame_len > ETH_HEADER_SIZE) {
+    l4_offset = ETH_HEADER_SIZE + 4 * (frame[ETH_HEADER_SIZE] & 0x0F);
+  }
+
+  int i, j, k;
+  for (i=0; i<ETH_FILTER_MAX_RULES; i++) {
+    struct eth_filter_rule * rule = &iface->filter_rules[i];
+    if (( ! rule->used ) || (rule->type != type)) {
+      continue;
+    }
+
+    int match = 1;
+    for (j=0; (j<rule->num_conds) && match; j++) {
+      eth_filter_cond_t * cond = &rule->conds[j];
+      int offset = (cond->base == ETH_FILTER_L4) ? l4_offset : ETH_HEADER_SIZE;
+      offset += cond->offset;
+      if ((offset < ETH_HEADER_SIZE) || (offset + cond->size > frame_len)) {
+        match = 0;
+        break;
+      }
+      uint32_t value = 0;
+      for (k=0; k<cond->size; k++) {
+        value = (value << 8) | frame[offset + k];
+      }
+      match = (value == cond->value);
+    }
+    if (match) {
+      return 1;
+    }
+  }
+
+  return 0;
+}
+
+
+/* int eth_filter_update ( eth_iface_t * iface );
+ *
+ * DESCRIPCIÓN:
+ *   Compila las reglas del filtro de recepción a un programa BPF clásico y
+ *   lo instala en el socket del backend. El programa acepta las tramas
+ *   dirigidas a la dirección MAC de la interfaz o a la de difusión que
+ *   cumplan alguna regla:
+ *
+ *     ld [0]; jeq MAC[0..3], 0, bcast; ldh [4]; jeq MAC[4..5], reglas, descartar;
+ *     bcast: jeq 0xFFFFFFFF, 0, descartar; ldh [4]; jeq 0xFFFF, reglas, 0;
+ *     descartar: ret 0;
+ *     reglas:
+ *     para cada regla:
+ *       ldh [12]; jeq tipo, 0, siguiente;
+ *       (ldxb 4*([14]&0xf) si hay condiciones de nivel 4)
+ *       para cada condición: ld [14+off] o [x+14+off]; jeq valor, 0, siguiente;
+ *       ret -1;
+ *     ret 0
+ *
+ *   Todos los saltos son hacia delante y cortos, por lo que nunca exceden
+ *   el desplazamiento máximo de 255 instrucciones.
+ *
+ * VALOR DEVUELTO:
+ *   '0' si se ha actualizado el filtro o el backend no admite filtros, y
+ *   '-1' si el núcleo lo ha rechazado (las tramas se siguen filtrando en
+ *   espacio de usuario).
+ */
+static int eth_filter_update ( eth_iface_t * iface )
+{
+  if (iface->backend->set_filter == NULL) {
+    return 0;
+  }
+  if (iface->filter_num_rules == 0) {
+    return iface->backend->set_filter(iface->backend_data, NULL, 0);
+  }
+
+  struct sock_filter insns[ETH_FILTER_MAX_INSNS];
+  int n = 0;
+  unsigned char * mac = iface->mac_address;
+
+  /* Dirección MAC destino */
+  uint32_t mac_high = ((uint32_t) mac[0] << 24) | (mac[1] << 16) |
+                      (mac[2] << 8) | mac[3];
+  uint32_t mac_low = (mac[4] << 8) | mac[5];
+  insns[n++] = (struct sock_filter) BPF_STMT(BPF_LD | BPF_W | BPF_ABS, 0);
+  insns[n++] = (struct sock_filter)
+    BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, mac_high, 0, 2);
+  insns[n++] = (struct sock_filter) BPF_STMT(BPF_LD | BPF_H | BPF_ABS, 4);
+  insns[n++] = (struct sock_filter)
+    BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, mac_low, 4, 3);
+  /* Dirección de difusión */
+  insns[n++] = (struct sock_filter)
+    BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, 0xFFFFFFFF, 0, 2);
+  insns[n++] = (struct sock_filter) BPF_STMT(BPF_LD | BPF_H | BPF_ABS, 4);
+  insns[n++] = (struct sock_filter)
+    BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, 0xFFFF, 1, 0);
+  insns[n++] = (struct sock_filter) BPF_STMT(BPF_RET | BPF_K, 0);
+
+  int i, j;
+  for (i=0; i<ETH_FILTER_MAX_RULES; i++) {
+    struct eth_filter_rule * rule = &iface->filter_rules[i];
+    if ( ! rule->used ) {
+      continue;
+    }
+
+    int has_l4 = 0;
+    for (j=0; j<rule->num_conds; j++) {
+      if (rule->conds[j].base == ETH_FILTER_L4) {
+        has_l4 = 1;
+      }
+    }
+
+    /* Longitud de la regla: los saltos 'jf' llevan a la siguiente */
+    int rule_start = n;
+    int rule_len = 2 + has_l4 + 2 * rule->num_conds + 1;
+
+    insns[n++] = (struct sock_filter) BPF_STMT(BPF_LD | BPF_H | BPF_ABS, 12);
+    insns[n] = (struct sock_filter)
+      BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, rule->type, 0,
+               rule_len - 1 - (n - rule_start));
+    n++;
+    if (has_l4) {
+      insns[n++] = (struct sock_filter)
+        BPF_STMT(BPF_LDX | BPF_B | BPF_MSH, ETH_HEADER_SIZE);
+    }
+    for (j=0; j<rule->num_conds; j++) {
+      eth_filter_cond_t * cond = &rule->conds[j];
+      int size = (cond->size == 1) ? BPF_B : ((cond->size == 2) ? BPF_H : BPF_W);
+      int mode = (cond->base == ETH_FILTER_L4) ? BPF_IND : BPF_ABS;
+      insns[n++] = (struct sock_filter)
+        BPF_STMT(BPF_LD | size | mode, ETH_HEADER_SIZE + cond->offset);
+      insns[n] = (struct sock_filter)
+        BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, cond->value, 0,
+                 rule_len - 1 - (n - rule_start));
+      n++;
+    }
+    insns[n++] = (struct sock_filter) BPF_STMT(BPF_RET | BPF_K, 0xFFFFFFFF);
+  }
+  insns[n++] = (struct sock_filter) BPF_STMT(BPF_RET | BPF_K, 0);
+
+  return iface->backend->set_filter(iface->backend_data, insns, n);
+}
+
+
+/* void eth_frame_release ( eth_iface_t * iface, eth_rx_frame_t * frame );
+ *
+ * DESCRIPCIÓN:
+ *   Esta función devuelve al anillo de recepción de la interfaz una trama
+ *   obtenida con 'eth_recv_frame()'. Tras la llamada no debe accederse a los
+ *   datos de la trama.
+ *
+ * PARÁMETROS:
+ *   'iface': Manejador de la interfaz Ethernet por la que se recibió la
+ *            trama.
+ *   'frame': Descriptor de la trama que se desea liberar.
+ */
+void eth_frame_release ( eth_iface_t * iface, eth_rx_frame_t * frame )
+{
+  if ((iface != NULL) && (frame != NULL) &&
+      (iface->rx_free_count < ETH_RX_RING_SIZE)) {
+    iface->rx_free[iface->rx_free_count] = frame->slot;
+    iface->rx_free_count++;
+  }
+}
+
+
+/* int eth_getfd ( eth_iface_t * iface );
+ *
+ * DESCRIPCIÓN:
+ *   Esta función devuelve el descriptor de fichero de la interfaz, que
+ *   puede esperarse con poll() o epoll() para saber si hay tramas
+ *   pendientes de leer (por ejemplo, desde un reactor que sirve varias
+ *   interfaces en un único hilo).
+ *
+ *   Las tramas que ya estén encoladas en el distribuidor de recepción no
+ *   señalan el descriptor.
+ *
+ * PARÁMETROS:
+ *   'iface': Manejador de la interfaz Ethernet.
+ *
+ * VALOR DEVUELTO:
+ *   El descriptor de fichero de la interfaz.
+ *
+ * ERRORES:
+ *   La función devuelve '-1' si el backend de la interfaz no tiene un
+ *   descriptor que pueda esperarse (como 'rawnet').
+ */
+int eth_getfd ( eth_iface_t * iface )
+{
+  if (iface == NULL) {
+    fprintf(stderr, "eth_getfd(): ERROR: iface == NULL\n");
+    return -1;
+  }
+
+  return iface->backend->getfd(iface->backend_data);
+}
+
+
+/* int eth_poll
+ * ( eth_iface_t * ifaces[], int ifnum, long int timeout );
+ *
+ * DESCRIPCIÓN:
+ *   Esta función permite esperar paquetes en múltiples interfaces Ethernet
+ *   simultaneamente. Cuando alguna de las interfaces indicadas reciba una
+ *   trama, la función devolverá la primera interfaz que tiene una trama
+ *   listo para ser recibida mediante la funcion 'eth_recv()'.
+ *
+ *   Esta operación puede escuchar de los interfaces Ethernet indefinidamente
+ *   o un tiempo limitado dependiento del parámetro 'timeout'.
+ *
+ * PARÁMETROS:
+ *  'ifaces': Array con los manejadores de interfaces Ethernet por los que se
+ *            quiere recibir.
+ *            Todos los interfaces deben haber sido inicializados con
+ *            'eth_open()' previamente.
+ *   'ifnum': Número de interfaces que aparecen en el array 'ifaces'.
+ * 'timeout': Tiempo en milisegundos que debe esperarse a recibir una trama
+ *            antes de retornar. Un número negativo indicará que debe
+ *            esperarse indefinidamente.
+ *
+ * VALOR DEVUELTO:
+ *   El índice del primer interfaz [0, ifnum-1] que tiene una trama lista para
+ *   ser recibida o '-2' si ha expirado el temporizador. Como siempre se
+ *   devuelve la primera, una interfaz muy cargada puede acaparar las
+ *   llamadas; para atender varias interfaces con equidad utilice
+ *   'eth_poll_batch()'.
+ *
+ * ERRORES:
+ *   La función devuelve '-1' si se ha producido algún error.
+ */
+int eth_poll
+( eth_iface_t * ifaces[], int ifnum, long int timeout )
+{
+  int iface_index;
+  int i;
+
+  /* Si todas las interfaces usan 'rawnet', esperar con rawnet_poll() */
+  int all_rawnet = 1;
   for (i=0; i<ifnum; i++) {
-    raw_ifaces[i] = ifaces[i]->raw_iface;
+    if (ifaces[i]->backend != &ETH_BACKEND_RAWNET) {
+      all_rawnet = 0;
+    }
   }
 
-  /* Llamar a rawnet_poll() y procesar errores */
-  iface_index = rawnet_poll(raw_ifaces, ifnum, timeout);
-  if (iface_index == -1) {
-    fprintf(stderr, "eth_poll(): ERROR en rawnet_poll(): %s\n",
-            rawnet_strerror());
+  if (all_rawnet) {
+    /* Crear lista de interfaces hardware */
+    rawiface_t * raw_ifaces[ifnum];
+    for (i=0; i<ifnum; i++) {
+      raw_ifaces[i] = (rawiface_t *) ifaces[i]->backend_data;
+    }
+
+    /* Llamar a rawnet_poll() y procesar errores */
+    iface_index = rawnet_poll(raw_ifaces, ifnum, timeout);
+    if (iface_index == -1) {
+      fprintf(stderr, "eth_poll(): ERROR en rawnet_poll(): %s\n",
+              rawnet_strerror());
+      return -1;
+    } else if (iface_index == -2) {
+      /* Timeout! */
+      return -2;
+    }
+
+    return iface_index;
+  }
+
+  /* En otro caso, esperar con poll() sobre los descriptores de los
+     backends */
+  struct pollfd pfds[ifnum];
+  for (i=0; i<ifnum; i++) {
+    pfds[i].fd = ifaces[i]->backend->getfd(ifaces[i]->backend_data);
+    pfds[i].events = POLLIN;
+    pfds[i].revents = 0;
+    if (pfds[i].fd == -1) {
+      fprintf(stderr, "eth_poll(): ERROR: no se pueden mezclar interfaces "
+              "'%s' con otros backends\n", ifaces[i]->backend->name);
+      return -1;
+    }
+  }
+
+  int poll_timeout = (timeout < 0) ? -1 : (int) timeout;
+  int err = poll(pfds, ifnum, poll_timeout);
+  if (err == -1) {
+    fprintf(stderr, "eth_poll(): ERROR en poll(): %s\n", strerror(errno));
     return -1;
-  } else if (iface_index == -2) {
+  } else if (err == 0) {
     /* Timeout! */
     return -2;
   }
 
+  for (i=0; i<ifnum; i++) {
+    if (pfds[i].revents != 0) {
+      break;
+    }
+  }
+  iface_index = i;
+
   return iface_index;
 }
 
 
+
+/* Turno de 'eth_poll_batch()': primera interfaz que se atiende en la
+   siguiente llamada de cada hilo */
+static __thread unsigned int eth_poll_turn = 0;
+
+
+/* int eth_poll_batch
+ * ( eth_poll_entry_t entries[], int num, int budget, long int timeout );
+ *
+ * DESCRIPCIÓN:
+ *   Esta función espera a que alguna de las interfaces indicadas tenga
+ *   tramas y, a diferencia de 'eth_poll()', atiende todas las que estén
+ *   listas: marca cada una en su campo 'ready' y reparte sus tramas
+ *   pendientes, como 'eth_dispatch()', hasta 'budget' * 'weight' tramas por
+ *   interfaz. Las tramas que excedan el presupuesto quedan para la
+ *   siguiente llamada, que no espera.
+ *
+ *   Las interfaces listas se atienden por turno rotatorio: cada llamada
+ *   empieza por la siguiente a la que empezó la anterior. Así una interfaz
+ *   muy cargada nunca retrasa a las demás más de su presupuesto, y el peso
+ *   permite dar más capacidad a los enlaces que la necesiten.
+ *
+ * PARÁMETROS:
+ *   'entries': Array con las interfaces a atender y sus pesos. Los campos
+ *              'ready' y 'frames' son parámetros de salida.
+ *       'num': Número de interfaces de 'entries'.
+ *    'budget': Número máximo de tramas que se reparten de cada interfaz de
+ *              peso '1' en una llamada.
+ *   'timeout': Tiempo en milisegundos que debe esperarse a que alguna
+ *              interfaz tenga tramas. Un número negativo indicará que debe
+ *              esperarse indefinidamente.
+ *
+ * VALOR DEVUELTO:
+ *   El número de interfaces que estaban listas, o '0' si ha expirado el
+ *   temporizador.
+ *
+ * ERRORES:
+ *   La función devuelve '-1' si los parámetros no son válidos, si se mezclan
+ *   interfaces 'rawnet' con otros backends o si se ha producido algún otro
+ *   error.
+ */
+int eth_poll_batch
+( eth_poll_entry_t entries[], int num, int budget, long int timeout )
+{
+  if ((entries == NULL) || (num <= 0) || (budget <= 0)) {
+    fprintf(stderr, "eth_poll_batch(): ERROR: parámetro inválido\n");
+    return -1;
+  }
+  int i;
+  for (i=0; i<num; i++) {
+    if ((entries[i].iface == NULL) || (entries[i].weight < 1)) {
+      fprintf(stderr, "eth_poll_batch(): ERROR: interfaz %d inválida\n", i);
+      return -1;
+    }
+    entries[i].ready = 0;
+    entries[i].frames = 0;
+  }
+
+  /* Esperar y obtener el conjunto completo de interfaces listas */
+  int num_ready = eth_poll_wait(entries, num, timeout);
+  if (num_ready <= 0) {
+    return num_ready;
+  }
+
+  /* Vaciar cada interfaz lista hasta su presupuesto, por turno */
+  int first = eth_poll_turn % num;
+  eth_poll_turn++;
+  int n;
+  for (n=0; n<num; n++) {
+    eth_poll_entry_t * entry = &entries[(first + n) % num];
+    if ( ! entry->ready ) {
+      continue;
+    }
+
+    int quota = budget * entry->weight;
+    while (entry->frames < quota) {
+      int max_frames = quota - entry->frames;
+      if (max_frames > ETH_BATCH_MAX) {
+        max_frames = ETH_BATCH_MAX;
+      }
+      int frames_read = eth_dispatch_frames(entry->iface, max_frames, 0);
+      if (frames_read == -1) {
+        return -1;
+      }
+      entry->frames += frames_read;
+      if (frames_read < max_frames) {
+        /* Interfaz vacía */
+        break;
+      }
+    }
+  }
+
+  return num_ready;
+}
+
+
+/* int eth_poll_wait
+ * ( eth_poll_entry_t entries[], int num, long int timeout );
+ *
+ * DESCRIPCIÓN:
+ *   Espera a que alguna de las interfaces tenga tramas y marca en su campo
+ *   'ready' todas las que estén listas.
+ *
+ * VALOR DEVUELTO:
+ *   El número de interfaces listas, '0' si ha expirado el temporizador o
+ *   '-1' si se ha producido algún error.
+ */
+static int eth_poll_wait
+( eth_poll_entry_t entries[], int num, long int timeout )
+{
+  int num_ready = 0;
+  int i;
+
+  int all_rawnet = 1;
+  for (i=0; i<num; i++) {
+    if (entries[i].iface->backend != &ETH_BACKEND_RAWNET) {
+      all_rawnet = 0;
+    }
+  }
+
+  if (all_rawnet) {
+    rawiface_t * raw_ifaces[num];
+    for (i=0; i<num; i++) {
+      raw_ifaces[i] = (rawiface_t *) entries[i].iface->backend_data;
+    }
+
+    int iface_index = rawnet_poll(raw_ifaces, num, timeout);
+    if (iface_index == -1) {
+      fprintf(stderr, "eth_poll_batch(): ERROR en rawnet_poll(): %s\n",
+              rawnet_strerror());
+      return -1;
+    } else if (iface_index == -2) {
+      /* Timeout! */
+      return 0;
+    }
+
+    /* rawnet_poll() sólo indica la primera interfaz lista: consultar las
+       demás una a una sin esperar */
+    for (i=0; i<num; i++) {
+      if ((i == iface_index) || (rawnet_poll(&raw_ifaces[i], 1, 0) == 0)) {
+        entries[i].ready = 1;
+        num_ready++;
+      }
+    }
+
+    return num_ready;
+  }
+
+  struct pollfd pfds[num];
+  for (i=0; i<num; i++) {
+    eth_iface_t * iface = entries[i].iface;
+    pfds[i].fd = iface->backend->getfd(iface->backend_data);
+    pfds[i].events = POLLIN;
+    pfds[i].revents = 0;
+    if (pfds[i].fd == -1) {
+      fprintf(stderr, "eth_poll_batch(): ERROR: no se pueden mezclar "
+              "interfaces '%s' con otros backends\n", iface->backend->name);
+      return -1;
+    }
+  }
+
+  int poll_timeout = (timeout < 0) ? -1 : (int) timeout;
+  int err;
+  do {
+    err = poll(pfds, num, poll_timeout);
+  } while ((err == -1) && (errno == EINTR));
+  if (err == -1) {
+    fprintf(stderr, "eth_poll_batch(): ERROR en poll(): %s\n",
+            strerror(errno));
+    return -1;
+  }
+
+  for (i=0; i<num; i++) {
+    if (pfds[i].revents != 0) {
+      entries[i].ready = 1;
+      num_ready++;
+    }
+  }
+
+  return num_ready;
+}
+
 /* int eth_close ( eth_iface_t * iface );
  *
  * DESCRIPCIÓN:
@@ -381,7 +2531,12 @@ int eth_close ( eth_iface_t * iface )
   int err = -1;
 
   if (iface != NULL) {
-    err = rawiface_close(iface->raw_iface);
+    if (iface->capture != NULL) {
+      eth_capture_stop(iface);
+    }
+    err = iface->backend->close(iface->backend_data);
+    pthread_mutex_destroy(&iface->tx_lock);
+    free(iface->rx_buffers);
     free(iface);
   }
 
@@ -447,6 +2602,112 @@ int mac_str_addr ( char* str, mac_addr_t addr )
 }
 
 
+/* void pkt_buf_init ( pkt_buf_t * pkt );
+ *
+ * DESCRIPCIÓN:
+ *   Esta función inicializa un buffer de paquete vacío, reservando
+ *   'PKT_BUF_HEADROOM' bytes al principio para las cabeceras.
+ *
+ * PARÁMETROS:
+ *   'pkt': Buffer de paquete que se desea inicializar.
+ */
+void pkt_buf_init ( pkt_buf_t * pkt )
+{
+  if (pkt != NULL) {
+    pkt->data = pkt->buffer + PKT_BUF_HEADROOM;
+    pkt->len = 0;
+  }
+}
+
+
+/* unsigned char * pkt_buf_put ( pkt_buf_t * pkt, int len );
+ *
+ * DESCRIPCIÓN:
+ *   Esta función añade 'len' bytes al final de los datos del buffer de
+ *   paquete y devuelve un puntero a ellos para que sean rellenados.
+ *
+ * PARÁMETROS:
+ *   'pkt': Buffer de paquete.
+ *   'len': Número de bytes a añadir al final de los datos.
+ *
+ * VALOR DEVUELTO:
+ *   Puntero al comienzo de los bytes añadidos.
+ *
+ * ERRORES:
+ *   La función devuelve 'NULL' si no hay espacio suficiente al final del
+ *   buffer.
+ */
+unsigned char * pkt_buf_put ( pkt_buf_t * pkt, int len )
+{
+  unsigned char * tail = pkt->data + pkt->len;
+
+  if ((len < 0) || (tail + len > pkt->buffer + PKT_BUF_SIZE)) {
+    return NULL;
+  }
+  pkt->len += len;
+
+  return tail;
+}
+
+
+/* unsigned char * pkt_buf_push ( pkt_buf_t * pkt, int len );
+ *
+ * DESCRIPCIÓN:
+ *   Esta función antepone 'len' bytes a los datos del buffer de paquete,
+ *   utilizando el espacio reservado al principio del mismo, y devuelve un
+ *   puntero a ellos para que se rellene la cabecera correspondiente.
+ *
+ * PARÁMETROS:
+ *   'pkt': Buffer de paquete.
+ *   'len': Longitud en bytes de la cabecera a anteponer.
+ *
+ * VALOR DEVUELTO:
+ *   Puntero al nuevo comienzo de los datos del paquete.
+ *
+ * ERRORES:
+ *   La función devuelve 'NULL' si no queda espacio suficiente al principio
+ *   del buffer.
+ */
+unsigned char * pkt_buf_push ( pkt_buf_t * pkt, int len )
+{
+  if ((len < 0) || (pkt->data - len < pkt->buffer)) {
+    return NULL;
+  }
+  pkt->data -= len;
+  pkt->len += len;
+
+  return pkt->data;
+}
+
+
+/* unsigned char * pkt_buf_pull ( pkt_buf_t * pkt, int len );
+ *
+ * DESCRIPCIÓN:
+ *   Esta función quita los 'len' primeros bytes de los datos del buffer de
+ *   paquete, deshaciendo un 'pkt_buf_push()' de la misma longitud.
+ *
+ * PARÁMETROS:
+ *   'pkt': Buffer de paquete.
+ *   'len': Longitud en bytes de la cabecera a quitar.
+ *
+ * VALOR DEVUELTO:
+ *   Puntero al nuevo comienzo de los datos del paquete.
+ *
+ * ERRORES:
+ *   La función devuelve 'NULL' si los datos tienen menos de 'len' bytes.
+ */
+unsigned char * pkt_buf_pull ( pkt_buf_t * pkt, int len )
+{
+  if ((len < 0) || (len > pkt->len)) {
+    return NULL;
+  }
+  pkt->data += len;
+  pkt->len -= len;
+
+  return pkt->data;
+}
+
+
 /* void print_pkt ( unsigned char * packet, int pkt_len, int hdr_len );
  *
  * DESCRIPCIÓN:
@@ -15,13 +15,175 @@ extern mac_addr_t MAC_BCAST_ADDR;
 /* Longitud en bytes de una cadena de texto que representa una dirección MAC */
 #define MAC_STR_LENGTH 18
 
-/* Maximum Transmission Unit (MTU) de la tramas Ethernet. */
+/* Maximum Transmission Unit (MTU) de la tramas Ethernet. Es la MTU por
+   defecto de las interfaces cuyo backend no permite consultarla. */
 #define ETH_MTU 1500
 
+/* MTU máxima admitida por la librería (tramas "jumbo"). Cada interfaz tiene
+   su propia MTU, que puede consultarse y modificarse con 'eth_getmtu()' y
+   'eth_setmtu()'; este valor sólo limita el tamaño de los buffers que se
+   reservan estáticamente, como 'pkt_buf_t'. */
+#define ETH_MAX_MTU 9000
+
+/* MTU mínima de una interfaz: el payload mínimo de una trama Ethernet */
+#define ETH_MIN_MTU 46
+
+/* Tamaño de la cabecera Ethernet (sin incluir el campo FCS) */
+#define ETH_HEADER_SIZE 14
+
+/* Espacio reservado al principio de un 'pkt_buf_t' para que cada capa añada
+   su cabecera sin copiar los datos: Ethernet (14 bytes) + IPv4 (20 bytes) +
+   UDP (8 bytes), redondeado para que la cabecera IPv4 quede alineada. */
+#define PKT_BUF_HEADROOM 64
+
+/* Tamaño total del buffer de un 'pkt_buf_t' */
+#define PKT_BUF_SIZE (PKT_BUF_HEADROOM + ETH_MAX_MTU)
+
+/* Buffer de paquete para el envío de tramas sin copias intermedias.
+ *
+ * Los datos válidos del paquete son los 'len' bytes que comienzan en 'data'.
+ * Inicialmente 'data' apunta a 'PKT_BUF_HEADROOM' bytes del comienzo de
+ * 'buffer', de forma que la capa superior escribe su payload una única vez
+ * con 'pkt_buf_put()' y cada capa inferior antepone su cabecera en el propio
+ * buffer con 'pkt_buf_push()'.
+ *
+ * Utilice las funciones 'pkt_buf_*()' en lugar de acceder directamente a los
+ * campos de esta estructura.
+ */
+typedef struct pkt_buf {
+  unsigned char * data; /* Comienzo de los datos válidos del paquete */
+  int len;              /* Longitud en bytes de los datos válidos */
+  unsigned char buffer[PKT_BUF_SIZE]; /* Memoria del paquete */
+} pkt_buf_t;
+
+/* Número de tramas del anillo de recepción de cada interfaz Ethernet. Es el
+   número máximo de tramas recibidas con 'eth_recv_frame()' que pueden estar
+   prestadas simultáneamente. */
+#define ETH_RX_RING_SIZE 64
+
+/* Número máximo de tipos de trama ('EtherType') que pueden registrarse en
+   el distribuidor de recepción de cada interfaz */
+#define ETH_DISPATCH_TYPES 4
+
+/* Número máximo de tramas encoladas para cada tipo registrado. Las tramas
+   encoladas ocupan posiciones del anillo de recepción, por lo que
+   ETH_DISPATCH_TYPES * ETH_DISPATCH_QUEUE_LEN debe ser bastante menor que
+   ETH_RX_RING_SIZE. */
+#define ETH_DISPATCH_QUEUE_LEN 8
+
+/* Presupuesto mínimo en microsegundos del sondeo activo adaptativo
+   ('eth_set_busy_poll()'). Sin tráfico, el presupuesto se reduce hasta este
+   valor en lugar de anularse, para detectar cuándo vuelve a haberlo. */
+#define ETH_BUSY_POLL_MIN 5
+
+/* Número máximo de reglas del filtro de recepción de cada interfaz, y de
+   condiciones de cada regla */
+#define ETH_FILTER_MAX_RULES 16
+#define ETH_FILTER_MAX_CONDS 4
+
+/* Origen del desplazamiento de una condición del filtro de recepción */
+#define ETH_FILTER_L3 0 /* Desde el comienzo de la cabecera de red */
+#define ETH_FILTER_L4 1 /* Desde el comienzo de la cabecera de transporte,
+                           calculado con la longitud de la cabecera IPv4 */
+
+/* Condición de una regla del filtro de recepción: el campo de 'size' bytes
+ * (1, 2 ó 4) situado 'offset' bytes después del origen 'base' debe valer
+ * 'value' (leído en orden de red, como las instrucciones BPF).
+ */
+typedef struct eth_filter_cond {
+  int base;       /* ETH_FILTER_L3 o ETH_FILTER_L4 */
+  int offset;     /* Desplazamiento en bytes desde el origen */
+  int size;       /* Tamaño del campo en bytes */
+  uint32_t value; /* Valor esperado del campo */
+} eth_filter_cond_t;
+
+/* Origen de una marca de tiempo */
+#define ETH_TSTAMP_NONE   0 /* No hay marca de tiempo */
+#define ETH_TSTAMP_STACK  1 /* Tomada por la pila al leer o enviar la trama */
+#define ETH_TSTAMP_KERNEL 2 /* Tomada por el núcleo (o por el backend) al
+                               recibir o transmitir la trama */
+
+/* Metadatos de recepción de una trama.
+ *
+ * Las marcas de tiempo son nanosegundos del reloj CLOCK_REALTIME, el de las
+ * marcas software del núcleo, y pueden compararse con 'eth_tstamp_now()':
+ * 'rx_read' - 'rx_tstamp' es el tiempo que la trama ha esperado en el núcleo
+ * (o en el backend) y 'eth_tstamp_now()' - 'rx_read' el que lleva dentro de
+ * la pila.
+ */
+typedef struct eth_meta {
+  uint64_t rx_tstamp; /* Llegada de la trama a la interfaz */
+  uint64_t rx_read;   /* Lectura de la trama del backend por la pila */
+  int rx_tstamp_src;  /* Origen de 'rx_tstamp': 'ETH_TSTAMP_KERNEL', o
+                         'ETH_TSTAMP_STACK' si el backend no la proporciona
+                         (y entonces es igual a 'rx_read') */
+} eth_meta_t;
+
+/* Descriptor de una trama recibida.
+ *
+ * La trama pertenece al anillo de recepción de la interfaz y se presta a las
+ * capas superiores, que acceden directamente a sus bytes en lugar de
+ * copiarlos. Cada capa analiza su cabecera, rellena el desplazamiento de la
+ * siguiente y actualiza 'payload_offset' y 'payload_len' para que apunten a
+ * los datos de la capa superior.
+ *
+ * La trama debe devolverse al anillo con 'eth_frame_release()' cuando ya no
+ * se necesite.
+ */
+typedef struct eth_rx_frame {
+  unsigned char * frame; /* Bytes de la trama, desde la cabecera Ethernet */
+  int frame_len;         /* Longitud en bytes de la trama recibida */
+  int l2_offset;         /* Desplazamiento de la cabecera Ethernet */
+  int l3_offset;         /* Desplazamiento de la cabecera de red */
+  int l4_offset;         /* Desplazamiento de la cabecera de transporte, o
+                            '-1' si todavía no se ha analizado */
+  int payload_offset;    /* Desplazamiento de los datos de la capa actual */
+  int payload_len;       /* Longitud en bytes de los datos de la capa actual */
+  int slot;              /* Posición de la trama en el anillo de recepción */
+  eth_meta_t meta;       /* Marcas de tiempo de la recepción */
+} eth_rx_frame_t;
+
+/* Estadísticas de recepción de una interfaz Ethernet */
+typedef struct eth_stats {
+  long int rx_frames;       /* Tramas aceptadas (dirigidas a la interfaz o
+                               de difusión) */
+  long int rx_not_for_us;   /* Tramas descartadas por la dirección destino */
+  long int rx_unknown_type; /* Tramas descartadas por tipo no registrado */
+  long int rx_queued;       /* Tramas encoladas para otro tipo registrado */
+  long int rx_queue_full;   /* Tramas descartadas por cola de tipo llena */
+  long int rx_handled;      /* Tramas consumidas por un manejador */
+  long int rx_filtered;     /* Tramas descartadas por el filtro */
+  long int capture_frames;  /* Tramas guardadas por la captura */
+  long int capture_dropped; /* Tramas no capturadas por anillo lleno */
+  long int busy_poll_spins;     /* Lecturas sin espera del sondeo activo */
+  long int busy_poll_hits;      /* Esperas resueltas durante el sondeo */
+  long int busy_poll_fallbacks; /* Sondeos agotados: se pasa a bloquear */
+  long int busy_poll_budget;    /* Presupuesto actual del sondeo (us) */
+} eth_stats_t;
+
 /* Manejador de un interfaz ethernet. Esta es una estructura opaca que no debe
    ser accedida directamente, sino a través de las funciones de esta librería. */
 typedef struct eth_iface eth_iface_t;
 
+/* Interfaz de un sondeo de varias interfaces con 'eth_poll_batch()' */
+typedef struct eth_poll_entry {
+  eth_iface_t * iface; /* Interfaz que se atiende */
+  int weight;          /* Peso (>= 1): multiplica el presupuesto de tramas */
+  int ready;           /* Salida: '1' si la interfaz estaba lista */
+  int frames;          /* Salida: tramas leídas y repartidas */
+} eth_poll_entry_t;
+
+/* Función manejadora de las tramas de un tipo registrado con
+ * 'eth_register_type()'. Se invoca desde el camino de recepción de la
+ * interfaz con la trama recibida, que sigue perteneciendo al anillo de
+ * recepción: no debe liberarse ni conservarse tras retornar.
+ *
+ * Debe devolver '1' si ha consumido la trama, o '0' si la trama debe
+ * seguir entregándose (o encolándose) al receptor de ese tipo.
+ */
+typedef int (* eth_handler_t)
+( eth_iface_t * iface, eth_rx_frame_t * frame, void * arg );
+
 
 /* eth_iface_t * eth_open ( char* ifname );
  *
@@ -32,9 +194,35 @@ typedef struct eth_iface eth_iface_t;
  *   La memoria del manejador de interfaz devuelto debe ser liberada con la
  *   función 'eth_close()'.
  *
+ *   Por defecto las tramas se envían y reciben con la librería 'rawnet'. El
+ *   nombre de la interfaz puede llevar un prefijo "<backend>:" para
+ *   seleccionar otra implementación, sin que cambie el resto de funciones:
+ *     "packet:<ifname>": Socket AF_PACKET propio, que permite enviar y
+ *                        recibir lotes de tramas con una única llamada al
+ *                        sistema.
+ *       "ring:<ifname>": Socket AF_PACKET con anillos TPACKET_V3 de
+ *                        recepción y envío compartidos con el núcleo, sin
+ *                        llamadas al sistema por trama.
+ *                        Ambos admiten la opción ",fanout=<grupo>[:<modo>]"
+ *                        para unirse a un grupo PACKET_FANOUT, en el que
+ *                        el núcleo reparte las tramas recibidas entre
+ *                        varios sockets de la misma interfaz por flujo
+ *                        ("hash", por defecto), por CPU ("cpu"), por
+ *                        turno ("rr") o por cola de la tarjeta ("qm")
+ *                        (ver eth_fanout.h).
+ *   "vwire:<cable>[,<MAC>]": Cable virtual dentro del proceso que conecta
+ *                        todas las interfaces abiertas con el mismo
+ *                        nombre de cable, sin necesidad de tarjeta de red
+ *                        ni de privilegios.
+ *   "pcap:<fichero>[,<opciones>]": Reproduce las tramas de un fichero
+ *                        pcap a su ritmo original, a un número fijo de
+ *                        tramas por segundo o lo más rápido posible, y
+ *                        guarda las tramas enviadas en otro fichero pcap
+ *                        (ver eth_pcap.c).
+ *
  * PARÁMETROS:
  *   'ifname': Cadena de texto con el nombre de la interfaz Ethernet que se
- *             desea inicializar.
+ *             desea inicializar, opcionalmente precedido de "<backend>:".
  *
  * VALOR DEVUELTO:
  *   Manejador de la interfaz Ethernet inicializada.
@@ -86,6 +274,57 @@ char * eth_getname ( eth_iface_t * iface );
 void eth_getaddr ( eth_iface_t * iface, mac_addr_t addr );
 
 
+/* int eth_getmtu ( eth_iface_t * iface );
+ *
+ * DESCRIPCIÓN:
+ *   Esta función devuelve la MTU de la interfaz Ethernet especificada, es
+ *   decir, el tamaño máximo del payload de las tramas que pueden enviarse y
+ *   recibirse por ella.
+ *
+ *   Al abrir la interfaz, la MTU es la configurada en el sistema operativo
+ *   (backends "packet", "ring" y 'rawnet') o 'ETH_MTU' si el backend no
+ *   permite consultarla, limitada siempre a 'ETH_MAX_MTU'.
+ *
+ * PARÁMETROS:
+ *   'iface': Manejador de la interfaz Ethernet.
+ *
+ * VALOR DEVUELTO:
+ *   La MTU de la interfaz en bytes.
+ *
+ * ERRORES:
+ *   La función devuelve '-1' si la interfaz no ha sido inicializada
+ *   correctamente.
+ */
+int eth_getmtu ( eth_iface_t * iface );
+
+
+/* int eth_setmtu ( eth_iface_t * iface, int mtu );
+ *
+ * DESCRIPCIÓN:
+ *   Esta función modifica la MTU con la que la librería usa la interfaz
+ *   Ethernet especificada (por ejemplo, para usar tramas "jumbo"). No
+ *   modifica la MTU configurada en el sistema operativo, que no puede
+ *   superarse si el backend permite consultarla.
+ *
+ *   Las tramas del anillo de recepción se reservan de nuevo con el tamaño
+ *   de la nueva MTU, por lo que no puede haber tramas recibidas prestadas
+ *   con 'eth_recv_frame()' o encoladas en el distribuidor.
+ *
+ * PARÁMETROS:
+ *   'iface': Manejador de la interfaz Ethernet.
+ *     'mtu': Nueva MTU en bytes, entre 'ETH_MIN_MTU' y 'ETH_MAX_MTU'.
+ *
+ * VALOR DEVUELTO:
+ *   Devuelve '0' si se ha modificado la MTU.
+ *
+ * ERRORES:
+ *   La función devuelve '-1' si la MTU no es válida, supera la MTU del
+ *   sistema operativo, hay tramas prestadas o se ha producido algún otro
+ *   error.
+ */
+int eth_setmtu ( eth_iface_t * iface, int mtu );
+
+
 /* int eth_send
  * ( eth_iface_t * iface,
  *   mac_addr_t dst, uint16_t type, unsigned char * data, int data_len );
@@ -94,6 +333,13 @@ void eth_getaddr ( eth_iface_t * iface, mac_addr_t addr );
  *   Esta función permite enviar una trama Ethernet a través de la interfaz
  *   indicada.
  *
+ *   Las funciones de envío ('eth_send()', 'eth_send_pkt()' y
+ *   'eth_send_batch()') pueden llamarse desde varios hilos a la vez sobre la
+ *   misma interfaz, mientras otro hilo recibe por ella: los envíos se
+ *   serializan con un cerrojo de la interfaz, que la recepción no toma
+ *   salvo para capturar las tramas. Las demás funciones de la interfaz
+ *   deben llamarse desde un único hilo.
+ *
  * PARÁMETROS:
  *       'iface': Manejador de la interfaz Ethernet por la que se quiere
  *                enviar el paquete.
@@ -116,6 +362,72 @@ int eth_send
   mac_addr_t dst, uint16_t type, unsigned char * payload, int payload_len );
 
 
+/* int eth_send_pkt
+ * ( eth_iface_t * iface, mac_addr_t dst, uint16_t type, pkt_buf_t * pkt );
+ *
+ * DESCRIPCIÓN:
+ *   Esta función permite enviar una trama Ethernet cuyo payload se encuentra
+ *   en el buffer de paquete indicado. La cabecera Ethernet se antepone en el
+ *   propio buffer, por lo que el payload no se copia.
+ *
+ *   Tras la llamada, el buffer contiene la trama Ethernet completa si se
+ *   ha enviado, o queda como estaba, sin la cabecera, si no.
+ *
+ * PARÁMETROS:
+ *   'iface': Manejador de la interfaz Ethernet por la que se quiere
+ *            enviar el paquete.
+ *            La interfaz debe haber sido inicializada con 'eth_open()'
+ *            previamente.
+ *     'dst': Dirección MAC del equipo destino.
+ *    'type': Valor del campo 'Tipo' de la trama Ethernet a enviar.
+ *     'pkt': Buffer de paquete que contiene el payload de la trama, con al
+ *            menos 'ETH_HEADER_SIZE' bytes libres delante de los datos.
+ *
+ * VALOR DEVUELTO:
+ *   El número de bytes de datos que han podido ser enviados.
+ *
+ * ERRORES:
+ *   La función devuelve '-1' si se ha producido algún error.
+ */
+int eth_send_pkt
+( eth_iface_t * iface, mac_addr_t dst, uint16_t type, pkt_buf_t * pkt );
+
+
+/* int eth_send_batch
+ * ( eth_iface_t * iface, mac_addr_t dst[], uint16_t type,
+ *   pkt_buf_t * pkts[], int num );
+ *
+ * DESCRIPCIÓN:
+ *   Esta función permite enviar un lote de tramas Ethernet a través de la
+ *   interfaz indicada. Si el backend de la interfaz lo permite, todo el lote
+ *   se entrega al núcleo con una única llamada al sistema.
+ *
+ *   Igual que en 'eth_send_pkt()', la cabecera Ethernet de cada trama se
+ *   antepone en su propio buffer de paquete. Los buffers de las tramas que
+ *   no se envían quedan como estaban, sin la cabecera, de modo que el resto
+ *   del lote puede volver a enviarse.
+ *
+ * PARÁMETROS:
+ *   'iface': Manejador de la interfaz Ethernet por la que se quieren enviar
+ *            las tramas.
+ *     'dst': Array con la dirección MAC destino de cada trama.
+ *    'type': Valor del campo 'Tipo' de todas las tramas del lote.
+ *    'pkts': Array con los buffers de paquete de cada trama.
+ *     'num': Número de tramas del lote.
+ *
+ * VALOR DEVUELTO:
+ *   El número de tramas que han podido ser enviadas, que son siempre las
+ *   primeras del lote ('0' si 'num' es '0').
+ *
+ * ERRORES:
+ *   La función devuelve '-1' si se ha producido algún error antes de enviar
+ *   ninguna trama.
+ */
+int eth_send_batch
+( eth_iface_t * iface, mac_addr_t dst[], uint16_t type,
+  pkt_buf_t * pkts[], int num );
+
+
 /* int eth_recv
  * ( eth_iface_t * iface,
  *   mac_addr_t src, uint16_t type, unsigned char buffer[], long int timeout );
@@ -139,7 +451,11 @@ int eth_send
  *             memoria indicada, que debe estar reservada previamente.
  *     'type': Valor del campo 'Tipo' de la trama Ethernet que se desea
  *             recibir.
- *             Las tramas con un valor 'type' diferente serán descartadas.
+ *             Las tramas de otro tipo registrado (ver 'eth_register_type()')
+ *             se pasan a su manejador o se encolan en su cola del
+ *             distribuidor; sólo se descartan las de tipos no registrados
+ *             y las que no caben en una cola llena, y ambas se cuentan en
+ *             las estadísticas de la interfaz.
  *   'buffer': Array donde se almacenarán los datos de la trama recibida.
  *  'buf_len': Longitud del 'buffer' dónde se almacenarán los datos de la trama
  *             recibida. Si se reciben más datos de los que caben el en 'buffer'
@@ -162,6 +478,414 @@ int eth_recv
   int buf_len, long int timeout );
 
 
+/* int eth_recv_frame
+ * ( eth_iface_t * iface, mac_addr_t src, uint16_t type,
+ *   eth_rx_frame_t ** frame, long int timeout );
+ *
+ * DESCRIPCIÓN:
+ *   Esta función permite obtener el siguiente paquete recibido por la
+ *   interfaz Ethernet indicada sin copiar sus datos. La trama se recibe
+ *   directamente en una posición libre del anillo de recepción de la
+ *   interfaz y se devuelve un descriptor que la referencia.
+ *
+ *   La trama prestada debe devolverse con 'eth_frame_release()'.
+ *
+ * PARÁMETROS:
+ *    'iface': Manejador de la interfaz Ethernet por la que se desea recibir
+ *             un paquete.
+ *             La interfaz debe haber sido inicializada con 'eth_open()'
+ *             previamente.
+ *      'src': Dirección MAC del equipo que envió la trama Ethernet recibida.
+ *             Este es un parámetro de salida.
+ *     'type': Valor del campo 'Tipo' de la trama Ethernet que se desea
+ *             recibir.
+ *             Las tramas de otro tipo registrado (ver 'eth_register_type()')
+ *             se pasan a su manejador o se encolan en su cola del
+ *             distribuidor; sólo se descartan las de tipos no registrados
+ *             y las que no caben en una cola llena, y ambas se cuentan en
+ *             las estadísticas de la interfaz.
+ *    'frame': Parámetro de salida donde se devuelve el descriptor de la trama
+ *             recibida. Su 'payload_offset' y 'payload_len' indican el payload
+ *             de la trama Ethernet.
+ *  'timeout': Tiempo en milisegundos que debe esperarse a recibir una trama
+ *             antes de retornar, con la misma semántica que en 'eth_recv()'.
+ *
+ * VALOR DEVUELTO:
+ *   La longitud en bytes de los datos de la trama recibida, o '0' si no se
+ *   ha recibido ninguna trama porque ha expirado el temporizador.
+ *
+ * ERRORES:
+ *   La función devuelve '-1' si se ha producido algún error, incluyendo que
+ *   todas las tramas del anillo de recepción estén prestadas.
+ */
+int eth_recv_frame
+( eth_iface_t * iface, mac_addr_t src, uint16_t type,
+  eth_rx_frame_t ** frame, long int timeout );
+
+
+/* int eth_recv_batch
+ * ( eth_iface_t * iface, uint16_t type,
+ *   eth_rx_frame_t * frames[], int max_frames, long int timeout );
+ *
+ * DESCRIPCIÓN:
+ *   Esta función permite obtener de una vez todas las tramas pendientes de
+ *   la interfaz Ethernet indicada, hasta un máximo de 'max_frames'. Si el
+ *   backend de la interfaz lo permite, el lote se lee del núcleo con una
+ *   única llamada al sistema.
+ *
+ *   Igual que con 'eth_recv_frame()', las tramas se prestan del anillo de
+ *   recepción y deben liberarse una a una con 'eth_frame_release()'. La
+ *   dirección MAC origen de cada trama se encuentra en su cabecera
+ *   Ethernet, en 'frame + l2_offset + MAC_ADDR_SIZE'.
+ *
+ * PARÁMETROS:
+ *        'iface': Manejador de la interfaz Ethernet por la que se desea
+ *                 recibir.
+ *         'type': Valor del campo 'Tipo' de las tramas que se desean recibir.
+ *                 Las tramas de otros tipos se tratan como en 'eth_recv()'.
+ *       'frames': Array donde se devuelven los descriptores de las tramas
+ *                 recibidas.
+ *   'max_frames': Número máximo de tramas a recibir.
+ *      'timeout': Tiempo en milisegundos que debe esperarse a recibir la
+ *                 primera trama, con la misma semántica que en 'eth_recv()'.
+ *
+ * VALOR DEVUELTO:
+ *   El número de tramas recibidas, o '0' si ha expirado el temporizador.
+ *
+ * ERRORES:
+ *   La función devuelve '-1' si se ha producido algún error.
+ */
+int eth_recv_batch
+( eth_iface_t * iface, uint16_t type,
+  eth_rx_frame_t * frames[], int max_frames, long int timeout );
+
+
+/* void eth_frame_release ( eth_iface_t * iface, eth_rx_frame_t * frame );
+ *
+ * DESCRIPCIÓN:
+ *   Esta función devuelve al anillo de recepción de la interfaz una trama
+ *   obtenida con 'eth_recv_frame()'. Tras la llamada no debe accederse a los
+ *   datos de la trama.
+ *
+ * PARÁMETROS:
+ *   'iface': Manejador de la interfaz Ethernet por la que se recibió la
+ *            trama.
+ *   'frame': Descriptor de la trama que se desea liberar.
+ */
+void eth_frame_release ( eth_iface_t * iface, eth_rx_frame_t * frame );
+
+
+/* int eth_register_type
+ * ( eth_iface_t * iface, uint16_t type, eth_handler_t handler, void * arg );
+ *
+ * DESCRIPCIÓN:
+ *   Esta función registra un tipo de trama en el distribuidor de recepción
+ *   de la interfaz. Cada vez que cualquier función de recepción lea de la
+ *   interfaz una trama de un tipo registrado distinto del que está
+ *   esperando, la trama se encola (hasta 'ETH_DISPATCH_QUEUE_LEN' tramas)
+ *   en lugar de descartarse, y la siguiente llamada a 'eth_recv()' o
+ *   'eth_recv_frame()' con ese tipo la obtiene sin leer de la interfaz.
+ *
+ *   Si se indica una función manejadora, se invoca con cada trama de ese
+ *   tipo antes de encolarla o entregarla.
+ *
+ *   'eth_recv()' y 'eth_recv_frame()' registran automáticamente (sin
+ *   manejador) el tipo que reciben, así que los protocolos que esperan
+ *   tramas quedan registrados desde su primera recepción. Registrar un tipo
+ *   ya registrado sólo cambia su manejador.
+ *
+ * PARÁMETROS:
+ *     'iface': Manejador de la interfaz Ethernet.
+ *      'type': Valor del campo 'Tipo' de las tramas que se desea registrar.
+ *   'handler': Función manejadora de las tramas de ese tipo, o 'NULL'.
+ *       'arg': Argumento que se pasará a la función manejadora.
+ *
+ * VALOR DEVUELTO:
+ *   Devuelve '0' si el tipo se ha registrado.
+ *
+ * ERRORES:
+ *   La función devuelve '-1' si ya hay 'ETH_DISPATCH_TYPES' tipos
+ *   registrados.
+ */
+int eth_register_type
+( eth_iface_t * iface, uint16_t type, eth_handler_t handler, void * arg );
+
+
+/* int eth_unregister_type ( eth_iface_t * iface, uint16_t type );
+ *
+ * DESCRIPCIÓN:
+ *   Esta función elimina un tipo de trama del distribuidor de recepción,
+ *   descartando las tramas que tuviera encoladas.
+ *
+ * PARÁMETROS:
+ *   'iface': Manejador de la interfaz Ethernet.
+ *    'type': Valor del campo 'Tipo' que se desea eliminar.
+ *
+ * VALOR DEVUELTO:
+ *   Devuelve '0' si el tipo se ha eliminado, o '-1' si no estaba registrado.
+ */
+int eth_unregister_type ( eth_iface_t * iface, uint16_t type );
+
+
+/* int eth_dispatch ( eth_iface_t * iface, long int timeout );
+ *
+ * DESCRIPCIÓN:
+ *   Esta función lee de la interfaz todas las tramas pendientes (esperando
+ *   como máximo 'timeout' milisegundos a la primera) y las reparte entre los
+ *   manejadores y colas de los tipos registrados, sin entregar ninguna al
+ *   llamante.
+ *
+ * PARÁMETROS:
+ *     'iface': Manejador de la interfaz Ethernet.
+ *   'timeout': Tiempo máximo de espera, con la misma semántica que en
+ *              'eth_recv()'.
+ *
+ * VALOR DEVUELTO:
+ *   El número de tramas leídas, o '0' si ha expirado el temporizador.
+ *
+ * ERRORES:
+ *   La función devuelve '-1' si se ha producido algún error.
+ */
+int eth_dispatch ( eth_iface_t * iface, long int timeout );
+
+
+/* void eth_get_stats ( eth_iface_t * iface, eth_stats_t * stats );
+ *
+ * DESCRIPCIÓN:
+ *   Esta función copia en 'stats' las estadísticas de recepción de la
+ *   interfaz indicada.
+ */
+void eth_get_stats ( eth_iface_t * iface, eth_stats_t * stats );
+
+
+/* int eth_set_busy_poll ( eth_iface_t * iface, long int budget );
+ *
+ * DESCRIPCIÓN:
+ *   Esta función activa el modo de sondeo activo ("busy-poll") en la
+ *   recepción de la interfaz indicada. Antes de bloquearse esperando una
+ *   trama, las funciones de recepción leen de la interfaz sin esperar
+ *   repetidamente durante, como mucho, el presupuesto actual. Así se evita
+ *   la latencia de dormir y despertar al hilo cuando las tramas llegan
+ *   poco después de empezar a esperar, a cambio de ocupar la CPU.
+ *
+ *   El presupuesto se adapta al tráfico reciente: se duplica (hasta
+ *   'budget') cada vez que llega una trama durante el sondeo y se reduce a
+ *   la mitad (hasta 'ETH_BUSY_POLL_MIN', o 'budget' si es menor) cada vez
+ *   que se agota sin que llegue ninguna. Las lecturas, aciertos, esperas bloqueantes y el
+ *   presupuesto actual se consultan con 'eth_get_stats()'.
+ *
+ *   El tiempo de sondeo forma parte del 'timeout' de cada función de
+ *   recepción, cuya semántica no cambia. Con 'timeout' igual a '0' no se
+ *   sondea.
+ *
+ * PARÁMETROS:
+ *    'iface': Manejador de la interfaz Ethernet.
+ *   'budget': Presupuesto máximo del sondeo en microsegundos, o '0' para
+ *             desactivarlo (modo por defecto).
+ *
+ * VALOR DEVUELTO:
+ *   Devuelve '0' si se ha cambiado el modo de recepción.
+ *
+ * ERRORES:
+ *   La función devuelve '-1' si la interfaz no es válida o el presupuesto
+ *   es negativo.
+ */
+int eth_set_busy_poll ( eth_iface_t * iface, long int budget );
+
+
+/* uint64_t eth_tstamp_now ( void );
+ *
+ * DESCRIPCIÓN:
+ *   Esta función devuelve el instante actual en el reloj de las marcas de
+ *   tiempo de las tramas ('eth_meta_t'), en nanosegundos.
+ */
+uint64_t eth_tstamp_now ( void );
+
+
+/* int eth_set_tx_tstamps ( eth_iface_t * iface, int enable );
+ *
+ * DESCRIPCIÓN:
+ *   Esta función activa o desactiva las marcas de tiempo de transmisión del
+ *   núcleo en la interfaz indicada. Con ellas activadas, el núcleo anota el
+ *   instante en que cada trama enviada sale hacia la tarjeta y
+ *   'eth_get_tx_tstamp()' lo devuelve.
+ *
+ *   Las marcas se acumulan en el socket hasta que se consultan, por lo que
+ *   debe llamarse a 'eth_get_tx_tstamp()' tras cada envío mientras estén
+ *   activadas.
+ *
+ * PARÁMETROS:
+ *    'iface': Manejador de la interfaz Ethernet.
+ *   'enable': '1' para activar las marcas o '0' para desactivarlas.
+ *
+ * VALOR DEVUELTO:
+ *   Devuelve '0' si se ha cambiado la configuración.
+ *
+ * ERRORES:
+ *   La función devuelve '-1' si el backend de la interfaz no proporciona
+ *   marcas de tiempo de transmisión (sólo lo hace "packet") o se ha
+ *   producido algún error. Las marcas de la pila de 'eth_get_tx_tstamp()'
+ *   siguen disponibles.
+ */
+int eth_set_tx_tstamps ( eth_iface_t * iface, int enable );
+
+
+/* int eth_get_tx_tstamp ( eth_iface_t * iface, uint64_t * tstamp );
+ *
+ * DESCRIPCIÓN:
+ *   Esta función devuelve en 'tstamp' el instante en que se completó el
+ *   envío de la última trama enviada por la interfaz: la marca del núcleo si
+ *   están activadas con 'eth_set_tx_tstamps()' y ya está disponible, o si
+ *   no la marca de la pila tomada cuando el backend terminó de enviarla.
+ *
+ * PARÁMETROS:
+ *    'iface': Manejador de la interfaz Ethernet.
+ *   'tstamp': Parámetro de salida con la marca de tiempo, en el mismo reloj
+ *             que 'eth_tstamp_now()'.
+ *
+ * VALOR DEVUELTO:
+ *   El origen de la marca ('ETH_TSTAMP_KERNEL' o 'ETH_TSTAMP_STACK'), o
+ *   'ETH_TSTAMP_NONE' si todavía no se ha enviado ninguna trama.
+ *
+ * ERRORES:
+ *   La función devuelve '-1' si se ha producido algún error.
+ */
+int eth_get_tx_tstamp ( eth_iface_t * iface, uint64_t * tstamp );
+
+
+/* int eth_filter_add
+ * ( eth_iface_t * iface, uint16_t type,
+ *   eth_filter_cond_t conds[], int num_conds );
+ *
+ * DESCRIPCIÓN:
+ *   Esta función añade una regla al filtro de recepción de la interfaz. La
+ *   regla acepta las tramas del tipo indicado que cumplan todas las
+ *   condiciones de 'conds'.
+ *
+ *   Mientras la interfaz tenga alguna regla, sólo se reciben las tramas
+ *   dirigidas a su dirección MAC (o a la de difusión) que cumplan alguna de
+ *   ellas. Si el backend lo permite, el filtro se compila a un programa BPF
+ *   que se instala en el socket, de modo que el resto de tramas se
+ *   descartan en el núcleo sin llegar a copiarse. El programa se regenera
+ *   cada vez que se añade o elimina una regla. Sin reglas se reciben todas
+ *   las tramas.
+ *
+ * PARÁMETROS:
+ *       'iface': Manejador de la interfaz Ethernet.
+ *        'type': Valor del campo 'Tipo' de las tramas aceptadas.
+ *       'conds': Condiciones adicionales que deben cumplir las tramas.
+ *   'num_conds': Número de condiciones (como máximo
+ *                'ETH_FILTER_MAX_CONDS').
+ *
+ * VALOR DEVUELTO:
+ *   El identificador de la regla, necesario para eliminarla con
+ *   'eth_filter_remove()'.
+ *
+ * ERRORES:
+ *   La función devuelve '-1' si la regla no es válida o si ya hay
+ *   'ETH_FILTER_MAX_RULES' reglas.
+ */
+int eth_filter_add
+( eth_iface_t * iface, uint16_t type,
+  eth_filter_cond_t conds[], int num_conds );
+
+
+/* int eth_filter_remove ( eth_iface_t * iface, int rule_id );
+ *
+ * DESCRIPCIÓN:
+ *   Esta función elimina una regla del filtro de recepción de la interfaz y
+ *   actualiza el programa BPF instalado en el socket.
+ *
+ * PARÁMETROS:
+ *     'iface': Manejador de la interfaz Ethernet.
+ *   'rule_id': Identificador devuelto por 'eth_filter_add()'.
+ *
+ * VALOR DEVUELTO:
+ *   Devuelve '0' si la regla se ha eliminado.
+ *
+ * ERRORES:
+ *   La función devuelve '-1' si la regla no existe.
+ */
+int eth_filter_remove ( eth_iface_t * iface, int rule_id );
+
+
+/* int eth_capture_start
+ * ( eth_iface_t * iface, char * filename, int snaplen, long int rotate_size );
+ *
+ * DESCRIPCIÓN:
+ *   Esta función inicia la captura en formato pcapng de todas las tramas
+ *   enviadas y recibidas por la interfaz, con marcas de tiempo en
+ *   nanosegundos.
+ *
+ *   Las tramas se copian a un anillo en memoria que un hilo aparte vuelca al
+ *   fichero, por lo que la captura nunca bloquea el envío ni la recepción:
+ *   si el hilo no da abasto las tramas se descartan y se contabilizan en el
+ *   campo 'capture_dropped' de 'eth_get_stats()'.
+ *
+ * PARÁMETROS:
+ *         'iface': Manejador de la interfaz Ethernet.
+ *      'filename': Nombre del fichero pcapng.
+ *       'snaplen': Número máximo de bytes que se guardan de cada trama, o
+ *                  '0' para guardarlas completas.
+ *   'rotate_size': Tamaño en bytes a partir del cual se continúa en el
+ *                  fichero "<filename>.1", "<filename>.2", etc., o '0' para
+ *                  no rotar.
+ *
+ * VALOR DEVUELTO:
+ *   Devuelve '0' si la captura se ha iniciado.
+ *
+ * ERRORES:
+ *   La función devuelve '-1' si ya había una captura en curso o si no ha
+ *   podido abrirse el fichero.
+ */
+int eth_capture_start
+( eth_iface_t * iface, char * filename, int snaplen, long int rotate_size );
+
+
+/* int eth_capture_stop ( eth_iface_t * iface );
+ *
+ * DESCRIPCIÓN:
+ *   Esta función termina la captura de la interfaz, esperando a que se
+ *   escriban en el fichero todas las tramas capturadas. 'eth_close()' la
+ *   invoca automáticamente.
+ *
+ * PARÁMETROS:
+ *   'iface': Manejador de la interfaz Ethernet.
+ *
+ * VALOR DEVUELTO:
+ *   Devuelve '0' si la captura ha terminado correctamente.
+ *
+ * ERRORES:
+ *   La función devuelve '-1' si no había captura en curso o si se ha
+ *   producido algún error al escribir el fichero.
+ */
+int eth_capture_stop ( eth_iface_t * iface );
+
+
+/* int eth_getfd ( eth_iface_t * iface );
+ *
+ * DESCRIPCIÓN:
+ *   Esta función devuelve el descriptor de fichero de la interfaz, que
+ *   puede esperarse con poll() o epoll() para saber si hay tramas
+ *   pendientes de leer (por ejemplo, desde un reactor que sirve varias
+ *   interfaces en un único hilo).
+ *
+ *   Las tramas que ya estén encoladas en el distribuidor de recepción no
+ *   señalan el descriptor.
+ *
+ * PARÁMETROS:
+ *   'iface': Manejador de la interfaz Ethernet.
+ *
+ * VALOR DEVUELTO:
+ *   El descriptor de fichero de la interfaz.
+ *
+ * ERRORES:
+ *   La función devuelve '-1' si el backend de la interfaz no tiene un
+ *   descriptor que pueda esperarse (como 'rawnet').
+ */
+int eth_getfd ( eth_iface_t * iface );
+
+
 /* int eth_poll
  * ( eth_iface_t * ifaces[], int ifnum, long int timeout );
  *
@@ -186,7 +910,10 @@ int eth_recv
  *
  * VALOR DEVUELTO:
  *   El índice del primer interfaz [0, ifnum-1] que tiene una trama lista para
- *   ser recibida o '-2' si ha expirado el temporizador.
+ *   ser recibida o '-2' si ha expirado el temporizador. Como siempre se
+ *   devuelve la primera, una interfaz muy cargada puede acaparar las
+ *   llamadas; para atender varias interfaces con equidad utilice
+ *   'eth_poll_batch()'.
  *
  * ERRORES:
  *   La función devuelve '-1' si se ha producido algún error.
@@ -195,6 +922,45 @@ int eth_poll
 ( eth_iface_t * ifaces[], int ifnum, long int timeout );
 
 
+/* int eth_poll_batch
+ * ( eth_poll_entry_t entries[], int num, int budget, long int timeout );
+ *
+ * DESCRIPCIÓN:
+ *   Esta función espera a que alguna de las interfaces indicadas tenga
+ *   tramas y, a diferencia de 'eth_poll()', atiende todas las que estén
+ *   listas: marca cada una en su campo 'ready' y reparte sus tramas
+ *   pendientes, como 'eth_dispatch()', hasta 'budget' * 'weight' tramas por
+ *   interfaz. Las tramas que excedan el presupuesto quedan para la
+ *   siguiente llamada, que no espera.
+ *
+ *   Las interfaces listas se atienden por turno rotatorio: cada llamada
+ *   empieza por la siguiente a la que empezó la anterior. Así una interfaz
+ *   muy cargada nunca retrasa a las demás más de su presupuesto, y el peso
+ *   permite dar más capacidad a los enlaces que la necesiten.
+ *
+ * PARÁMETROS:
+ *   'entries': Array con las interfaces a atender y sus pesos. Los campos
+ *              'ready' y 'frames' son parámetros de salida.
+ *       'num': Número de interfaces de 'entries'.
+ *    'budget': Número máximo de tramas que se reparten de cada interfaz de
+ *              peso '1' en una llamada.
+ *   'timeout': Tiempo en milisegundos que debe esperarse a que alguna
+ *              interfaz tenga tramas. Un número negativo indicará que debe
+ *              esperarse indefinidamente.
+ *
+ * VALOR DEVUELTO:
+ *   El número de interfaces que estaban listas, o '0' si ha expirado el
+ *   temporizador.
+ *
+ * ERRORES:
+ *   La función devuelve '-1' si los parámetros no son válidos, si se mezclan
+ *   interfaces 'rawnet' con otros backends o si se ha producido algún otro
+ *   error.
+ */
+int eth_poll_batch
+( eth_poll_entry_t entries[], int num, int budget, long int timeout );
+
+
 /* int eth_close ( eth_iface_t * iface );
  *
  * DESCRIPCIÓN:
@@ -245,6 +1011,78 @@ void mac_addr_str ( mac_addr_t addr, char str[] );
 int mac_str_addr ( char* str, mac_addr_t addr );
 
 
+/* void pkt_buf_init ( pkt_buf_t * pkt );
+ *
+ * DESCRIPCIÓN:
+ *   Esta función inicializa un buffer de paquete vacío, reservando
+ *   'PKT_BUF_HEADROOM' bytes al principio para las cabeceras.
+ *
+ * PARÁMETROS:
+ *   'pkt': Buffer de paquete que se desea inicializar.
+ */
+void pkt_buf_init ( pkt_buf_t * pkt );
+
+
+/* unsigned char * pkt_buf_put ( pkt_buf_t * pkt, int len );
+ *
+ * DESCRIPCIÓN:
+ *   Esta función añade 'len' bytes al final de los datos del buffer de
+ *   paquete y devuelve un puntero a ellos para que sean rellenados.
+ *
+ * PARÁMETROS:
+ *   'pkt': Buffer de paquete.
+ *   'len': Número de bytes a añadir al final de los datos.
+ *
+ * VALOR DEVUELTO:
+ *   Puntero al comienzo de los bytes añadidos.
+ *
+ * ERRORES:
+ *   La función devuelve 'NULL' si no hay espacio suficiente al final del
+ *   buffer.
+ */
+unsigned char * pkt_buf_put ( pkt_buf_t * pkt, int len );
+
+
+/* unsigned char * pkt_buf_push ( pkt_buf_t * pkt, int len );
+ *
+ * DESCRIPCIÓN:
+ *   Esta función antepone 'len' bytes a los datos del buffer de paquete,
+ *   utilizando el espacio reservado al principio del mismo, y devuelve un
+ *   puntero a ellos para que se rellene la cabecera correspondiente.
+ *
+ * PARÁMETROS:
+ *   'pkt': Buffer de paquete.
+ *   'len': Longitud en bytes de la cabecera a anteponer.
+ *
+ * VALOR DEVUELTO:
+ *   Puntero al nuevo comienzo de los datos del paquete.
+ *
+ * ERRORES:
+ *   La función devuelve 'NULL' si no queda espacio suficiente al principio
+ *   del buffer.
+ */
+unsigned char * pkt_buf_push ( pkt_buf_t * pkt, int len );
+
+
+/* unsigned char * pkt_buf_pull ( pkt_buf_t * pkt, int len );
+ *
+ * DESCRIPCIÓN:
+ *   Esta función quita los 'len' primeros bytes de los datos del buffer de
+ *   paquete, deshaciendo un 'pkt_buf_push()' de la misma longitud.
+ *
+ * PARÁMETROS:
+ *   'pkt': Buffer de paquete.
+ *   'len': Longitud en bytes de la cabecera a quitar.
+ *
+ * VALOR DEVUELTO:
+ *   Puntero al nuevo comienzo de los datos del paquete.
+ *
+ * ERRORES:
+ *   La función devuelve 'NULL' si los datos tienen menos de 'len' bytes.
+ */
+unsigned char * pkt_buf_pull ( pkt_buf_t * pkt, int len );
+
+
 /* void print_pkt ( unsigned char * packet, int pkt_len, int hdr_len );
  *
  * DESCRIPCIÓN:
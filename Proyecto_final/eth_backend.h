@@ -0,0 +1,109 @@
+#ifndef _ETH_BACKEND_H
+#define _ETH_BACKEND_H
+
+#include "eth.h"
+
+#include <linux/filter.h>
+
+/* Interfaz interna entre 'eth.c' y las implementaciones ("backends") que
+ * envían y reciben las tramas de un 'eth_iface_t'.
+ *
+ * Las capas superiores nunca usan este fichero: el backend se elige en
+ * 'eth_open()' mediante un prefijo en el nombre de la interfaz
+ * ("<backend>:<ifname>"), y el resto de funciones 'eth_*()' se comportan
+ * igual sea cual sea el backend.
+ *
+ * Todas las operaciones reciben el puntero 'priv' devuelto por 'open()'.
+ * Las operaciones imprimen por la salida de error la causa de los errores
+ * que detecten y devuelven '-1'.
+ */
+typedef struct eth_backend {
+
+  /* Prefijo del nombre de interfaz que selecciona este backend */
+  char * name;
+
+  /* Abre la interfaz 'ifname' y copia su dirección MAC en 'addr'. Devuelve
+     el estado privado del backend o 'NULL' si se ha producido un error. */
+  void * (*open) ( char * ifname, mac_addr_t addr );
+
+  /* Envía una trama completa. Devuelve los bytes enviados. */
+  int (*send) ( void * priv, unsigned char * frame, int frame_len );
+
+  /* Envía 'num' tramas completas con una única llamada al sistema.
+     Devuelve el número de tramas enviadas. Puede ser 'NULL' si el backend
+     no permite envíos por lotes. */
+  int (*send_batch) ( void * priv, unsigned char * frames[],
+                      int frame_lens[], int num );
+
+  /* Recibe una trama en 'buffer'. Devuelve su longitud, o '0' si ha
+     expirado el temporizador ('timeout' como en 'eth_recv()'). */
+  int (*recv) ( void * priv, unsigned char buffer[], int buf_len,
+                long int timeout );
+
+  /* Recibe hasta 'num' tramas en 'buffers' con una única llamada al
+     sistema, esperando como máximo 'timeout' a que llegue la primera.
+     Devuelve el número de buffers utilizados y las longitudes de sus tramas
+     en 'frame_lens' (una longitud '0' indica una trama descartada por el
+     backend), o '0' si ha expirado el temporizador. En 'tstamps' devuelve
+     el instante de llegada de cada trama (con el reloj de
+     'eth_tstamp_now()'), o '0' si el backend no lo conoce. Puede ser 'NULL'
+     si el backend no permite recepciones por lotes. */
+  int (*recv_batch) ( void * priv, unsigned char * buffers[], int buf_len,
+                      int frame_lens[], uint64_t tstamps[], int num,
+                      long int timeout );
+
+  /* Devuelve el descriptor de fichero que puede esperarse con poll() para
+     saber si hay tramas pendientes, o '-1' si el backend no lo tiene. */
+  int (*getfd) ( void * priv );
+
+  /* Devuelve la MTU de la interfaz configurada en el sistema operativo, o
+     '-1' si no ha podido consultarse. Puede ser 'NULL' si el backend no
+     tiene una MTU propia (se usa 'ETH_MTU'). */
+  int (*getmtu) ( void * priv );
+
+  /* Instala en el socket el programa BPF 'insns' de 'num' instrucciones,
+     sustituyendo al anterior, o elimina el filtro si 'num' es '0'. Puede
+     ser 'NULL' si el backend no permite filtros en el núcleo. */
+  int (*set_filter) ( void * priv, struct sock_filter insns[], int num );
+
+  /* Activa ('enable' igual a '1') o desactiva las marcas de tiempo de
+     transmisión del núcleo. Puede ser 'NULL' si el backend no las
+     proporciona. */
+  int (*set_tx_tstamps) ( void * priv, int enable );
+
+  /* Lee sin esperar las marcas de tiempo de transmisión pendientes y
+     devuelve en 'tstamp' la más reciente y en 'id' el número de orden de su
+     trama (contando desde '0' las enviadas desde que se activaron). Devuelve
+     '1' si había alguna marca pendiente o '0' si no. Puede ser 'NULL' si el
+     backend no las proporciona. */
+  int (*tx_tstamp) ( void * priv, uint64_t * tstamp, uint32_t * id );
+
+  /* Cierra la interfaz y libera el estado privado del backend. */
+  int (*close) ( void * priv );
+
+} eth_backend_t;
+
+
+/* Backend por defecto, basado en la librería 'rawnet' (eth.c) */
+extern eth_backend_t ETH_BACKEND_RAWNET;
+
+/* Backend basado en un socket AF_PACKET propio, con envíos y recepciones
+   por lotes mediante sendmmsg()/recvmmsg() (eth_packet.c).
+   Prefijo: "packet:<ifname>[,fanout=<grupo>[:<modo>]]" */
+extern eth_backend_t ETH_BACKEND_PACKET;
+
+/* Backend basado en anillos TPACKET_V3 de recepción y envío proyectados en
+   memoria con mmap() (eth_packet.c).
+   Prefijo: "ring:<ifname>[,fanout=<grupo>[:<modo>]]" */
+extern eth_backend_t ETH_BACKEND_RING;
+
+/* Cable virtual dentro del proceso que conecta interfaces mediante anillos
+   sin cerrojos (eth_vwire.c). Prefijo: "vwire:<cable>[,<MAC>]" */
+extern eth_backend_t ETH_BACKEND_VWIRE;
+
+/* Reproducción de un fichero pcap como tramas recibidas (eth_pcap.c).
+   Prefijo: "pcap:<fichero>[,rate=orig|max|<pps>][,loop=<n>][,tx=<fichero>]
+   [,mac=<MAC>]" */
+extern eth_backend_t ETH_BACKEND_PCAP;
+
+#endif /* _ETH_BACKEND_H */
@@ -0,0 +1,359 @@
+#define _GNU_SOURCE /* memfd_create() */
+
+#include "eth_capture.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/mman.h>
+
+/* Tamaño del anillo de captura (múltiplo del tamaño de página) */
+#define ETH_CAPTURE_RING_SIZE (4 * 1024 * 1024)
+
+/* Tiempo que espera el hilo escritor cuando el anillo está vacío (ms) */
+#define ETH_CAPTURE_IDLE_MS 1
+
+/* Tipos de bloque pcapng */
+#define PCAPNG_SHB 0x0A0D0D0A /* Section Header Block */
+#define PCAPNG_IDB 0x00000001 /* Interface Description Block */
+#define PCAPNG_EPB 0x00000006 /* Enhanced Packet Block */
+#define PCAPNG_BYTE_ORDER_MAGIC 0x1A2B3C4D
+#define PCAPNG_LINKTYPE_ETHERNET 1
+#define PCAPNG_OPT_IF_TSRESOL 9
+
+/* Cabecera de un "Enhanced Packet Block". Le siguen los bytes de la trama,
+   rellenos hasta múltiplo de 4, y la longitud total del bloque. */
+struct pcapng_epb {
+  uint32_t block_type;
+  uint32_t block_len;
+  uint32_t interface_id;
+  uint32_t ts_high;
+  uint32_t ts_low;
+  uint32_t captured_len;
+  uint32_t original_len;
+};
+
+/* Estado de una captura */
+struct eth_capture {
+  char * filename;        /* Nombre del primer fichero */
+  int snaplen;            /* Bytes guardados de cada trama */
+  long int rotate_size;   /* Tamaño de rotación, o '0' */
+  int fd;                 /* Fichero actual */
+  long int file_size;     /* Bytes escritos en el fichero actual */
+  int file_num;           /* Número del fichero actual (0 = 'filename') */
+  int error;              /* Se ha producido un error de escritura */
+
+  /* Anillo proyectado dos veces: 'ring[i]' y 'ring[i + RING_SIZE]' son el
+     mismo byte */
+  unsigned char * ring;
+  uint64_t head;          /* Bytes escritos por el camino de datos */
+  uint64_t tail;          /* Bytes escritos al fichero por el hilo */
+
+  /* Contadores del camino de datos, que se leen desde cualquier hilo con
+     'eth_capture_stats()' */
+  long int captured;      /* Tramas copiadas al anillo */
+  long int dropped;       /* Tramas descartadas por anillo lleno */
+
+  pthread_t writer;       /* Hilo escritor */
+  int stop;               /* Indica al hilo escritor que termine */
+};
+
+
+/* Proyecta el anillo de captura dos veces consecutivas sobre el mismo
+   fichero anónimo. Devuelve la dirección del anillo o 'NULL'. */
+static unsigned char * eth_capture_ring_map ( void )
+{
+  int fd = memfd_create("eth_capture", 0);
+  if (fd == -1) {
+    fprintf(stderr, "eth_capture: ERROR en memfd_create(): %s\n",
+            strerror(errno));
+    return NULL;
+  }
+  if (ftruncate(fd, ETH_CAPTURE_RING_SIZE) == -1) {
+    fprintf(stderr, "eth_capture: ERROR en ftruncate(): %s\n",
+            strerror(errno));
+    close(fd);
+    return NULL;
+  }
+
+  /* Reservar el doble de espacio y proyectar el fichero en cada mitad */
+  unsigned char * ring = mmap(NULL, 2 * ETH_CAPTURE_RING_SIZE, PROT_NONE,
+                              MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (ring == MAP_FAILED) {
+    fprintf(stderr, "eth_capture: ERROR en mmap(): %s\n", strerror(errno));
+    close(fd);
+    return NULL;
+  }
+  int i;
+  for (i=0; i<2; i++) {
+    void * half = mmap(ring + i * ETH_CAPTURE_RING_SIZE, ETH_CAPTURE_RING_SIZE,
+                       PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0);
+    if (half == MAP_FAILED) {
+      fprintf(stderr, "eth_capture: ERROR en mmap(): %s\n", strerror(errno));
+      munmap(ring, 2 * ETH_CAPTURE_RING_SIZE);
+      close(fd);
+      return NULL;
+    }
+  }
+  close(fd);
+
+  return ring;
+}
+
+
+/* Escribe 'len' bytes en el fichero actual */
+static int eth_capture_write ( eth_capture_t * capture, void * data, int len )
+{
+  unsigned char * bytes = data;
+  while (len > 0) {
+    ssize_t written = write(capture->fd, bytes, len);
+    if (written == -1) {
+      if (errno == EINTR) {
+        continue;
+      }
+      fprintf(stderr, "eth_capture: ERROR en write(): %s\n", strerror(errno));
+      capture->error = 1;
+      return -1;
+    }
+    bytes += written;
+    len -= written;
+    capture->file_size += written;
+  }
+
+  return 0;
+}
+
+
+/* Abre el siguiente fichero de la captura y escribe las cabeceras pcapng de
+   sección y de interfaz */
+static int eth_capture_file_open ( eth_capture_t * capture )
+{
+  char filename[strlen(capture->filename) + 16];
+  if (capture->file_num == 0) {
+    strcpy(filename, capture->filename);
+  } else {
+    sprintf(filename, "%s.%d", capture->filename, capture->file_num);
+  }
+
+  capture->fd = open(filename, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (capture->fd == -1) {
+    fprintf(stderr, "eth_capture: ERROR en open(%s): %s\n",
+            filename, strerror(errno));
+    capture->error = 1;
+    return -1;
+  }
+  capture->file_size = 0;
+
+  /* Section Header Block, versión 1.0 y longitud de sección desconocida */
+  uint32_t shb[7] = { PCAPNG_SHB, 28, PCAPNG_BYTE_ORDER_MAGIC, 0x00000001,
+                      0xFFFFFFFF, 0xFFFFFFFF, 28 };
+
+  /* Interface Description Block con marcas de tiempo en nanosegundos */
+  uint32_t idb[8] = { PCAPNG_IDB, 32, 0, capture->snaplen, 0, 0, 0, 32 };
+  uint16_t * linktype = (uint16_t *) &idb[2];
+  linktype[0] = PCAPNG_LINKTYPE_ETHERNET;
+  uint16_t * tsresol = (uint16_t *) &idb[4];
+  tsresol[0] = PCAPNG_OPT_IF_TSRESOL;
+  tsresol[1] = 1;
+  ((unsigned char *) &idb[5])[0] = 9; /* 10^-9 s */
+
+  if ((eth_capture_write(capture, shb, sizeof(shb)) == -1) ||
+      (eth_capture_write(capture, idb, sizeof(idb)) == -1)) {
+    return -1;
+  }
+
+  return 0;
+}
+
+
+/* Hilo escritor: vuelca al fichero los bloques del anillo y rota el fichero
+   cuando supera el tamaño indicado */
+static void * eth_capture_writer ( void * arg )
+{
+  eth_capture_t * capture = arg;
+
+  while (1) {
+    uint64_t head = __atomic_load_n(&capture->head, __ATOMIC_ACQUIRE);
+    uint64_t tail = capture->tail;
+
+    if (head == tail) {
+      if (__atomic_load_n(&capture->stop, __ATOMIC_ACQUIRE)) {
+        break;
+      }
+      struct timespec idle = { 0, ETH_CAPTURE_IDLE_MS * 1000000L };
+      nanosleep(&idle, NULL);
+      continue;
+    }
+
+    /* Escribir bloque a bloque para poder rotar entre dos bloques */
+    unsigned char * block = capture->ring + (tail % ETH_CAPTURE_RING_SIZE);
+    int len = (int) (head - tail);
+    if (capture->rotate_size > 0) {
+      len = ((struct pcapng_epb *) block)->block_len;
+    }
+    if ( ! capture->error ) {
+      eth_capture_write(capture, block, len);
+    }
+    __atomic_store_n(&capture->tail, tail + len, __ATOMIC_RELEASE);
+
+    if ((capture->rotate_size > 0) && ( ! capture->error ) &&
+        (capture->file_size >= capture->rotate_size)) {
+      close(capture->fd);
+      capture->file_num++;
+      eth_capture_file_open(capture);
+    }
+  }
+
+  return NULL;
+}
+
+
+/* eth_capture_t * eth_capture_open
+ * ( char * filename, int snaplen, long int rotate_size );
+ *
+ * DESCRIPCIÓN:
+ *   Abre el fichero 'filename', reserva el anillo de captura e inicia el
+ *   hilo escritor.
+ *
+ * VALOR DEVUELTO:
+ *   La captura, o 'NULL' si se ha producido un error.
+ */
+eth_capture_t * eth_capture_open
+( char * filename, int snaplen, long int rotate_size )
+{
+  eth_capture_t * capture = calloc(1, sizeof(eth_capture_t));
+  if (capture == NULL) {
+    fprintf(stderr, "eth_capture_open(): ERROR en calloc()\n");
+    return NULL;
+  }
+  if ((snaplen <= 0) || (snaplen > ETH_HEADER_SIZE + ETH_MAX_MTU)) {
+    snaplen = ETH_HEADER_SIZE + ETH_MAX_MTU;
+  }
+  capture->snaplen = snaplen;
+  capture->rotate_size = rotate_size;
+  capture->filename = strdup(filename);
+  if (capture->filename == NULL) {
+    fprintf(stderr, "eth_capture_open(): ERROR en strdup()\n");
+    free(capture);
+    return NULL;
+  }
+
+  capture->ring = eth_capture_ring_map();
+  if (capture->ring == NULL) {
+    free(capture->filename);
+    free(capture);
+    return NULL;
+  }
+
+  if (eth_capture_file_open(capture) == -1) {
+    munmap(capture->ring, 2 * ETH_CAPTURE_RING_SIZE);
+    free(capture->filename);
+    free(capture);
+    return NULL;
+  }
+
+  int err = pthread_create(&capture->writer, NULL, eth_capture_writer, capture);
+  if (err != 0) {
+    fprintf(stderr, "eth_capture_open(): ERROR en pthread_create(): %s\n",
+            strerror(err));
+    close(capture->fd);
+    munmap(capture->ring, 2 * ETH_CAPTURE_RING_SIZE);
+    free(capture->filename);
+    free(capture);
+    return NULL;
+  }
+
+  return capture;
+}
+
+
+/* void eth_capture_frame
+ * ( eth_capture_t * capture, unsigned char * frame, int frame_len,
+ *   uint64_t tstamp );
+ *
+ * DESCRIPCIÓN:
+ *   Copia la trama, con su marca de tiempo 'tstamp' en nanosegundos (la de
+ *   llegada de la trama en recepción), como un bloque pcapng en el anillo de
+ *   captura. Si no hay hueco la trama se descarta.
+ */
+void eth_capture_frame
+( eth_capture_t * capture, unsigned char * frame, int frame_len,
+  uint64_t tstamp )
+{
+  int captured_len = (frame_len > capture->snaplen) ?
+                     capture->snaplen : frame_len;
+  int padded_len = (captured_len + 3) & ~3;
+  uint32_t block_len = sizeof(struct pcapng_epb) + padded_len + 4;
+
+  uint64_t head = capture->head;
+  uint64_t tail = __atomic_load_n(&capture->tail, __ATOMIC_ACQUIRE);
+  if (head - tail + block_len > ETH_CAPTURE_RING_SIZE) {
+    __atomic_store_n(&capture->dropped, capture->dropped + 1,
+                     __ATOMIC_RELAXED);
+    return;
+  }
+
+  /* Gracias a la doble proyección el bloque siempre es contiguo */
+  unsigned char * block = capture->ring + (head % ETH_CAPTURE_RING_SIZE);
+  struct pcapng_epb * epb = (struct pcapng_epb *) block;
+  epb->block_type = PCAPNG_EPB;
+  epb->block_len = block_len;
+  epb->interface_id = 0;
+  epb->ts_high = (uint32_t) (tstamp >> 32);
+  epb->ts_low = (uint32_t) tstamp;
+  epb->captured_len = captured_len;
+  epb->original_len = frame_len;
+  unsigned char * data = block + sizeof(struct pcapng_epb);
+  memcpy(data, frame, captured_len);
+  memset(data + captured_len, 0, padded_len - captured_len);
+  memcpy(data + padded_len, &block_len, 4);
+
+  __atomic_store_n(&capture->captured, capture->captured + 1,
+                   __ATOMIC_RELAXED);
+  __atomic_store_n(&capture->head, head + block_len, __ATOMIC_RELEASE);
+}
+
+
+/* void eth_capture_stats
+ * ( eth_capture_t * capture, long int * captured, long int * dropped );
+ *
+ * DESCRIPCIÓN:
+ *   Copia el número de tramas capturadas y descartadas por anillo lleno.
+ */
+void eth_capture_stats
+( eth_capture_t * capture, long int * captured, long int * dropped )
+{
+  *captured = __atomic_load_n(&capture->captured, __ATOMIC_RELAXED);
+  *dropped = __atomic_load_n(&capture->dropped, __ATOMIC_RELAXED);
+}
+
+
+/* int eth_capture_close ( eth_capture_t * capture );
+ *
+ * DESCRIPCIÓN:
+ *   Espera a que el hilo escritor vacíe el anillo, cierra el fichero y
+ *   libera la captura.
+ *
+ * VALOR DEVUELTO:
+ *   '0', o '-1' si se ha producido algún error de escritura.
+ */
+int eth_capture_close ( eth_capture_t * capture )
+{
+  __atomic_store_n(&capture->stop, 1, __ATOMIC_RELEASE);
+  pthread_join(capture->writer, NULL);
+
+  int err = capture->error ? -1 : 0;
+  if (capture->fd != -1) {
+    close(capture->fd);
+  }
+  munmap(capture->ring, 2 * ETH_CAPTURE_RING_SIZE);
+  free(capture->filename);
+  free(capture);
+
+  return err;
+}
@@ -0,0 +1,44 @@
+#ifndef _ETH_CAPTURE_H
+#define _ETH_CAPTURE_H
+
+#include "eth.h"
+
+/* Interfaz interna entre 'eth.c' y el sumidero de captura pcapng
+ * (eth_capture.c). Las capas superiores usan 'eth_capture_start()' y
+ * 'eth_capture_stop()' (eth.h).
+ *
+ * El camino de datos copia cada trama, ya con formato de bloque pcapng
+ * ("Enhanced Packet Block"), en un anillo reservado al iniciar la captura y
+ * proyectado dos veces consecutivas en memoria, de modo que ningún bloque
+ * se parte al dar la vuelta. Un hilo escritor vacía el anillo al fichero.
+ * Si el anillo está lleno la trama no se captura y se cuenta como
+ * descartada: la captura nunca bloquea el envío ni la recepción.
+ *
+ * Sólo un hilo puede capturar en cada 'eth_capture_t' (el que usa la
+ * interfaz), ya que el anillo tiene un único productor.
+ */
+typedef struct eth_capture eth_capture_t;
+
+
+/* Abre el fichero 'filename' e inicia el hilo escritor. 'snaplen' es el
+   número máximo de bytes guardados de cada trama y 'rotate_size' el tamaño
+   a partir del cual se pasa al fichero "<filename>.1", "<filename>.2", ...
+   ('0' para no rotar). Devuelve 'NULL' si se ha producido un error. */
+eth_capture_t * eth_capture_open
+( char * filename, int snaplen, long int rotate_size );
+
+/* Copia la trama, con la marca de tiempo 'tstamp' (en nanosegundos), en el
+   anillo de captura, o la descarta si está lleno */
+void eth_capture_frame
+( eth_capture_t * capture, unsigned char * frame, int frame_len,
+  uint64_t tstamp );
+
+/* Copia el número de tramas capturadas y descartadas por anillo lleno */
+void eth_capture_stats
+( eth_capture_t * capture, long int * captured, long int * dropped );
+
+/* Espera a que el hilo escritor vacíe el anillo, cierra el fichero y libera
+   la captura. Devuelve '-1' si se ha producido algún error de escritura. */
+int eth_capture_close ( eth_capture_t * capture );
+
+#endif /* _ETH_CAPTURE_H */
@@ -0,0 +1,229 @@
+#define _GNU_SOURCE /* pthread_setaffinity_np() */
+
+#include "eth_fanout.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sched.h>
+#include <pthread.h>
+
+struct eth_fanout_worker {
+  struct eth_fanout * fanout;
+  int index;
+  pthread_t thread;
+  int opened;    /* El hilo ha abierto su miembro del grupo */
+  int result;    /* Valor devuelto por la función de trabajo */
+};
+
+struct eth_fanout {
+  char ifname[256];  /* Nombre con la opción de fanout */
+  eth_worker_t worker;
+  void * arg;
+  int num_workers;
+  /* Arranque: cada hilo cuenta su miembro en 'num_ready' y espera a que
+     'eth_fanout_start()' ponga 'started' (o 'abort' si algo ha fallado) */
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+  int num_ready;
+  int started;
+  int abort;
+  struct eth_fanout_worker workers[ETH_FANOUT_MAX_WORKERS];
+};
+
+/* Contador para que cada grupo del proceso tenga un identificador
+   distinto */
+static int eth_fanout_seq = 0;
+
+
+/* Hilo de trabajo: abre su miembro del grupo, espera a que lo hayan hecho
+   todos e invoca a la función de trabajo */
+static void * eth_fanout_thread ( void * arg )
+{
+  struct eth_fanout_worker * w = arg;
+  struct eth_fanout * fanout = w->fanout;
+
+  /* Fijar el hilo a una CPU antes de abrir el socket, para que el modo
+     "cpu" reparta a cada hilo las tramas de su CPU */
+  long int num_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+  if (num_cpus > 0) {
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    CPU_SET(w->index % num_cpus, &cpus);
+    pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+  }
+
+  eth_iface_t * iface = eth_open(fanout->ifname);
+  w->opened = (iface != NULL);
+
+  pthread_mutex_lock(&fanout->lock);
+  fanout->num_ready++;
+  pthread_cond_broadcast(&fanout->cond);
+  while (( ! fanout->started ) && ( ! fanout->abort )) {
+    pthread_cond_wait(&fanout->cond, &fanout->lock);
+  }
+  pthread_mutex_unlock(&fanout->lock);
+
+  if (iface == NULL) {
+    w->result = -1;
+    return NULL;
+  }
+  if (fanout->abort) {
+    eth_close(iface);
+    w->result = -1;
+    return NULL;
+  }
+
+  w->result = fanout->worker(iface, w->index, fanout->arg);
+  eth_close(iface);
+
+  return NULL;
+}
+
+
+/* eth_fanout_t * eth_fanout_start
+ * ( char * ifname, char * mode, int num_workers,
+ *   eth_worker_t worker, void * arg );
+ *
+ * DESCRIPCIÓN:
+ *   Esta función crea un grupo de fanout nuevo sobre la interfaz 'ifname'
+ *   y lanza 'num_workers' hilos. Cada hilo se fija a una CPU (el hilo 'i' a
+ *   la CPU 'i' módulo el número de CPUs), abre su propio miembro del grupo
+ *   y, una vez que todos los miembros están abiertos, invoca a 'worker'.
+ *
+ *   Los hilos deben esperarse y el grupo liberarse con
+ *   'eth_fanout_join()'.
+ *
+ * PARÁMETROS:
+ *        'ifname': Nombre de la interfaz con el prefijo "packet:" o
+ *                  "ring:", sin opción de fanout.
+ *          'mode': Modo de reparto: "hash", "cpu", "rr" o "qm". Si es
+ *                  NULL se usa "hash".
+ *   'num_workers': Número de hilos, de 1 a 'ETH_FANOUT_MAX_WORKERS'.
+ *        'worker': Función de cada hilo.
+ *           'arg': Argumento de 'worker'.
+ *
+ * VALOR DEVUELTO:
+ *   El grupo de fanout, con todos los hilos en marcha.
+ *
+ * ERRORES:
+ *   La función devuelve 'NULL' si no se ha podido abrir algún miembro del
+ *   grupo o se ha producido algún otro error. En ese caso no queda ningún
+ *   hilo en marcha.
+ */
+eth_fanout_t * eth_fanout_start
+( char * ifname, char * mode, int num_workers,
+  eth_worker_t worker, void * arg )
+{
+  if ((ifname == NULL) || (worker == NULL)) {
+    fprintf(stderr, "eth_fanout_start(): ERROR: parámetro NULL\n");
+    return NULL;
+  }
+  if ((num_workers < 1) || (num_workers > ETH_FANOUT_MAX_WORKERS)) {
+    fprintf(stderr, "eth_fanout_start(): ERROR: número de hilos inválido\n");
+    return NULL;
+  }
+  if (mode == NULL) {
+    mode = "hash";
+  }
+
+  eth_fanout_t * fanout = calloc(1, sizeof(struct eth_fanout));
+  if (fanout == NULL) {
+    fprintf(stderr, "eth_fanout_start(): ERROR en calloc()\n");
+    return NULL;
+  }
+
+  /* El identificador del grupo es único en el espacio de red, por lo que
+     se combina el PID con un contador del proceso */
+  int seq = __atomic_fetch_add(&eth_fanout_seq, 1, __ATOMIC_RELAXED);
+  unsigned int group = ((unsigned int) getpid() + (seq << 10)) & 0xFFFF;
+  int len = snprintf(fanout->ifname, sizeof(fanout->ifname), "%s,fanout=%u:%s",
+                     ifname, group, mode);
+  if (len >= (int) sizeof(fanout->ifname)) {
+    fprintf(stderr, "eth_fanout_start(): ERROR: nombre demasiado largo\n");
+    free(fanout);
+    return NULL;
+  }
+  fanout->worker = worker;
+  fanout->arg = arg;
+  pthread_mutex_init(&fanout->lock, NULL);
+  pthread_cond_init(&fanout->cond, NULL);
+
+  int i;
+  for (i=0; i<num_workers; i++) {
+    struct eth_fanout_worker * w = &fanout->workers[i];
+    w->fanout = fanout;
+    w->index = i;
+    int err = pthread_create(&w->thread, NULL, eth_fanout_thread, w);
+    if (err != 0) {
+      fprintf(stderr, "eth_fanout_start(): ERROR en pthread_create(): %s\n",
+              strerror(err));
+      fanout->abort = 1;
+      break;
+    }
+    fanout->num_workers++;
+  }
+
+  /* Esperar a que todos los hilos hayan abierto su miembro y decidir si
+     se continúa */
+  pthread_mutex_lock(&fanout->lock);
+  while (fanout->num_ready < fanout->num_workers) {
+    pthread_cond_wait(&fanout->cond, &fanout->lock);
+  }
+  for (i=0; i<fanout->num_workers; i++) {
+    if ( ! fanout->workers[i].opened ) {
+      fprintf(stderr, "eth_fanout_start(): ERROR: no se ha podido abrir el "
+              "miembro %d de \"%s\"\n", i, fanout->ifname);
+      fanout->abort = 1;
+      break;
+    }
+  }
+  fanout->started = ! fanout->abort;
+  pthread_cond_broadcast(&fanout->cond);
+  pthread_mutex_unlock(&fanout->lock);
+
+  if (fanout->abort) {
+    eth_fanout_join(fanout);
+    return NULL;
+  }
+
+  return fanout;
+}
+
+
+/* int eth_fanout_join ( eth_fanout_t * fanout );
+ *
+ * DESCRIPCIÓN:
+ *   Esta función espera a que terminen todos los hilos del grupo y lo
+ *   libera. Cada función de trabajo decide cuándo termina (por ejemplo,
+ *   consultando una variable compartida a través de su argumento).
+ *
+ * VALOR DEVUELTO:
+ *   Devuelve '0' si todos los hilos han terminado correctamente.
+ *
+ * ERRORES:
+ *   La función devuelve '-1' si alguna función de trabajo ha devuelto
+ *   '-1'.
+ */
+int eth_fanout_join ( eth_fanout_t * fanout )
+{
+  if (fanout == NULL) {
+    fprintf(stderr, "eth_fanout_join(): ERROR: fanout == NULL\n");
+    return -1;
+  }
+
+  int err = 0;
+  int i;
+  for (i=0; i<fanout->num_workers; i++) {
+    pthread_join(fanout->workers[i].thread, NULL);
+    if (fanout->workers[i].result == -1) {
+      err = -1;
+    }
+  }
+  pthread_cond_destroy(&fanout->cond);
+  pthread_mutex_destroy(&fanout->lock);
+  free(fanout);
+
+  return err;
+}
@@ -0,0 +1,103 @@
+#ifndef _ETH_FANOUT_H
+#define _ETH_FANOUT_H
+
+#include "eth.h"
+
+/* Recepción multicola con PACKET_FANOUT.
+ *
+ * Un grupo de fanout abre la misma interfaz varias veces, una por hilo de
+ * trabajo, con los backends "packet" o "ring" y la opción
+ * ",fanout=<grupo>:<modo>". El núcleo reparte cada trama recibida a uno
+ * solo de los sockets del grupo según el modo:
+ *   "hash": Por flujo (direcciones y puertos), reensamblando antes los
+ *           fragmentos IP. Todas las tramas de un flujo llegan al mismo
+ *           hilo, en orden.
+ *    "cpu": Por la CPU que ha recibido la trama. Con un hilo fijado a cada
+ *           CPU (lo que hace 'eth_fanout_start()'), la trama se procesa en
+ *           la misma CPU en que la recibió la tarjeta.
+ *     "rr": Por turno entre los sockets del grupo, sin mantener el orden
+ *           de los flujos.
+ *     "qm": Por cola de recepción de la tarjeta (RSS).
+ *
+ * Cada hilo tiene su propio estado de la pila: su manejador de interfaz
+ * (con su propio anillo en el backend "ring"), su reactor y sus capas IPv4
+ * y UDP, abiertas desde el propio hilo, y sus resoluciones ARP en curso y
+ * anillo de traza, que son locales al hilo. Así los hilos no comparten
+ * nada en el camino de recepción ni necesitan cerrojos.
+ *
+ * Las tramas ARP no se reparten: cada miembro las recibe todas por un
+ * socket ARP propio, fuera del grupo, para que la respuesta a una petición
+ * llegue al hilo que la ha enviado y todas las cachés de vecinos se
+ * mantengan al día. Cada hilo responde también a las peticiones dirigidas
+ * a la interfaz, así que el que pregunta recibe una respuesta por hilo,
+ * todas iguales; es inofensivo, porque sólo vuelven a confirmar la misma
+ * entrada de su caché.
+ *
+ * Las capas superiores se unen al grupo indicando la misma opción en el
+ * fichero de configuración de cada hilo, por ejemplo
+ * "Interface ring:eth0,fanout=42:hash".
+ */
+typedef struct eth_fanout eth_fanout_t;
+
+/* Número máximo de hilos de un grupo */
+#define ETH_FANOUT_MAX_WORKERS 64
+
+/* Función de cada hilo de trabajo. Recibe el manejador de su miembro del
+   grupo, ya abierto, su índice (de 0 a 'num_workers'-1) y el argumento de
+   'eth_fanout_start()'. La interfaz se cierra cuando la función retorna;
+   devolver '-1' indica que el hilo ha terminado con error. */
+typedef int (* eth_worker_t) ( eth_iface_t * iface, int index, void * arg );
+
+
+/* eth_fanout_t * eth_fanout_start
+ * ( char * ifname, char * mode, int num_workers,
+ *   eth_worker_t worker, void * arg );
+ *
+ * DESCRIPCIÓN:
+ *   Esta función crea un grupo de fanout nuevo sobre la interfaz 'ifname'
+ *   y lanza 'num_workers' hilos. Cada hilo se fija a una CPU (el hilo 'i' a
+ *   la CPU 'i' módulo el número de CPUs), abre su propio miembro del grupo
+ *   y, una vez que todos los miembros están abiertos, invoca a 'worker'.
+ *
+ *   Los hilos deben esperarse y el grupo liberarse con
+ *   'eth_fanout_join()'.
+ *
+ * PARÁMETROS:
+ *        'ifname': Nombre de la interfaz con el prefijo "packet:" o
+ *                  "ring:", sin opción de fanout.
+ *          'mode': Modo de reparto: "hash", "cpu", "rr" o "qm". Si es
+ *                  NULL se usa "hash".
+ *   'num_workers': Número de hilos, de 1 a 'ETH_FANOUT_MAX_WORKERS'.
+ *        'worker': Función de cada hilo.
+ *           'arg': Argumento de 'worker'.
+ *
+ * VALOR DEVUELTO:
+ *   El grupo de fanout, con todos los hilos en marcha.
+ *
+ * ERRORES:
+ *   La función devuelve 'NULL' si no se ha podido abrir algún miembro del
+ *   grupo o se ha producido algún otro error. En ese caso no queda ningún
+ *   hilo en marcha.
+ */
+eth_fanout_t * eth_fanout_start
+( char * ifname, char * mode, int num_workers,
+  eth_worker_t worker, void * arg );
+
+
+/* int eth_fanout_join ( eth_fanout_t * fanout );
+ *
+ * DESCRIPCIÓN:
+ *   Esta función espera a que terminen todos los hilos del grupo y lo
+ *   libera. Cada función de trabajo decide cuándo termina (por ejemplo,
+ *   consultando una variable compartida a través de su argumento).
+ *
+ * VALOR DEVUELTO:
+ *   Devuelve '0' si todos los hilos han terminado correctamente.
+ *
+ * ERRORES:
+ *   La función devuelve '-1' si alguna función de trabajo ha devuelto
+ *   '-1'.
+ */
+int eth_fanout_join ( eth_fanout_t * fanout );
+
+#endif /* _ETH_FANOUT_H */
@@ -0,0 +1,1373 @@
+#define _GNU_SOURCE /* sendmmsg(), recvmmsg() */
+
+/* <linux/if_ether.h> define también ETH_MIN_MTU y ETH_MAX_MTU con los
+   límites del núcleo (ETH_MAX_MTU es 65535U): se incluye antes que
+   "eth_backend.h" y se descartan, para que aquí valgan los de la librería */
+#include <linux/if_ether.h>
+#undef ETH_MIN_MTU
+#undef ETH_MAX_MTU
+
+#include "eth_backend.h"
+#include <timerms.h>
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <poll.h>
+#include <time.h>
+#include <sys/socket.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/epoll.h>
+#include <net/if.h>
+#include <netinet/in.h>
+#include <linux/if_packet.h>
+#include <linux/net_tstamp.h>
+#include <linux/errqueue.h>
+
+/* Número máximo de tramas que se pasan al núcleo en cada llamada a
+   sendmmsg()/recvmmsg() */
+#define ETH_PACKET_BATCH_MAX 64
+
+/* Espacio para los mensajes de control de cada trama recibida: la marca de
+   SO_TIMESTAMPNS y, con las marcas de transmisión activadas, la de
+   SO_TIMESTAMPING */
+#define ETH_PACKET_CMSG_SIZE \
+  (CMSG_SPACE(sizeof(struct timespec)) + \
+   CMSG_SPACE(3 * sizeof(struct timespec)))
+
+/* Estado privado del backend "packet" */
+struct eth_packet {
+  int fd;      /* Socket AF_PACKET asociado a la interfaz */
+  int ifindex; /* Índice de la interfaz en el núcleo */
+  int mtu;     /* MTU de la interfaz en el núcleo */
+  /* Marcas de tiempo de transmisión leídas de la cola de errores y todavía
+     no consultadas */
+  int tx_tstamps;      /* Marcas de transmisión activadas */
+  int tx_pending;      /* Hay una marca sin consultar */
+  uint64_t tx_tstamp;  /* Marca más reciente */
+  uint32_t tx_id;      /* Número de orden de su trama */
+  /* Socket ARP propio y epoll con ambos sockets (sólo en un grupo de
+     fanout, '-1' en otro caso) */
+  int arp_fd;
+  int epfd;
+};
+
+
+/* Valores de 'eth_packet_wait()' que indican qué socket tiene datos */
+#define ETH_PACKET_READY 1
+#define ETH_PACKET_ARP_READY 2
+
+/* int eth_packet_wait ( int fd, int arp_fd, long int timeout );
+ *
+ * DESCRIPCIÓN:
+ *   Espera a que el socket indicado, o el socket ARP del miembro de un
+ *   grupo de fanout si 'arp_fd' no es '-1', tenga datos para leer.
+ *
+ * VALOR DEVUELTO:
+ *   Una combinación de 'ETH_PACKET_READY' y 'ETH_PACKET_ARP_READY' según
+ *   los sockets que tienen datos, '0' si ha expirado el temporizador o '-1'
+ *   si se ha producido algún error.
+ */
+static int eth_packet_wait ( int fd, int arp_fd, long int timeout )
+{
+  /* poll() ignora las entradas con descriptor negativo */
+  struct pollfd pfds[2];
+  pfds[0].fd = fd;
+  pfds[0].events = POLLIN;
+  pfds[0].revents = 0;
+  pfds[1].fd = arp_fd;
+  pfds[1].events = POLLIN;
+  pfds[1].revents = 0;
+
+  int poll_timeout = (timeout < 0) ? -1 : (int) timeout;
+  int err;
+  do {
+    err = poll(pfds, 2, poll_timeout);
+  } while ((err == -1) && (errno == EINTR));
+
+  if (err == -1) {
+    fprintf(stderr, "eth_packet: ERROR en poll(): %s\n", strerror(errno));
+    return -1;
+  } else if (err == 0) {
+    return 0;
+  }
+
+  int ready = 0;
+  if (pfds[0].revents != 0) {
+    ready |= ETH_PACKET_READY;
+  }
+  if (pfds[1].revents != 0) {
+    ready |= ETH_PACKET_ARP_READY;
+  }
+
+  return ready;
+}
+
+
+/* int eth_packet_socket
+ * ( char * ifname, mac_addr_t addr, int * ifindex, int * mtu );
+ *
+ * DESCRIPCIÓN:
+ *   Crea un socket AF_PACKET y obtiene el índice, la dirección MAC y la MTU
+ *   de la interfaz indicada. El socket todavía no está asociado a la
+ *   interfaz.
+ *
+ * VALOR DEVUELTO:
+ *   El descriptor del socket, o '-1' si se ha producido algún error.
+ */
+static int eth_packet_socket
+( char * ifname, mac_addr_t addr, int * ifindex, int * mtu )
+{
+  int fd = socket(AF_PACKET, SOCK_RAW, htons(ETH_P_ALL));
+  if (fd == -1) {
+    fprintf(stderr, "eth_packet: ERROR en socket(): %s\n", strerror(errno));
+    return -1;
+  }
+
+  /* Obtener el índice y la dirección MAC de la interfaz */
+  struct ifreq ifr;
+  memset(&ifr, 0, sizeof(struct ifreq));
+  strncpy(ifr.ifr_name, ifname, IFNAMSIZ - 1);
+  if (ioctl(fd, SIOCGIFINDEX, &ifr) == -1) {
+    fprintf(stderr, "eth_packet: ERROR en ioctl(SIOCGIFINDEX, %s): %s\n",
+            ifname, strerror(errno));
+    close(fd);
+    return -1;
+  }
+  *ifindex = ifr.ifr_ifindex;
+
+  if (ioctl(fd, SIOCGIFHWADDR, &ifr) == -1) {
+    fprintf(stderr, "eth_packet: ERROR en ioctl(SIOCGIFHWADDR, %s): %s\n",
+            ifname, strerror(errno));
+    close(fd);
+    return -1;
+  }
+  memcpy(addr, ifr.ifr_hwaddr.sa_data, MAC_ADDR_SIZE);
+
+  if (ioctl(fd, SIOCGIFMTU, &ifr) == -1) {
+    fprintf(stderr, "eth_packet: ERROR en ioctl(SIOCGIFMTU, %s): %s\n",
+            ifname, strerror(errno));
+    close(fd);
+    return -1;
+  }
+  *mtu = ifr.ifr_mtu;
+
+#ifdef PACKET_IGNORE_OUTGOING
+  /* No recibir las tramas enviadas por nosotros mismos. Si el núcleo no lo
+     permite se descartan al recibir comprobando 'sll_pkttype'. */
+  int one = 1;
+  setsockopt(fd, SOL_PACKET, PACKET_IGNORE_OUTGOING, &one, sizeof(one));
+#endif
+
+  return fd;
+}
+
+
+/* int eth_packet_bind ( int fd, int ifindex, int protocol, char * ifname );
+ *
+ * DESCRIPCIÓN:
+ *   Asocia el socket AF_PACKET indicado a la interfaz 'ifindex', para
+ *   recibir las tramas del tipo 'protocol' ('ETH_P_ALL' para todas).
+ *
+ * VALOR DEVUELTO:
+ *   '0' si el socket se ha asociado o '-1' si se ha producido algún error.
+ */
+static int eth_packet_bind ( int fd, int ifindex, int protocol, char * ifname )
+{
+  struct sockaddr_ll sll;
+  memset(&sll, 0, sizeof(struct sockaddr_ll));
+  sll.sll_family = AF_PACKET;
+  sll.sll_protocol = htons(protocol);
+  sll.sll_ifindex = ifindex;
+  if (bind(fd, (struct sockaddr *) &sll, sizeof(sll)) == -1) {
+    fprintf(stderr, "eth_packet: ERROR en bind(%s): %s\n",
+            ifname, strerror(errno));
+    return -1;
+  }
+
+  return 0;
+}
+
+
+/* int eth_packet_filter
+ * ( int fd, struct sock_filter insns[], int num );
+ *
+ * DESCRIPCIÓN:
+ *   Instala el programa BPF indicado en el socket, o elimina el filtro
+ *   instalado si 'num' es '0'.
+ *
+ * VALOR DEVUELTO:
+ *   '0' si se ha actualizado el filtro o '-1' si se ha producido algún error.
+ */
+static int eth_packet_filter ( int fd, struct sock_filter insns[], int num )
+{
+  int err;
+
+  if (num == 0) {
+    int unused = 0;
+    err = setsockopt(fd, SOL_SOCKET, SO_DETACH_FILTER, &unused, sizeof(unused));
+    if ((err == -1) && (errno == ENOENT)) {
+      /* No había ningún filtro instalado */
+      err = 0;
+    }
+  } else {
+    struct sock_fprog prog;
+    prog.len = num;
+    prog.filter = insns;
+    err = setsockopt(fd, SOL_SOCKET, SO_ATTACH_FILTER, &prog, sizeof(prog));
+  }
+  if (err == -1) {
+    fprintf(stderr, "eth_packet: ERROR en setsockopt(SO_%s_FILTER): %s\n",
+            (num == 0) ? "DETACH" : "ATTACH", strerror(errno));
+  }
+
+  return err;
+}
+
+
+/* int eth_packet_options ( char * ifname, char * name, int * fanout );
+ *
+ * DESCRIPCIÓN:
+ *   Separa el nombre de la interfaz de sus opciones
+ *   ("<ifname>[,fanout=<grupo>[:hash|cpu|rr|qm]]"). Copia el nombre en
+ *   'name' (de IFNAMSIZ bytes) y en 'fanout' el argumento de
+ *   PACKET_FANOUT para unirse al grupo, o '-1' si no se ha pedido.
+ *
+ * VALOR DEVUELTO:
+ *   '0' si las opciones son válidas o '-1' en otro caso.
+ */
+static int eth_packet_options ( char * ifname, char * name, int * fanout )
+{
+  *fanout = -1;
+
+  char * opts = strchr(ifname, ',');
+  int name_len = (opts == NULL) ? (int) strlen(ifname) : (int) (opts - ifname);
+  if (name_len >= IFNAMSIZ) {
+    fprintf(stderr, "eth_packet: ERROR: nombre de interfaz demasiado largo\n");
+    return -1;
+  }
+  memcpy(name, ifname, name_len);
+  name[name_len] = '\0';
+  if (opts == NULL) {
+    return 0;
+  }
+
+  /* Grupo y modo de reparto: por defecto, por flujo (hash de las
+     direcciones y puertos), reensamblando antes los fragmentos IP para que
+     todos vayan al mismo miembro */
+  unsigned int group;
+  char mode[8] = "hash";
+  if ((sscanf(opts, ",fanout=%u:%7s", &group, mode) < 1) ||
+      (group > 0xFFFF)) {
+    fprintf(stderr, "eth_packet: ERROR: opción inválida: '%s'\n", opts + 1);
+    return -1;
+  }
+  int type;
+  if (strcmp(mode, "hash") == 0) {
+    type = PACKET_FANOUT_HASH | PACKET_FANOUT_FLAG_DEFRAG;
+  } else if (strcmp(mode, "cpu") == 0) {
+    type = PACKET_FANOUT_CPU;
+  } else if (strcmp(mode, "rr") == 0) {
+    type = PACKET_FANOUT_LB;
+  } else if (strcmp(mode, "qm") == 0) {
+    type = PACKET_FANOUT_QM;
+  } else {
+    fprintf(stderr, "eth_packet: ERROR: modo de fanout desconocido: '%s'\n",
+            mode);
+    return -1;
+  }
+  *fanout = group | (type << 16);
+
+  return 0;
+}
+
+
+/* int eth_packet_fanout ( int fd, int fanout );
+ *
+ * DESCRIPCIÓN:
+ *   Une el socket, ya asociado a la interfaz, al grupo PACKET_FANOUT
+ *   indicado por 'eth_packet_options()'. El núcleo reparte entonces las
+ *   tramas recibidas entre todos los sockets del grupo.
+ *
+ * VALOR DEVUELTO:
+ *   '0' si el socket se ha unido al grupo (o no se ha pedido) o '-1' si se
+ *   ha producido algún error.
+ */
+static int eth_packet_fanout ( int fd, int fanout )
+{
+  if (fanout == -1) {
+    return 0;
+  }
+  if (setsockopt(fd, SOL_PACKET, PACKET_FANOUT, &fanout, sizeof(fanout)) == -1) {
+    fprintf(stderr, "eth_packet: ERROR en setsockopt(PACKET_FANOUT): %s\n",
+            strerror(errno));
+    return -1;
+  }
+
+  return 0;
+}
+
+
+/* int eth_packet_arp_open
+ * ( char * ifname, int ifindex, int fd, int fanout, int * arp_fd );
+ *
+ * DESCRIPCIÓN:
+ *   Abre el socket ARP propio del miembro de un grupo de fanout, si se ha
+ *   pedido. El núcleo entrega cada trama a un solo socket del grupo, así
+ *   que las respuestas ARP a las peticiones de un hilo llegarían casi
+ *   siempre a otro. El socket ARP no pertenece al grupo y recibe una copia
+ *   de todas las tramas ARP en cada miembro; las que lleguen por el socket
+ *   del grupo se descartan ('eth_packet_arp_dup()').
+ *
+ *   Como 'eth_getfd()' debe devolver un único descriptor, se crea también
+ *   un epoll con ambos sockets, que señala cuándo alguno tiene datos.
+ *
+ * VALOR DEVUELTO:
+ *   El descriptor del epoll, o '-1' si se ha producido algún error o no se
+ *   ha pedido fanout. El socket ARP se devuelve en 'arp_fd' ('-1' sin
+ *   fanout).
+ */
+static int eth_packet_arp_open
+( char * ifname, int ifindex, int fd, int fanout, int * arp_fd )
+{
+  *arp_fd = -1;
+  if (fanout == -1) {
+    return -1;
+  }
+
+  int sock = socket(AF_PACKET, SOCK_RAW, htons(ETH_P_ARP));
+  if (sock == -1) {
+    fprintf(stderr, "eth_packet: ERROR en socket(): %s\n", strerror(errno));
+    return -1;
+  }
+  int one = 1;
+  if (setsockopt(sock, SOL_SOCKET, SO_TIMESTAMPNS, &one, sizeof(one)) == -1) {
+    fprintf(stderr, "eth_packet: ERROR en setsockopt(SO_TIMESTAMPNS): %s\n",
+            strerror(errno));
+    close(sock);
+    return -1;
+  }
+  if (eth_packet_bind(sock, ifindex, ETH_P_ARP, ifname) == -1) {
+    close(sock);
+    return -1;
+  }
+
+  int epfd = epoll_create1(EPOLL_CLOEXEC);
+  if (epfd == -1) {
+    fprintf(stderr, "eth_packet: ERROR en epoll_create1(): %s\n",
+            strerror(errno));
+    close(sock);
+    return -1;
+  }
+  struct epoll_event event;
+  memset(&event, 0, sizeof(event));
+  event.events = EPOLLIN;
+  event.data.fd = fd;
+  int err = epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &event);
+  if (err == 0) {
+    event.data.fd = sock;
+    err = epoll_ctl(epfd, EPOLL_CTL_ADD, sock, &event);
+  }
+  if (err == -1) {
+    fprintf(stderr, "eth_packet: ERROR en epoll_ctl(): %s\n",
+            strerror(errno));
+    close(epfd);
+    close(sock);
+    return -1;
+  }
+
+  *arp_fd = sock;
+
+  return epfd;
+}
+
+
+/* int eth_packet_arp_dup
+ * ( int arp_fd, unsigned char frame[], int frame_len );
+ *
+ * DESCRIPCIÓN:
+ *   Indica si la trama recibida por el socket del grupo de fanout es una
+ *   trama ARP que ya entrega el socket ARP 'arp_fd' (ver
+ *   'eth_packet_arp_open()').
+ *
+ * VALOR DEVUELTO:
+ *   '1' si la trama debe descartarse, '0' en otro caso.
+ */
+static int eth_packet_arp_dup
+( int arp_fd, unsigned char frame[], int frame_len )
+{
+  return (arp_fd != -1) && (frame_len >= 14) &&
+         (frame[12] == (ETH_P_ARP >> 8)) && (frame[13] == (ETH_P_ARP & 0xFF));
+}
+
+
+/* Devuelve la marca SO_TIMESTAMPNS de una trama recibida, o '0' */
+static uint64_t eth_packet_rx_tstamp ( struct msghdr * msg )
+{
+  struct cmsghdr * cmsg;
+  for (cmsg = CMSG_FIRSTHDR(msg); cmsg != NULL; cmsg = CMSG_NXTHDR(msg, cmsg)) {
+    if ((cmsg->cmsg_level == SOL_SOCKET) &&
+        (cmsg->cmsg_type == SCM_TIMESTAMPNS)) {
+      struct timespec ts;
+      memcpy(&ts, CMSG_DATA(cmsg), sizeof(ts));
+      return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+    }
+  }
+
+  return 0;
+}
+
+
+/* int eth_packet_arp_recv
+ * ( int arp_fd, unsigned char buffer[], int buf_len, uint64_t * tstamp );
+ *
+ * DESCRIPCIÓN:
+ *   Lee sin esperar una trama del socket ARP del miembro de un grupo de
+ *   fanout, con su marca de tiempo de llegada.
+ *
+ * VALOR DEVUELTO:
+ *   La longitud de la trama (que puede ser mayor que 'buf_len'), '0' si no
+ *   hay ninguna o '-1' si se ha producido algún error.
+ */
+static int eth_packet_arp_recv
+( int arp_fd, unsigned char buffer[], int buf_len, uint64_t * tstamp )
+{
+  while (1) {
+    struct sockaddr_ll sll;
+    unsigned char control[ETH_PACKET_CMSG_SIZE];
+    struct iovec iov = { buffer, buf_len };
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_name = &sll;
+    msg.msg_namelen = sizeof(sll);
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+
+    int frame_len = recvmsg(arp_fd, &msg, MSG_DONTWAIT | MSG_TRUNC);
+    if (frame_len == -1) {
+      if (errno == EINTR) {
+        continue;
+      } else if ((errno == EAGAIN) || (errno == EWOULDBLOCK)) {
+        return 0;
+      }
+      fprintf(stderr, "eth_packet: ERROR en recvmsg(): %s\n",
+              strerror(errno));
+      return -1;
+    }
+
+    /* Descartar las tramas enviadas por este equipo */
+    if (sll.sll_pkttype != PACKET_OUTGOING) {
+      *tstamp = eth_packet_rx_tstamp(&msg);
+      return frame_len;
+    }
+  }
+}
+
+
+/* void eth_packet_arp_close ( int arp_fd, int epfd );
+ *
+ * DESCRIPCIÓN:
+ *   Cierra el socket ARP y el epoll de 'eth_packet_arp_open()', si existen.
+ */
+static void eth_packet_arp_close ( int arp_fd, int epfd )
+{
+  if (arp_fd != -1) {
+    close(arp_fd);
+  }
+  if (epfd != -1) {
+    close(epfd);
+  }
+}
+
+
+static void * eth_packet_open ( char * ifname, mac_addr_t addr )
+{
+  struct eth_packet * packet = malloc(sizeof(struct eth_packet));
+  if (packet == NULL) {
+    fprintf(stderr, "eth_packet: ERROR en malloc()\n");
+    return NULL;
+  }
+
+  char name[IFNAMSIZ];
+  int fanout;
+  if (eth_packet_options(ifname, name, &fanout) == -1) {
+    free(packet);
+    return NULL;
+  }
+
+  packet->fd = eth_packet_socket(name, addr, &packet->ifindex, &packet->mtu);
+  if (packet->fd == -1) {
+    free(packet);
+    return NULL;
+  }
+  packet->tx_tstamps = 0;
+  packet->tx_pending = 0;
+
+  /* Pedir al núcleo la marca de tiempo software de llegada de cada trama */
+  int one = 1;
+  if (setsockopt(packet->fd, SOL_SOCKET, SO_TIMESTAMPNS,
+                 &one, sizeof(one)) == -1) {
+    fprintf(stderr, "eth_packet: ERROR en setsockopt(SO_TIMESTAMPNS): %s\n",
+            strerror(errno));
+    close(packet->fd);
+    free(packet);
+    return NULL;
+  }
+
+  /* Asociar el socket a la interfaz y, si se ha pedido, al grupo de
+     fanout */
+  if ((eth_packet_bind(packet->fd, packet->ifindex, ETH_P_ALL, name) == -1) ||
+      (eth_packet_fanout(packet->fd, fanout) == -1)) {
+    close(packet->fd);
+    free(packet);
+    return NULL;
+  }
+
+  /* En un grupo de fanout, las tramas ARP llegan por un socket propio */
+  packet->epfd = eth_packet_arp_open(name, packet->ifindex, packet->fd,
+                                     fanout, &packet->arp_fd);
+  if ((fanout != -1) && (packet->epfd == -1)) {
+    close(packet->fd);
+    free(packet);
+    return NULL;
+  }
+
+  return packet;
+}
+
+
+static int eth_packet_send ( void * priv, unsigned char * frame, int frame_len )
+{
+  struct eth_packet * packet = priv;
+
+  int bytes_sent = send(packet->fd, frame, frame_len, 0);
+  if (bytes_sent == -1) {
+    fprintf(stderr, "eth_packet: ERROR en send(): %s\n", strerror(errno));
+  }
+
+  return bytes_sent;
+}
+
+
+static int eth_packet_send_batch
+( void * priv, unsigned char * frames[], int frame_lens[], int num )
+{
+  struct eth_packet * packet = priv;
+  struct mmsghdr msgs[ETH_PACKET_BATCH_MAX];
+  struct iovec iovs[ETH_PACKET_BATCH_MAX];
+  int frames_sent = 0;
+
+  while (frames_sent < num) {
+    int batch_len = num - frames_sent;
+    if (batch_len > ETH_PACKET_BATCH_MAX) {
+      batch_len = ETH_PACKET_BATCH_MAX;
+    }
+
+    memset(msgs, 0, batch_len * sizeof(struct mmsghdr));
+    int i;
+    for (i=0; i<batch_len; i++) {
+      iovs[i].iov_base = frames[frames_sent + i];
+      iovs[i].iov_len = frame_lens[frames_sent + i];
+      msgs[i].msg_hdr.msg_iov = &iovs[i];
+      msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+
+    int err = sendmmsg(packet->fd, msgs, batch_len, 0);
+    if (err == -1) {
+      if (errno == EINTR) {
+        continue;
+      }
+      fprintf(stderr, "eth_packet: ERROR en sendmmsg(): %s\n",
+              strerror(errno));
+      return (frames_sent > 0) ? frames_sent : -1;
+    }
+    frames_sent += err;
+  }
+
+  return frames_sent;
+}
+
+
+static int eth_packet_recv
+( void * priv, unsigned char buffer[], int buf_len, long int timeout )
+{
+  struct eth_packet * packet = priv;
+  struct sockaddr_ll sll;
+  socklen_t sll_len;
+  int frame_len;
+
+  timerms_t timer;
+  timerms_reset(&timer, timeout);
+
+  do {
+    int err = eth_packet_wait(packet->fd, packet->arp_fd,
+                              timerms_left(&timer));
+    if (err <= 0) {
+      /* Error o timeout */
+      return err;
+    }
+
+    if (err & ETH_PACKET_ARP_READY) {
+      uint64_t tstamp;
+      frame_len = eth_packet_arp_recv(packet->arp_fd, buffer, buf_len,
+                                      &tstamp);
+      if (frame_len != 0) {
+        return frame_len;
+      }
+      if ((err & ETH_PACKET_READY) == 0) {
+        continue;
+      }
+    }
+
+    sll_len = sizeof(sll);
+    frame_len = recvfrom(packet->fd, buffer, buf_len, MSG_TRUNC,
+                         (struct sockaddr *) &sll, &sll_len);
+    if (frame_len == -1) {
+      if (errno == EINTR) {
+        continue;
+      }
+      fprintf(stderr, "eth_packet: ERROR en recvfrom(): %s\n",
+              strerror(errno));
+      return -1;
+    }
+
+    /* Descartar las tramas enviadas por este equipo y, en un grupo de
+       fanout, las ARP que ya entrega el socket ARP */
+  } while ((frame_len == -1) || (sll.sll_pkttype == PACKET_OUTGOING) ||
+           eth_packet_arp_dup(packet->arp_fd, buffer, frame_len));
+
+  return frame_len;
+}
+
+
+/* int eth_packet_tx_drain ( struct eth_packet * packet );
+ *
+ * DESCRIPCIÓN:
+ *   Lee sin esperar todas las marcas de tiempo de transmisión de la cola de
+ *   errores del socket y guarda la más reciente. Hay que vaciar la cola
+ *   aunque nadie consulte las marcas, porque mientras tenga mensajes poll()
+ *   y epoll señalan el socket continuamente.
+ *
+ * VALOR DEVUELTO:
+ *   '0', o '-1' si se ha producido algún error.
+ */
+static int eth_packet_tx_drain ( struct eth_packet * packet )
+{
+  while (1) {
+    unsigned char control[512];
+    unsigned char data[64];
+    struct iovec iov = { data, sizeof(data) };
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+
+    if (recvmsg(packet->fd, &msg, MSG_ERRQUEUE | MSG_DONTWAIT) == -1) {
+      if (errno == EINTR) {
+        continue;
+      } else if ((errno == EAGAIN) || (errno == EWOULDBLOCK)) {
+        return 0;
+      }
+      fprintf(stderr, "eth_packet: ERROR en recvmsg(MSG_ERRQUEUE): %s\n",
+              strerror(errno));
+      return -1;
+    }
+
+    /* Cada mensaje lleva la marca (SCM_TIMESTAMPING) y el número de orden
+       de la trama (PACKET_TX_TIMESTAMP) */
+    uint64_t tstamp = 0;
+    struct sock_extended_err * serr = NULL;
+    struct cmsghdr * cmsg;
+    for (cmsg = CMSG_FIRSTHDR(&msg); cmsg != NULL;
+         cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+      if ((cmsg->cmsg_level == SOL_SOCKET) &&
+          (cmsg->cmsg_type == SCM_TIMESTAMPING)) {
+        struct scm_timestamping tss;
+        memcpy(&tss, CMSG_DATA(cmsg), sizeof(tss));
+        tstamp = (uint64_t) tss.ts[0].tv_sec * 1000000000ULL +
+                 tss.ts[0].tv_nsec;
+      } else if ((cmsg->cmsg_level == SOL_PACKET) &&
+                 (cmsg->cmsg_type == PACKET_TX_TIMESTAMP)) {
+        serr = (struct sock_extended_err *) CMSG_DATA(cmsg);
+      }
+    }
+    if ((tstamp != 0) && (serr != NULL) &&
+        (serr->ee_origin == SO_EE_ORIGIN_TIMESTAMPING)) {
+      packet->tx_tstamp = tstamp;
+      packet->tx_id = serr->ee_data;
+      packet->tx_pending = 1;
+    }
+  }
+}
+
+
+static int eth_packet_recv_batch
+( void * priv, unsigned char * buffers[], int buf_len,
+  int frame_lens[], uint64_t tstamps[], int num, long int timeout )
+{
+  struct eth_packet * packet = priv;
+  struct mmsghdr msgs[ETH_PACKET_BATCH_MAX];
+  struct iovec iovs[ETH_PACKET_BATCH_MAX];
+  struct sockaddr_ll slls[ETH_PACKET_BATCH_MAX];
+  unsigned char controls[ETH_PACKET_BATCH_MAX][ETH_PACKET_CMSG_SIZE];
+  int frames_recv = 0;
+
+  if (num > ETH_PACKET_BATCH_MAX) {
+    num = ETH_PACKET_BATCH_MAX;
+  }
+
+  timerms_t timer;
+  timerms_reset(&timer, timeout);
+
+  do {
+    int err = eth_packet_wait(packet->fd, packet->arp_fd,
+                              timerms_left(&timer));
+    if (err <= 0) {
+      /* Error o timeout */
+      return err;
+    }
+
+    /* Las tramas del socket ARP se entregan antes, de una en una */
+    if (err & ETH_PACKET_ARP_READY) {
+      frame_lens[0] = eth_packet_arp_recv(packet->arp_fd, buffers[0],
+                                          buf_len, &tstamps[0]);
+      if (frame_lens[0] != 0) {
+        return (frame_lens[0] > 0) ? 1 : -1;
+      }
+      if ((err & ETH_PACKET_READY) == 0) {
+        continue;
+      }
+    }
+
+    memset(msgs, 0, num * sizeof(struct mmsghdr));
+    int i;
+    for (i=0; i<num; i++) {
+      iovs[i].iov_base = buffers[i];
+      iovs[i].iov_len = buf_len;
+      msgs[i].msg_hdr.msg_iov = &iovs[i];
+      msgs[i].msg_hdr.msg_iovlen = 1;
+      msgs[i].msg_hdr.msg_name = &slls[i];
+      msgs[i].msg_hdr.msg_namelen = sizeof(struct sockaddr_ll);
+      msgs[i].msg_hdr.msg_control = controls[i];
+      msgs[i].msg_hdr.msg_controllen = ETH_PACKET_CMSG_SIZE;
+    }
+
+    /* Leer todas las tramas disponibles, sin bloquear */
+    int msgs_recv = recvmmsg(packet->fd, msgs, num,
+                             MSG_DONTWAIT | MSG_TRUNC, NULL);
+    if (msgs_recv == -1) {
+      if ((errno == EAGAIN) || (errno == EWOULDBLOCK)) {
+        /* Puede que poll() sólo haya señalado marcas de transmisión en la
+           cola de errores */
+        if (packet->tx_tstamps && (eth_packet_tx_drain(packet) == -1)) {
+          return -1;
+        }
+        continue;
+      } else if (errno == EINTR) {
+        continue;
+      }
+      fprintf(stderr, "eth_packet: ERROR en recvmmsg(): %s\n",
+              strerror(errno));
+      return -1;
+    }
+
+    /* Anular las tramas enviadas por este equipo y, en un grupo de fanout,
+       las ARP que ya entrega el socket ARP */
+    int frames_valid = 0;
+    for (i=0; i<msgs_recv; i++) {
+      if ((slls[i].sll_pkttype == PACKET_OUTGOING) ||
+          eth_packet_arp_dup(packet->arp_fd, buffers[i], msgs[i].msg_len)) {
+        frame_lens[i] = 0;
+      } else {
+        frame_lens[i] = msgs[i].msg_len;
+        tstamps[i] = eth_packet_rx_tstamp(&msgs[i].msg_hdr);
+        frames_valid++;
+      }
+    }
+    if (frames_valid > 0) {
+      frames_recv = msgs_recv;
+    }
+  } while (frames_recv == 0);
+
+  return frames_recv;
+}
+
+
+static int eth_packet_getfd ( void * priv )
+{
+  struct eth_packet * packet = priv;
+
+  return (packet->epfd != -1) ? packet->epfd : packet->fd;
+}
+
+
+static int eth_packet_getmtu ( void * priv )
+{
+  struct eth_packet * packet = priv;
+
+  return packet->mtu;
+}
+
+
+static int eth_packet_set_filter
+( void * priv, struct sock_filter insns[], int num )
+{
+  struct eth_packet * packet = priv;
+
+  if ((packet->arp_fd != -1) &&
+      (eth_packet_filter(packet->arp_fd, insns, num) == -1)) {
+    return -1;
+  }
+
+  return eth_packet_filter(packet->fd, insns, num);
+}
+
+
+static int eth_packet_set_tx_tstamps ( void * priv, int enable )
+{
+  struct eth_packet * packet = priv;
+
+  /* Marca software al entregar cada trama a la tarjeta, numerada desde la
+     activación y sin copia de la trama en la cola de errores */
+  int flags = 0;
+  if (enable) {
+    flags = SOF_TIMESTAMPING_TX_SOFTWARE | SOF_TIMESTAMPING_SOFTWARE |
+            SOF_TIMESTAMPING_OPT_ID | SOF_TIMESTAMPING_OPT_TSONLY;
+  }
+  if (setsockopt(packet->fd, SOL_SOCKET, SO_TIMESTAMPING,
+                 &flags, sizeof(flags)) == -1) {
+    fprintf(stderr, "eth_packet: ERROR en setsockopt(SO_TIMESTAMPING): %s\n",
+            strerror(errno));
+    return -1;
+  }
+
+  /* Descartar las marcas anteriores */
+  int err = eth_packet_tx_drain(packet);
+  packet->tx_tstamps = enable;
+  packet->tx_pending = 0;
+
+  return err;
+}
+
+
+static int eth_packet_tx_tstamp
+( void * priv, uint64_t * tstamp, uint32_t * id )
+{
+  struct eth_packet * packet = priv;
+
+  if (eth_packet_tx_drain(packet) == -1) {
+    return -1;
+  }
+  if ( ! packet->tx_pending ) {
+    return 0;
+  }
+
+  *tstamp = packet->tx_tstamp;
+  *id = packet->tx_id;
+  packet->tx_pending = 0;
+
+  return 1;
+}
+
+
+static int eth_packet_close ( void * priv )
+{
+  struct eth_packet * packet = priv;
+
+  eth_packet_arp_close(packet->arp_fd, packet->epfd);
+  int err = close(packet->fd);
+  free(packet);
+
+  return err;
+}
+
+
+/* Backend basado en un socket AF_PACKET propio. Prefijo: "packet:<ifname>" */
+eth_backend_t ETH_BACKEND_PACKET = {
+  .name = "packet",
+  .open = eth_packet_open,
+  .send = eth_packet_send,
+  .send_batch = eth_packet_send_batch,
+  .recv = eth_packet_recv,
+  .recv_batch = eth_packet_recv_batch,
+  .getfd = eth_packet_getfd,
+  .getmtu = eth_packet_getmtu,
+  .set_filter = eth_packet_set_filter,
+  .set_tx_tstamps = eth_packet_set_tx_tstamps,
+  .tx_tstamp = eth_packet_tx_tstamp,
+  .close = eth_packet_close
+};
+
+
+/* Backend "ring": socket AF_PACKET con anillos TPACKET_V3 de recepción y
+ * envío compartidos con el núcleo mediante mmap().
+ *
+ * En recepción el núcleo entrega bloques completos de tramas: se recorren
+ * las tramas del bloque actual sin llamadas al sistema y sólo se espera con
+ * poll() cuando el bloque siguiente todavía no está listo. En envío las
+ * tramas se escriben directamente en el anillo y un único sendto() entrega
+ * al núcleo todas las pendientes.
+ */
+
+/* Tamaño y número de bloques del anillo de recepción */
+#define ETH_RING_RX_BLOCK_SIZE (1 << 18)
+#define ETH_RING_RX_BLOCK_NR 8
+/* Tiempo máximo en milisegundos que el núcleo retiene un bloque de
+   recepción incompleto antes de entregarlo */
+#define ETH_RING_RX_BLOCK_TIMEOUT 10
+/* Tamaño y número de bloques del anillo de envío (con tramas de
+   ETH_RING_FRAME_SIZE bytes; con tramas mayores se usan más bloques para
+   mantener el número de tramas del anillo) */
+#define ETH_RING_TX_BLOCK_SIZE (1 << 16)
+#define ETH_RING_TX_BLOCK_NR 8
+/* Tamaño mínimo de cada trama de los anillos: cabecera TPACKET_V3 + trama.
+   Si la MTU de la interfaz no cabe se usa la siguiente potencia de 2. */
+#define ETH_RING_FRAME_SIZE 2048
+
+/* Estado privado del backend "ring" */
+struct eth_ring {
+  int fd;                    /* Socket AF_PACKET asociado a la interfaz */
+  int ifindex;               /* Índice de la interfaz en el núcleo */
+  int mtu;                   /* MTU de la interfaz en el núcleo */
+  unsigned char * map;       /* Anillos proyectados: recepción y envío */
+  size_t map_len;            /* Tamaño total de la proyección */
+  struct tpacket_req3 rx_req; /* Geometría del anillo de recepción */
+  struct tpacket_req3 tx_req; /* Geometría del anillo de envío */
+  unsigned int rx_block;     /* Bloque de recepción actual */
+  int rx_block_held;         /* El bloque actual pertenece al usuario */
+  unsigned int rx_pkts_left; /* Tramas pendientes del bloque actual */
+  struct tpacket3_hdr * rx_pkt; /* Siguiente trama del bloque actual */
+  unsigned int tx_frame;     /* Siguiente trama del anillo de envío */
+  /* Socket ARP propio y epoll con ambos sockets (sólo en un grupo de
+     fanout, '-1' en otro caso) */
+  int arp_fd;
+  int epfd;
+  int arp_check;             /* Hay que mirar el socket ARP */
+};
+
+
+static int eth_ring_close ( void * priv );
+
+
+static void * eth_ring_open ( char * ifname, mac_addr_t addr )
+{
+  struct eth_ring * ring = calloc(1, sizeof(struct eth_ring));
+  if (ring == NULL) {
+    fprintf(stderr, "eth_ring: ERROR en malloc()\n");
+    return NULL;
+  }
+  ring->map = MAP_FAILED;
+  ring->arp_fd = -1;
+  ring->epfd = -1;
+
+  char name[IFNAMSIZ];
+  int fanout;
+  if (eth_packet_options(ifname, name, &fanout) == -1) {
+    free(ring);
+    return NULL;
+  }
+
+  ring->fd = eth_packet_socket(name, addr, &ring->ifindex, &ring->mtu);
+  if (ring->fd == -1) {
+    free(ring);
+    return NULL;
+  }
+
+  /* Configurar los anillos TPACKET_V3 */
+  int version = TPACKET_V3;
+  if (setsockopt(ring->fd, SOL_PACKET, PACKET_VERSION,
+                 &version, sizeof(version)) == -1) {
+    fprintf(stderr, "eth_ring: ERROR en setsockopt(PACKET_VERSION): %s\n",
+            strerror(errno));
+    eth_ring_close(ring);
+    return NULL;
+  }
+
+  ring->rx_req.tp_block_size = ETH_RING_RX_BLOCK_SIZE;
+  ring->rx_req.tp_block_nr = ETH_RING_RX_BLOCK_NR;
+  ring->rx_req.tp_frame_size = ETH_RING_FRAME_SIZE;
+  ring->rx_req.tp_frame_nr =
+    (ETH_RING_RX_BLOCK_SIZE / ETH_RING_FRAME_SIZE) * ETH_RING_RX_BLOCK_NR;
+  ring->rx_req.tp_retire_blk_tov = ETH_RING_RX_BLOCK_TIMEOUT;
+  ring->rx_req.tp_feature_req_word = TP_FT_REQ_FILL_RXHASH;
+  if (setsockopt(ring->fd, SOL_PACKET, PACKET_RX_RING,
+                 &ring->rx_req, sizeof(ring->rx_req)) == -1) {
+    fprintf(stderr, "eth_ring: ERROR en setsockopt(PACKET_RX_RING): %s\n",
+            strerror(errno));
+    eth_ring_close(ring);
+    return NULL;
+  }
+
+  /* Cada trama del anillo de envío debe caber en una posición, así que su
+     tamaño depende de la MTU (hasta ETH_MAX_MTU, como las tramas que
+     acepta eth.c) */
+  int mtu = (ring->mtu < ETH_MAX_MTU) ? ring->mtu : ETH_MAX_MTU;
+  unsigned int frame_size = ETH_RING_FRAME_SIZE;
+  while (frame_size < TPACKET3_HDRLEN + ETH_HEADER_SIZE + mtu) {
+    frame_size *= 2;
+  }
+  unsigned int block_size = ETH_RING_TX_BLOCK_SIZE;
+  if (block_size < frame_size) {
+    block_size = frame_size;
+  }
+  unsigned int frame_nr =
+    (ETH_RING_TX_BLOCK_SIZE / ETH_RING_FRAME_SIZE) * ETH_RING_TX_BLOCK_NR;
+  ring->tx_req.tp_block_size = block_size;
+  ring->tx_req.tp_frame_size = frame_size;
+  ring->tx_req.tp_block_nr = frame_nr / (block_size / frame_size);
+  ring->tx_req.tp_frame_nr = frame_nr;
+  if (setsockopt(ring->fd, SOL_PACKET, PACKET_TX_RING,
+                 &ring->tx_req, sizeof(ring->tx_req)) == -1) {
+    fprintf(stderr, "eth_ring: ERROR en setsockopt(PACKET_TX_RING): %s\n",
+            strerror(errno));
+    eth_ring_close(ring);
+    return NULL;
+  }
+
+  /* Proyectar ambos anillos: primero el de recepción y luego el de envío */
+  ring->map_len =
+    (size_t) ring->rx_req.tp_block_size * ring->rx_req.tp_block_nr +
+    (size_t) ring->tx_req.tp_block_size * ring->tx_req.tp_block_nr;
+  ring->map = mmap(NULL, ring->map_len, PROT_READ | PROT_WRITE,
+                   MAP_SHARED, ring->fd, 0);
+  if (ring->map == MAP_FAILED) {
+    fprintf(stderr, "eth_ring: ERROR en mmap(): %s\n", strerror(errno));
+    eth_ring_close(ring);
+    return NULL;
+  }
+
+  /* Asociar el socket a la interfaz y, si se ha pedido, al grupo de
+     fanout */
+  if ((eth_packet_bind(ring->fd, ring->ifindex, ETH_P_ALL, name) == -1) ||
+      (eth_packet_fanout(ring->fd, fanout) == -1)) {
+    eth_ring_close(ring);
+    return NULL;
+  }
+
+  /* En un grupo de fanout, las tramas ARP llegan por un socket propio */
+  ring->epfd = eth_packet_arp_open(name, ring->ifindex, ring->fd,
+                                   fanout, &ring->arp_fd);
+  if ((fanout != -1) && (ring->epfd == -1)) {
+    eth_ring_close(ring);
+    return NULL;
+  }
+
+  return ring;
+}
+
+
+/* struct tpacket3_hdr * eth_ring_rx_next ( struct eth_ring * ring );
+ *
+ * DESCRIPCIÓN:
+ *   Devuelve la siguiente trama del anillo de recepción, devolviendo al
+ *   núcleo el bloque anterior cuando se han consumido todas sus tramas.
+ *
+ * VALOR DEVUELTO:
+ *   La cabecera TPACKET_V3 de la trama, o 'NULL' si el núcleo todavía no ha
+ *   entregado el siguiente bloque.
+ */
+static struct tpacket3_hdr * eth_ring_rx_next ( struct eth_ring * ring )
+{
+  while (ring->rx_pkts_left == 0) {
+    struct tpacket_block_desc * block;
+
+    if (ring->rx_block_held) {
+      /* Bloque consumido: devolverlo al núcleo y pasar al siguiente */
+      block = (struct tpacket_block_desc *)
+        (ring->map + (size_t) ring->rx_block * ring->rx_req.tp_block_size);
+      __atomic_store_n(&block->hdr.bh1.block_status, TP_STATUS_KERNEL,
+                       __ATOMIC_RELEASE);
+      ring->rx_block_held = 0;
+      ring->rx_block = (ring->rx_block + 1) % ring->rx_req.tp_block_nr;
+    }
+
+    block = (struct tpacket_block_desc *)
+      (ring->map + (size_t) ring->rx_block * ring->rx_req.tp_block_size);
+    uint32_t status = __atomic_load_n(&block->hdr.bh1.block_status,
+                                      __ATOMIC_ACQUIRE);
+    if ((status & TP_STATUS_USER) == 0) {
+      return NULL;
+    }
+
+    ring->rx_block_held = 1;
+    ring->rx_pkts_left = block->hdr.bh1.num_pkts;
+    ring->arp_check = 1;
+    ring->rx_pkt = (struct tpacket3_hdr *)
+      ((unsigned char *) block + block->hdr.bh1.offset_to_first_pkt);
+  }
+
+  struct tpacket3_hdr * pkt = ring->rx_pkt;
+  ring->rx_pkt = (struct tpacket3_hdr *)
+    ((unsigned char *) pkt + pkt->tp_next_offset);
+  ring->rx_pkts_left--;
+
+  return pkt;
+}
+
+
+/* int eth_ring_rx_copy
+ * ( struct eth_ring * ring, struct tpacket3_hdr * pkt,
+ *   unsigned char buffer[], int buf_len, uint64_t * tstamp );
+ *
+ * DESCRIPCIÓN:
+ *   Copia en 'buffer' la trama del anillo de recepción indicada y en
+ *   'tstamp' la marca de tiempo de llegada que anotó el núcleo en su
+ *   cabecera.
+ *
+ * VALOR DEVUELTO:
+ *   La longitud de la trama (que puede ser mayor que 'buf_len'), o '0' si la
+ *   trama la ha enviado este equipo, o es una trama ARP que ya entrega el
+ *   socket ARP del grupo de fanout, y debe descartarse.
+ */
+static int eth_ring_rx_copy
+( struct eth_ring * ring, struct tpacket3_hdr * pkt,
+  unsigned char buffer[], int buf_len, uint64_t * tstamp )
+{
+  struct sockaddr_ll * sll = (struct sockaddr_ll *)
+    ((unsigned char *) pkt + TPACKET_ALIGN(sizeof(struct tpacket3_hdr)));
+  if (sll->sll_pkttype == PACKET_OUTGOING) {
+    return 0;
+  }
+
+  int copy_len = pkt->tp_snaplen;
+  if (copy_len > buf_len) {
+    copy_len = buf_len;
+  }
+  memcpy(buffer, (unsigned char *) pkt + pkt->tp_mac, copy_len);
+  if (eth_packet_arp_dup(ring->arp_fd, buffer, copy_len)) {
+    return 0;
+  }
+  *tstamp = (uint64_t) pkt->tp_sec * 1000000000ULL + pkt->tp_nsec;
+
+  return pkt->tp_len;
+}
+
+
+/* Espera y copia la siguiente trama del anillo de recepción, como
+   'eth_ring_recv()', devolviendo también su marca de tiempo */
+static int eth_ring_recv_tstamp
+( struct eth_ring * ring, unsigned char buffer[], int buf_len,
+  uint64_t * tstamp, long int timeout )
+{
+  int frame_len = 0;
+
+  timerms_t timer;
+  timerms_reset(&timer, timeout);
+
+  do {
+    /* En un grupo de fanout se mira el socket ARP al empezar cada bloque y
+       cuando poll() lo señala, para no añadir una llamada al sistema por
+       trama */
+    if ((ring->arp_fd != -1) && ring->arp_check) {
+      ring->arp_check = 0;
+      frame_len = eth_packet_arp_recv(ring->arp_fd, buffer, buf_len, tstamp);
+      if (frame_len != 0) {
+        return frame_len;
+      }
+    }
+
+    struct tpacket3_hdr * pkt = eth_ring_rx_next(ring);
+    if (pkt == NULL) {
+      /* Esperar a que el núcleo entregue el siguiente bloque */
+      int err = eth_packet_wait(ring->fd, ring->arp_fd, timerms_left(&timer));
+      if (err <= 0) {
+        /* Error o timeout */
+        return err;
+      }
+      if (err & ETH_PACKET_ARP_READY) {
+        ring->arp_check = 1;
+      }
+      continue;
+    }
+    frame_len = eth_ring_rx_copy(ring, pkt, buffer, buf_len, tstamp);
+  } while (frame_len == 0);
+
+  return frame_len;
+}
+
+
+static int eth_ring_recv
+( void * priv, unsigned char buffer[], int buf_len, long int timeout )
+{
+  uint64_t tstamp;
+
+  return eth_ring_recv_tstamp(priv, buffer, buf_len, &tstamp, timeout);
+}
+
+
+static int eth_ring_recv_batch
+( void * priv, unsigned char * buffers[], int buf_len,
+  int frame_lens[], uint64_t tstamps[], int num, long int timeout )
+{
+  struct eth_ring * ring = priv;
+
+  /* Esperar a la primera trama */
+  frame_lens[0] =
+    eth_ring_recv_tstamp(ring, buffers[0], buf_len, &tstamps[0], timeout);
+  if (frame_lens[0] <= 0) {
+    return frame_lens[0];
+  }
+
+  /* Recoger sin esperar las tramas ya entregadas por el núcleo */
+  int frames_recv = 1;
+  while (frames_recv < num) {
+    struct tpacket3_hdr * pkt = eth_ring_rx_next(ring);
+    if (pkt == NULL) {
+      break;
+    }
+    frame_lens[frames_recv] =
+      eth_ring_rx_copy(ring, pkt, buffers[frames_recv], buf_len,
+                       &tstamps[frames_recv]);
+    frames_recv++;
+  }
+
+  return frames_recv;
+}
+
+
+static int eth_ring_send_batch
+( void * priv, unsigned char * frames[], int frame_lens[], int num )
+{
+  struct eth_ring * ring = priv;
+  unsigned char * tx_map = ring->map +
+    (size_t) ring->rx_req.tp_block_size * ring->rx_req.tp_block_nr;
+  unsigned int frames_per_block =
+    ring->tx_req.tp_block_size / ring->tx_req.tp_frame_size;
+  int data_offset = TPACKET3_HDRLEN - sizeof(struct sockaddr_ll);
+  int frames_queued = 0;
+
+  while (frames_queued < num) {
+    unsigned int block = ring->tx_frame / frames_per_block;
+    unsigned int index = ring->tx_frame % frames_per_block;
+    struct tpacket3_hdr * hdr = (struct tpacket3_hdr *)
+      (tx_map + (size_t) block * ring->tx_req.tp_block_size +
+       (size_t) index * ring->tx_req.tp_frame_size);
+
+    uint32_t status = __atomic_load_n(&hdr->tp_status, __ATOMIC_ACQUIRE);
+    if ((status != TP_STATUS_AVAILABLE) &&
+        (status != TP_STATUS_WRONG_FORMAT)) {
+      /* Anillo lleno: entregar lo pendiente y esperar a que se libere */
+      if (frames_queued > 0) {
+        break;
+      }
+      if (send(ring->fd, NULL, 0, 0) == -1) {
+        fprintf(stderr, "eth_ring: ERROR en send(): %s\n", strerror(errno));
+        return -1;
+      }
+      struct pollfd pfd = { .fd = ring->fd, .events = POLLOUT, .revents = 0 };
+      poll(&pfd, 1, -1);
+      continue;
+    }
+
+    int frame_len = frame_lens[frames_queued];
+    if (frame_len > (int) ring->tx_req.tp_frame_size - data_offset) {
+      fprintf(stderr, "eth_ring: ERROR: trama demasiado grande: %d bytes\n",
+              frame_len);
+      break;
+    }
+    memcpy((unsigned char *) hdr + data_offset,
+           frames[frames_queued], frame_len);
+    hdr->tp_len = frame_len;
+    hdr->tp_snaplen = frame_len;
+    __atomic_store_n(&hdr->tp_status, TP_STATUS_SEND_REQUEST,
+                     __ATOMIC_RELEASE);
+
+    ring->tx_frame = (ring->tx_frame + 1) % ring->tx_req.tp_frame_nr;
+    frames_queued++;
+  }
+
+  if (frames_queued == 0) {
+    return -1;
+  }
+
+  /* Entregar al núcleo todas las tramas del lote con una única llamada */
+  int err;
+  do {
+    err = send(ring->fd, NULL, 0, 0);
+  } while ((err == -1) && (errno == EINTR));
+  if (err == -1) {
+    fprintf(stderr, "eth_ring: ERROR en send(): %s\n", strerror(errno));
+    return -1;
+  }
+
+  return frames_queued;
+}
+
+
+static int eth_ring_send ( void * priv, unsigned char * frame, int frame_len )
+{
+  int err = eth_ring_send_batch(priv, &frame, &frame_len, 1);
+  if (err != 1) {
+    return -1;
+  }
+
+  return frame_len;
+}
+
+
+static int eth_ring_getfd ( void * priv )
+{
+  struct eth_ring * ring = priv;
+
+  return (ring->epfd != -1) ? ring->epfd : ring->fd;
+}
+
+
+static int eth_ring_getmtu ( void * priv )
+{
+  struct eth_ring * ring = priv;
+
+  return ring->mtu;
+}
+
+
+static int eth_ring_set_filter
+( void * priv, struct sock_filter insns[], int num )
+{
+  struct eth_ring * ring = priv;
+
+  if ((ring->arp_fd != -1) &&
+      (eth_packet_filter(ring->arp_fd, insns, num) == -1)) {
+    return -1;
+  }
+
+  return eth_packet_filter(ring->fd, insns, num);
+}
+
+
+static int eth_ring_close ( void * priv )
+{
+  struct eth_ring * ring = priv;
+
+  if (ring->map != MAP_FAILED) {
+    munmap(ring->map, ring->map_len);
+  }
+  eth_packet_arp_close(ring->arp_fd, ring->epfd);
+  int err = close(ring->fd);
+  free(ring);
+
+  return err;
+}
+
+
+/* Backend con anillos TPACKET_V3 proyectados en memoria.
+   Prefijo: "ring:<ifname>" */
+eth_backend_t ETH_BACKEND_RING = {
+  .name = "ring",
+  .open = eth_ring_open,
+  .send = eth_ring_send,
+  .send_batch = eth_ring_send_batch,
+  .recv = eth_ring_recv,
+  .recv_batch = eth_ring_recv_batch,
+  .getfd = eth_ring_getfd,
+  .getmtu = eth_ring_getmtu,
+  .set_filter = eth_ring_set_filter,
+  .close = eth_ring_close
+};
@@ -0,0 +1,582 @@
+#include "eth_backend.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/timerfd.h>
+
+/* Backend "pcap": reproduce un fichero de captura como si sus tramas
+ * llegasen por la interfaz.
+ *
+ * El nombre de la interfaz tiene el formato
+ *
+ *   "pcap:<fichero>[,rate=orig|max|<pps>][,loop=<n>][,tx=<fichero>][,mac=<MAC>]"
+ *
+ *  - 'rate=orig' (por defecto) respeta los tiempos entre tramas de la
+ *    captura, 'rate=<pps>' entrega '<pps>' tramas por segundo y 'rate=max'
+ *    las entrega tan rápido como se reciban.
+ *  - 'loop=<n>' reproduce el fichero '<n>' veces ('0' indefinidamente). Por
+ *    defecto se reproduce una vez; después la interfaz queda en silencio:
+ *    las recepciones con temporizador expiran y las que esperan sin límite
+ *    devuelven '-1' (fin de la captura) en lugar de bloquearse para siempre.
+ *  - 'tx=<fichero>' guarda las tramas enviadas en otro fichero pcap. Si no
+ *    se indica, las tramas enviadas se descartan.
+ *  - 'mac=<MAC>' fija la dirección MAC de la interfaz. Por defecto se usa la
+ *    dirección destino de la primera trama unicast de la captura, de modo
+ *    que 'eth_recv()' acepte las tramas reproducidas.
+ *
+ * El fichero se proyecta completo en memoria al abrir la interfaz, por lo
+ * que la recepción no hace llamadas al sistema salvo para esperar en los
+ * modos 'orig' y '<pps>'. Con 'rate=max' sirve como banco de pruebas
+ * reproducible del camino de recepción eth_recv() -> ipv4_recv() ->
+ * udp_recv().
+ *
+ * Sólo se admiten capturas pcap clásicas de tramas Ethernet (DLT_EN10MB),
+ * con marcas de tiempo en microsegundos o nanosegundos y en cualquier orden
+ * de bytes.
+ */
+
+/* Cabecera global de un fichero pcap */
+struct pcap_file_header {
+  uint32_t magic;
+  uint16_t version_major;
+  uint16_t version_minor;
+  int32_t thiszone;
+  uint32_t sigfigs;
+  uint32_t snaplen;
+  uint32_t linktype;
+};
+
+/* Cabecera de cada trama de un fichero pcap */
+struct pcap_record_header {
+  uint32_t ts_sec;
+  uint32_t ts_frac;   /* Microsegundos o nanosegundos según 'magic' */
+  uint32_t incl_len;  /* Bytes guardados en el fichero */
+  uint32_t orig_len;  /* Bytes de la trama original */
+};
+
+#define PCAP_MAGIC_USEC 0xa1b2c3d4
+#define PCAP_MAGIC_NSEC 0xa1b23c4d
+#define PCAP_LINKTYPE_ETHERNET 1
+
+/* Modos de reproducción */
+#define ETH_PCAP_RATE_ORIG 0
+#define ETH_PCAP_RATE_PPS  1
+#define ETH_PCAP_RATE_MAX  2
+
+/* Estado privado de una interfaz "pcap" */
+struct eth_pcap {
+  unsigned char * map;  /* Fichero de captura proyectado en memoria */
+  size_t map_len;
+  int swapped;          /* Fichero con el orden de bytes contrario */
+  uint64_t ts_unit;     /* Nanosegundos por unidad de 'ts_frac' */
+  size_t offset;        /* Posición de la siguiente trama */
+
+  int rate;             /* ETH_PCAP_RATE_* */
+  long int pps;
+  int loops;            /* Pasadas a reproducir ('0' indefinidamente) */
+  int loop_num;         /* Pasada actual, empezando en 1 */
+
+  uint64_t start_ns;    /* Instante de entrega de la primera trama de la
+                           pasada actual */
+  uint64_t first_ts;    /* Marca de tiempo de la primera trama */
+  uint64_t last_release;/* Instante de entrega de la última trama */
+  uint64_t frame_num;   /* Tramas entregadas desde el inicio */
+
+  int tfd;              /* timerfd armado a la entrega de la siguiente trama */
+  FILE * tx_file;       /* Fichero pcap de las tramas enviadas, o 'NULL' */
+};
+
+
+/* Devuelve el instante actual del reloj monotónico en nanosegundos */
+static uint64_t eth_pcap_now ( void )
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+
+  return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+
+/* Espera hasta el instante 'ns' del reloj monotónico */
+static void eth_pcap_sleep_until ( uint64_t ns )
+{
+  struct timespec ts;
+  ts.tv_sec = ns / 1000000000ULL;
+  ts.tv_nsec = ns % 1000000000ULL;
+  while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR);
+}
+
+
+static uint32_t eth_pcap_u32 ( struct eth_pcap * pcap, uint32_t value )
+{
+  return pcap->swapped ? __builtin_bswap32(value) : value;
+}
+
+
+/* Lee la cabecera de la trama en 'offset'. Devuelve '0' si no quedan tramas
+   completas en el fichero. */
+static int eth_pcap_record
+( struct eth_pcap * pcap, size_t offset, struct pcap_record_header * hdr )
+{
+  if (offset + sizeof(struct pcap_record_header) > pcap->map_len) {
+    return 0;
+  }
+  memcpy(hdr, pcap->map + offset, sizeof(struct pcap_record_header));
+  hdr->ts_sec = eth_pcap_u32(pcap, hdr->ts_sec);
+  hdr->ts_frac = eth_pcap_u32(pcap, hdr->ts_frac);
+  hdr->incl_len = eth_pcap_u32(pcap, hdr->incl_len);
+  hdr->orig_len = eth_pcap_u32(pcap, hdr->orig_len);
+  if (hdr->incl_len >
+      pcap->map_len - offset - sizeof(struct pcap_record_header)) {
+    /* Trama cortada al final del fichero */
+    return 0;
+  }
+
+  return 1;
+}
+
+
+static uint64_t eth_pcap_ts ( struct eth_pcap * pcap,
+                              struct pcap_record_header * hdr )
+{
+  return (uint64_t) hdr->ts_sec * 1000000000ULL + hdr->ts_frac * pcap->ts_unit;
+}
+
+
+/* Localiza la siguiente trama a entregar, volviendo al principio del fichero
+   si quedan pasadas. Devuelve '0' si la reproducción ha terminado; en otro
+   caso copia la trama en 'frame' y 'frame_len' y el instante en el que debe
+   entregarse en 'release'. No avanza la reproducción. */
+static int eth_pcap_peek
+( struct eth_pcap * pcap, unsigned char ** frame, int * frame_len,
+  uint64_t * release )
+{
+  struct pcap_record_header hdr;
+  if ( ! eth_pcap_record(pcap, pcap->offset, &hdr)) {
+    if ((pcap->loops != 0) && (pcap->loop_num >= pcap->loops)) {
+      return 0;
+    }
+    /* Nueva pasada: con 'rate=orig' la primera trama sigue inmediatamente
+       a la última */
+    pcap->offset = sizeof(struct pcap_file_header);
+    pcap->loop_num++;
+    if (pcap->rate == ETH_PCAP_RATE_ORIG) {
+      pcap->start_ns = pcap->last_release;
+    }
+    if ( ! eth_pcap_record(pcap, pcap->offset, &hdr)) {
+      return 0;
+    }
+  }
+
+  *frame = pcap->map + pcap->offset + sizeof(struct pcap_record_header);
+  *frame_len = hdr.incl_len;
+
+  if (pcap->start_ns == 0) {
+    /* Primera trama de la reproducción */
+    pcap->start_ns = eth_pcap_now();
+    pcap->last_release = pcap->start_ns;
+  }
+
+  switch (pcap->rate) {
+    case ETH_PCAP_RATE_ORIG: {
+      uint64_t ts = eth_pcap_ts(pcap, &hdr);
+      *release = pcap->start_ns +
+        ((ts > pcap->first_ts) ? (ts - pcap->first_ts) : 0);
+      /* Las marcas de tiempo desordenadas no retroceden la reproducción */
+      if (*release < pcap->last_release) {
+        *release = pcap->last_release;
+      }
+      break;
+    }
+    case ETH_PCAP_RATE_PPS:
+      *release = pcap->start_ns +
+        (pcap->frame_num * 1000000000ULL) / pcap->pps;
+      break;
+    default:
+      *release = 0;
+      break;
+  }
+
+  return 1;
+}
+
+
+/* Avanza la reproducción tras entregar la trama devuelta por
+   'eth_pcap_peek()' */
+static void eth_pcap_consume
+( struct eth_pcap * pcap, int frame_len, uint64_t release )
+{
+  pcap->offset += sizeof(struct pcap_record_header) + frame_len;
+  pcap->frame_num++;
+  if (release > pcap->last_release) {
+    pcap->last_release = release;
+  }
+}
+
+
+/* Escribe la cabecera global del fichero pcap de tramas enviadas */
+static int eth_pcap_tx_header ( FILE * file )
+{
+  struct pcap_file_header hdr;
+  hdr.magic = PCAP_MAGIC_NSEC;
+  hdr.version_major = 2;
+  hdr.version_minor = 4;
+  hdr.thiszone = 0;
+  hdr.sigfigs = 0;
+  hdr.snaplen = ETH_HEADER_SIZE + ETH_MAX_MTU;
+  hdr.linktype = PCAP_LINKTYPE_ETHERNET;
+
+  return (fwrite(&hdr, sizeof(hdr), 1, file) == 1) ? 0 : -1;
+}
+
+
+static int eth_pcap_close ( void * priv );
+
+static void * eth_pcap_open ( char * ifname, mac_addr_t addr )
+{
+  struct eth_pcap * pcap = calloc(1, sizeof(struct eth_pcap));
+  if (pcap == NULL) {
+    fprintf(stderr, "eth_pcap: ERROR en calloc()\n");
+    return NULL;
+  }
+  pcap->map = MAP_FAILED;
+  pcap->tfd = -1;
+  pcap->rate = ETH_PCAP_RATE_ORIG;
+  pcap->loops = 1;
+  pcap->loop_num = 1;
+
+  /* Separar el nombre del fichero y las opciones */
+  char * args = strdup(ifname);
+  if (args == NULL) {
+    fprintf(stderr, "eth_pcap: ERROR en strdup()\n");
+    free(pcap);
+    return NULL;
+  }
+  char * save = NULL;
+  char * filename = strtok_r(args, ",", &save);
+  char * opt;
+  int mac_set = 0;
+  int err = (filename == NULL);
+  if (err) {
+    fprintf(stderr, "eth_pcap: ERROR: falta el nombre del fichero\n");
+  }
+  while (( ! err ) && ((opt = strtok_r(NULL, ",", &save)) != NULL)) {
+    if (strcmp(opt, "rate=orig") == 0) {
+      pcap->rate = ETH_PCAP_RATE_ORIG;
+    } else if (strcmp(opt, "rate=max") == 0) {
+      pcap->rate = ETH_PCAP_RATE_MAX;
+    } else if (strncmp(opt, "rate=", 5) == 0) {
+      pcap->rate = ETH_PCAP_RATE_PPS;
+      pcap->pps = atol(opt + 5);
+      err = (pcap->pps <= 0);
+    } else if (strncmp(opt, "loop=", 5) == 0) {
+      pcap->loops = atoi(opt + 5);
+      err = (pcap->loops < 0);
+    } else if (strncmp(opt, "tx=", 3) == 0) {
+      pcap->tx_file = fopen(opt + 3, "w");
+      if (pcap->tx_file == NULL) {
+        fprintf(stderr, "eth_pcap: ERROR al crear '%s': %s\n",
+                opt + 3, strerror(errno));
+        err = 1;
+      } else {
+        setvbuf(pcap->tx_file, NULL, _IOFBF, 1 << 20);
+        err = (eth_pcap_tx_header(pcap->tx_file) == -1);
+      }
+    } else if (strncmp(opt, "mac=", 4) == 0) {
+      err = (mac_str_addr(opt + 4, addr) != 0);
+      mac_set = 1;
+    } else {
+      err = 1;
+    }
+    if (err) {
+      fprintf(stderr, "eth_pcap: ERROR: opción inválida: '%s'\n", opt);
+    }
+  }
+
+  /* Proyectar la captura completa en memoria */
+  int fd = -1;
+  struct stat st;
+  if ( ! err ) {
+    fd = open(filename, O_RDONLY);
+    if ((fd == -1) || (fstat(fd, &st) == -1)) {
+      fprintf(stderr, "eth_pcap: ERROR al abrir '%s': %s\n",
+              filename, strerror(errno));
+      err = 1;
+    } else if (st.st_size < (off_t) sizeof(struct pcap_file_header)) {
+      fprintf(stderr, "eth_pcap: ERROR: '%s' no es un fichero pcap\n",
+              filename);
+      err = 1;
+    }
+  }
+  if ( ! err ) {
+    pcap->map_len = st.st_size;
+    pcap->map = mmap(NULL, pcap->map_len, PROT_READ,
+                     MAP_PRIVATE | MAP_POPULATE, fd, 0);
+    if (pcap->map == MAP_FAILED) {
+      fprintf(stderr, "eth_pcap: ERROR en mmap(): %s\n", strerror(errno));
+      err = 1;
+    }
+  }
+  if (fd != -1) {
+    close(fd);
+  }
+
+  /* Validar la cabecera global */
+  if ( ! err ) {
+    struct pcap_file_header hdr;
+    memcpy(&hdr, pcap->map, sizeof(hdr));
+    uint32_t magic = hdr.magic;
+    if ((magic == __builtin_bswap32(PCAP_MAGIC_USEC)) ||
+        (magic == __builtin_bswap32(PCAP_MAGIC_NSEC))) {
+      pcap->swapped = 1;
+      magic = __builtin_bswap32(magic);
+    }
+    if (magic == PCAP_MAGIC_USEC) {
+      pcap->ts_unit = 1000;
+    } else if (magic == PCAP_MAGIC_NSEC) {
+      pcap->ts_unit = 1;
+    } else {
+      fprintf(stderr, "eth_pcap: ERROR: '%s' no es un fichero pcap\n",
+              filename);
+      err = 1;
+    }
+    if (( ! err ) &&
+        (eth_pcap_u32(pcap, hdr.linktype) != PCAP_LINKTYPE_ETHERNET)) {
+      fprintf(stderr, "eth_pcap: ERROR: '%s' no contiene tramas Ethernet\n",
+              filename);
+      err = 1;
+    }
+  }
+
+  /* Marca de tiempo de la primera trama y dirección MAC por defecto */
+  if ( ! err ) {
+    pcap->offset = sizeof(struct pcap_file_header);
+    struct pcap_record_header rec;
+    size_t offset = pcap->offset;
+    int first = 1;
+    while (eth_pcap_record(pcap, offset, &rec)) {
+      unsigned char * frame = pcap->map + offset + sizeof(rec);
+      if (first) {
+        pcap->first_ts = eth_pcap_ts(pcap, &rec);
+        first = 0;
+      }
+      if (mac_set) {
+        break;
+      }
+      if ((rec.incl_len >= ETH_HEADER_SIZE) && ((frame[0] & 0x01) == 0)) {
+        memcpy(addr, frame, MAC_ADDR_SIZE);
+        mac_set = 1;
+        break;
+      }
+      offset += sizeof(rec) + rec.incl_len;
+    }
+    if ( ! mac_set ) {
+      mac_addr_t default_mac = { 0x02, 0x70, 0x63, 0x61, 0x70, 0x01 };
+      memcpy(addr, default_mac, MAC_ADDR_SIZE);
+    }
+  }
+
+  if ( ! err ) {
+    pcap->tfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK);
+    if (pcap->tfd == -1) {
+      fprintf(stderr, "eth_pcap: ERROR en timerfd_create(): %s\n",
+              strerror(errno));
+      err = 1;
+    }
+  }
+
+  free(args);
+  if (err) {
+    eth_pcap_close(pcap);
+    return NULL;
+  }
+
+  return pcap;
+}
+
+
+static int eth_pcap_send ( void * priv, unsigned char * frame, int frame_len )
+{
+  struct eth_pcap * pcap = priv;
+
+  if (pcap->tx_file == NULL) {
+    /* Sumidero: las tramas enviadas se descartan */
+    return frame_len;
+  }
+
+  struct timespec ts;
+  clock_gettime(CLOCK_REALTIME, &ts);
+
+  struct pcap_record_header hdr;
+  hdr.ts_sec = ts.tv_sec;
+  hdr.ts_frac = ts.tv_nsec;
+  hdr.incl_len = frame_len;
+  hdr.orig_len = frame_len;
+  if ((fwrite(&hdr, sizeof(hdr), 1, pcap->tx_file) != 1) ||
+      (fwrite(frame, frame_len, 1, pcap->tx_file) != 1)) {
+    fprintf(stderr, "eth_pcap: ERROR al escribir la trama enviada: %s\n",
+            strerror(errno));
+    return -1;
+  }
+
+  return frame_len;
+}
+
+
+static int eth_pcap_send_batch
+( void * priv, unsigned char * frames[], int frame_lens[], int num )
+{
+  int i;
+  for (i=0; i<num; i++) {
+    if (eth_pcap_send(priv, frames[i], frame_lens[i]) == -1) {
+      return (i > 0) ? i : -1;
+    }
+  }
+
+  return num;
+}
+
+
+static int eth_pcap_recv_batch
+( void * priv, unsigned char * buffers[], int buf_len,
+  int frame_lens[], uint64_t tstamps[], int num, long int timeout )
+{
+  struct eth_pcap * pcap = priv;
+
+  uint64_t now = eth_pcap_now();
+  uint64_t deadline = (timeout < 0) ?
+    UINT64_MAX : now + (uint64_t) timeout * 1000000ULL;
+
+  /* Esperar a que deba entregarse la primera trama */
+  unsigned char * frame;
+  int frame_len;
+  uint64_t release;
+  if ( ! eth_pcap_peek(pcap, &frame, &frame_len, &release)) {
+    /* Reproducción terminada: la interfaz queda en silencio. Sin
+       temporizador no se bloquea para siempre, porque ya no va a llegar
+       ninguna trama */
+    if (deadline == UINT64_MAX) {
+      fprintf(stderr, "eth_pcap: ERROR: fin de la captura\n");
+      return -1;
+    }
+    release = UINT64_MAX;
+  }
+  if (release > deadline) {
+    eth_pcap_sleep_until(deadline);
+    return 0;
+  }
+  if (release > now) {
+    eth_pcap_sleep_until(release);
+    now = release;
+  }
+
+  /* Entregar también, sin esperar, las siguientes tramas que ya tocan. La
+     marca de llegada de cada trama es su instante de entrega, pasado al
+     reloj de 'eth_tstamp_now()' */
+  uint64_t tstamp_offset = eth_tstamp_now() - eth_pcap_now();
+  int frames_recv = 0;
+  do {
+    int copy_len = (frame_len > buf_len) ? buf_len : frame_len;
+    memcpy(buffers[frames_recv], frame, copy_len);
+    frame_lens[frames_recv] = copy_len;
+    tstamps[frames_recv] = release + tstamp_offset;
+    frames_recv++;
+    eth_pcap_consume(pcap, frame_len, release);
+  } while ((frames_recv < num) &&
+           eth_pcap_peek(pcap, &frame, &frame_len, &release) &&
+           (release <= now));
+
+  return frames_recv;
+}
+
+
+static int eth_pcap_recv
+( void * priv, unsigned char buffer[], int buf_len, long int timeout )
+{
+  int frame_len;
+  uint64_t tstamp;
+  unsigned char * buffers[1] = { buffer };
+  int r = eth_pcap_recv_batch(priv, buffers, buf_len, &frame_len, &tstamp, 1,
+                              timeout);
+  if (r <= 0) {
+    return r;
+  }
+
+  return frame_len;
+}
+
+
+/* Arma el timerfd para que poll() lo vea listo al llegar el instante de
+   entrega de la siguiente trama */
+static int eth_pcap_getfd ( void * priv )
+{
+  struct eth_pcap * pcap = priv;
+
+  unsigned char * frame;
+  int frame_len;
+  uint64_t release;
+  struct itimerspec its;
+  memset(&its, 0, sizeof(its));
+  if (eth_pcap_peek(pcap, &frame, &frame_len, &release)) {
+    if (release == 0) {
+      /* Un instante ya pasado: el temporizador vence inmediatamente */
+      release = 1;
+    }
+    its.it_value.tv_sec = release / 1000000000ULL;
+    its.it_value.tv_nsec = release % 1000000000ULL;
+  }
+  if (timerfd_settime(pcap->tfd, TFD_TIMER_ABSTIME, &its, NULL) == -1) {
+    fprintf(stderr, "eth_pcap: ERROR en timerfd_settime(): %s\n",
+            strerror(errno));
+    return -1;
+  }
+
+  return pcap->tfd;
+}
+
+
+static int eth_pcap_close ( void * priv )
+{
+  struct eth_pcap * pcap = priv;
+  int err = 0;
+
+  if (pcap->tx_file != NULL) {
+    if (fclose(pcap->tx_file) != 0) {
+      fprintf(stderr, "eth_pcap: ERROR al cerrar el fichero de envío: %s\n",
+              strerror(errno));
+      err = -1;
+    }
+  }
+  if (pcap->map != MAP_FAILED) {
+    munmap(pcap->map, pcap->map_len);
+  }
+  if (pcap->tfd != -1) {
+    close(pcap->tfd);
+  }
+  free(pcap);
+
+  return err;
+}
+
+
+/* Reproducción de un fichero pcap. Prefijo:
+   "pcap:<fichero>[,rate=orig|max|<pps>][,loop=<n>][,tx=<fichero>][,mac=<MAC>]" */
+eth_backend_t ETH_BACKEND_PCAP = {
+  .name = "pcap",
+  .open = eth_pcap_open,
+  .send = eth_pcap_send,
+  .send_batch = eth_pcap_send_batch,
+  .recv = eth_pcap_recv,
+  .recv_batch = eth_pcap_recv_batch,
+  .getfd = eth_pcap_getfd,
+  .getmtu = NULL,
+  .set_filter = NULL,
+  .close = eth_pcap_close
+};
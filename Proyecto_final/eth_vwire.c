@@ -0,0 +1,457 @@
+#include "eth_backend.h"
+#include <timerms.h>
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sys/eventfd.h>
+
+/* Backend "vwire": cable virtual dentro del proceso.
+ *
+ * Todas las interfaces abiertas con el mismo nombre de cable
+ * ("vwire:<cable>[,<MAC>]") quedan conectadas como en un concentrador: cada
+ * trama enviada por una de ellas se copia a todas las demás, que filtran la
+ * dirección MAC destino igual que con una tarjeta real. Cada par
+ * origen/destino tiene su propio anillo con un único productor y un único
+ * consumidor, por lo que el camino de datos no usa cerrojos: basta con que
+ * cada interfaz reciba desde un único hilo, pues los envíos de varios hilos
+ * ya los serializa la interfaz Ethernet ('eth_send()').
+ *
+ * Si no se indica la dirección MAC, la interfaz i-ésima del cable recibe
+ * 02:76:77:00:00:<i+1>. Si el anillo hacia una interfaz está lleno la trama
+ * se pierde, como en un cable saturado.
+ *
+ * Las interfaces de un cable no deben cerrarse mientras otras envían.
+ */
+
+/* Número máximo de interfaces conectadas a un mismo cable */
+#define ETH_VWIRE_MAX_PORTS 4
+
+/* Número de tramas de cada anillo (potencia de 2) */
+#define ETH_VWIRE_RING_SIZE 256
+
+/* Tamaño máximo de una trama (sin incluir el campo FCS). El cable admite
+   tramas "jumbo", aunque las interfaces se abren con la MTU por defecto
+   ('ETH_MTU') y hay que aumentarla con 'eth_setmtu()' para usarlas. */
+#define ETH_VWIRE_FRAME_MAX (ETH_HEADER_SIZE + ETH_MAX_MTU)
+
+/* Longitud máxima del nombre de un cable */
+#define ETH_VWIRE_NAME_MAX 32
+
+/* Anillo de tramas de una interfaz a otra. 'head' sólo lo escribe el
+   productor y 'tail' el consumidor; están en líneas de caché distintas. */
+struct eth_vwire_ring {
+  uint32_t head __attribute__((aligned(64)));
+  uint32_t tail __attribute__((aligned(64)));
+  int frame_lens[ETH_VWIRE_RING_SIZE];
+  uint64_t tstamps[ETH_VWIRE_RING_SIZE]; /* Instante de envío de cada trama */
+  unsigned char frames[ETH_VWIRE_RING_SIZE][ETH_VWIRE_FRAME_MAX];
+};
+
+struct eth_vwire_port;
+
+/* Cable virtual */
+struct eth_vwire {
+  char name[ETH_VWIRE_NAME_MAX];
+  int num_ports;
+  struct eth_vwire_port * ports[ETH_VWIRE_MAX_PORTS];
+  /* 'rings[i][j]' lleva las tramas de la interfaz 'i' a la 'j' */
+  struct eth_vwire_ring * rings[ETH_VWIRE_MAX_PORTS][ETH_VWIRE_MAX_PORTS];
+  struct eth_vwire * next;
+};
+
+/* Estado privado de cada interfaz conectada a un cable */
+struct eth_vwire_port {
+  struct eth_vwire * wire;
+  int index;     /* Posición de la interfaz en el cable */
+  int efd;       /* eventfd que se señala al llegar tramas con anillo vacío */
+  int next_rx;   /* Primer anillo que se consulta en la siguiente lectura */
+};
+
+/* Cables existentes, protegidos por 'eth_vwire_lock' (sólo se usa al abrir
+   y cerrar interfaces) */
+static struct eth_vwire * eth_vwires = NULL;
+static pthread_mutex_t eth_vwire_lock = PTHREAD_MUTEX_INITIALIZER;
+
+
+/* Busca el cable con el nombre indicado o lo crea si no existe */
+static struct eth_vwire * eth_vwire_get ( char * name )
+{
+  struct eth_vwire * wire;
+  for (wire = eth_vwires; wire != NULL; wire = wire->next) {
+    if (strcmp(wire->name, name) == 0) {
+      return wire;
+    }
+  }
+
+  wire = calloc(1, sizeof(struct eth_vwire));
+  if (wire == NULL) {
+    fprintf(stderr, "eth_vwire: ERROR en calloc()\n");
+    return NULL;
+  }
+  strcpy(wire->name, name); /* Ya truncado a ETH_VWIRE_NAME_MAX - 1 */
+  wire->next = eth_vwires;
+  eth_vwires = wire;
+
+  return wire;
+}
+
+
+/* Elimina de la lista y libera un cable sin interfaces */
+static void eth_vwire_free ( struct eth_vwire * wire )
+{
+  struct eth_vwire ** prev = &eth_vwires;
+  while (*prev != wire) {
+    prev = &(*prev)->next;
+  }
+  *prev = wire->next;
+  free(wire);
+}
+
+
+static void * eth_vwire_open ( char * ifname, mac_addr_t addr )
+{
+  /* Separar el nombre del cable y la dirección MAC opcional */
+  char name[ETH_VWIRE_NAME_MAX];
+  strncpy(name, ifname, ETH_VWIRE_NAME_MAX - 1);
+  name[ETH_VWIRE_NAME_MAX - 1] = '\0';
+  char * mac_str = strchr(name, ',');
+  if (mac_str != NULL) {
+    *mac_str = '\0';
+    mac_str++;
+    if (mac_str_addr(mac_str, addr) != 0) {
+      fprintf(stderr, "eth_vwire: ERROR: dirección MAC inválida: '%s'\n",
+              mac_str);
+      return NULL;
+    }
+  }
+
+  struct eth_vwire_port * port = calloc(1, sizeof(struct eth_vwire_port));
+  if (port == NULL) {
+    fprintf(stderr, "eth_vwire: ERROR en calloc()\n");
+    return NULL;
+  }
+  port->efd = eventfd(0, EFD_NONBLOCK);
+  if (port->efd == -1) {
+    fprintf(stderr, "eth_vwire: ERROR en eventfd(): %s\n", strerror(errno));
+    free(port);
+    return NULL;
+  }
+
+  pthread_mutex_lock(&eth_vwire_lock);
+
+  struct eth_vwire * wire = eth_vwire_get(name);
+  int index = -1;
+  int i;
+  if (wire != NULL) {
+    for (i=0; i<ETH_VWIRE_MAX_PORTS; i++) {
+      if (wire->ports[i] == NULL) {
+        index = i;
+        break;
+      }
+    }
+    if (index == -1) {
+      fprintf(stderr, "eth_vwire: ERROR: el cable '%s' está completo\n",
+              name);
+    }
+  }
+
+  /* Crear los anillos hacia y desde cada interfaz ya conectada */
+  int err = (index == -1);
+  for (i=0; (i<ETH_VWIRE_MAX_PORTS) && ( ! err ); i++) {
+    if (wire->ports[i] == NULL) {
+      continue;
+    }
+    wire->rings[index][i] = calloc(1, sizeof(struct eth_vwire_ring));
+    wire->rings[i][index] = calloc(1, sizeof(struct eth_vwire_ring));
+    if ((wire->rings[index][i] == NULL) || (wire->rings[i][index] == NULL)) {
+      fprintf(stderr, "eth_vwire: ERROR en calloc()\n");
+      err = 1;
+    }
+  }
+  if (err) {
+    if (wire != NULL) {
+      for (i=0; i<ETH_VWIRE_MAX_PORTS; i++) {
+        if ((index != -1) && (wire->ports[i] != NULL)) {
+          free(wire->rings[index][i]);
+          free(wire->rings[i][index]);
+          wire->rings[index][i] = NULL;
+          wire->rings[i][index] = NULL;
+        }
+      }
+      if (wire->num_ports == 0) {
+        eth_vwire_free(wire);
+      }
+    }
+    pthread_mutex_unlock(&eth_vwire_lock);
+    close(port->efd);
+    free(port);
+    return NULL;
+  }
+
+  port->wire = wire;
+  port->index = index;
+  if (mac_str == NULL) {
+    mac_addr_t default_mac = { 0x02, 0x76, 0x77, 0x00, 0x00, index + 1 };
+    memcpy(addr, default_mac, MAC_ADDR_SIZE);
+  }
+
+  /* Publicar la interfaz cuando sus anillos ya existen */
+  wire->num_ports++;
+  __atomic_store_n(&wire->ports[index], port, __ATOMIC_RELEASE);
+
+  pthread_mutex_unlock(&eth_vwire_lock);
+
+  return port;
+}
+
+
+static int eth_vwire_send ( void * priv, unsigned char * frame, int frame_len )
+{
+  struct eth_vwire_port * port = priv;
+  struct eth_vwire * wire = port->wire;
+
+  if (frame_len > ETH_VWIRE_FRAME_MAX) {
+    fprintf(stderr, "eth_vwire: ERROR: trama demasiado grande: %d bytes\n",
+            frame_len);
+    return -1;
+  }
+
+  /* En el cable la trama llega a los receptores al enviarse: su marca de
+     tiempo de llegada es la del envío */
+  uint64_t tstamp = eth_tstamp_now();
+
+  int i;
+  for (i=0; i<ETH_VWIRE_MAX_PORTS; i++) {
+    struct eth_vwire_port * dst =
+      __atomic_load_n(&wire->ports[i], __ATOMIC_ACQUIRE);
+    if ((dst == NULL) || (i == port->index)) {
+      continue;
+    }
+
+    struct eth_vwire_ring * ring = wire->rings[port->index][i];
+    uint32_t head = ring->head;
+    uint32_t tail = __atomic_load_n(&ring->tail, __ATOMIC_SEQ_CST);
+    if (head - tail == ETH_VWIRE_RING_SIZE) {
+      /* Anillo lleno: la trama se pierde para esta interfaz */
+      continue;
+    }
+
+    int slot = head & (ETH_VWIRE_RING_SIZE - 1);
+    memcpy(ring->frames[slot], frame, frame_len);
+    ring->frame_lens[slot] = frame_len;
+    ring->tstamps[slot] = tstamp;
+    __atomic_store_n(&ring->head, head + 1, __ATOMIC_SEQ_CST);
+
+    /* Despertar al receptor sólo si el anillo estaba vacío: con tramas
+       pendientes ya se le ha despertado antes. 'tail' se lee de nuevo tras
+       publicar 'head', porque el receptor puede haber vaciado el anillo (y
+       el eventfd) después de la primera lectura: si no ha visto esta trama,
+       'tail' ya vale 'head' y hay que despertarle. */
+    tail = __atomic_load_n(&ring->tail, __ATOMIC_SEQ_CST);
+    if (head == tail) {
+      uint64_t one = 1;
+      if (write(dst->efd, &one, sizeof(one)) == -1) {
+        /* El contador ya estaba señalado */
+      }
+    }
+  }
+
+  return frame_len;
+}
+
+
+static int eth_vwire_send_batch
+( void * priv, unsigned char * frames[], int frame_lens[], int num )
+{
+  int i;
+  for (i=0; i<num; i++) {
+    if (eth_vwire_send(priv, frames[i], frame_lens[i]) == -1) {
+      return (i > 0) ? i : -1;
+    }
+  }
+
+  return num;
+}
+
+
+/* Extrae la siguiente trama de los anillos hacia la interfaz, consultándolos
+   por turnos, y su marca de tiempo de envío. Devuelve su longitud o '0' si
+   no hay tramas pendientes. */
+static int eth_vwire_dequeue
+( struct eth_vwire_port * port, unsigned char buffer[], int buf_len,
+  uint64_t * tstamp )
+{
+  struct eth_vwire * wire = port->wire;
+
+  int n;
+  for (n=0; n<ETH_VWIRE_MAX_PORTS; n++) {
+    int i = (port->next_rx + n) % ETH_VWIRE_MAX_PORTS;
+    struct eth_vwire_ring * ring =
+      __atomic_load_n(&wire->rings[i][port->index], __ATOMIC_ACQUIRE);
+    if ((ring == NULL) || (i == port->index)) {
+      continue;
+    }
+
+    uint32_t tail = ring->tail;
+    uint32_t head = __atomic_load_n(&ring->head, __ATOMIC_SEQ_CST);
+    if (head == tail) {
+      continue;
+    }
+
+    int slot = tail & (ETH_VWIRE_RING_SIZE - 1);
+    int frame_len = ring->frame_lens[slot];
+    if (frame_len > buf_len) {
+      frame_len = buf_len;
+    }
+    memcpy(buffer, ring->frames[slot], frame_len);
+    *tstamp = ring->tstamps[slot];
+    __atomic_store_n(&ring->tail, tail + 1, __ATOMIC_SEQ_CST);
+
+    port->next_rx = (i + 1) % ETH_VWIRE_MAX_PORTS;
+    return frame_len;
+  }
+
+  return 0;
+}
+
+
+/* Espera y extrae la siguiente trama, como 'eth_vwire_recv()', devolviendo
+   también su marca de tiempo */
+static int eth_vwire_recv_tstamp
+( struct eth_vwire_port * port, unsigned char buffer[], int buf_len,
+  uint64_t * tstamp, long int timeout )
+{
+  timerms_t timer;
+  timerms_reset(&timer, timeout);
+
+  while (1) {
+    /* Vaciar el eventfd antes de consultar los anillos: una trama que llegue
+       después de la consulta volverá a señalarlo */
+    uint64_t count;
+    if (read(port->efd, &count, sizeof(count)) == -1) {
+      /* No estaba señalado */
+    }
+
+    int frame_len = eth_vwire_dequeue(port, buffer, buf_len, tstamp);
+    if (frame_len > 0) {
+      return frame_len;
+    }
+
+    long int time_left = timerms_left(&timer);
+    if (time_left == 0) {
+      return 0;
+    }
+
+    struct pollfd pfd;
+    pfd.fd = port->efd;
+    pfd.events = POLLIN;
+    pfd.revents = 0;
+    int err = poll(&pfd, 1, (time_left < 0) ? -1 : (int) time_left);
+    if ((err == -1) && (errno != EINTR)) {
+      fprintf(stderr, "eth_vwire: ERROR en poll(): %s\n", strerror(errno));
+      return -1;
+    }
+  }
+}
+
+
+static int eth_vwire_recv
+( void * priv, unsigned char buffer[], int buf_len, long int timeout )
+{
+  uint64_t tstamp;
+
+  return eth_vwire_recv_tstamp(priv, buffer, buf_len, &tstamp, timeout);
+}
+
+
+static int eth_vwire_recv_batch
+( void * priv, unsigned char * buffers[], int buf_len,
+  int frame_lens[], uint64_t tstamps[], int num, long int timeout )
+{
+  struct eth_vwire_port * port = priv;
+
+  /* Esperar a la primera trama y recoger sin esperar las siguientes */
+  int frames_recv = 0;
+  int frame_len =
+    eth_vwire_recv_tstamp(port, buffers[0], buf_len, &tstamps[0], timeout);
+  while (frame_len > 0) {
+    frame_lens[frames_recv] = frame_len;
+    frames_recv++;
+    if (frames_recv == num) {
+      break;
+    }
+    frame_len = eth_vwire_dequeue(port, buffers[frames_recv], buf_len,
+                                  &tstamps[frames_recv]);
+  }
+  if ((frame_len == -1) && (frames_recv == 0)) {
+    return -1;
+  }
+
+  /* Si el lote se ha llenado puede que queden tramas: volver a señalar el
+     eventfd para que poll() y epoll sigan viendo la interfaz lista */
+  if (frames_recv == num) {
+    uint64_t one = 1;
+    if (write(port->efd, &one, sizeof(one)) == -1) {
+      /* El contador ya estaba señalado */
+    }
+  }
+
+  return frames_recv;
+}
+
+
+static int eth_vwire_getfd ( void * priv )
+{
+  struct eth_vwire_port * port = priv;
+
+  return port->efd;
+}
+
+
+static int eth_vwire_close ( void * priv )
+{
+  struct eth_vwire_port * port = priv;
+  struct eth_vwire * wire = port->wire;
+
+  pthread_mutex_lock(&eth_vwire_lock);
+
+  __atomic_store_n(&wire->ports[port->index], NULL, __ATOMIC_RELEASE);
+  int i;
+  for (i=0; i<ETH_VWIRE_MAX_PORTS; i++) {
+    free(wire->rings[port->index][i]);
+    free(wire->rings[i][port->index]);
+    wire->rings[port->index][i] = NULL;
+    wire->rings[i][port->index] = NULL;
+  }
+  wire->num_ports--;
+  if (wire->num_ports == 0) {
+    eth_vwire_free(wire);
+  }
+
+  pthread_mutex_unlock(&eth_vwire_lock);
+
+  close(port->efd);
+  free(port);
+
+  return 0;
+}
+
+
+/* Cable virtual dentro del proceso. Prefijo: "vwire:<cable>[,<MAC>]" */
+eth_backend_t ETH_BACKEND_VWIRE = {
+  .name = "vwire",
+  .open = eth_vwire_open,
+  .send = eth_vwire_send,
+  .send_batch = eth_vwire_send_batch,
+  .recv = eth_vwire_recv,
+  .recv_batch = eth_vwire_recv_batch,
+  .getfd = eth_vwire_getfd,
+  .getmtu = NULL,
+  .set_filter = NULL,
+  .close = eth_vwire_close
+};
@@ -105,3 +105,23 @@ uint16_t ipv4_checksum ( unsigned char * data, int len )
 
   return (uint16_t) sum;
 }
+
+
+/* uint32_t ipv4_addr_value ( ipv4_addr_t addr );
+ *
+ * DESCRIPCIÓN:
+ *   Esta función devuelve la dirección IPv4 indicada como un entero de 32
+ *   bits, con el primer byte de la dirección en los bits más significativos.
+ *   Es el valor que leen las instrucciones BPF y el que se guarda en las
+ *   trazas.
+ *
+ * PARÁMETROS:
+ *   'addr': La dirección IPv4 que se quiere convertir.
+ *
+ * VALOR DEVUELTO:
+ *   El valor numérico de la dirección.
+ */
+uint32_t ipv4_addr_value ( ipv4_addr_t addr )
+{
+  return ((uint32_t) addr[0] << 24) | (addr[1] << 16) | (addr[2] << 8) | addr[3];
+}
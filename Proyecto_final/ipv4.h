@@ -19,7 +19,7 @@ typedef unsigned char ipv4_addr_t [IPv4_ADDR_SIZE];
 extern ipv4_addr_t IPv4_ZERO_ADDR;
 
 /* Logitud máxmima del nombre de un interfaz de red */
-#define IFACE_NAME_MAX_LENGTH 32
+#define IFACE_NAME_MAX_LENGTH 256
 
 
 /* void ipv4_addr_str ( ipv4_addr_t addr, char* str );
@@ -71,4 +71,21 @@ int ipv4_str_addr ( char* str, ipv4_addr_t addr );
 uint16_t ipv4_checksum ( unsigned char * data, int len );
 
 
+/* uint32_t ipv4_addr_value ( ipv4_addr_t addr );
+ *
+ * DESCRIPCIÓN:
+ *   Esta función devuelve la dirección IPv4 indicada como un entero de 32
+ *   bits, con el primer byte de la dirección en los bits más significativos.
+ *   Es el valor que leen las instrucciones BPF y el que se guarda en las
+ *   trazas.
+ *
+ * PARÁMETROS:
+ *   'addr': La dirección IPv4 que se quiere convertir.
+ *
+ * VALOR DEVUELTO:
+ *   El valor numérico de la dirección.
+ */
+uint32_t ipv4_addr_value ( ipv4_addr_t addr );
+
+
 #endif /* _IPv4_H */
@@ -1,22 +1,28 @@
 #include "ipv4_config.h"
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <errno.h>
 #include <string.h>
 #include <rawnet.h>
 #include <netinet/in.h>
 
 /* int ipv4_config_read
- * ( char* filename, char ifname[], ipv4_addr_t addr, ipv4_addr_t netmask );
+ * ( char* filename, char ifname[], ipv4_addr_t addr, ipv4_addr_t netmask,
+ *   int* mtu, char neighbors[], char snapshot[] );
  *
  * DESCRIPCIÓN:
  *   Esta función lee el fichero de configuración IPv4 especificado y devuelve
- *   el nombre del interfaz, la direccion IPv4 del mismo, y la máscara de
- *   subred.
+ *   el nombre del interfaz, la direccion IPv4 del mismo, la máscara de
+ *   subred y, si se indican las variables opcionales, la MTU del interfaz
+ *   ('MTU'), el fichero de vecinos estáticos ('Neighbors', ver
+ *   'arp_cache_read()') y el fichero de la instantánea de la caché ARP
+ *   ('NeighborSnapshot', ver 'arp_cache_save()').
  *
  *   La memoria del nombre del interfaz y de las direcciones IPv4 debe haber
  *   sido reservada previamente. Deben reservarse al menos 'IFACE_NAME_MAX_LENGTH'
- *   bytes para almacenar el nombre del interfaz.
+ *   bytes para almacenar el nombre del interfaz y 'IPv4_CONFIG_PATH_MAX'
+ *   bytes para cada nombre de fichero.
  *
  * PARÁMETROS:
  *    'filename': Nombre del fichero de configuración que se desea leer.
@@ -26,6 +32,13 @@
  *                leida del fichero de configuración.
  *     'netmask': Variable donde se copiará la máscara de subred leida del
  *                fichero de configuración.
+ *         'mtu': Variable donde se copiará la MTU leida del fichero de
+ *                configuración, o '0' si no se indica (se usa la MTU del
+ *                interfaz).
+ *   'neighbors': Variable donde se copiará el nombre del fichero de
+ *                vecinos estáticos, o "" si no se indica.
+ *    'snapshot': Variable donde se copiará el nombre del fichero de la
+ *                instantánea de la caché ARP, o "" si no se indica.
  *
  * VALOR DEVUELTO:
  *   La función devuelve '0' si el fichero de configuración se ha leido
@@ -36,7 +49,8 @@
  *   fichero de configuración.
  */
 int ipv4_config_read
-( char* filename, char ifname[], ipv4_addr_t addr, ipv4_addr_t netmask )
+( char* filename, char ifname[], ipv4_addr_t addr, ipv4_addr_t netmask,
+  int* mtu, char neighbors[], char snapshot[] )
 {
   int err = 0;
 
@@ -56,11 +70,14 @@ int ipv4_config_read
   ifname[0] = '\0';
   memset(addr, 0x00, IPv4_ADDR_SIZE);
   memset(netmask, 0x00, IPv4_ADDR_SIZE);
+  *mtu = 0;
+  neighbors[0] = '\0';
+  snapshot[0] = '\0';
 
   int linenum = 0;
   char line_buf[1024];
   char name_str[256];
-  char value_str[256];
+  char value_str[IPv4_CONFIG_PATH_MAX];
 
   while ((! feof(conf_file)) && (err==0)) {
 
@@ -79,7 +96,7 @@ int ipv4_config_read
     }
 
     /* Parse line: Format "<var> <value>\n" */
-    err = sscanf(line, "%s %s\n", name_str, value_str);
+    err = sscanf(line, "%255s %255s\n", name_str, value_str);
     if (err != 2) {
       fprintf(stderr, "%s:%d: Invalid IPv4 Configuration file format.\n",
               filename, linenum);
@@ -110,6 +127,23 @@ int ipv4_config_read
         } else {
           netmask_read = 1;
         }
+      } else if (strcasecmp(name_str, "MTU") == 0) {
+        char* end;
+        long int value = strtol(value_str, &end, 10);
+        if ((*end != '\0') || (value < ETH_MIN_MTU) || (value > ETH_MAX_MTU)) {
+          fprintf(stderr, "%s:%d: Invalid 'MTU' value: '%s'\n",
+                  filename, linenum, value_str);
+          err = -1;
+        } else {
+          *mtu = (int) value;
+          err = 0;
+        }
+      } else if (strcasecmp(name_str, "Neighbors") == 0) {
+        strcpy(neighbors, value_str);
+        err = 0;
+      } else if (strcasecmp(name_str, "NeighborSnapshot") == 0) {
+        strcpy(snapshot, value_str);
+        err = 0;
       } else {
         fprintf(stderr, "%s:%d: Unknown variable: '%s'\n",
                 filename, linenum, name_str);
@@ -6,17 +6,25 @@
 #include "ipv4_config.h"
 #include <stdio.h>
 
+/* Longitud máxima de los nombres de fichero de la configuración */
+#define IPv4_CONFIG_PATH_MAX 256
+
 /* int ipv4_config_read
- * ( char* filename, char ifname[], ipv4_addr_t addr, ipv4_addr_t netmask );
+ * ( char* filename, char ifname[], ipv4_addr_t addr, ipv4_addr_t netmask,
+ *   int* mtu, char neighbors[], char snapshot[] );
  *
  * DESCRIPCIÓN:
  *   Esta función lee el fichero de configuración IPv4 especificado y devuelve
- *   el nombre del interfaz, la direccion IPv4 del mismo, y la máscara de
- *   subred.
+ *   el nombre del interfaz, la direccion IPv4 del mismo, la máscara de
+ *   subred y, si se indican las variables opcionales, la MTU del interfaz
+ *   ('MTU'), el fichero de vecinos estáticos ('Neighbors', ver
+ *   'arp_cache_read()') y el fichero de la instantánea de la caché ARP
+ *   ('NeighborSnapshot', ver 'arp_cache_save()').
  *
  *   La memoria del nombre del interfaz y de las direcciones IPv4 debe haber
  *   sido reservada previamente. Deben reservarse al menos 'IFACE_NAME_MAX_LENGTH'
- *   bytes para almacenar el nombre del interfaz.
+ *   bytes para almacenar el nombre del interfaz y 'IPv4_CONFIG_PATH_MAX'
+ *   bytes para cada nombre de fichero.
  *
  * PARÁMETROS:
  *    'filename': Nombre del fichero de configuración que se desea leer.
@@ -26,6 +34,13 @@
  *                leida del fichero de configuración.
  *     'netmask': Variable donde se copiará la máscara de subred leida del
  *                fichero de configuración.
+ *         'mtu': Variable donde se copiará la MTU leida del fichero de
+ *                configuración, o '0' si no se indica (se usa la MTU del
+ *                interfaz).
+ *   'neighbors': Variable donde se copiará el nombre del fichero de
+ *                vecinos estáticos, o "" si no se indica.
+ *    'snapshot': Variable donde se copiará el nombre del fichero de la
+ *                instantánea de la caché ARP, o "" si no se indica.
  *
  * VALOR DEVUELTO:
  *   La función devuelve '0' si el fichero de configuración se ha leido
@@ -36,7 +51,8 @@
  *   fichero de configuración.
  */
 int ipv4_config_read
-( char* filename, char ifname[], ipv4_addr_t addr, ipv4_addr_t netmask );
+( char* filename, char ifname[], ipv4_addr_t addr, ipv4_addr_t netmask,
+  int* mtu, char neighbors[], char snapshot[] );
 
 
 #endif /* _IPv4_CONFIG_H*/
@@ -2,6 +2,8 @@
 #include "ipv4_route_table.h"
 #include "ipv4_config.h"
 #include "arp.h"
+#include "arp_cache.h"
+#include "trace.h"
 
 #include <timerms.h>
 #include <stdio.h>
@@ -142,11 +144,7 @@ int ipv4_route_lookup ( ipv4_route_t * route, ipv4_addr_t addr )
 
   prefix_length = bit_cnt;
 
-  if(prefix_length == -1){
-    printf("No son iguales.\n");
-  }else{
-    printf("El prefijo de red es: %d\n", prefix_length);
-  }
+  TRACE(TRACE_DEBUG, TRACE_IPV4_ROUTE, ipv4_addr_value(addr), prefix_length, 0, 0, NULL, 0);
 
 
   return prefix_length;
@@ -766,16 +764,23 @@ void ipv4_route_table_print ( ipv4_route_table_t * table )
 
 /* Funciones open(), close(), send(), recive() */
 
+static int ipv4_next_hop(ipv4_layer_t *layer, ipv4_addr_t dst, ipv4_addr_t next_hop);
+static int ipv4_pkt_push_header(ipv4_layer_t *layer, ipv4_addr_t dst, uint8_t protocol, pkt_buf_t * pkt);
+static int ipv4_listen_all(ipv4_layer_t* layer);
+
 ipv4_layer_t *ipv4_open(char* file_conf, char* file_conf_route){
   /*1. Crear layer->routing_table*/
   ipv4_layer_t *layer = malloc(sizeof(ipv4_layer_t));
-  layer->routing_table = malloc(sizeof(ipv4_route_table_t));
+  layer->routing_table = ipv4_route_table_create();
 
   /*2. Leer direcciones y subred de file_conf*/
   //ipv4_config_read(nom del archivo, var donde guardar iface, var donde guardar la addr, var donde guardar la netmask)
   char nom_iface[IFACE_NAME_MAX_LENGTH];
+  int mtu;
+  char neighbors[IPv4_CONFIG_PATH_MAX];
+  char snapshot[IPv4_CONFIG_PATH_MAX];
 
-  int read_config = ipv4_config_read(file_conf, nom_iface, layer->addr, layer->netmask );
+  int read_config = ipv4_config_read(file_conf, nom_iface, layer->addr, layer->netmask, &mtu, neighbors, snapshot );
   if (read_config != 0) {//en caso de que nose lea bien el archivo devolvera 0 y si hay fallo devolvera -1
       ipv4_route_table_free (layer->routing_table);
       free(layer);
@@ -800,6 +805,58 @@ ipv4_layer_t *ipv4_open(char* file_conf, char* file_conf_route){
     free(layer);
     return NULL;
   }
+  //Si el fichero indica la MTU (p.ej. 9000 para tramas jumbo) se usa en lugar de la del interfaz
+  if ((mtu > 0) && (eth_setmtu(new_eth, mtu) == -1)) {
+    eth_close(new_eth);
+    ipv4_route_table_free (layer->routing_table);
+    free(layer);
+    return NULL;
+  }
+
+  /*5. Filtro de recepcion: llegan todos los mensajes ARP (tambien las
+       peticiones a otros equipos, que confirman en la cache a los vecinos
+       que ya conocemos) y los datagramas dirigidos a nuestra IP; cuando se
+       escucha algun protocolo con ipv4_listen(), solo los de ese protocolo*/
+  memset(layer->listeners, 0, sizeof(layer->listeners));
+  memset(layer->handlers, 0, sizeof(layer->handlers));
+  memset(layer->handler_args, 0, sizeof(layer->handler_args));
+  layer->num_rules = 0;
+  layer->ip_rule = -1;
+  layer->arp_rule = eth_filter_add(layer->iface, 0x0806, NULL, 0);
+  if ((layer->arp_rule == -1) || (ipv4_listen_all(layer) == -1)) {
+    eth_close(new_eth);
+    ipv4_route_table_free (layer->routing_table);
+    free(layer);
+    return NULL;
+  }
+
+  /*6. Cache de vecinos ARP, para no resolver el siguiente salto en cada envio*/
+  //Las respuestas ARP llegan a la cache desde cualquier camino de recepcion
+  layer->arp_cache = arp_cache_create(ARP_CACHE_SIZE, ARP_REACHABLE_TIME, ARP_STALE_TIME);
+  if ((layer->arp_cache == NULL) ||
+      (arp_cache_attach(layer->arp_cache, layer->iface, layer->addr) == -1)) {
+    arp_cache_free(layer->arp_cache);
+    eth_close(new_eth);
+    ipv4_route_table_free (layer->routing_table);
+    free(layer);
+    return NULL;
+  }
+
+  /*7. Vecinos estaticos y, si se indica, la cache que guardo la ejecucion
+       anterior, para no tener que resolver otra vez los siguientes saltos*/
+  layer->arp_snapshot = NULL;
+  if ((neighbors[0] != '\0') && (arp_cache_read(layer->arp_cache, neighbors) == -1)) {
+    arp_cache_free(layer->arp_cache);
+    eth_close(new_eth);
+    ipv4_route_table_free (layer->routing_table);
+    free(layer);
+    return NULL;
+  }
+  if (snapshot[0] != '\0') {
+    layer->arp_snapshot = strdup(snapshot);
+    //una instantanea que no se puede leer no impide arrancar: la cache empieza vacia
+    arp_cache_load(layer->arp_cache, snapshot);
+  }
 
   return layer;
 }
@@ -810,10 +867,20 @@ int ipv4_close(ipv4_layer_t* layer){
   if(layer->routing_table != NULL){
     /*1. Liberar tabla de rutas layer->routing_table*/
     ipv4_route_table_free (layer->routing_table);
-    free(layer);
-    /*2. Cerrar la interfaz ethernet layer->iface*/
+    if (layer->arp_snapshot != NULL) {
+      arp_cache_save(layer->arp_cache, layer->arp_snapshot);
+      free(layer->arp_snapshot);
+    }
+    arp_cache_free(layer->arp_cache);
+    /*2. Quitar las reglas del filtro de recepcion y cerrar la interfaz
+         ethernet layer->iface (antes de liberar layer)*/
+    eth_filter_remove(layer->iface, layer->arp_rule);
+    if (layer->ip_rule >= 0) {
+      eth_filter_remove(layer->iface, layer->ip_rule);
+    }
     printf("Cerrando la interfaz Ethernet\n");
      eth_close(layer->iface);
+    free(layer);
   }
   return err;
 }
@@ -826,47 +893,55 @@ int ipv4_send(ipv4_layer_t *layer, ipv4_addr_t dst, uint8_t protocol, unsigned c
     unsigned char * payload : datos a enviar,
     int payload_length: longitud de los datos que enviamos*/
 
-   /*1. Hacer ipv4 lookup para encontrar ruta */
-   mac_addr_t mac_dst;
-   ipv4_route_t * ruta_ip = ipv4_route_table_lookup ( layer->routing_table, dst);
-   char str[IPv4_STR_MAX_LENGTH] ;
-   ipv4_addr_str ( ruta_ip->gateway_addr,str );
+  /* Se copia el payload una sola vez en el buffer de paquete, las cabeceras
+     IPv4 y Ethernet se anteponen despues en el mismo buffer */
+  pkt_buf_t pkt;
+  pkt_buf_init(&pkt);
+  unsigned char * data = pkt_buf_put(&pkt, payload_length);
+  if (data == NULL) {
+    fprintf(stderr, "ipv4_send(): ERROR: payload demasiado grande: %d bytes\n", payload_length);
+    return -1;
+  }
+  memcpy(data, payload, payload_length);
 
-   /*1.1 ruta.geteway = 0.0.0.0 => arp_resolve(ip_dest)*/
-   if (memcmp(ruta_ip->gateway_addr, IPv4_ZERO_ADDR, IPv4_ADDR_SIZE )==0){ //if (strcmp(str, "0.0.0.0")== 0){
-     printf("\n\nDirectamente contectado: %s\n",str );
-     arp_resolve(layer->iface, dst, mac_dst, layer->addr);
-   }else{
-     /*1.2 ruta.geteway != 0.0.0.0=> arp_resolve(ip_getway)*/
-      printf("\n\nIP Gateway: %s\n",str );
-      arp_resolve(layer->iface, ruta_ip->gateway_addr, mac_dst, layer->addr);
+  return ipv4_send_pkt(layer, dst, protocol, &pkt);
+}
+
+
+int ipv4_send_pkt(ipv4_layer_t *layer, ipv4_addr_t dst, uint8_t protocol, pkt_buf_t * pkt){
+  /*ipv4_layer_t *layer: info capa ip,
+    ipv4_addr_t dst: ip destino del mensaje ip,
+    uint8_t protocol: protocolo,
+    pkt_buf_t * pkt: buffer con los datos a enviar y hueco para las cabeceras*/
+
+   /*1. Hacer ipv4 lookup para encontrar el siguiente salto */
+   ipv4_addr_t next_hop;
+   if (ipv4_next_hop(layer, dst, next_hop) == -1) {
+     return -1;
    }
    uint16_t type = 0x0800;
-   /*2. Rellenar la cabecera IPv4(sin OPTION)*/
-   struct ipv4_frame ipv4_message;
-   ipv4_message.version_IHL = 0x45;
-   ipv4_message.ip_type= 0x00;
-   ipv4_message.total_length = htons(IPv4_HEADER_LENGTH + payload_length);
-   ipv4_message.id= 0x0000;
-   ipv4_message.flags_offset = 0x0000;
-   ipv4_message.ttl = 0x40;
-   ipv4_message.prot = protocol;
-   ipv4_message.checksum = 0;
-   memcpy(ipv4_message.src_addr, layer->addr, IPv4_ADDR_SIZE);
-   memcpy(ipv4_message.dst_addr, dst, IPv4_ADDR_SIZE);
-
-
-   memcpy(ipv4_message.payload, payload, payload_length);//En este punto lo que se hace es copiar
-                                                        //los valores de la payload en el campo de payload de
-                                                        //ip para luego poder enivarlo por ethernet
-   ipv4_message.checksum = htons(ipv4_checksum((unsigned char *) &ipv4_message, IPv4_HEADER_LENGTH));
-   printf("Enviamos mensaje:\n" );
-   /*3. Enviar cabecera + payload con eth_send()*/
-   int datagram_length = IPv4_HEADER_LENGTH + payload_length;
-   int r = eth_send(layer->iface, mac_dst, type, (unsigned char *) &ipv4_message, datagram_length);
-   //int r = eth_send(layer->iface, mac_dst, type, (unsigned char *) &ipv4_message, datagram_length);
-   if (r == -1) {
-     fprintf(stderr, "ERROR en eth_send)\n");
+
+   /*2. Anteponer la cabecera IPv4(sin OPTION) en el buffer y rellenarla*/
+   if (ipv4_pkt_push_header(layer, dst, protocol, pkt) == -1) {
+     return -1;
+   }
+   TRACE(TRACE_DEBUG, TRACE_IPV4_SEND, ipv4_addr_value(dst), protocol, pkt->len - IPv4_HEADER_LENGTH, 0, NULL, 0);
+
+   /*3. Enviar cabecera + payload al siguiente salto. Si no esta resuelto en la
+        cache, el datagrama se encola hasta que llegue la respuesta ARP y no se
+        espera aqui*/
+   int r = arp_cache_send(layer->arp_cache, next_hop, type, pkt);
+   if (r < 0) {
+     //El buffer se devuelve como estaba, sin la cabecera IPv4
+     pkt_buf_pull(pkt, IPv4_HEADER_LENGTH);
+   }
+   if (r == ARP_UNREACHABLE) {
+     /* El siguiente salto no respondio a la ultima resolucion: se falla sin
+        esperar ni encolar, con su propio codigo de error */
+     fprintf(stderr, "ipv4_send(): ERROR: siguiente salto inalcanzable\n");
+     return r;
+   } else if (r == -1) {
+     fprintf(stderr, "ERROR en arp_cache_send()\n");
      return r;
    } else if (r == 0) {
      fprintf(stderr, "ERROR: No hay envio de bytes\n");
@@ -877,6 +952,136 @@ int ipv4_send(ipv4_layer_t *layer, ipv4_addr_t dst, uint8_t protocol, unsigned c
 }
 
 
+int ipv4_send_batch(ipv4_layer_t *layer, ipv4_addr_t dst[], uint8_t protocol, pkt_buf_t * pkts[], int num){
+  /*ipv4_addr_t dst[]: ip destino de cada datagrama,
+    pkt_buf_t * pkts[]: buffer de cada datagrama,
+    int num: numero de datagramas del lote*/
+
+  if (num <= 0) {
+    return 0;
+  }
+  mac_addr_t mac_dst[num];
+  ipv4_addr_t next_hop;
+  int done = 0;      //datagramas ya enviados o encolados: pkts[0..done)
+  int num_batch = 0; //datagramas resueltos pendientes de enviar: pkts[done..done+num_batch)
+  int pushed = 0;    //datagramas con la cabecera IPv4 puesta: pkts[0..pushed)
+  int err = 0;
+  int i;
+
+  for (i=0; i<num; i++) {
+    /*1. Buscar el siguiente salto y anteponer la cabecera IPv4*/
+    if (ipv4_next_hop(layer, dst[i], next_hop) == -1) {
+      err = -1;
+      break;
+    }
+    if (ipv4_pkt_push_header(layer, dst[i], protocol, pkts[i]) == -1) {
+      err = -1;
+      break;
+    }
+    pushed++;
+
+    /*2. Los datagramas con el siguiente salto en la cache van al lote*/
+    int state = arp_cache_lookup(layer->arp_cache, next_hop, mac_dst[num_batch]);
+    if ((state == ARP_STATE_REACHABLE) || (state == ARP_STATE_STALE)) {
+      num_batch++;
+      continue;
+    }
+
+    /*3. Los demas se encolan hasta que llegue la respuesta ARP. Antes se
+         envia el lote pendiente, para que los datagramas salgan en orden y
+         los enviados sean siempre los primeros*/
+    if (num_batch > 0) {
+      int r = eth_send_batch(layer->iface, mac_dst, 0x0800, &pkts[done], num_batch);
+      if (r > 0) {
+        done += r;
+      }
+      num_batch = 0;
+      if (done < i) {//no se ha enviado todo el lote
+        fprintf(stderr, "ERROR en eth_send_batch()\n");
+        err = -1;
+        break;
+      }
+    }
+    int r = arp_cache_send(layer->arp_cache, next_hop, 0x0800, pkts[i]);
+    if ((r == -1) || (r == ARP_UNREACHABLE)) {
+      //Cola llena o siguiente salto inalcanzable: el lote termina aqui
+      err = r;
+      break;
+    }
+    done++;
+  }
+
+  /*4. Enviar el lote pendiente, que son los datagramas resueltos anteriores
+       al que ha terminado el lote, si lo hay*/
+  if (num_batch > 0) {
+    int r = eth_send_batch(layer->iface, mac_dst, 0x0800, &pkts[done], num_batch);
+    if (r > 0) {
+      done += r;
+    }
+    if (r < num_batch) {
+      fprintf(stderr, "ERROR en eth_send_batch()\n");
+      err = -1;
+    }
+  }
+
+  /*5. Quitar la cabecera IPv4 de los datagramas que no se han enviado ni
+       encolado, para que el llamante pueda volver a enviarlos*/
+  for (i=done; i<pushed; i++) {
+    pkt_buf_pull(pkts[i], IPv4_HEADER_LENGTH);
+  }
+
+  return (done > 0) ? done : err;
+}
+
+
+/* Busca la ruta hacia 'dst' y copia en 'next_hop' la direccion IPv4 que hay
+   que resolver con ARP: el gateway de la ruta o el propio destino si esta
+   directamente conectado. Devuelve 0, o -1 si no hay ruta. */
+static int ipv4_next_hop(ipv4_layer_t *layer, ipv4_addr_t dst, ipv4_addr_t next_hop){
+   ipv4_route_t * ruta_ip = ipv4_route_table_lookup ( layer->routing_table, dst);
+   if (ruta_ip == NULL) {
+     fprintf(stderr, "ipv4_send(): ERROR: no hay ruta al destino\n");
+     return -1;
+   }
+   /*1.1 ruta.geteway = 0.0.0.0 => arp_resolve(ip_dest)*/
+   int is_gateway = (memcmp(ruta_ip->gateway_addr, IPv4_ZERO_ADDR, IPv4_ADDR_SIZE ) != 0);
+   if (!is_gateway){
+     memcpy(next_hop, dst, IPv4_ADDR_SIZE);
+   }else{
+     /*1.2 ruta.geteway != 0.0.0.0=> arp_resolve(ip_getway)*/
+      memcpy(next_hop, ruta_ip->gateway_addr, IPv4_ADDR_SIZE);
+   }
+   TRACE(TRACE_DEBUG, TRACE_IPV4_NEXT_HOP, ipv4_addr_value(dst), ipv4_addr_value(next_hop), is_gateway, 0, NULL, 0);
+   return 0;
+}
+
+
+/* Antepone y rellena la cabecera IPv4 (sin OPTION) en el buffer de paquete.
+   Devuelve 0, o -1 si no hay hueco para la cabecera. */
+static int ipv4_pkt_push_header(ipv4_layer_t *layer, ipv4_addr_t dst, uint8_t protocol, pkt_buf_t * pkt){
+   int payload_length = pkt->len;
+
+   struct ipv4_frame * ipv4_message = (struct ipv4_frame *) pkt_buf_push(pkt, IPv4_HEADER_LENGTH);
+   if (ipv4_message == NULL) {
+     fprintf(stderr, "ipv4_send(): ERROR: no hay espacio para la cabecera\n");
+     return -1;
+   }
+   ipv4_message->version_IHL = 0x45;
+   ipv4_message->ip_type= 0x00;
+   ipv4_message->total_length = htons(IPv4_HEADER_LENGTH + payload_length);
+   ipv4_message->id= 0x0000;
+   ipv4_message->flags_offset = 0x0000;
+   ipv4_message->ttl = 0x40;
+   ipv4_message->prot = protocol;
+   ipv4_message->checksum = 0;
+   memcpy(ipv4_message->src_addr, layer->addr, IPv4_ADDR_SIZE);
+   memcpy(ipv4_message->dst_addr, dst, IPv4_ADDR_SIZE);
+   ipv4_message->checksum = htons(ipv4_checksum((unsigned char *) ipv4_message, IPv4_HEADER_LENGTH));
+
+   return 0;
+}
+
+
 int ipv4_recv(ipv4_layer_t* layer,uint8_t protocol, unsigned char buffer[], ipv4_addr_t sender, int buf_len, long int timeout){
   /*ipv4_layer_t* layer: info capa ip,
     uint8_t protocol: protocolo,
@@ -884,6 +1089,68 @@ int ipv4_recv(ipv4_layer_t* layer,uint8_t protocol, unsigned char buffer[], ipv4
     ipv4_addr_t sender: se guarda la ip de quien nos ha mandado ,
     int buf_len: longitud de los datos recibidos,
     long int timeout*/
+  return ipv4_recv_meta(layer, protocol, buffer, sender, buf_len, timeout, NULL);
+}
+
+
+/* Igual que ipv4_recv(), devolviendo ademas en 'meta' (si no es NULL) las
+   marcas de tiempo de la trama que contenia el datagrama */
+int ipv4_recv_meta(ipv4_layer_t* layer, uint8_t protocol, unsigned char buffer[], ipv4_addr_t sender, int buf_len, long int timeout, eth_meta_t* meta){
+  eth_rx_frame_t * frame;
+
+  int r = ipv4_recv_frame(layer, protocol, sender, &frame, timeout);
+  if (r <= 0) {
+    return r;
+  }
+
+  /* Copiar el datagrama completo (cabecera + payload) y liberar la trama */
+  int datagram_len = frame->frame_len - frame->l3_offset;
+  if (buf_len > datagram_len) {
+    buf_len = datagram_len;
+  }
+  memcpy(buffer, frame->frame + frame->l3_offset, buf_len);
+  if (meta != NULL) {
+    *meta = frame->meta;
+  }
+  eth_frame_release(layer->iface, frame);
+
+  return r;
+}
+
+
+/*
+* Funcion que comprueba que la trama IPv4 recibida es un datagrama dirigido
+* a la capa y ajusta el descriptor para que apunte al payload IPv4 (se
+* descarta el relleno Ethernet si total_length es menor que la trama).
+* Devuelve el protocolo del datagrama, o -1 si no es para nosotros
+*/
+static int ipv4_frame_open(ipv4_layer_t* layer, eth_rx_frame_t* rx_frame, ipv4_addr_t sender){
+  struct ipv4_frame * ipv4_message = (struct ipv4_frame *) (rx_frame->frame + rx_frame->payload_offset);
+  int r = rx_frame->payload_len;
+  if (r < IPv4_HEADER_LENGTH) {
+    return -1;
+  }
+  int header_len = (ipv4_message->version_IHL & 0x0F) * 4;
+  int datagram_len = ntohs(ipv4_message->total_length);
+  if ((header_len < IPv4_HEADER_LENGTH) || (header_len > r) ||
+      (memcmp(layer->addr, ipv4_message->dst_addr, IPv4_ADDR_SIZE) != 0)) {
+    return -1;
+  }
+
+  memcpy(sender, ipv4_message->src_addr, IPv4_ADDR_SIZE);
+  if ((datagram_len < header_len) || (datagram_len > r)) {
+    datagram_len = r;
+  }
+  rx_frame->l3_offset = rx_frame->payload_offset;
+  rx_frame->l4_offset = rx_frame->l3_offset + header_len;
+  rx_frame->payload_offset = rx_frame->l4_offset;
+  rx_frame->payload_len = datagram_len - header_len;
+
+  return ipv4_message->prot;
+}
+
+
+int ipv4_recv_frame(ipv4_layer_t* layer, uint8_t protocol, ipv4_addr_t sender, eth_rx_frame_t** frame, long int timeout){
   /* Comprobar parámetros */
   if (layer->iface == NULL) {
     fprintf(stderr, "ipv4_recv(): ERROR: iface == NULL\n");
@@ -891,21 +1158,25 @@ int ipv4_recv(ipv4_layer_t* layer,uint8_t protocol, unsigned char buffer[], ipv4
   }
 
   uint16_t type = 0x0800;
-  struct ipv4_frame ipv4_message;
+  eth_rx_frame_t * rx_frame;
   bool is_my_response;
 
-  /*2. Crear temporizador*/
+  /*1. Crear temporizador*/
   timerms_t timer;
   long int time_left = timerms_reset(&timer, timeout);
   int r;
   mac_addr_t mac_dst;
 
-  /*2. Escuchar paquetes IPv4 con eth_recv*/
+  /*2. Escuchar paquetes IPv4 con eth_recv_frame. Si nadie ha pedido este
+       protocolo, se anade al filtro de recepcion*/
+  if (layer->listeners[protocol] == 0) {
+    ipv4_listen(layer, protocol, NULL, 0);
+  }
   do {
     time_left = timerms_left(&timer);
 
     /* Recibir trama del interfaz Ethernet */
-    r = eth_recv (layer->iface, mac_dst, type, (unsigned char *) &ipv4_message, buf_len, time_left);
+    r = eth_recv_frame (layer->iface, mac_dst, type, &rx_frame, time_left);
     if (r == -1) {
       fprintf(stderr, "ERROR en eth_recv()\n");
       return r;
@@ -914,16 +1185,144 @@ int ipv4_recv(ipv4_layer_t* layer,uint8_t protocol, unsigned char buffer[], ipv4
       return r;
     }
 
-    /*3. Ver si coincide el protocolo e IP*/
-    is_my_response =  (memcmp(layer->addr, ipv4_message.dst_addr,IPv4_ADDR_SIZE)==0) && (protocol == ipv4_message.prot);
+    /*3. Ver si coincide el protocolo e IP, sin copiar la trama*/
+    is_my_response = (ipv4_frame_open(layer, rx_frame, sender) == protocol);
 
-    if (is_my_response) {
-      memcpy(buffer, (unsigned char *) &ipv4_message, buf_len);
-      memcpy(sender,ipv4_message.src_addr, IPv4_ADDR_SIZE);
-      printf("Es la respuesta que espero:\n" );
+    if (!is_my_response) {
+      eth_frame_release(layer->iface, rx_frame);
     }
 
   }while(!is_my_response );
 
-  return (r - IPv4_HEADER_LENGTH);
+  *frame = rx_frame;
+  TRACE(TRACE_DEBUG, TRACE_IPV4_RECV, ipv4_addr_value(sender), protocol, rx_frame->payload_len, 0, NULL, 0);
+
+  return rx_frame->payload_len;
+}
+
+
+/*
+* Funcion que anade al filtro de recepcion una regla para los datagramas
+* dirigidos a la capa con el protocolo indicado
+*/
+int ipv4_listen(ipv4_layer_t* layer, uint8_t protocol, eth_filter_cond_t l4_conds[], int num_conds){
+  eth_filter_cond_t conds[ETH_FILTER_MAX_CONDS];
+  if (num_conds > ETH_FILTER_MAX_CONDS - 2) {
+    fprintf(stderr, "ipv4_listen(): ERROR: demasiadas condiciones\n");
+    return -1;
+  }
+
+  //La IP destino tiene que ser la nuestra
+  conds[0].base = ETH_FILTER_L3;
+  conds[0].offset = 16;
+  conds[0].size = IPv4_ADDR_SIZE;
+  conds[0].value = ipv4_addr_value(layer->addr);
+  //El protocolo tiene que ser el indicado
+  conds[1].base = ETH_FILTER_L3;
+  conds[1].offset = 9;
+  conds[1].size = 1;
+  conds[1].value = protocol;
+  //Condiciones sobre la cabecera de transporte
+  if (num_conds > 0) {
+    memcpy(&conds[2], l4_conds, num_conds * sizeof(eth_filter_cond_t));
+  }
+
+  int rule_id = eth_filter_add(layer->iface, 0x0800, conds, num_conds + 2);
+  if (rule_id >= 0) {
+    layer->listeners[protocol]++;
+    layer->rule_protocol[rule_id] = protocol;
+    layer->num_rules++;
+    //Con la primera regla ya no se aceptan todos los datagramas
+    if (layer->ip_rule >= 0) {
+      eth_filter_remove(layer->iface, layer->ip_rule);
+      layer->ip_rule = -1;
+    }
+  }
+
+  return rule_id;
+}
+
+
+/*
+* Funcion que elimina una regla anadida con ipv4_listen()
+*/
+int ipv4_unlisten(ipv4_layer_t* layer, int rule_id){
+  int err = eth_filter_remove(layer->iface, rule_id);
+  if (err == 0) {
+    layer->listeners[layer->rule_protocol[rule_id]]--;
+    layer->num_rules--;
+    //Sin reglas se vuelven a aceptar todos los datagramas, como al abrir
+    if (layer->num_rules == 0) {
+      ipv4_listen_all(layer);
+    }
+  }
+
+  return err;
+}
+
+
+/*
+* Funcion que anade al filtro de recepcion la regla que acepta todos los
+* datagramas dirigidos a la capa, que se usa mientras no hay reglas de
+* ipv4_listen(). Devuelve 0, o -1 si hay error
+*/
+static int ipv4_listen_all(ipv4_layer_t* layer){
+  eth_filter_cond_t cond;
+  cond.base = ETH_FILTER_L3;
+  cond.offset = 16;//direccion IPv4 destino
+  cond.size = IPv4_ADDR_SIZE;
+  cond.value = ipv4_addr_value(layer->addr);
+  layer->ip_rule = eth_filter_add(layer->iface, 0x0800, &cond, 1);
+
+  return (layer->ip_rule >= 0) ? 0 : -1;
+}
+
+
+/*
+* Funcion manejadora de las tramas IPv4 de la interfaz: entrega cada
+* datagrama a la funcion registrada para su protocolo con ipv4_set_handler()
+*/
+static int ipv4_eth_handler(eth_iface_t* iface, eth_rx_frame_t* frame, void* arg){
+  ipv4_layer_t* layer = arg;
+  ipv4_addr_t sender;
+  (void)iface;
+
+  //Se guarda el descriptor por si la trama sigue hacia ipv4_recv()
+  eth_rx_frame_t saved = *frame;
+  int protocol = ipv4_frame_open(layer, frame, sender);
+  if ((protocol >= 0) && (layer->handlers[protocol] != NULL)) {
+    TRACE(TRACE_DEBUG, TRACE_IPV4_RECV, ipv4_addr_value(sender), protocol, frame->payload_len, 0, NULL, 0);
+    if (layer->handlers[protocol](layer, sender, frame, layer->handler_args[protocol])) {
+      return 1;
+    }
+  }
+  *frame = saved;
+
+  return 0;
+}
+
+
+/*
+* Funcion que registra la funcion manejadora de los datagramas de un
+* protocolo
+*/
+int ipv4_set_handler(ipv4_layer_t* layer, uint8_t protocol, ipv4_handler_t handler, void* arg){
+  if (layer->iface == NULL) {
+    fprintf(stderr, "ipv4_set_handler(): ERROR: iface == NULL\n");
+    return -1;
+  }
+
+  //La primera funcion manejadora instala la de las tramas IPv4
+  if (eth_register_type(layer->iface, 0x0800, ipv4_eth_handler, layer) == -1) {
+    return -1;
+  }
+  if ((handler != NULL) && (layer->listeners[protocol] == 0)) {
+    if (ipv4_listen(layer, protocol, NULL, 0) < 0) {
+      return -1;
+    }
+  }
+  layer->handlers[protocol] = handler;
+  layer->handler_args[protocol] = arg;
+
+  return 0;
 }
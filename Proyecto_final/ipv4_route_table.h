@@ -2,6 +2,7 @@
 #define _IPv4_ROUTE_TABLE_H
 
 #include "ipv4.h"
+#include "arp_cache.h"
 
 #include <stdio.h>
 /* Número de entradas máximo de la tabla de rutas IPv4 */
@@ -40,7 +41,7 @@ typedef struct ipv4_route {
     uint16_t checksum;
     ipv4_addr_t src_addr;
     ipv4_addr_t dst_addr;
-    unsigned char payload[ETH_MTU - IPv4_HEADER_LENGTH];
+    unsigned char payload[ETH_MAX_MTU - IPv4_HEADER_LENGTH];
  };
 
 
@@ -72,11 +73,28 @@ typedef struct ipv4_route {
   * respectivamente, leer/escribir la tabla de rutas de/a un fichero, e
   * imprimirla por la salida estándar.
   */
+  /* Funcion manejadora de los datagramas de un protocolo, registrada con
+     ipv4_set_handler(). Recibe la trama prestada con 'l4_offset',
+     'payload_offset' y 'payload_len' apuntando al payload IPv4 y la IP
+     origen en 'sender'. Debe devolver 1 si consume la trama (sin liberarla
+     ni conservarla) o 0 si debe seguir entregandose a ipv4_recv() */
+  struct ipv4_layer;
+  typedef int (*ipv4_handler_t)(struct ipv4_layer* layer, ipv4_addr_t sender, eth_rx_frame_t* frame, void* arg);
+
   typedef struct ipv4_layer {
     eth_iface_t *iface;
     ipv4_addr_t addr;
     ipv4_addr_t netmask;
     ipv4_route_table_t *routing_table;
+    int arp_rule; //regla del filtro de recepcion para los mensajes ARP
+    int ip_rule; //regla para todos los datagramas dirigidos a addr mientras no hay reglas de ipv4_listen(), o -1
+    int num_rules; //numero de reglas de ipv4_listen()
+    int listeners[256]; //numero de reglas del filtro de recepcion de cada protocolo
+    uint8_t rule_protocol[ETH_FILTER_MAX_RULES]; //protocolo de cada regla de ipv4_listen()
+    ipv4_handler_t handlers[256]; //funcion manejadora de cada protocolo, o NULL
+    void* handler_args[256]; //argumento de la funcion manejadora de cada protocolo
+    arp_cache_t *arp_cache; //cache de vecinos ARP de la interfaz
+    char *arp_snapshot; //fichero donde se guarda la cache ARP al cerrar, o NULL
   }ipv4_layer_t;
 
 
@@ -381,7 +399,56 @@ int ipv4_route_table_write ( ipv4_route_table_t * table, char * filename );
 /* Funciones open(), close(), send(), recive() */
 ipv4_layer_t *ipv4_open(char* file_conf, char* file_conf_route);
 int ipv4_close(ipv4_layer_t* layer);
+/* Envia el datagrama sin bloquearse: si el siguiente salto no esta resuelto,
+   se encola en la cache ARP hasta que llegue la respuesta (ver
+   arp_cache_send()). Si el siguiente salto no respondio a su ultima
+   resolucion, devuelve ARP_UNREACHABLE sin enviar nada.
+   Las funciones de envio (ipv4_send, ipv4_send_pkt y ipv4_send_batch)
+   pueden llamarse desde varios hilos a la vez con la misma capa. La
+   recepcion no: se hace desde el hilo que abrio la capa, que es el que
+   procesa las respuestas ARP y envia los datagramas encolados */
 int ipv4_send(ipv4_layer_t* layer, ipv4_addr_t dst, uint8_t protocol, unsigned char* payload, int payload_len);
+/* Igual que ipv4_send(), pero antepone la cabecera IPv4 en el propio
+   buffer de paquete 'pkt' en lugar de copiar el payload. Si hay error el
+   buffer queda como estaba, sin la cabecera */
+int ipv4_send_pkt(ipv4_layer_t* layer, ipv4_addr_t dst, uint8_t protocol, pkt_buf_t* pkt);
+/* Envia un lote de 'num' datagramas, el i-esimo con destino 'dst[i]' y
+   payload en 'pkts[i]', con una unica llamada a eth_send_batch() por cada
+   tramo de datagramas con el siguiente salto resuelto. Los datagramas cuyo
+   siguiente salto no esta resuelto se encolan en la cache ARP (ver
+   arp_cache_send()). Los datagramas se procesan en orden y el lote termina
+   en el primero que no puede enviarse ni encolarse (sin ruta, sin hueco
+   para la cabecera, cola llena o siguiente salto inalcanzable).
+   Devuelve el numero de datagramas enviados o encolados, que son siempre
+   los primeros del lote; los demas quedan como estaban, sin la cabecera
+   IPv4, y pueden volver a enviarse. Si no se envia ninguno devuelve -1, o
+   ARP_UNREACHABLE si el siguiente salto del primero es inalcanzable */
+int ipv4_send_batch(ipv4_layer_t* layer, ipv4_addr_t dst[], uint8_t protocol, pkt_buf_t* pkts[], int num);
 int ipv4_recv(ipv4_layer_t* layer,uint8_t protocol, unsigned char buffer[], ipv4_addr_t sender, int buf_len, long int timeout);
+/* Igual que ipv4_recv(), pero devuelve ademas en 'meta' (si no es NULL) las
+   marcas de tiempo de llegada y lectura de la trama (ver eth_meta_t). Las
+   funciones que devuelven la trama prestada las tienen en 'frame->meta' */
+int ipv4_recv_meta(ipv4_layer_t* layer, uint8_t protocol, unsigned char buffer[], ipv4_addr_t sender, int buf_len, long int timeout, eth_meta_t* meta);
+/* Igual que ipv4_recv(), pero sin copiar el datagrama: devuelve en 'frame'
+   la trama prestada por eth_recv_frame() con 'l4_offset', 'payload_offset' y
+   'payload_len' apuntando al payload IPv4. La trama debe liberarse con
+   eth_frame_release(layer->iface, frame) */
+int ipv4_recv_frame(ipv4_layer_t* layer, uint8_t protocol, ipv4_addr_t sender, eth_rx_frame_t** frame, long int timeout);
+/* Anade al filtro de recepcion de la interfaz una regla que acepta los
+   datagramas dirigidos a la capa con el protocolo 'protocol' y que cumplen
+   las condiciones 'l4_conds' (con base ETH_FILTER_L4, como maximo
+   ETH_FILTER_MAX_CONDS - 2). ipv4_recv() anade una regla sin condiciones si
+   el protocolo no tiene ninguna. Devuelve el identificador de la regla, o
+   -1 si hay error */
+int ipv4_listen(ipv4_layer_t* layer, uint8_t protocol, eth_filter_cond_t l4_conds[], int num_conds);
+/* Elimina una regla anadida con ipv4_listen() */
+int ipv4_unlisten(ipv4_layer_t* layer, int rule_id);
+/* Registra la funcion manejadora de los datagramas dirigidos a la capa con
+   el protocolo 'protocol' ('NULL' para eliminarla). La funcion se invoca
+   desde el camino de recepcion de la interfaz, por ejemplo desde
+   eth_dispatch() en un reactor, sin que nadie llame a ipv4_recv(). Si el
+   protocolo no tiene ninguna regla en el filtro de recepcion se anade una.
+   Devuelve 0, o -1 si hay error */
+int ipv4_set_handler(ipv4_layer_t* layer, uint8_t protocol, ipv4_handler_t handler, void* arg);
 
 #endif /* _IPv4_ROUTE_TABLE_H */
@@ -0,0 +1,307 @@
+#include "reactor.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+
+struct reactor {
+  int epfd;                                 /* Descriptor de epoll */
+  eth_iface_t * ifaces[REACTOR_MAX_IFACES]; /* Interfaces, o NULL */
+  int polled[REACTOR_MAX_IFACES];           /* La interfaz no tiene
+                                               descriptor y se sondea */
+  int num_polled;
+  timer_wheel_t * wheel;                    /* Temporizadores */
+  int stopped;
+};
+
+
+/* Devuelve el instante actual del reloj monotónico en milisegundos */
+static long long int reactor_now ( void )
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+
+  return (long long int) ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+
+/* reactor_t * reactor_create ( void );
+ *
+ * DESCRIPCIÓN:
+ *   Esta función crea un reactor sin interfaces ni temporizadores.
+ *
+ *   La memoria del reactor debe ser liberada con 'reactor_free()'.
+ *
+ * VALOR DEVUELTO:
+ *   El reactor creado.
+ *
+ * ERRORES:
+ *   La función devuelve 'NULL' si se ha producido algún error.
+ */
+reactor_t * reactor_create ( void )
+{
+  reactor_t * reactor = calloc(1, sizeof(struct reactor));
+  if (reactor == NULL) {
+    fprintf(stderr, "reactor_create(): ERROR en calloc()\n");
+    return NULL;
+  }
+
+  reactor->epfd = epoll_create1(EPOLL_CLOEXEC);
+  if (reactor->epfd == -1) {
+    fprintf(stderr, "reactor_create(): ERROR en epoll_create1(): %s\n",
+            strerror(errno));
+    free(reactor);
+    return NULL;
+  }
+
+  reactor->wheel = timer_wheel_create();
+  if (reactor->wheel == NULL) {
+    close(reactor->epfd);
+    free(reactor);
+    return NULL;
+  }
+
+  return reactor;
+}
+
+
+/* int reactor_add_iface ( reactor_t * reactor, eth_iface_t * iface );
+ *
+ * DESCRIPCIÓN:
+ *   Esta función añade una interfaz Ethernet al reactor. Desde ese momento
+ *   'reactor_run()' reparte sus tramas con 'eth_dispatch()'. Añadir una
+ *   interfaz que ya está en el reactor no tiene efecto.
+ *
+ * PARÁMETROS:
+ *   'reactor': Reactor creado con 'reactor_create()'.
+ *     'iface': Manejador de la interfaz Ethernet.
+ *
+ * VALOR DEVUELTO:
+ *   Devuelve '0' si la interfaz se ha añadido.
+ *
+ * ERRORES:
+ *   La función devuelve '-1' si el reactor ya tiene 'REACTOR_MAX_IFACES'
+ *   interfaces o se ha producido algún error.
+ */
+int reactor_add_iface ( reactor_t * reactor, eth_iface_t * iface )
+{
+  if ((reactor == NULL) || (iface == NULL)) {
+    fprintf(stderr, "reactor_add_iface(): ERROR: parámetro NULL\n");
+    return -1;
+  }
+
+  int index = -1;
+  int i;
+  for (i=REACTOR_MAX_IFACES-1; i>=0; i--) {
+    if (reactor->ifaces[i] == iface) {
+      return 0;
+    } else if (reactor->ifaces[i] == NULL) {
+      index = i;
+    }
+  }
+  if (index == -1) {
+    fprintf(stderr, "reactor_add_iface(): ERROR: demasiadas interfaces\n");
+    return -1;
+  }
+
+  int fd = eth_getfd(iface);
+  if (fd == -1) {
+    /* Backend sin descriptor: se sondea en cada vuelta del reactor */
+    reactor->polled[index] = 1;
+    reactor->num_polled++;
+  } else {
+    struct epoll_event event;
+    memset(&event, 0, sizeof(event));
+    event.events = EPOLLIN;
+    event.data.u32 = index;
+    if (epoll_ctl(reactor->epfd, EPOLL_CTL_ADD, fd, &event) == -1) {
+      fprintf(stderr, "reactor_add_iface(): ERROR en epoll_ctl(): %s\n",
+              strerror(errno));
+      return -1;
+    }
+    reactor->polled[index] = 0;
+  }
+  reactor->ifaces[index] = iface;
+
+  return 0;
+}
+
+
+/* int reactor_remove_iface ( reactor_t * reactor, eth_iface_t * iface );
+ *
+ * DESCRIPCIÓN:
+ *   Esta función elimina una interfaz Ethernet del reactor. Debe llamarse
+ *   antes de cerrar la interfaz con 'eth_close()'.
+ *
+ * VALOR DEVUELTO:
+ *   Devuelve '0' si la interfaz se ha eliminado, o '-1' si no estaba en el
+ *   reactor.
+ */
+int reactor_remove_iface ( reactor_t * reactor, eth_iface_t * iface )
+{
+  int i;
+  for (i=0; i<REACTOR_MAX_IFACES; i++) {
+    if ((iface != NULL) && (reactor->ifaces[i] == iface)) {
+      if (reactor->polled[i]) {
+        reactor->num_polled--;
+      } else {
+        epoll_ctl(reactor->epfd, EPOLL_CTL_DEL, eth_getfd(iface), NULL);
+      }
+      reactor->ifaces[i] = NULL;
+      reactor->polled[i] = 0;
+      return 0;
+    }
+  }
+
+  return -1;
+}
+
+
+/* timer_wheel_t * reactor_wheel ( reactor_t * reactor );
+ *
+ * DESCRIPCIÓN:
+ *   Esta función devuelve la rueda de temporizadores del reactor, en la que
+ *   los protocolos programan sus plazos con 'timer_wheel_add()'. Las
+ *   funciones de los temporizadores se invocan desde 'reactor_run()'.
+ */
+timer_wheel_t * reactor_wheel ( reactor_t * reactor )
+{
+  return reactor->wheel;
+}
+
+
+/* Reparte las tramas pendientes de la interfaz 'index' del reactor */
+static int reactor_dispatch ( reactor_t * reactor, int index )
+{
+  eth_iface_t * iface = reactor->ifaces[index];
+  if (iface == NULL) {
+    /* Eliminada por una función manejadora en esta misma vuelta */
+    return 0;
+  }
+
+  if (eth_dispatch(iface, 0) == -1) {
+    fprintf(stderr, "reactor_run(): ERROR en eth_dispatch()\n");
+    return -1;
+  }
+
+  /* Algunos backends (pcap) rearman su descriptor al consultarlo */
+  if ((reactor->ifaces[index] == iface) && ( ! reactor->polled[index] )) {
+    eth_getfd(iface);
+  }
+
+  return 0;
+}
+
+
+/* int reactor_run ( reactor_t * reactor, long int timeout );
+ *
+ * DESCRIPCIÓN:
+ *   Esta función atiende las interfaces y temporizadores del reactor hasta
+ *   que se llame a 'reactor_stop()' o transcurran 'timeout' milisegundos.
+ *
+ * PARÁMETROS:
+ *   'reactor': Reactor creado con 'reactor_create()'.
+ *   'timeout': Tiempo máximo en milisegundos. Un número negativo indicará
+ *              que debe atenderse hasta que se llame a 'reactor_stop()'.
+ *
+ * VALOR DEVUELTO:
+ *   Devuelve '1' si se ha detenido con 'reactor_stop()', o '0' si ha
+ *   expirado el temporizador.
+ *
+ * ERRORES:
+ *   La función devuelve '-1' si se ha producido algún error.
+ */
+int reactor_run ( reactor_t * reactor, long int timeout )
+{
+  if (reactor == NULL) {
+    fprintf(stderr, "reactor_run(): ERROR: reactor == NULL\n");
+    return -1;
+  }
+
+  long long int deadline = (timeout < 0) ? -1 : reactor_now() + timeout;
+  struct epoll_event events[REACTOR_MAX_IFACES];
+
+  reactor->stopped = 0;
+  while ( ! reactor->stopped ) {
+
+    /* 1. Atender los temporizadores vencidos y calcular la espera */
+    timer_wheel_advance(reactor->wheel);
+    long int wait = timer_wheel_next(reactor->wheel);
+    if (reactor->stopped) {
+      break;
+    }
+    if (deadline >= 0) {
+      long long int now = reactor_now();
+      if (now >= deadline) {
+        return 0;
+      }
+      if ((wait == -1) || (deadline - now < wait)) {
+        wait = deadline - now;
+      }
+    }
+    if ((reactor->num_polled > 0) &&
+        ((wait == -1) || (wait > REACTOR_POLL_INTERVAL))) {
+      wait = REACTOR_POLL_INTERVAL;
+    }
+
+    /* 2. Esperar a que alguna interfaz tenga tramas */
+    int num_events = epoll_wait(reactor->epfd, events, REACTOR_MAX_IFACES,
+                                (int) wait);
+    if (num_events == -1) {
+      if (errno == EINTR) {
+        continue;
+      }
+      fprintf(stderr, "reactor_run(): ERROR en epoll_wait(): %s\n",
+              strerror(errno));
+      return -1;
+    }
+
+    /* 3. Repartir las tramas de las interfaces preparadas y de las que se
+          sondean */
+    int i;
+    for (i=0; (i<num_events) && ( ! reactor->stopped ); i++) {
+      if (reactor_dispatch(reactor, events[i].data.u32) == -1) {
+        return -1;
+      }
+    }
+    for (i=0; (i<REACTOR_MAX_IFACES) && (reactor->num_polled > 0) &&
+              ( ! reactor->stopped ); i++) {
+      if (reactor->polled[i] && (reactor_dispatch(reactor, i) == -1)) {
+        return -1;
+      }
+    }
+  }
+
+  return 1;
+}
+
+
+/* void reactor_stop ( reactor_t * reactor );
+ *
+ * DESCRIPCIÓN:
+ *   Esta función hace que 'reactor_run()' retorne tras atender el evento
+ *   en curso. Normalmente se llama desde una función manejadora.
+ */
+void reactor_stop ( reactor_t * reactor )
+{
+  reactor->stopped = 1;
+}
+
+
+/* void reactor_free ( reactor_t * reactor );
+ *
+ * DESCRIPCIÓN:
+ *   Esta función libera el reactor. Las interfaces añadidas no se cierran.
+ */
+void reactor_free ( reactor_t * reactor )
+{
+  if (reactor != NULL) {
+    timer_wheel_free(reactor->wheel);
+    close(reactor->epfd);
+    free(reactor);
+  }
+}
@@ -0,0 +1,134 @@
+#ifndef _REACTOR_H
+#define _REACTOR_H
+
+#include "eth.h"
+#include "timer_wheel.h"
+
+/* Reactor de eventos basado en epoll.
+ *
+ * Un reactor espera a la vez en varias interfaces Ethernet y temporizadores
+ * desde un único hilo. Cuando una interfaz tiene tramas pendientes las lee
+ * con 'eth_dispatch()', que las entrega a las funciones manejadoras
+ * registradas por cada protocolo ('eth_register_type()',
+ * 'ipv4_set_handler()', 'udp_set_handler()', 'arp_resolve_start()'). Los
+ * temporizadores se programan en la rueda del reactor ('reactor_wheel()'),
+ * que el reactor avanza y usa para calcular cuánto puede esperar. Así un
+ * hilo puede atender muchas interfaces, resoluciones ARP y puertos UDP sin
+ * bloquearse en ninguna función de recepción.
+ *
+ * Las interfaces cuyo backend no tiene descriptor de fichero (como
+ * 'rawnet') se sondean sin esperar cada 'REACTOR_POLL_INTERVAL'
+ * milisegundos.
+ *
+ * Un reactor sólo debe usarse desde un hilo. Las funciones manejadoras y
+ * de temporizadores pueden programar y cancelar temporizadores y llamar a
+ * 'reactor_stop()'.
+ */
+typedef struct reactor reactor_t;
+
+/* Número máximo de interfaces de un reactor */
+#define REACTOR_MAX_IFACES 16
+
+/* Intervalo en milisegundos con el que se sondean las interfaces sin
+   descriptor de fichero */
+#define REACTOR_POLL_INTERVAL 1
+
+
+/* reactor_t * reactor_create ( void );
+ *
+ * DESCRIPCIÓN:
+ *   Esta función crea un reactor sin interfaces ni temporizadores.
+ *
+ *   La memoria del reactor debe ser liberada con 'reactor_free()'.
+ *
+ * VALOR DEVUELTO:
+ *   El reactor creado.
+ *
+ * ERRORES:
+ *   La función devuelve 'NULL' si se ha producido algún error.
+ */
+reactor_t * reactor_create ( void );
+
+
+/* int reactor_add_iface ( reactor_t * reactor, eth_iface_t * iface );
+ *
+ * DESCRIPCIÓN:
+ *   Esta función añade una interfaz Ethernet al reactor. Desde ese momento
+ *   'reactor_run()' reparte sus tramas con 'eth_dispatch()'. Añadir una
+ *   interfaz que ya está en el reactor no tiene efecto.
+ *
+ * PARÁMETROS:
+ *   'reactor': Reactor creado con 'reactor_create()'.
+ *     'iface': Manejador de la interfaz Ethernet.
+ *
+ * VALOR DEVUELTO:
+ *   Devuelve '0' si la interfaz se ha añadido.
+ *
+ * ERRORES:
+ *   La función devuelve '-1' si el reactor ya tiene 'REACTOR_MAX_IFACES'
+ *   interfaces o se ha producido algún error.
+ */
+int reactor_add_iface ( reactor_t * reactor, eth_iface_t * iface );
+
+
+/* int reactor_remove_iface ( reactor_t * reactor, eth_iface_t * iface );
+ *
+ * DESCRIPCIÓN:
+ *   Esta función elimina una interfaz Ethernet del reactor. Debe llamarse
+ *   antes de cerrar la interfaz con 'eth_close()'.
+ *
+ * VALOR DEVUELTO:
+ *   Devuelve '0' si la interfaz se ha eliminado, o '-1' si no estaba en el
+ *   reactor.
+ */
+int reactor_remove_iface ( reactor_t * reactor, eth_iface_t * iface );
+
+
+/* timer_wheel_t * reactor_wheel ( reactor_t * reactor );
+ *
+ * DESCRIPCIÓN:
+ *   Esta función devuelve la rueda de temporizadores del reactor, en la que
+ *   los protocolos programan sus plazos con 'timer_wheel_add()'. Las
+ *   funciones de los temporizadores se invocan desde 'reactor_run()'.
+ */
+timer_wheel_t * reactor_wheel ( reactor_t * reactor );
+
+
+/* int reactor_run ( reactor_t * reactor, long int timeout );
+ *
+ * DESCRIPCIÓN:
+ *   Esta función atiende las interfaces y temporizadores del reactor hasta
+ *   que se llame a 'reactor_stop()' o transcurran 'timeout' milisegundos.
+ *
+ * PARÁMETROS:
+ *   'reactor': Reactor creado con 'reactor_create()'.
+ *   'timeout': Tiempo máximo en milisegundos. Un número negativo indicará
+ *              que debe atenderse hasta que se llame a 'reactor_stop()'.
+ *
+ * VALOR DEVUELTO:
+ *   Devuelve '1' si se ha detenido con 'reactor_stop()', o '0' si ha
+ *   expirado el temporizador.
+ *
+ * ERRORES:
+ *   La función devuelve '-1' si se ha producido algún error.
+ */
+int reactor_run ( reactor_t * reactor, long int timeout );
+
+
+/* void reactor_stop ( reactor_t * reactor );
+ *
+ * DESCRIPCIÓN:
+ *   Esta función hace que 'reactor_run()' retorne tras atender el evento
+ *   en curso. Normalmente se llama desde una función manejadora.
+ */
+void reactor_stop ( reactor_t * reactor );
+
+
+/* void reactor_free ( reactor_t * reactor );
+ *
+ * DESCRIPCIÓN:
+ *   Esta función libera el reactor. Las interfaces añadidas no se cierran.
+ */
+void reactor_free ( reactor_t * reactor );
+
+#endif /* _REACTOR_H */
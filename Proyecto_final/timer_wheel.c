@@ -0,0 +1,371 @@
+#include "timer_wheel.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <time.h>
+
+/* Tamaño de los niveles de la rueda: el primero tiene 2^TW_ROOT_BITS
+   posiciones de 1 ms y los TW_LEVELS siguientes 2^TW_LEVEL_BITS posiciones
+   cada uno */
+#define TW_ROOT_BITS 8
+#define TW_LEVEL_BITS 6
+#define TW_LEVELS 3
+#define TW_ROOT_SIZE (1 << TW_ROOT_BITS)
+#define TW_LEVEL_SIZE (1 << TW_LEVEL_BITS)
+#define TW_ROOT_MASK (TW_ROOT_SIZE - 1)
+#define TW_LEVEL_MASK (TW_LEVEL_SIZE - 1)
+
+/* Plazo máximo (en ms) que cabe en la rueda */
+#define TW_MAX_TIMEOUT ((1ULL << (TW_ROOT_BITS + TW_LEVELS * TW_LEVEL_BITS)) - 1)
+
+struct timer_wheel {
+  uint64_t base;   /* Instante de creación, en ms del reloj monotónico */
+  uint64_t now;    /* Siguiente milisegundo de la rueda por procesar */
+  long int count;  /* Temporizadores programados */
+  /* Cada posición es una lista circular con un temporizador centinela */
+  wheel_timer_t root[TW_ROOT_SIZE];
+  wheel_timer_t levels[TW_LEVELS][TW_LEVEL_SIZE];
+};
+
+
+/* Devuelve los milisegundos transcurridos desde la creación de la rueda */
+static uint64_t timer_wheel_clock ( timer_wheel_t * wheel )
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+
+  return ((uint64_t) ts.tv_sec * 1000 + ts.tv_nsec / 1000000) - wheel->base;
+}
+
+
+static void timer_list_init ( wheel_timer_t * head )
+{
+  head->next = head;
+  head->prev = head;
+}
+
+
+static void timer_list_unlink ( wheel_timer_t * timer )
+{
+  timer->prev->next = timer->next;
+  timer->next->prev = timer->prev;
+  timer->next = NULL;
+  timer->prev = NULL;
+}
+
+
+static void timer_list_append ( wheel_timer_t * head, wheel_timer_t * timer )
+{
+  timer->prev = head->prev;
+  timer->next = head;
+  head->prev->next = timer;
+  head->prev = timer;
+}
+
+
+/* Mueve todos los temporizadores de la lista 'from' a la lista 'to' */
+static void timer_list_splice ( wheel_timer_t * from, wheel_timer_t * to )
+{
+  if (from->next == from) {
+    timer_list_init(to);
+    return;
+  }
+  to->next = from->next;
+  to->prev = from->prev;
+  to->next->prev = to;
+  to->prev->next = to;
+  timer_list_init(from);
+}
+
+
+/* Coloca el temporizador en la posición de la rueda que corresponde a su
+   vencimiento */
+static void timer_wheel_place ( timer_wheel_t * wheel, wheel_timer_t * timer )
+{
+  uint64_t expires = timer->expires;
+  wheel_timer_t * head;
+
+  if (expires < wheel->now) {
+    /* Ya vencido: se procesa en el siguiente milisegundo */
+    head = &wheel->root[wheel->now & TW_ROOT_MASK];
+  } else {
+    uint64_t delta = expires - wheel->now;
+    if (delta > TW_MAX_TIMEOUT) {
+      /* Demasiado lejos: se recolocará al llegar al último nivel */
+      expires = wheel->now + TW_MAX_TIMEOUT;
+      delta = TW_MAX_TIMEOUT;
+    }
+    if (delta < TW_ROOT_SIZE) {
+      head = &wheel->root[expires & TW_ROOT_MASK];
+    } else {
+      int level = 0;
+      while (delta >= (1ULL << (TW_ROOT_BITS + (level + 1) * TW_LEVEL_BITS))) {
+        level++;
+      }
+      int shift = TW_ROOT_BITS + level * TW_LEVEL_BITS;
+      head = &wheel->levels[level][(expires >> shift) & TW_LEVEL_MASK];
+    }
+  }
+
+  timer_list_append(head, timer);
+}
+
+
+/* Recoloca los temporizadores de la posición actual del nivel 'level' en
+   los niveles inferiores. Devuelve el índice de esa posición. */
+static int timer_wheel_cascade ( timer_wheel_t * wheel, int level )
+{
+  int shift = TW_ROOT_BITS + level * TW_LEVEL_BITS;
+  int index = (wheel->now >> shift) & TW_LEVEL_MASK;
+
+  wheel_timer_t list;
+  timer_list_splice(&wheel->levels[level][index], &list);
+  while (list.next != &list) {
+    wheel_timer_t * timer = list.next;
+    timer_list_unlink(timer);
+    timer_wheel_place(wheel, timer);
+  }
+
+  return index;
+}
+
+
+/* timer_wheel_t * timer_wheel_create ( void );
+ *
+ * DESCRIPCIÓN:
+ *   Esta función crea una rueda de temporizadores vacía, cuyo tiempo
+ *   comienza en el instante actual.
+ *
+ *   La memoria de la rueda debe ser liberada con 'timer_wheel_free()'.
+ *
+ * VALOR DEVUELTO:
+ *   La rueda creada.
+ *
+ * ERRORES:
+ *   La función devuelve 'NULL' si se ha producido algún error.
+ */
+timer_wheel_t * timer_wheel_create ( void )
+{
+  timer_wheel_t * wheel = malloc(sizeof(struct timer_wheel));
+  if (wheel == NULL) {
+    fprintf(stderr, "timer_wheel_create(): ERROR en malloc()\n");
+    return NULL;
+  }
+
+  wheel->base = 0;
+  wheel->base = timer_wheel_clock(wheel);
+  wheel->now = 0;
+  wheel->count = 0;
+  int i, j;
+  for (i=0; i<TW_ROOT_SIZE; i++) {
+    timer_list_init(&wheel->root[i]);
+  }
+  for (i=0; i<TW_LEVELS; i++) {
+    for (j=0; j<TW_LEVEL_SIZE; j++) {
+      timer_list_init(&wheel->levels[i][j]);
+    }
+  }
+
+  return wheel;
+}
+
+
+/* void wheel_timer_init
+ * ( wheel_timer_t * timer, wheel_timer_cb_t callback, void * arg );
+ *
+ * DESCRIPCIÓN:
+ *   Esta función inicializa un temporizador sin programar, que invocará a
+ *   'callback' con el argumento 'arg' al vencer.
+ */
+void wheel_timer_init
+( wheel_timer_t * timer, wheel_timer_cb_t callback, void * arg )
+{
+  timer->next = NULL;
+  timer->prev = NULL;
+  timer->expires = 0;
+  timer->callback = callback;
+  timer->arg = arg;
+}
+
+
+/* void timer_wheel_add
+ * ( timer_wheel_t * wheel, wheel_timer_t * timer, long int timeout );
+ *
+ * DESCRIPCIÓN:
+ *   Esta función programa el temporizador para que venza dentro de
+ *   'timeout' milisegundos. Si ya estaba programado, se reprograma con el
+ *   nuevo plazo.
+ *
+ *   Por la resolución de la rueda, el temporizador puede vencer hasta 1 ms
+ *   después del plazo, pero nunca antes.
+ *
+ * PARÁMETROS:
+ *     'wheel': Rueda de temporizadores.
+ *     'timer': Temporizador inicializado con 'wheel_timer_init()'.
+ *   'timeout': Milisegundos hasta el vencimiento.
+ */
+void timer_wheel_add
+( timer_wheel_t * wheel, wheel_timer_t * timer, long int timeout )
+{
+  if (timer->next != NULL) {
+    timer_list_unlink(timer);
+    wheel->count--;
+  }
+
+  timer->expires = timer_wheel_clock(wheel) + ((timeout > 0) ? timeout : 0);
+  timer_wheel_place(wheel, timer);
+  wheel->count++;
+}
+
+
+/* int timer_wheel_cancel ( timer_wheel_t * wheel, wheel_timer_t * timer );
+ *
+ * DESCRIPCIÓN:
+ *   Esta función cancela un temporizador programado.
+ *
+ * VALOR DEVUELTO:
+ *   Devuelve '0' si el temporizador se ha cancelado, o '-1' si no estaba
+ *   programado.
+ */
+int timer_wheel_cancel ( timer_wheel_t * wheel, wheel_timer_t * timer )
+{
+  if (timer->next == NULL) {
+    return -1;
+  }
+
+  timer_list_unlink(timer);
+  wheel->count--;
+
+  return 0;
+}
+
+
+/* int wheel_timer_pending ( wheel_timer_t * timer );
+ *
+ * DESCRIPCIÓN:
+ *   Esta función indica si el temporizador está programado.
+ *
+ * VALOR DEVUELTO:
+ *   Devuelve '1' si el temporizador está programado, o '0' en otro caso.
+ */
+int wheel_timer_pending ( wheel_timer_t * timer )
+{
+  return (timer->next != NULL);
+}
+
+
+/* int timer_wheel_advance ( timer_wheel_t * wheel );
+ *
+ * DESCRIPCIÓN:
+ *   Esta función avanza la rueda hasta el instante actual e invoca las
+ *   funciones de los temporizadores vencidos, en orden de vencimiento.
+ *
+ * VALOR DEVUELTO:
+ *   El número de temporizadores vencidos.
+ */
+int timer_wheel_advance ( timer_wheel_t * wheel )
+{
+  uint64_t target = timer_wheel_clock(wheel);
+  int expired = 0;
+
+  while (wheel->now <= target) {
+
+    if (wheel->count == 0) {
+      /* Rueda vacía: no hay nada que recolocar ni vencer */
+      wheel->now = target + 1;
+      break;
+    }
+
+    /* Al dar la vuelta el primer nivel, bajar la siguiente posición de
+       cada nivel superior que también dé la vuelta */
+    int index = wheel->now & TW_ROOT_MASK;
+    if (index == 0) {
+      int level;
+      for (level=0; level<TW_LEVELS; level++) {
+        if (timer_wheel_cascade(wheel, level) != 0) {
+          break;
+        }
+      }
+    }
+
+    /* Sacar la lista vencida antes de invocar a las funciones, que pueden
+       programar o cancelar temporizadores */
+    wheel_timer_t list;
+    timer_list_splice(&wheel->root[index], &list);
+    wheel->now++;
+
+    while (list.next != &list) {
+      wheel_timer_t * timer = list.next;
+      timer_list_unlink(timer);
+      wheel->count--;
+      expired++;
+      timer->callback(timer->arg);
+    }
+  }
+
+  return expired;
+}
+
+
+/* long int timer_wheel_next ( timer_wheel_t * wheel );
+ *
+ * DESCRIPCIÓN:
+ *   Esta función devuelve cuántos milisegundos pueden esperarse antes de
+ *   volver a llamar a 'timer_wheel_advance()'. Si el siguiente vencimiento
+ *   está en un nivel superior de la rueda, devuelve el tiempo hasta que
+ *   deba recolocarse, que nunca es posterior al vencimiento.
+ *
+ * VALOR DEVUELTO:
+ *   Los milisegundos de espera, o '-1' si no hay temporizadores
+ *   programados.
+ */
+long int timer_wheel_next ( timer_wheel_t * wheel )
+{
+  if (wheel->count == 0) {
+    return -1;
+  }
+
+  /* Buscar la primera posición ocupada del primer nivel, o la siguiente
+     vuelta, en la que hay que recolocar los niveles superiores */
+  uint64_t next = wheel->now;
+  int i;
+  for (i=0; i<TW_ROOT_SIZE; i++, next++) {
+    int index = next & TW_ROOT_MASK;
+    if ((index == 0) || (wheel->root[index].next != &wheel->root[index])) {
+      break;
+    }
+  }
+
+  uint64_t now = timer_wheel_clock(wheel);
+
+  return (next > now) ? (long int) (next - now) : 0;
+}
+
+
+/* void timer_wheel_free ( timer_wheel_t * wheel );
+ *
+ * DESCRIPCIÓN:
+ *   Esta función libera la rueda. Los temporizadores programados quedan
+ *   sin programar y no se invocan.
+ */
+void timer_wheel_free ( timer_wheel_t * wheel )
+{
+  if (wheel == NULL) {
+    return;
+  }
+
+  int i, j;
+  for (i=0; i<TW_ROOT_SIZE; i++) {
+    while (wheel->root[i].next != &wheel->root[i]) {
+      timer_list_unlink(wheel->root[i].next);
+    }
+  }
+  for (i=0; i<TW_LEVELS; i++) {
+    for (j=0; j<TW_LEVEL_SIZE; j++) {
+      while (wheel->levels[i][j].next != &wheel->levels[i][j]) {
+        timer_list_unlink(wheel->levels[i][j].next);
+      }
+    }
+  }
+  free(wheel);
+}
@@ -0,0 +1,149 @@
+#ifndef _TIMER_WHEEL_H
+#define _TIMER_WHEEL_H
+
+#include <stdint.h>
+
+/* Rueda de temporizadores jerárquica con resolución de milisegundos.
+ *
+ * Los temporizadores de la pila (resoluciones ARP, plazos de los puertos,
+ * reensamblado...) se guardan en una rueda de cuatro niveles: el primero
+ * tiene una posición por milisegundo de los próximos 256 ms y cada nivel
+ * siguiente tiene 64 posiciones que abarcan 64 veces más tiempo (hasta unas
+ * 18 horas; los plazos mayores se recolocan al llegar al último nivel).
+ * Programar, reprogramar y cancelar un temporizador cuesta O(1), y al
+ * avanzar la rueda sólo se recorren las posiciones vencidas.
+ *
+ * Los temporizadores son estructuras 'wheel_timer_t' que reserva quien los
+ * usa (normalmente dentro de su propio estado), por lo que la rueda nunca
+ * reserva memoria. Un temporizador no debe liberarse mientras esté
+ * programado.
+ *
+ * La rueda se avanza con 'timer_wheel_advance()' desde el bucle de
+ * recepción o desde un reactor ('reactor_wheel()'), que además usa
+ * 'timer_wheel_next()' para saber cuánto puede esperar. Una rueda sólo debe
+ * usarse desde un hilo.
+ */
+typedef struct timer_wheel timer_wheel_t;
+
+/* Función invocada al vencer un temporizador. El temporizador ya no está
+   programado cuando se invoca, así que puede volver a programarse. */
+typedef void (* wheel_timer_cb_t) ( void * arg );
+
+/* Temporizador de una rueda. Utilice las funciones de este fichero en lugar
+   de acceder directamente a sus campos. */
+typedef struct wheel_timer {
+  struct wheel_timer * next;  /* Lista de la posición de la rueda, o NULL */
+  struct wheel_timer * prev;  /* si no está programado */
+  uint64_t expires;           /* Milisegundo de vencimiento en la rueda */
+  wheel_timer_cb_t callback;
+  void * arg;
+} wheel_timer_t;
+
+
+/* timer_wheel_t * timer_wheel_create ( void );
+ *
+ * DESCRIPCIÓN:
+ *   Esta función crea una rueda de temporizadores vacía, cuyo tiempo
+ *   comienza en el instante actual.
+ *
+ *   La memoria de la rueda debe ser liberada con 'timer_wheel_free()'.
+ *
+ * VALOR DEVUELTO:
+ *   La rueda creada.
+ *
+ * ERRORES:
+ *   La función devuelve 'NULL' si se ha producido algún error.
+ */
+timer_wheel_t * timer_wheel_create ( void );
+
+
+/* void wheel_timer_init
+ * ( wheel_timer_t * timer, wheel_timer_cb_t callback, void * arg );
+ *
+ * DESCRIPCIÓN:
+ *   Esta función inicializa un temporizador sin programar, que invocará a
+ *   'callback' con el argumento 'arg' al vencer.
+ */
+void wheel_timer_init
+( wheel_timer_t * timer, wheel_timer_cb_t callback, void * arg );
+
+
+/* void timer_wheel_add
+ * ( timer_wheel_t * wheel, wheel_timer_t * timer, long int timeout );
+ *
+ * DESCRIPCIÓN:
+ *   Esta función programa el temporizador para que venza dentro de
+ *   'timeout' milisegundos. Si ya estaba programado, se reprograma con el
+ *   nuevo plazo.
+ *
+ *   Por la resolución de la rueda, el temporizador puede vencer hasta 1 ms
+ *   después del plazo, pero nunca antes.
+ *
+ * PARÁMETROS:
+ *     'wheel': Rueda de temporizadores.
+ *     'timer': Temporizador inicializado con 'wheel_timer_init()'.
+ *   'timeout': Milisegundos hasta el vencimiento.
+ */
+void timer_wheel_add
+( timer_wheel_t * wheel, wheel_timer_t * timer, long int timeout );
+
+
+/* int timer_wheel_cancel ( timer_wheel_t * wheel, wheel_timer_t * timer );
+ *
+ * DESCRIPCIÓN:
+ *   Esta función cancela un temporizador programado.
+ *
+ * VALOR DEVUELTO:
+ *   Devuelve '0' si el temporizador se ha cancelado, o '-1' si no estaba
+ *   programado.
+ */
+int timer_wheel_cancel ( timer_wheel_t * wheel, wheel_timer_t * timer );
+
+
+/* int wheel_timer_pending ( wheel_timer_t * timer );
+ *
+ * DESCRIPCIÓN:
+ *   Esta función indica si el temporizador está programado.
+ *
+ * VALOR DEVUELTO:
+ *   Devuelve '1' si el temporizador está programado, o '0' en otro caso.
+ */
+int wheel_timer_pending ( wheel_timer_t * timer );
+
+
+/* int timer_wheel_advance ( timer_wheel_t * wheel );
+ *
+ * DESCRIPCIÓN:
+ *   Esta función avanza la rueda hasta el instante actual e invoca las
+ *   funciones de los temporizadores vencidos, en orden de vencimiento.
+ *
+ * VALOR DEVUELTO:
+ *   El número de temporizadores vencidos.
+ */
+int timer_wheel_advance ( timer_wheel_t * wheel );
+
+
+/* long int timer_wheel_next ( timer_wheel_t * wheel );
+ *
+ * DESCRIPCIÓN:
+ *   Esta función devuelve cuántos milisegundos pueden esperarse antes de
+ *   volver a llamar a 'timer_wheel_advance()'. Si el siguiente vencimiento
+ *   está en un nivel superior de la rueda, devuelve el tiempo hasta que
+ *   deba recolocarse, que nunca es posterior al vencimiento.
+ *
+ * VALOR DEVUELTO:
+ *   Los milisegundos de espera, o '-1' si no hay temporizadores
+ *   programados.
+ */
+long int timer_wheel_next ( timer_wheel_t * wheel );
+
+
+/* void timer_wheel_free ( timer_wheel_t * wheel );
+ *
+ * DESCRIPCIÓN:
+ *   Esta función libera la rueda. Los temporizadores programados quedan
+ *   sin programar y no se invocan.
+ */
+void timer_wheel_free ( timer_wheel_t * wheel );
+
+#endif /* _TIMER_WHEEL_H */
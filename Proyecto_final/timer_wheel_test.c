@@ -0,0 +1,164 @@
+#include "timer_wheel.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <libgen.h>
+
+#define MAX_TIMERS 100000
+
+/* Reloj simulado en milisegundos. La rueda lee el tiempo con
+   clock_gettime(), que este programa sustituye por el reloj simulado para
+   poder saltar horas de golpe y comprobar cada vencimiento sin esperar */
+static uint64_t fake_ms = 1000000;
+
+int clock_gettime(clockid_t clock_id, struct timespec * ts){
+  (void)clock_id;
+  ts->tv_sec = fake_ms / 1000;
+  ts->tv_nsec = (fake_ms % 1000) * 1000000;
+  return 0;
+}
+
+/* Estado esperado de cada temporizador de la prueba */
+static wheel_timer_t timers[MAX_TIMERS];
+static uint64_t due[MAX_TIMERS];  //milisegundo de vencimiento esperado
+static int armed[MAX_TIMERS];     //programado segun la prueba
+static long int fired = 0;
+static long int errors = 0;
+
+
+/* Vencimiento de un temporizador: no puede llegar antes de su plazo ni si
+   la prueba lo habia cancelado */
+static void timer_fired(void * arg){
+  long int i = (long int) arg;
+
+  if (!armed[i]) {
+    errors++;
+    printf("Temporizador %ld vencido sin estar programado\n", i);
+  } else if (fake_ms < due[i]) {
+    errors++;
+    printf("Temporizador %ld vencido %lu ms antes de tiempo\n", i,
+           (unsigned long) (due[i] - fake_ms));
+  }
+  armed[i] = 0;
+  fired++;
+}
+
+
+/* Plazo aleatorio: sobre todo del primer nivel de la rueda, pero tambien de
+   los superiores y mayores que toda la rueda */
+static long int random_timeout(unsigned int * seed){
+  int r = rand_r(seed) % 10;
+  if (r < 5) {
+    return rand_r(seed) % 300;
+  } else if (r < 8) {
+    return rand_r(seed) % 20000;
+  } else if (r < 9) {
+    return rand_r(seed) % 2000000;
+  }
+  return rand_r(seed) % (1 << 28);
+}
+
+
+int main ( int argc, char * argv[] )
+{
+  /* Mostrar mensaje de ayuda si el número de argumentos es incorrecto */
+  char * myself = basename(argv[0]);
+  if ((argc != 3) && (argc != 4)) {
+    printf("\nUso: %s <temporizadores> <rondas> [semilla]\n", myself);
+    printf("\n     <temporizadores>: Numero de temporizadores de la prueba\n");
+    printf("\n     <rondas>: Numero de avances del reloj simulado\n");
+    printf("\n     [semilla]: Semilla de las operaciones aleatorias\n");
+    exit(-1);
+  }
+
+  /* Procesar los argumentos de la línea de comandos */
+  int num_timers = atoi(argv[1]);
+  int rounds = atoi(argv[2]);
+  unsigned int seed = (argc == 4) ? atoi(argv[3]) : 1;
+  if ((num_timers < 1) || (num_timers > MAX_TIMERS) || (rounds < 1)) {
+    fprintf(stderr, "\n%s: Argumentos incorrectos\n", myself);
+    exit(-1);
+  }
+
+  timer_wheel_t * wheel = timer_wheel_create();
+  if (wheel == NULL) {
+    exit(-1);
+  }
+  long int i;
+  for (i=0; i<num_timers; i++) {
+    wheel_timer_init(&timers[i], timer_fired, (void *) i);
+  }
+
+  int round;
+  for (round=0; round<rounds; round++) {
+    /* Programar, reprogramar y cancelar temporizadores al azar */
+    int k;
+    for (k=0; k<20; k++) {
+      i = rand_r(&seed) % num_timers;
+      if ((rand_r(&seed) % 4) < 3) {
+        long int timeout = random_timeout(&seed);
+        timer_wheel_add(wheel, &timers[i], timeout);
+        due[i] = fake_ms + timeout;
+        armed[i] = 1;
+      } else {
+        int r = timer_wheel_cancel(wheel, &timers[i]);
+        if ((r == 0) != armed[i]) {
+          errors++;
+          printf("Cancelar el temporizador %ld devuelve %d\n", i, r);
+        }
+        armed[i] = 0;
+      }
+    }
+
+    /* Avanzar el reloj: pasos pequeños, grandes, justo lo que indica
+       timer_wheel_next() y, de vez en cuando, mas de una hora */
+    long int next = timer_wheel_next(wheel);
+    long int step;
+    if ((round % 500) == 0) {
+      step = 1 << 22;
+    } else if (((rand_r(&seed) % 3) == 0) && (next > 0)) {
+      step = next;
+    } else if (rand_r(&seed) % 2) {
+      step = rand_r(&seed) % 5;
+    } else {
+      step = rand_r(&seed) % 5000;
+    }
+    fake_ms += step;
+    timer_wheel_advance(wheel);
+
+    /* Todos los temporizadores vencidos deben haberse invocado (la rueda
+       puede retrasarlos 1 ms), y la siguiente espera no puede pasarse del
+       primer vencimiento pendiente */
+    uint64_t first_due = UINT64_MAX;
+    for (i=0; i<num_timers; i++) {
+      if (!armed[i]) {
+        continue;
+      }
+      if (due[i] + 1 <= fake_ms) {
+        errors++;
+        printf("Temporizador %ld no vencido: plazo %lu, reloj %lu\n", i,
+               (unsigned long) due[i], (unsigned long) fake_ms);
+        timer_wheel_cancel(wheel, &timers[i]);
+        armed[i] = 0;
+      } else if (due[i] < first_due) {
+        first_due = due[i];
+      }
+    }
+    next = timer_wheel_next(wheel);
+    if ((first_due == UINT64_MAX) != (next == -1)) {
+      errors++;
+      printf("timer_wheel_next() devuelve %ld\n", next);
+    } else if ((next >= 0) && (fake_ms + next > first_due + 1)) {
+      errors++;
+      printf("timer_wheel_next() espera %ld ms, el primer plazo es en %lu\n",
+             next, (unsigned long) (first_due - fake_ms));
+    }
+  }
+
+  timer_wheel_free(wheel);
+
+  printf("Temporizadores vencidos: %ld, errores: %ld\n", fired, errors);
+
+  return (errors == 0) ? 0 : -1;
+}
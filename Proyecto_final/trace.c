@@ -0,0 +1,236 @@
+#define _GNU_SOURCE /* syscall(SYS_gettid) */
+
+#include "trace.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+
+/* Fichero donde se vuelcan las trazas si no se indica 'TRACE_FILE' */
+#define TRACE_DEFAULT_FILE "trace.bin"
+
+/* Anillo de trazas de un hilo. Sólo escribe en él su hilo, por lo que no
+   necesita cerrojos: 'head' se publica con semántica "release" después de
+   escribir cada registro. */
+struct trace_ring {
+  struct trace_ring * next;  /* Siguiente anillo de la lista global */
+  uint32_t tid;              /* Identificador del hilo */
+  uint32_t head;             /* Número de registros escritos */
+  trace_record_t records[TRACE_RING_SIZE];
+};
+
+/* Nivel de trazas en tiempo de ejecución */
+int trace_level = TRACE_OFF;
+
+/* Lista de los anillos de todos los hilos, para volcarlos */
+static struct trace_ring * trace_rings = NULL;
+
+/* Anillo del hilo actual */
+static __thread struct trace_ring * trace_local = NULL;
+
+/* Fichero donde se vuelcan las trazas al terminar el programa */
+static char * trace_file = TRACE_DEFAULT_FILE;
+
+/* Descripción de los eventos, indexada por 'trace_event_t' */
+static trace_event_desc_t trace_events[TRACE_EVENT_MAX] = {
+  [TRACE_ETH_SEND]      = { "eth_send", "type:x payload:d" },
+  [TRACE_ETH_RECV]      = { "eth_recv", "type:x payload:d" },
+  [TRACE_ARP_REQUEST]   = { "arp_request", "ip:i" },
+  [TRACE_ARP_REPLY]     = { "arp_reply", "ip:i mac_high:x mac_low:x" },
+  [TRACE_ARP_TIMEOUT]   = { "arp_timeout", "ip:i" },
+  [TRACE_IPV4_ROUTE]    = { "ipv4_route_lookup", "addr:i prefix:d" },
+  [TRACE_IPV4_NEXT_HOP] = { "ipv4_next_hop", "dst:i next_hop:i gateway:d" },
+  [TRACE_IPV4_SEND]     = { "ipv4_send", "dst:i protocol:d payload:d" },
+  [TRACE_IPV4_RECV]     = { "ipv4_recv", "src:i protocol:d payload:d" },
+  [TRACE_UDP_SEND]      = { "udp_send", "port_src:d port_dst:d payload:d" },
+  [TRACE_UDP_RECV]      = { "udp_recv", "src:i port_dst:d payload:d" },
+  [TRACE_ARP_ANSWER]    = { "arp_answer", "ip:i" }
+};
+
+
+/* Vuelca las trazas al terminar el programa */
+static void trace_atexit ( void )
+{
+  trace_dump(trace_file);
+}
+
+
+/* Lee el nivel de trazas y el fichero de volcado de las variables de entorno
+   'TRACE_LEVEL' y 'TRACE_FILE' antes de ejecutar 'main()' */
+__attribute__((constructor))
+static void trace_init ( void )
+{
+  char * level = getenv("TRACE_LEVEL");
+  if (level != NULL) {
+    trace_level = atoi(level);
+  }
+  char * file = getenv("TRACE_FILE");
+  if (file != NULL) {
+    trace_file = file;
+  }
+  if (trace_level > TRACE_OFF) {
+    atexit(trace_atexit);
+  }
+}
+
+
+/* Crea el anillo del hilo actual y lo añade a la lista global */
+static struct trace_ring * trace_ring_create ( void )
+{
+  struct trace_ring * ring = calloc(1, sizeof(struct trace_ring));
+  if (ring == NULL) {
+    return NULL;
+  }
+  ring->tid = (uint32_t) syscall(SYS_gettid);
+
+  ring->next = __atomic_load_n(&trace_rings, __ATOMIC_RELAXED);
+  while ( ! __atomic_compare_exchange_n(&trace_rings, &ring->next, ring, 0,
+                                        __ATOMIC_RELEASE, __ATOMIC_RELAXED) ) {
+    /* 'ring->next' se actualiza con la cabeza actual de la lista */
+  }
+
+  return ring;
+}
+
+
+/* void trace_write
+ * ( int level, int event, uint32_t a0, uint32_t a1, uint32_t a2,
+ *   uint32_t a3, unsigned char * data, int data_len );
+ *
+ * DESCRIPCIÓN:
+ *   Esta función escribe un registro en el anillo de trazas del hilo que la
+ *   invoca, creándolo si es la primera traza del hilo. No debe usarse
+ *   directamente, sino a través de la macro 'TRACE()'.
+ */
+void trace_write
+( int level, int event, uint32_t a0, uint32_t a1, uint32_t a2, uint32_t a3,
+  unsigned char * data, int data_len )
+{
+  struct trace_ring * ring = trace_local;
+  if (ring == NULL) {
+    ring = trace_ring_create();
+    if (ring == NULL) {
+      return;
+    }
+    trace_local = ring;
+  }
+
+  uint32_t seq = ring->head;
+  trace_record_t * record = &ring->records[seq & (TRACE_RING_SIZE - 1)];
+
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  record->timestamp = (uint64_t) now.tv_sec * 1000000000ULL + now.tv_nsec;
+  record->seq = seq;
+  record->event = event;
+  record->level = level;
+  record->args[0] = a0;
+  record->args[1] = a1;
+  record->args[2] = a2;
+  record->args[3] = a3;
+
+  if ((data == NULL) || (data_len <= 0) || (trace_level < TRACE_PKT)) {
+    data_len = 0;
+  } else if (data_len > TRACE_DATA_SIZE) {
+    data_len = TRACE_DATA_SIZE;
+  }
+  if (data_len > 0) {
+    memcpy(record->data, data, data_len);
+  }
+  record->data_len = data_len;
+
+  __atomic_store_n(&ring->head, seq + 1, __ATOMIC_RELEASE);
+}
+
+
+/* int trace_dump ( char * filename );
+ *
+ * DESCRIPCIÓN:
+ *   Esta función vuelca al fichero indicado el contenido de los anillos de
+ *   trazas de todos los hilos. Se invoca automáticamente al terminar el
+ *   programa si la variable de entorno 'TRACE_LEVEL' activa las trazas.
+ *
+ *   El fichero empieza con la cadena "TRC1" y el tamaño de los registros
+ *   (uint32_t). A continuación, para cada hilo, su identificador y el número
+ *   de registros (uint32_t), seguidos de los registros por orden.
+ *
+ * PARÁMETROS:
+ *   'filename': Nombre del fichero de trazas.
+ *
+ * VALOR DEVUELTO:
+ *   El número de registros volcados.
+ *
+ * ERRORES:
+ *   La función devuelve '-1' si no ha podido escribirse el fichero.
+ */
+int trace_dump ( char * filename )
+{
+  FILE * out = fopen(filename, "w");
+  if (out == NULL) {
+    fprintf(stderr, "trace_dump(): ERROR en fopen(): %s\n", filename);
+    return -1;
+  }
+
+  uint32_t record_size = sizeof(trace_record_t);
+  fwrite("TRC1", 1, 4, out);
+  fwrite(&record_size, sizeof(uint32_t), 1, out);
+
+  trace_record_t * copy = malloc(TRACE_RING_SIZE * sizeof(trace_record_t));
+  if (copy == NULL) {
+    fclose(out);
+    return -1;
+  }
+
+  int total = 0;
+  struct trace_ring * ring = __atomic_load_n(&trace_rings, __ATOMIC_ACQUIRE);
+  while (ring != NULL) {
+    /* Copiar los registros válidos, del más antiguo al más reciente. Si el
+       hilo sigue escribiendo, los registros sobrescritos durante la copia
+       se detectan por su número de secuencia y se descartan. */
+    uint32_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+    uint32_t first = (head > TRACE_RING_SIZE) ? head - TRACE_RING_SIZE : 0;
+    uint32_t count = 0;
+    uint32_t seq;
+    for (seq=first; seq<head; seq++) {
+      trace_record_t * record = &ring->records[seq & (TRACE_RING_SIZE - 1)];
+      if (record->seq == seq) {
+        copy[count++] = *record;
+      }
+    }
+
+    fwrite(&ring->tid, sizeof(uint32_t), 1, out);
+    fwrite(&count, sizeof(uint32_t), 1, out);
+    fwrite(copy, sizeof(trace_record_t), count, out);
+    total += count;
+
+    ring = ring->next;
+  }
+
+  free(copy);
+  if (fclose(out) != 0) {
+    fprintf(stderr, "trace_dump(): ERROR al escribir: %s\n", filename);
+    return -1;
+  }
+
+  return total;
+}
+
+
+/* trace_event_desc_t * trace_event_desc ( int event );
+ *
+ * DESCRIPCIÓN:
+ *   Esta función devuelve la descripción del evento indicado, o 'NULL' si
+ *   el evento no existe.
+ */
+trace_event_desc_t * trace_event_desc ( int event )
+{
+  if ((event <= 0) || (event >= TRACE_EVENT_MAX) ||
+      (trace_events[event].name == NULL)) {
+    return NULL;
+  }
+
+  return &trace_events[event];
+}
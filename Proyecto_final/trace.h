@@ -0,0 +1,148 @@
+#ifndef _TRACE_H
+#define _TRACE_H
+
+#include <stdint.h>
+
+/* Subsistema de trazas de la pila de protocolos.
+ *
+ * En lugar de imprimir por consola en cada trama, los caminos de envío y
+ * recepción escriben registros binarios de tamaño fijo en un anillo propio
+ * de cada hilo, sin cerrojos ni llamadas al sistema. Al terminar el
+ * programa los anillos se vuelcan a un fichero, que se convierte a texto
+ * (incluido el volcado hexadecimal de las tramas) con la herramienta
+ * 'trace_decode'.
+ *
+ * El nivel de trazas se controla en dos puntos:
+ *   - En compilación, con 'TRACE_LEVEL_MAX' (por ejemplo
+ *     '-DTRACE_LEVEL_MAX=TRACE_OFF'): las trazas de nivel superior se
+ *     eliminan del código generado.
+ *   - En ejecución, con la variable global 'trace_level' o con las
+ *     variables de entorno 'TRACE_LEVEL' (número de nivel) y 'TRACE_FILE'
+ *     (fichero donde se vuelcan las trazas al terminar, por defecto
+ *     "trace.bin"). Por defecto las trazas están desactivadas y cada punto
+ *     de traza cuesta una comparación.
+ */
+
+/* Niveles de traza */
+#define TRACE_OFF   0 /* Trazas desactivadas */
+#define TRACE_ERROR 1 /* Errores */
+#define TRACE_INFO  2 /* Eventos poco frecuentes (resolución ARP, ...) */
+#define TRACE_DEBUG 3 /* Un registro por trama o datagrama */
+#define TRACE_PKT   4 /* Además, los primeros bytes de cada trama */
+
+/* Nivel máximo de las trazas que se compilan */
+#ifndef TRACE_LEVEL_MAX
+#define TRACE_LEVEL_MAX TRACE_PKT
+#endif
+
+/* Número de registros del anillo de cada hilo (potencia de 2). Cuando se
+   llena se sobrescriben los registros más antiguos. */
+#define TRACE_RING_SIZE 4096
+
+/* Número de argumentos numéricos y bytes de datos de cada registro */
+#define TRACE_ARGS 4
+#define TRACE_DATA_SIZE 96
+
+/* Eventos de traza. Los argumentos de cada evento se describen en
+   'trace_events[]' (trace.c). */
+typedef enum trace_event {
+  TRACE_ETH_SEND = 1,
+  TRACE_ETH_RECV,
+  TRACE_ARP_REQUEST,
+  TRACE_ARP_REPLY,
+  TRACE_ARP_TIMEOUT,
+  TRACE_IPV4_ROUTE,
+  TRACE_IPV4_NEXT_HOP,
+  TRACE_IPV4_SEND,
+  TRACE_IPV4_RECV,
+  TRACE_UDP_SEND,
+  TRACE_UDP_RECV,
+  TRACE_ARP_ANSWER,
+  TRACE_EVENT_MAX
+} trace_event_t;
+
+/* Registro de traza (128 bytes). Los campos numéricos se almacenan en el
+   orden del host que los escribe. */
+typedef struct trace_record {
+  uint64_t timestamp;  /* Instante del evento (ns, CLOCK_MONOTONIC) */
+  uint32_t seq;        /* Número de registro dentro del anillo del hilo */
+  uint16_t event;      /* Evento ('trace_event_t') */
+  uint8_t level;       /* Nivel de la traza */
+  uint8_t data_len;    /* Número de bytes válidos en 'data' */
+  uint32_t args[TRACE_ARGS];            /* Argumentos del evento */
+  unsigned char data[TRACE_DATA_SIZE];  /* Primeros bytes de la trama */
+} trace_record_t;
+
+/* Descripción de un evento para el decodificador: su nombre y la lista de
+   argumentos "nombre:formato" separados por espacios, donde el formato es
+   'd' (decimal), 'x' (hexadecimal) o 'i' (dirección IPv4). */
+typedef struct trace_event_desc {
+  char * name;
+  char * args;
+} trace_event_desc_t;
+
+/* Nivel de trazas en tiempo de ejecución */
+extern int trace_level;
+
+/* TRACE ( level, event, a0, a1, a2, a3, data, data_len );
+ *
+ * DESCRIPCIÓN:
+ *   Escribe un registro en el anillo de trazas del hilo si 'level' está
+ *   habilitado en compilación y en ejecución. Los 'data_len' bytes de 'data'
+ *   sólo se copian (truncados a 'TRACE_DATA_SIZE') con nivel 'TRACE_PKT'.
+ */
+#define TRACE(level, event, a0, a1, a2, a3, data, data_len)                 \
+  do {                                                                      \
+    if (((level) <= TRACE_LEVEL_MAX) && ((level) <= trace_level)) {         \
+      trace_write((level), (event), (a0), (a1), (a2), (a3),                 \
+                  (data), (data_len));                                      \
+    }                                                                       \
+  } while (0)
+
+
+/* void trace_write
+ * ( int level, int event, uint32_t a0, uint32_t a1, uint32_t a2,
+ *   uint32_t a3, unsigned char * data, int data_len );
+ *
+ * DESCRIPCIÓN:
+ *   Esta función escribe un registro en el anillo de trazas del hilo que la
+ *   invoca, creándolo si es la primera traza del hilo. No debe usarse
+ *   directamente, sino a través de la macro 'TRACE()'.
+ */
+void trace_write
+( int level, int event, uint32_t a0, uint32_t a1, uint32_t a2, uint32_t a3,
+  unsigned char * data, int data_len );
+
+
+/* int trace_dump ( char * filename );
+ *
+ * DESCRIPCIÓN:
+ *   Esta función vuelca al fichero indicado el contenido de los anillos de
+ *   trazas de todos los hilos. Se invoca automáticamente al terminar el
+ *   programa si la variable de entorno 'TRACE_LEVEL' activa las trazas.
+ *
+ *   El fichero empieza con la cadena "TRC1" y el tamaño de los registros
+ *   (uint32_t). A continuación, para cada hilo, su identificador y el número
+ *   de registros (uint32_t), seguidos de los registros por orden.
+ *
+ * PARÁMETROS:
+ *   'filename': Nombre del fichero de trazas.
+ *
+ * VALOR DEVUELTO:
+ *   El número de registros volcados.
+ *
+ * ERRORES:
+ *   La función devuelve '-1' si no ha podido escribirse el fichero.
+ */
+int trace_dump ( char * filename );
+
+
+/* trace_event_desc_t * trace_event_desc ( int event );
+ *
+ * DESCRIPCIÓN:
+ *   Esta función devuelve la descripción del evento indicado, o 'NULL' si
+ *   el evento no existe.
+ */
+trace_event_desc_t * trace_event_desc ( int event );
+
+#endif /* _TRACE_H */
@@ -0,0 +1,181 @@
+#include "trace.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <libgen.h>
+
+/* Registro leído del fichero junto con el hilo que lo escribió */
+struct trace_entry {
+  uint32_t tid;
+  trace_record_t record;
+};
+
+
+/* Ordena los registros de todos los hilos por instante */
+static int trace_entry_cmp ( const void * a, const void * b )
+{
+  const struct trace_entry * ea = a;
+  const struct trace_entry * eb = b;
+
+  if (ea->record.timestamp < eb->record.timestamp) {
+    return -1;
+  } else if (ea->record.timestamp > eb->record.timestamp) {
+    return 1;
+  }
+  return 0;
+}
+
+
+/* Imprime los argumentos del registro según la descripción del evento */
+static void trace_print_args ( trace_record_t * record, char * args )
+{
+  char desc[128];
+  strncpy(desc, args, sizeof(desc) - 1);
+  desc[sizeof(desc) - 1] = '\0';
+
+  int i = 0;
+  char * saveptr;
+  char * arg = strtok_r(desc, " ", &saveptr);
+  while ((arg != NULL) && (i < TRACE_ARGS)) {
+    char * format = strchr(arg, ':');
+    if (format != NULL) {
+      *format = '\0';
+      format++;
+    }
+    uint32_t value = record->args[i];
+
+    if ((format != NULL) && (*format == 'x')) {
+      printf(" %s=0x%04x", arg, value);
+    } else if ((format != NULL) && (*format == 'i')) {
+      printf(" %s=%u.%u.%u.%u", arg, (value >> 24) & 0xFF,
+             (value >> 16) & 0xFF, (value >> 8) & 0xFF, value & 0xFF);
+    } else {
+      printf(" %s=%u", arg, value);
+    }
+
+    arg = strtok_r(NULL, " ", &saveptr);
+    i++;
+  }
+}
+
+
+/* Imprime los bytes de la trama con el mismo formato que 'print_pkt()'
+   (eth.c), resaltando los 'hdr_len' primeros */
+static void trace_print_data ( unsigned char * data, int len, int hdr_len )
+{
+  int i;
+  for (i=0; i<len; i++) {
+    if ((i % 8) == 0) {
+      if (i > 0) {
+        printf("\n");
+        if (i <= hdr_len) {
+          printf("\033[0m");
+        }
+      }
+      printf("  0x%04x:", i);
+      if (i < hdr_len) {
+        printf("\033[1;34m");
+      }
+    } else if ((i % 4) == 0) {
+      printf(" ");
+    }
+    if (i == hdr_len) {
+      printf("\033[0m");
+    }
+    printf(" %02x", data[i]);
+  }
+  if (len <= hdr_len) {
+    printf("\033[0m");
+  }
+  printf("\n");
+}
+
+
+int main ( int argc, char * argv[] )
+{
+  /* Mostrar mensaje de ayuda si el número de argumentos es incorrecto */
+  char * myself = basename(argv[0]);
+  if (argc != 2) {
+    printf("Uso: %s <fichero>\n", myself);
+    printf("       <fichero>: Fichero de trazas volcado por la pila\n");
+    printf("                  (variables TRACE_LEVEL y TRACE_FILE)\n");
+    exit(-1);
+  }
+
+  FILE * in = fopen(argv[1], "r");
+  if (in == NULL) {
+    fprintf(stderr, "%s: ERROR: no se puede abrir '%s'\n", myself, argv[1]);
+    exit(-1);
+  }
+
+  /* Comprobar la cabecera del fichero */
+  char magic[4];
+  uint32_t record_size;
+  if ((fread(magic, 1, 4, in) != 4) || (memcmp(magic, "TRC1", 4) != 0) ||
+      (fread(&record_size, sizeof(uint32_t), 1, in) != 1) ||
+      (record_size != sizeof(trace_record_t))) {
+    fprintf(stderr, "%s: ERROR: '%s' no es un fichero de trazas\n",
+            myself, argv[1]);
+    exit(-1);
+  }
+
+  /* Leer los registros de todos los hilos */
+  struct trace_entry * entries = NULL;
+  int num_entries = 0;
+  uint32_t tid, count;
+  while ((fread(&tid, sizeof(uint32_t), 1, in) == 1) &&
+         (fread(&count, sizeof(uint32_t), 1, in) == 1)) {
+    entries = realloc(entries,
+                      (num_entries + count) * sizeof(struct trace_entry));
+    if (entries == NULL) {
+      fprintf(stderr, "%s: ERROR en realloc()\n", myself);
+      exit(-1);
+    }
+    uint32_t i;
+    for (i=0; i<count; i++) {
+      if (fread(&entries[num_entries].record, sizeof(trace_record_t), 1, in)
+          != 1) {
+        fprintf(stderr, "%s: ERROR: fichero truncado\n", myself);
+        exit(-1);
+      }
+      entries[num_entries].tid = tid;
+      num_entries++;
+    }
+  }
+  fclose(in);
+
+  qsort(entries, num_entries, sizeof(struct trace_entry), trace_entry_cmp);
+
+  /* Imprimir los registros con instantes relativos al primero */
+  uint64_t start = (num_entries > 0) ? entries[0].record.timestamp : 0;
+  int i;
+  for (i=0; i<num_entries; i++) {
+    trace_record_t * record = &entries[i].record;
+    uint64_t elapsed = record->timestamp - start;
+    printf("[%u] %llu.%09llu", entries[i].tid,
+           (unsigned long long) (elapsed / 1000000000ULL),
+           (unsigned long long) (elapsed % 1000000000ULL));
+
+    trace_event_desc_t * desc = trace_event_desc(record->event);
+    if (desc == NULL) {
+      printf(" evento(%u)", record->event);
+      trace_print_args(record, "a0:x a1:x a2:x a3:x");
+    } else {
+      printf(" %s", desc->name);
+      trace_print_args(record, desc->args);
+    }
+    printf("\n");
+
+    if (record->data_len > 0) {
+      /* Las trazas Ethernet empiezan por la cabecera de 14 bytes */
+      int hdr_len = ((record->event == TRACE_ETH_SEND) ||
+                     (record->event == TRACE_ETH_RECV)) ? 14 : 0;
+      trace_print_data(record->data, record->data_len, hdr_len);
+    }
+  }
+
+  free(entries);
+
+  return 0;
+}
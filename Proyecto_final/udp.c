@@ -11,13 +11,21 @@
 #include "ipv4.h"
 #include "ipv4_route_table.h"
 #include "ipv4_config.h"
+#include "trace.h"
 
 
 typedef struct udp_layer{
  ipv4_layer_t *ipv4_layer;
  uint16_t port;
+ int filter_rule;//regla del filtro de recepcion del puerto que se escucha
+ uint16_t filter_port;//puerto que se escucha
+ udp_handler_t handler;//funcion manejadora de los datagramas, o NULL
+ void *handler_arg;//argumento de la funcion manejadora
 }udp_layer_t;
 
+static int udp_pkt_push_header(udp_layer_t *layer, uint16_t port_dst, pkt_buf_t *pkt);
+static void udp_listen(udp_layer_t *layer, uint16_t port);
+
 /*
 * Funcion que abre la interfaz del nivel de transporte
 */
@@ -36,6 +44,12 @@ udp_layer_t* udp_open(char* file_conf, char* file_conf_route, uint16_t port){
     layer->port = dice;//Número random mayor que 1024
   }
   layer->ipv4_layer = ipv4_open(file_conf, file_conf_route);//en el campo de ipv4_layer se rrellena llamando a su vez aipv4_open
+  layer->filter_rule = -1;
+  layer->handler = NULL;
+  layer->handler_arg = NULL;
+  if(layer->ipv4_layer != NULL){
+    udp_listen(layer, layer->port);//solo llegan desde el nucleo los datagramas a nuestro puerto
+  }
   return layer;
 /*
 * Funcion que cierra la interfaz del nivel de transporte
@@ -47,6 +61,9 @@ int udp_close(udp_layer_t* layer){
 
   int err = -1;
   if(layer->ipv4_layer != NULL){
+    if(layer->filter_rule >= 0){
+      ipv4_unlisten(layer->ipv4_layer, layer->filter_rule);
+    }
     /*1. Cerrar la IPv4*/
     printf("Cerrando IPv4.\n");
     ipv4_close(layer->ipv4_layer);
@@ -60,54 +77,281 @@ int udp_close(udp_layer_t* layer){
 */
 int udp_send(udp_layer_t *layer, ipv4_addr_t dst,uint16_t port_dst, unsigned char *payload, int payload_length ){
 
-    struct udp_frame udp_message;//Se crea la estructura del mensaje y se rellenan los campos
+    pkt_buf_t pkt;//El payload se copia una unica vez en el buffer de paquete
+    pkt_buf_init(&pkt);
+    unsigned char *data = pkt_buf_put(&pkt, payload_length);
+    if (data == NULL) {
+      fprintf(stderr, "udp_send(): ERROR: payload demasiado grande: %d bytes\n", payload_length);
+      return -1;
+    }
+    memcpy(data, payload, payload_length);
+
+    return udp_send_pkt(layer, dst, port_dst, &pkt);
+}
 
-    udp_message.src_port = htons(layer->port);
-  	udp_message.dst_port = htons(port_dst);
-  	udp_message.length = htons(payload_length+UDP_HEADER_LENGTH) ;
-  	udp_message.checksum = 0;
-  	memcpy(udp_message.data,payload, payload_length );
-  	int udp_msg_length = UDP_HEADER_LENGTH + payload_length;// se define el tamaño que va a tener para asi poder pasarselo al ip_send()
+
+/*
+* Funcion que envia el datagrama UDP contenido en un buffer de paquete
+*/
+int udp_send_pkt(udp_layer_t *layer, ipv4_addr_t dst, uint16_t port_dst, pkt_buf_t *pkt){
+
+    if (udp_pkt_push_header(layer, port_dst, pkt) == -1) {
+      return -1;
+    }
 
     uint8_t protocol = 0x11;
+    TRACE(TRACE_DEBUG, TRACE_UDP_SEND, layer->port, port_dst, pkt->len - UDP_HEADER_LENGTH, 0, NULL, 0);
 
-  	int r = ipv4_send(layer->ipv4_layer, dst, protocol, (unsigned char*) &udp_message, udp_msg_length );
-    if (r == -1 || r ==0) {
-      	return r;
+  	int r = ipv4_send_pkt(layer->ipv4_layer, dst, protocol, pkt);
+    if (r < 0) {
+      pkt_buf_pull(pkt, UDP_HEADER_LENGTH);//el buffer queda como estaba
+    }
+    if (r <= 0) {
+      	return r;//error, o ARP_UNREACHABLE si el siguiente salto no responde
     }
     return r - UDP_HEADER_LENGTH;//si el mensaje se envia bien , se devuelve el tamaño de toda la carga que se envia e ip - el tamaño de la cabecera udp
 }
 
 
+/*
+* Funcion que envia un lote de datagramas UDP
+*/
+int udp_send_batch(udp_layer_t *layer, ipv4_addr_t dst[], uint16_t port_dst[], pkt_buf_t *pkts[], int num){
+    int i;
+    for (i=0; i<num; i++) {
+      if (udp_pkt_push_header(layer, port_dst[i], pkts[i]) == -1) {
+        break;
+      }
+    }
+
+    int r = -1;
+    if (i == num) {
+      uint8_t protocol = 0x11;
+      r = ipv4_send_batch(layer->ipv4_layer, dst, protocol, pkts, num);
+    }
+
+    //Los datagramas no enviados (siempre los ultimos) quedan sin la cabecera UDP
+    int k;
+    for (k=(r > 0) ? r : 0; k<i; k++) {
+      pkt_buf_pull(pkts[k], UDP_HEADER_LENGTH);
+    }
+    return r;
+}
+
+
+/*
+* Funcion que antepone la cabecera UDP al payload del buffer de paquete
+*/
+static int udp_pkt_push_header(udp_layer_t *layer, uint16_t port_dst, pkt_buf_t *pkt){
+
+    int payload_length = pkt->len;
+    //Se antepone la cabecera UDP al payload y se rellenan los campos
+    struct udp_frame *udp_message = (struct udp_frame *) pkt_buf_push(pkt, UDP_HEADER_LENGTH);
+    if (udp_message == NULL) {
+      fprintf(stderr, "udp_send(): ERROR: no hay espacio para la cabecera\n");
+      return -1;
+    }
+    udp_message->src_port = htons(layer->port);
+  	udp_message->dst_port = htons(port_dst);
+  	udp_message->length = htons(payload_length+UDP_HEADER_LENGTH) ;
+  	udp_message->checksum = 0;
+
+    return 0;
+}
+
+
 /*
 * Funcion que recibe el datagrama UDP
 */
 int udp_recv(udp_layer_t *layer, uint16_t port_dst, unsigned char buffer[], int buf_len, long int timeout){
-	struct udp_frame udp_recibido;// se crea la estructura en la que se va a almacenar el mensaje recibido
+	return udp_recv_meta(layer, port_dst, buffer, buf_len, timeout, NULL);
+}
+
+
+/*
+* Funcion que recibe el datagrama UDP y sus marcas de tiempo
+*/
+int udp_recv_meta(udp_layer_t *layer, uint16_t port_dst, unsigned char buffer[], int buf_len, long int timeout, eth_meta_t *meta){
+	eth_rx_frame_t *frame;
+	ipv4_addr_t sender;
+
+	int r = udp_recv_frame(layer, port_dst, sender, &frame, timeout);
+	if (r == -1 || r == 0){
+		return r;
+	}
+
+	//Se copian los datos UDP una unica vez al buffer y se libera la trama
+	if (buf_len > r) {
+		buf_len = r;
+	}
+	memcpy(buffer, frame->frame + frame->payload_offset, buf_len);
+	if (meta != NULL) {
+		*meta = frame->meta;
+	}
+	eth_frame_release(layer->ipv4_layer->iface, frame);
+
+	return r;
+}
+
+
+/*
+* Funcion que recibe el datagrama UDP sin copiarlo
+*/
+int udp_recv_frame(udp_layer_t *layer, uint16_t port_dst, ipv4_addr_t sender, eth_rx_frame_t **frame, long int timeout){
+	struct udp_frame *udp_recibido;// cabecera UDP dentro de la trama prestada
+	eth_rx_frame_t *rx_frame;
 	bool is_my_response;
 	uint8_t protocol = 0x11;
 
+	//Si se espera otro puerto, se cambia la regla del filtro de recepcion
+	if(layer->filter_rule < 0 || port_dst != layer->filter_port){
+		udp_listen(layer, port_dst);
+	}
+
 	timerms_t timer;
 	long int time_left = timerms_reset(&timer, timeout);
 	int r;
-  ipv4_addr_t dst;
 	do{
 		time_left = timerms_left(&timer);
-		r = ipv4_recv(layer->ipv4_layer, protocol, (unsigned char *) &udp_recibido, dst, buf_len, time_left);
+		r = ipv4_recv_frame(layer->ipv4_layer, protocol, sender, &rx_frame, time_left);
 		if (r == -1) {
 			fprintf(stderr, "ERROR en ipv4_recv()\n");
+			return r;
 		}else if(r == 0 ){
 			fprintf(stderr, "ERROR: No hay respuesta del Servidor IPv4\n");
+			return r;
 		}
-		is_my_response  = (port_dst == udp_recibido.dst_port);
-		if(is_my_response){
-			memcpy(buffer, udp_recibido.data, buf_len);
-			printf("Es la respuesta que espero:\n");
+		udp_recibido = (struct udp_frame *) (rx_frame->frame + rx_frame->l4_offset);
+		is_my_response = (rx_frame->payload_len >= UDP_HEADER_LENGTH) &&
+		                 (port_dst == ntohs(udp_recibido->dst_port));
+		if(!is_my_response){
+			eth_frame_release(layer->ipv4_layer->iface, rx_frame);
 		}
-	}while(!is_my_response && !(r>0));
+	}while(!is_my_response);
 
-	if (r == -1 || r == 0){
-		return r;
+	//Se ajusta el descriptor para que apunte a los datos UDP
+	int udp_length = ntohs(udp_recibido->length);
+	if ((udp_length < UDP_HEADER_LENGTH) || (udp_length > rx_frame->payload_len)) {
+		udp_length = rx_frame->payload_len;
+	}
+	rx_frame->payload_offset = rx_frame->l4_offset + UDP_HEADER_LENGTH;
+	rx_frame->payload_len = udp_length - UDP_HEADER_LENGTH;
+	*frame = rx_frame;
+	TRACE(TRACE_DEBUG, TRACE_UDP_RECV, ipv4_addr_value(sender), port_dst, rx_frame->payload_len, 0, NULL, 0);
+
+	return rx_frame->payload_len;
+}
+
+
+/*
+* Funcion que cambia la regla del filtro de recepcion para que solo lleguen
+* los datagramas UDP dirigidos al puerto indicado
+*/
+static void udp_listen(udp_layer_t *layer, uint16_t port){
+	eth_filter_cond_t port_cond;
+	port_cond.base = ETH_FILTER_L4;
+	port_cond.offset = 2;//puerto destino de la cabecera UDP
+	port_cond.size = 2;
+	port_cond.value = port;
+
+	if(layer->filter_rule >= 0){
+		ipv4_unlisten(layer->ipv4_layer, layer->filter_rule);
+	}
+	layer->filter_rule = ipv4_listen(layer->ipv4_layer, 0x11, &port_cond, 1);
+	layer->filter_port = port;
+}
+
+
+/*
+* Funcion manejadora de los datagramas UDP de la capa IPv4: entrega los
+* dirigidos a nuestro puerto a la funcion registrada con udp_set_handler()
+*/
+static int udp_ipv4_handler(ipv4_layer_t *ipv4_layer, ipv4_addr_t sender, eth_rx_frame_t *frame, void *arg){
+	udp_layer_t *layer = arg;
+	(void)ipv4_layer;
+	struct udp_frame *udp_recibido = (struct udp_frame *) (frame->frame + frame->l4_offset);
+
+	if((frame->payload_len < UDP_HEADER_LENGTH) || (ntohs(udp_recibido->dst_port) != layer->port)){
+		return 0;
 	}
-	return (r - UDP_HEADER_LENGTH );
+
+	//Se ajusta el descriptor para que apunte a los datos UDP
+	int udp_length = ntohs(udp_recibido->length);
+	if ((udp_length < UDP_HEADER_LENGTH) || (udp_length > frame->payload_len)) {
+		udp_length = frame->payload_len;
+	}
+	frame->payload_offset = frame->l4_offset + UDP_HEADER_LENGTH;
+	frame->payload_len = udp_length - UDP_HEADER_LENGTH;
+	TRACE(TRACE_DEBUG, TRACE_UDP_RECV, ipv4_addr_value(sender), layer->port, frame->payload_len, 0, NULL, 0);
+
+	return layer->handler(layer, sender, ntohs(udp_recibido->src_port), frame, layer->handler_arg);
+}
+
+
+/*
+* Funcion que registra la funcion manejadora de los datagramas dirigidos al
+* puerto de la capa y anade su interfaz al reactor
+*/
+int udp_set_handler(udp_layer_t *layer, reactor_t *reactor, udp_handler_t handler, void *arg){
+	if(layer->ipv4_layer == NULL){
+		fprintf(stderr, "udp_set_handler(): ERROR: capa IPv4 no abierta\n");
+		return -1;
+	}
+
+	//El filtro de recepcion tiene que dejar pasar nuestro puerto
+	if(layer->filter_rule < 0 || layer->filter_port != layer->port){
+		udp_listen(layer, layer->port);
+	}
+	layer->handler = handler;
+	layer->handler_arg = arg;
+	if(ipv4_set_handler(layer->ipv4_layer, 0x11, (handler != NULL) ? udp_ipv4_handler : NULL, layer) == -1){
+		return -1;
+	}
+	if((reactor != NULL) && (handler != NULL)){
+		return reactor_add_iface(reactor, layer->ipv4_layer->iface);
+	}
+
+	return 0;
+}
+
+
+/*
+* Funcion que devuelve el tamaño maximo de los datos de un datagrama UDP sin
+* fragmentar: la MTU del interfaz menos las cabeceras IPv4 y UDP
+*/
+int udp_max_payload(udp_layer_t *layer){
+	if(layer->ipv4_layer == NULL){
+		fprintf(stderr, "udp_max_payload(): ERROR: capa IPv4 no abierta\n");
+		return -1;
+	}
+
+	return eth_getmtu(layer->ipv4_layer->iface) - IPv4_HEADER_LENGTH - UDP_HEADER_LENGTH;
+}
+
+
+/*
+* Funcion que activa (enable = 1) o desactiva las marcas de tiempo de
+* transmision del nucleo en el interfaz de la capa
+*/
+int udp_set_tx_tstamps(udp_layer_t *layer, int enable){
+	if(layer->ipv4_layer == NULL){
+		fprintf(stderr, "udp_set_tx_tstamps(): ERROR: capa IPv4 no abierta\n");
+		return -1;
+	}
+
+	return eth_set_tx_tstamps(layer->ipv4_layer->iface, enable);
+}
+
+
+/*
+* Funcion que devuelve en 'tstamp' el instante en que se completo el envio
+* del ultimo datagrama
+*/
+int udp_get_tx_tstamp(udp_layer_t *layer, uint64_t *tstamp){
+	if(layer->ipv4_layer == NULL){
+		fprintf(stderr, "udp_get_tx_tstamp(): ERROR: capa IPv4 no abierta\n");
+		return -1;
+	}
+
+	return eth_get_tx_tstamp(layer->ipv4_layer->iface, tstamp);
 }
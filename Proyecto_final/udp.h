@@ -3,6 +3,7 @@
 #include "ipv4.h"
 #include "ipv4_route_table.h"
 #include "ipv4_config.h"
+#include "reactor.h"
 
 #define UDP_HEADER_LENGTH 8
 
@@ -12,12 +13,22 @@ struct udp_frame{
 	uint16_t dst_port;
 	uint16_t length;
 	uint16_t checksum;
-	unsigned char data[ETH_MTU - IPv4_HEADER_LENGTH - UDP_HEADER_LENGTH];
+	unsigned char data[ETH_MAX_MTU - IPv4_HEADER_LENGTH - UDP_HEADER_LENGTH];
 };
 
 
 typedef struct udp_layer udp_layer_t;
 
+/*
+* Funcion manejadora de los datagramas UDP dirigidos al puerto de la capa,
+* registrada con udp_set_handler(). Recibe la trama prestada con
+* 'payload_offset' y 'payload_len' apuntando a los datos UDP, la IP origen en
+* 'sender' y el puerto origen en 'port_src'. Debe devolver 1 si consume la
+* trama (sin liberarla ni conservarla) o 0 si debe seguir entregandose a
+* udp_recv()
+*/
+typedef int (*udp_handler_t)(udp_layer_t *layer, ipv4_addr_t sender, uint16_t port_src, eth_rx_frame_t *frame, void *arg);
+
 /*
 * Funcion que abre la interfaz del nivel de transporte
 */
@@ -29,10 +40,68 @@ udp_layer_t* udp_open(char* file_conf, char* file_conf_route, uint16_t port);
 int udp_close(udp_layer_t* layer);
 
 /*
-* Funcion que envia el datagrama UDP
+* Funcion que envia el datagrama UDP. Devuelve ARP_UNREACHABLE (ver
+* arp_cache.h) si el siguiente salto no respondio a su ultima resolucion ARP.
+* Como en IPv4, los envios pueden hacerse desde varios hilos a la vez
 */
 int udp_send(udp_layer_t *layer, ipv4_addr_t dst,uint16_t port_dst, unsigned char *payload, int payload_length );
 /*
+* Funcion que envia el datagrama UDP cuyo payload ya esta en el buffer de
+* paquete 'pkt'. Las cabeceras UDP, IPv4 y Ethernet se anteponen en el mismo
+* buffer, sin copiar el payload. Si hay error el buffer queda como estaba
+*/
+int udp_send_pkt(udp_layer_t *layer, ipv4_addr_t dst, uint16_t port_dst, pkt_buf_t *pkt);
+/*
+* Funcion que envia un lote de 'num' datagramas UDP, el i-esimo con destino
+* 'dst[i]':'port_dst[i]' y payload en 'pkts[i]', con una unica llamada al
+* sistema si el backend Ethernet lo permite. Devuelve el numero de
+* datagramas enviados o encolados, que son siempre los primeros del lote
+* (ver ipv4_send_batch()); los demas quedan como estaban, sin cabeceras
+*/
+int udp_send_batch(udp_layer_t *layer, ipv4_addr_t dst[], uint16_t port_dst[], pkt_buf_t *pkts[], int num);
+/*
 * Funcion que recibe el datagrama UDP
 */
 int udp_recv(udp_layer_t *layer,uint16_t port_dst, unsigned char buffer[], int buf_len, long int timeout );
+/*
+* Funcion que recibe el datagrama UDP como udp_recv() y devuelve ademas en
+* 'meta' (si no es NULL) las marcas de tiempo de su trama: la de llegada a la
+* interfaz (del nucleo si el backend la proporciona) y la de lectura por la
+* pila. Con eth_tstamp_now() se obtiene cuanto tiempo ha pasado el datagrama
+* dentro de la pila
+*/
+int udp_recv_meta(udp_layer_t *layer, uint16_t port_dst, unsigned char buffer[], int buf_len, long int timeout, eth_meta_t *meta);
+/*
+* Funcion que recibe el datagrama UDP sin copiarlo. Devuelve en 'frame' la
+* trama prestada con 'payload_offset' y 'payload_len' apuntando a los datos
+* UDP, y en 'sender' la IP origen. La trama debe liberarse con
+* eth_frame_release()
+*/
+int udp_recv_frame(udp_layer_t *layer, uint16_t port_dst, ipv4_addr_t sender, eth_rx_frame_t **frame, long int timeout);
+/*
+* Funcion que registra la funcion manejadora de los datagramas dirigidos al
+* puerto de la capa ('NULL' para eliminarla) y anade su interfaz al reactor
+* 'reactor' (si no es NULL), de modo que reactor_run() entrega los
+* datagramas sin que nadie llame a udp_recv(). Devuelve 0, o -1 si hay error
+*/
+int udp_set_handler(udp_layer_t *layer, reactor_t *reactor, udp_handler_t handler, void *arg);
+/*
+* Funcion que devuelve el tamaño maximo de los datos de un datagrama UDP, que
+* depende de la MTU del interfaz (1472 bytes con la MTU por defecto, 8972 con
+* tramas jumbo de 9000). Devuelve -1 si hay error
+*/
+int udp_max_payload(udp_layer_t *layer);
+/*
+* Funcion que activa (enable = 1) o desactiva las marcas de tiempo de
+* transmision del nucleo en el interfaz de la capa (ver eth_set_tx_tstamps()).
+* Devuelve 0, o -1 si el backend no las proporciona
+*/
+int udp_set_tx_tstamps(udp_layer_t *layer, int enable);
+/*
+* Funcion que devuelve en 'tstamp' el instante en que se completo el envio
+* del ultimo datagrama: la marca del nucleo si estan activadas o, si no, la
+* de la pila. Devuelve el origen de la marca (ETH_TSTAMP_KERNEL o
+* ETH_TSTAMP_STACK), ETH_TSTAMP_NONE si no se ha enviado nada o -1 si hay
+* error
+*/
+int udp_get_tx_tstamp(udp_layer_t *layer, uint64_t *tstamp);